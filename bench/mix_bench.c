@@ -0,0 +1,421 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sndfile.h>
+#include <pipewire/pipewire.h>
+#include "mixer.h"
+#include "track_desc.h"
+#include "log.h"
+
+// Mixing throughput without a PipeWire daemon: the mixer renders into plain
+// buffers on this thread, as the process callback would, cycle after cycle.
+// Voice setup goes through a loop that never runs, so invokes are direct.
+
+#define BENCH_MAX_CHANNELS 64   // AUX0 to AUX63
+#define BENCH_SOURCE_SECONDS 4
+#define BENCH_MAX_BUSES 64
+
+static char bench_name[] = "bench";
+static char bus_names[BENCH_MAX_BUSES][16];
+
+typedef struct {
+    uint32_t max_voices;
+    uint32_t step;
+    uint32_t max_workers;
+    uint32_t channels;
+    uint32_t quantum;
+    uint32_t rate;
+    uint32_t source_rate;
+    uint32_t cycles;
+    bool pan;
+    uint32_t ambisonic;          // Order of the voices, 0 for stereo
+    uint32_t fir_taps;           // Response every bus channel is convolved with, 0 for none
+    char *fir_path;
+    uint32_t buses;              // Submix buses the voices are spread over, 0 for none
+} bench_options_t;
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * SPA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("Options:\n");
+    printf("  -v, --voices N       Most voices to mix (default: 512)\n");
+    printf("  -s, --step N         Voices added per measurement (default: 64)\n");
+    printf("  -w, --workers N      Most worker threads to try (default: 3)\n");
+    printf("  -c, --channels N     Bus channels, at most %d (default: 32)\n", BENCH_MAX_CHANNELS);
+    printf("  -q, --quantum N      Frames per cycle (default: 128)\n");
+    printf("  -r, --rate N         Bus rate (default: 48000)\n");
+    printf("  -R, --source-rate N  File rate, differs from the bus to resample (default: bus rate)\n");
+    printf("  -n, --cycles N       Cycles per measurement (default: 2000)\n");
+    printf("  -p, --pan            Pan the voices over a ring of all bus channels\n");
+    printf("  -a, --ambisonic N    Decode order N voices onto a ring of all bus channels\n");
+    printf("  -f, --fir N          Convolve every bus channel with an N tap response\n");
+    printf("  -u, --buses N        Spread the voices over N submix buses, each ducked by the one before\n");
+    printf("  -h, --help           Show this help message\n");
+}
+
+// Noise, looped by every voice from its own handle
+static bool write_source(const char *path, const uint32_t rate, const uint32_t channels) {
+    SF_INFO info = {.samplerate = (int) rate, .channels = (int) channels, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+    SNDFILE *file = sf_open(path, SFM_WRITE, &info);
+    if (!file) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, sf_strerror(NULL));
+        return false;
+    }
+
+    float block[AMBISONIC_MAX_CHANNELS * 1024];
+    uint32_t seed = 1;
+    for (uint32_t done = 0; done < rate * BENCH_SOURCE_SECONDS; done += 1024) {
+        for (size_t i = 0; i < (size_t) channels * 1024; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            block[i] = ((float) (seed >> 8) / (float) (1u << 24) - 0.5f) * 0.1f;
+        }
+        sf_writef_float(file, block, 1024);
+    }
+    sf_close(file);
+    return true;
+}
+
+// Decaying noise, the one response every bus channel shares
+static bool write_response(const char *path, const uint32_t rate, const uint32_t taps) {
+    SF_INFO info = {.samplerate = (int) rate, .channels = 1, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+    SNDFILE *file = sf_open(path, SFM_WRITE, &info);
+    float *response = malloc(taps * sizeof(float));
+    if (!file || !response) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, sf_strerror(NULL));
+        if (file) sf_close(file);
+        free(response);
+        return false;
+    }
+
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < taps; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        response[i] = ((float) (seed >> 8) / (float) (1u << 24) - 0.5f) * expf(-6.0f * (float) i / (float) taps);
+    }
+    sf_writef_float(file, response, taps);
+    sf_close(file);
+    free(response);
+    return true;
+}
+
+// Average and worst cycle of the current voice set
+static void measure(mixer_t *m, float *const *out, const bench_options_t *opt, double *avg_us, double *max_us) {
+    uint64_t sum = 0, worst = 0;
+
+    // Let the workers and the file cache settle first
+    for (uint32_t i = 0; i < opt->cycles / 10; i++) {
+        mixer_render(m, out, opt->quantum);
+    }
+    for (uint32_t i = 0; i < opt->cycles; i++) {
+        const uint64_t start = get_time_ns();
+        mixer_render(m, out, opt->quantum);
+        const uint64_t duration = get_time_ns() - start;
+        sum += duration;
+        worst = SPA_MAX(worst, duration);
+    }
+
+    *avg_us = (double) sum / opt->cycles / 1e3;
+    *max_us = (double) worst / 1e3;
+}
+
+static int run(const bench_options_t *opt, track_instance_t *tracks) {
+    const double period_us = (double) opt->quantum * 1e6 / opt->rate;
+    float *bus = calloc((size_t) opt->channels * opt->quantum, sizeof(float));
+    float *out[BENCH_MAX_CHANNELS];
+    char names[BENCH_MAX_CHANNELS][DEVICE_CHANNEL_NAME_MAX];
+    char *channels[BENCH_MAX_CHANNELS];
+    speaker_config_t speakers[BENCH_MAX_CHANNELS];
+    fir_config_t firs[BENCH_MAX_CHANNELS];
+    bus_config_t buses[BENCH_MAX_BUSES];
+    submix_t submixes[BENCH_MAX_BUSES];
+
+    if (!bus) return EXIT_FAILURE;
+    for (uint32_t b = 0; b < opt->buses; b++) {
+        buses[b] = (bus_config_t) {
+            .name = bus_names[b],
+            .output = bench_name,
+            .gain = -3.0f,
+            .duck = {
+                .by = b > 0 ? bus_names[b - 1] : NULL,
+                .threshold = SUBMIX_DEFAULT_THRESHOLD_DB,
+                .depth = SUBMIX_DEFAULT_DEPTH_DB,
+                .attack = SUBMIX_DEFAULT_ATTACK_MS,
+                .release = SUBMIX_DEFAULT_RELEASE_MS,
+                .key_index = (int) b - 1
+            },
+            .output_index = -1,
+            .device_index = 0
+        };
+    }
+    for (uint32_t c = 0; c < opt->channels; c++) {
+        out[c] = bus + (size_t) c * opt->quantum;
+        snprintf(names[c], sizeof(names[c]), "AUX%u", c);
+        channels[c] = names[c];
+
+        // Evenly around the listener at ear height
+        const float azimuth = 2.0f * (float) M_PI * (float) c / (float) opt->channels;
+        speakers[c] = (speaker_config_t) {
+            .channel = names[c],
+            .position = { .set = true, .x = cosf(azimuth), .y = sinf(azimuth) }
+        };
+        firs[c] = (fir_config_t) { .channel = names[c], .file = opt->fir_path };
+    }
+
+    struct pw_loop *loop = pw_loop_new(NULL);
+    if (!loop) {
+        fprintf(stderr, "Failed to create loop\n");
+        free(bus);
+        return EXIT_FAILURE;
+    }
+
+    printf("Quantum %u at %u Hz (%.1f us), %u channels, source %u Hz, %u cycles per row%s",
+           opt->quantum, opt->rate, period_us, opt->channels, opt->source_rate, opt->cycles,
+           opt->pan ? ", panned" : "");
+    if (opt->ambisonic > 0) printf(", ambisonic order %u", opt->ambisonic);
+    if (opt->fir_taps > 0) printf(", %u tap FIR on every channel", opt->fir_taps);
+    if (opt->buses > 0) printf(", %u ducked buses", opt->buses);
+    printf("\n\n");
+    printf("%7s %7s %10s %10s %7s %14s\n", "threads", "voices", "avg us", "max us", "load", "voices/core");
+
+    for (uint32_t workers = 0; workers <= opt->max_workers; workers++) {
+        device_config_t device = {
+            .name = bench_name,
+            .rate = opt->rate,
+            .workers = workers,
+            .channels = channels,
+            .channel_count = (int) opt->channels,
+            .group_index = -1,
+            .speakers = speakers,
+            .speaker_count = opt->pan || opt->ambisonic > 0 ? (int) opt->channels : 0,
+            .firs = firs,
+            .fir_count = opt->fir_taps > 0 ? (int) opt->channels : 0,
+            .bus_count = (int) opt->buses
+        };
+
+        // Each bus is keyed by the one before, which comes first
+        mixer_t *m = mixer_new(&device, loop, loop, NULL);
+        for (uint32_t b = 0; m && b < opt->buses; b++) {
+            submix_init(&submixes[b], &buses[b]);
+            submixes[b].key = b > 0 ? &submixes[b - 1] : NULL;
+            mixer_add_bus(m, &submixes[b]);
+        }
+        if (!m || !mixer_set_layout(m, NULL, MIXER_MAX_CHANNELS)) {
+            fprintf(stderr, "Failed to create mixer with %u workers\n", workers);
+            mixer_destroy(m);
+            break;
+        }
+
+        uint32_t n_voices = 0;
+        for (uint32_t target = opt->step; target <= opt->max_voices; target += opt->step) {
+            for (; n_voices < target; n_voices++) {
+                tracks[n_voices].voice = mixer_add_voice(m, &tracks[n_voices]);
+                if (!tracks[n_voices].voice) break;
+            }
+            if (n_voices < target) break;
+
+            double avg_us, max_us;
+            measure(m, out, opt, &avg_us, &max_us);
+
+            // Voices one core would carry if the load stayed linear
+            const double per_core = n_voices * period_us / avg_us / (workers + 1);
+            printf("%7u %7u %10.1f %10.1f %6.0f%% %14.0f\n",
+                   workers + 1, n_voices, avg_us, max_us, 100.0 * avg_us / period_us, per_core);
+        }
+        printf("\n");
+
+        for (uint32_t i = 0; i < n_voices; i++) {
+            mixer_remove_voice(m, tracks[i].voice);
+            tracks[i].voice = NULL;
+        }
+        mixer_destroy(m);
+    }
+
+    pw_loop_destroy(loop);
+    free(bus);
+    return EXIT_SUCCESS;
+}
+
+int main(const int argc, char *argv[]) {
+    bench_options_t opt = {
+        .max_voices = 512,
+        .step = 64,
+        .max_workers = 3,
+        .channels = 32,
+        .quantum = 128,
+        .rate = 48000,
+        .cycles = 2000
+    };
+
+    static struct option long_options[] = {
+        {"voices", required_argument, 0, 'v'},
+        {"step", required_argument, 0, 's'},
+        {"workers", required_argument, 0, 'w'},
+        {"channels", required_argument, 0, 'c'},
+        {"quantum", required_argument, 0, 'q'},
+        {"rate", required_argument, 0, 'r'},
+        {"source-rate", required_argument, 0, 'R'},
+        {"cycles", required_argument, 0, 'n'},
+        {"pan", no_argument, 0, 'p'},
+        {"ambisonic", required_argument, 0, 'a'},
+        {"fir", required_argument, 0, 'f'},
+        {"buses", required_argument, 0, 'u'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt_char;
+    while ((opt_char = getopt_long(argc, argv, "v:s:w:c:q:r:R:n:pa:f:u:h", long_options, NULL)) != -1) {
+        switch (opt_char) {
+            case 'v': opt.max_voices = (uint32_t) atoi(optarg); break;
+            case 's': opt.step = (uint32_t) atoi(optarg); break;
+            case 'w': opt.max_workers = (uint32_t) atoi(optarg); break;
+            case 'c': opt.channels = (uint32_t) atoi(optarg); break;
+            case 'q': opt.quantum = (uint32_t) atoi(optarg); break;
+            case 'r': opt.rate = (uint32_t) atoi(optarg); break;
+            case 'R': opt.source_rate = (uint32_t) atoi(optarg); break;
+            case 'n': opt.cycles = (uint32_t) atoi(optarg); break;
+            case 'p': opt.pan = true; break;
+            case 'a': opt.ambisonic = (uint32_t) atoi(optarg); break;
+            case 'f': opt.fir_taps = (uint32_t) atoi(optarg); break;
+            case 'u': opt.buses = (uint32_t) atoi(optarg); break;
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    opt.max_voices = SPA_CLAMP(opt.max_voices, 1u, (uint32_t) MIXER_MAX_VOICES);
+    opt.step = SPA_CLAMP(opt.step, 1u, opt.max_voices);
+    opt.channels = SPA_CLAMP(opt.channels, 2u, (uint32_t) BENCH_MAX_CHANNELS);
+    opt.quantum = SPA_CLAMP(opt.quantum, 16u, (uint32_t) MIXER_MAX_FRAMES);
+    opt.cycles = SPA_MAX(opt.cycles, 10u);
+    if (opt.rate == 0) opt.rate = 48000;
+    if (opt.source_rate == 0) opt.source_rate = opt.rate;
+    opt.ambisonic = SPA_MIN(opt.ambisonic, (uint32_t) AMBISONIC_MAX_ORDER);
+    opt.fir_taps = SPA_MIN(opt.fir_taps, (uint32_t) CONVOLVER_MAX_TAPS);
+    opt.buses = SPA_MIN(opt.buses, (uint32_t) BENCH_MAX_BUSES);
+    for (uint32_t b = 0; b < opt.buses; b++) {
+        snprintf(bus_names[b], sizeof(bus_names[b]), "bus%u", b);
+    }
+    const uint32_t source_channels = opt.ambisonic > 0 ? (opt.ambisonic + 1) * (opt.ambisonic + 1) : 2;
+
+    pw_init(NULL, NULL);
+    log_set_level("WARN");
+
+    char path[] = "/tmp/papa-bench-XXXXXX.wav";
+    const int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        perror("mkstemps");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (!write_source(path, opt.source_rate, source_channels)) {
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    char fir_path[] = "/tmp/papa-bench-ir-XXXXXX.wav";
+    if (opt.fir_taps > 0) {
+        const int fir_fd = mkstemps(fir_path, 4);
+        if (fir_fd < 0) {
+            perror("mkstemps");
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+        close(fir_fd);
+        if (!write_response(fir_path, opt.rate, opt.fir_taps)) {
+            unlink(fir_path);
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+        opt.fir_path = fir_path;
+    }
+
+    // Each voice reads its own handle, as separate tracks would
+    track_config_t *configs = calloc(opt.max_voices, sizeof(track_config_t));
+    track_instance_t *tracks = calloc(opt.max_voices, sizeof(track_instance_t));
+    track_desc_t *descs = calloc(opt.max_voices, sizeof(track_desc_t));
+    char (*mapping_names)[2][DEVICE_CHANNEL_NAME_MAX] = calloc(opt.max_voices, sizeof(*mapping_names));
+    char *(*mappings)[2] = calloc(opt.max_voices, sizeof(*mappings));
+    const size_t block_size = (size_t) TRACK_BLOCK_FRAMES * source_channels * sizeof(float);
+    arena_t arena = {0};
+    size_t arena_size = 0;
+    int rc = EXIT_FAILURE;
+
+    if (!configs || !tracks || !descs || !mapping_names || !mappings) goto done;
+
+    for (uint32_t i = 0; i < opt.max_voices; i++) {
+        // Spread the voices over the bus, two channels each
+        for (int c = 0; c < 2; c++) {
+            snprintf(mapping_names[i][c], DEVICE_CHANNEL_NAME_MAX, "AUX%u", (2 * i + c) % opt.channels);
+            mappings[i][c] = mapping_names[i][c];
+        }
+        configs[i].id = bench_name;
+        configs[i].file_path = path;
+        configs[i].loop = true;
+        configs[i].volume = 1.0f;
+        configs[i].output.mapping = mappings[i];
+        configs[i].output.mapping_count = 2;
+        configs[i].ambisonic = (ambisonic_config_t) { .enabled = opt.ambisonic > 0, .order = (int) opt.ambisonic };
+        configs[i].bus = opt.buses > 0 ? bus_names[i % opt.buses] : NULL;
+
+        if (opt.pan) {
+            // Somewhere between two speakers, so two routes carry signal
+            const float azimuth = 2.0f * (float) M_PI * ((float) i + 0.37f) / (float) opt.max_voices;
+            tracks[i].pan = (pan_position_t) { .set = true, .x = cosf(azimuth), .y = sinf(azimuth) };
+        }
+        tracks[i].config = &configs[i];
+        tracks[i].state = TRACK_STATE_PLAYING;
+        gain_ramp_init(&tracks[i].ramp);
+        tracks[i].audio_file = audio_file_open(path, true, 1.0f);
+        if (!tracks[i].audio_file) {
+            fprintf(stderr, "Failed to open source for voice %u\n", i);
+            goto done;
+        }
+        arena_size += ARENA_SIZE(block_size) +
+                track_desc_arena_size(&configs[i], &tracks[i].audio_file->info, false);
+        if (opt.ambisonic > 0) arena_size += ARENA_SIZE(sizeof(ambisonic_stream_t));
+    }
+
+    // Blocks and descriptors come from one arena, as the track manager does
+    if (!arena_init(&arena, arena_size)) goto done;
+    for (uint32_t i = 0; i < opt.max_voices; i++) {
+        tracks[i].block = arena_alloc(&arena, block_size);
+        if (!track_desc_init(&descs[i], &configs[i], &tracks[i].audio_file->info, false, &arena)) goto done;
+        tracks[i].desc = &descs[i];
+        if (opt.ambisonic > 0) {
+            tracks[i].ambisonic = arena_alloc(&arena, sizeof(ambisonic_stream_t));
+            ambisonic_stream_init(tracks[i].ambisonic, &configs[i].ambisonic, opt.ambisonic);
+        }
+    }
+
+    rc = run(&opt, tracks);
+
+done:
+    for (uint32_t i = 0; tracks && i < opt.max_voices; i++) {
+        audio_file_close(tracks[i].audio_file);
+    }
+    free(mappings);
+    free(mapping_names);
+    free(descs);
+    free(tracks);
+    free(configs);
+    arena_clear(&arena);
+    unlink(path);
+    if (opt.fir_path) unlink(opt.fir_path);
+    pw_deinit();
+    return rc;
+}
@@ -9,6 +9,7 @@
 
 // Socket path definition
 #define BUFFER_SIZE 1024
+#define RESPONSE_SIZE 4096
 
 // Command line options
 static struct option long_options[] = {
@@ -16,10 +17,35 @@ static struct option long_options[] = {
     {"play", required_argument, 0, 'p'},
     {"stop", required_argument, 0, 's'},
     {"stop-all", no_argument, 0, 'a'},
+    {"pause", required_argument, 0, 'P'},
+    {"resume", required_argument, 0, 'R'},
+    {"ramp", required_argument, 0, 'm'},
+    {"quantize", required_argument, 0, 'q'},
+    {"next", required_argument, 0, 'n'},
+    {"prev", required_argument, 0, 'b'},
+    {"pan", required_argument, 0, 'N'},
+    {"azimuth", required_argument, 0, 'z'},
+    {"elevation", required_argument, 0, 'e'},
+    {"move", required_argument, 0, 'M'},
+    {"path", required_argument, 0, 'T'},
+    {"rotate", required_argument, 0, 'O'},
+    {"device", required_argument, 0, 'V'},
+    {"channel", required_argument, 0, 'C'},
+    {"delay", required_argument, 0, 'Y'},
+    {"band", required_argument, 0, 'K'},
+    {"eq", required_argument, 0, 'E'},
+    {"gain", required_argument, 0, 'D'},
+    {"bus", required_argument, 0, 'B'},
+    {"mute", required_argument, 0, 'u'},
+    {"unmute", required_argument, 0, 'U'},
+    {"go", required_argument, 0, 'g'},
+    {"goto", required_argument, 0, 'G'},
+    {"at", required_argument, 0, 'A'},
     {"reload", no_argument, 0, 'r'},
     {"status", no_argument, 0, 't'},
     {"help", no_argument, 0, 'h'},
     {"list-devices", no_argument, 0, 'd'},
+    {"stats", no_argument, 0, 'S'},
     {0, 0, 0, 0}
 };
 
@@ -30,11 +56,36 @@ static void print_help(const char *program_name) {
     printf("Options:\n");
     printf("  --list                List all configured tracks\n");
     printf("  --play <track_id>     Play a track\n");
-    printf("  --stop <track_id>     Stop a track\n");
+    printf("  --stop <track_id>     Stop a track, or halt a cue list\n");
     printf("  --stop-all            Stop all tracks\n");
+    printf("  --pause <track_id>    Pause a track, keeping its position\n");
+    printf("  --resume <track_id>   Resume a paused track\n");
+    printf("  --ramp <ms>           Fade for a following --pause or --resume\n");
+    printf("  --quantize <bar|beat> Start a following --play on the tempo grid\n");
+    printf("  --next <track_id>     Skip to the next item of a playlist\n");
+    printf("  --prev <track_id>     Go back to the previous item of a playlist\n");
+    printf("  --pan <track_id>      Move a panned track to a preceding --azimuth and --elevation\n");
+    printf("  --azimuth <degrees>   Direction for a following --pan or --rotate, positive to the left\n");
+    printf("  --elevation <degrees> Height for a following --pan (default 0)\n");
+    printf("  --move <track_id>     Move a panned track along a preceding --path, without one stop it\n");
+    printf("  --path <trajectory>   Trajectory for a following --move\n");
+    printf("  --rotate <track_id>   Turn an ambisonic track to a preceding --azimuth\n");
+    printf("  --device <name>       Device for a following --delay\n");
+    printf("  --channel <name>      Channel of that device for a following --delay\n");
+    printf("  --delay <ms>          Delay a preceding --channel of a --device\n");
+    printf("  --band <i:hz:db[:q]>  Insert index and settings for a following --eq\n");
+    printf("  --eq <target>         Retune a filter insert of a track or device to a preceding --band\n");
+    printf("  --gain <db>           Level for a following --bus\n");
+    printf("  --bus <name>          Set a submix bus to a preceding --gain\n");
+    printf("  --mute <name>         Mute a submix bus\n");
+    printf("  --unmute <name>       Unmute a submix bus\n");
+    printf("  --go <list_id>        Run a cue list from the top\n");
+    printf("  --goto <list_id>      Run a cue list from the time of a preceding --at\n");
+    printf("  --at <seconds>        Position for a following --goto\n");
     printf("  --reload              Reload configuration\n");
     printf("  --status              Show current status\n");
     printf("  --list-devices        List available PipeWire audio devices\n");
+    printf("  --stats               Show driver timing statistics\n");
     printf("  --help                Show this help message\n");
 }
 
@@ -56,20 +107,18 @@ static char* get_socket_path(char* buffer, size_t size)
 }
 
 
-// Send command to socket server
-static int send_command(const char *command) {
-    int sock;
+// Connect to the socket server, returns -1 if it is not reachable
+static int connect_server(void) {
     struct sockaddr_un addr;
-    char buffer[BUFFER_SIZE];
 
     char socket_path[256];
     get_socket_path(socket_path, sizeof(socket_path));
 
     // Create socket
-    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
     if (sock < 0) {
         perror("socket");
-        return EXIT_FAILURE;
+        return -1;
     }
 
     // Setup address structure
@@ -77,11 +126,23 @@ static int send_command(const char *command) {
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
 
-    // Connect to server
     if (connect(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+// Send command to socket server
+static int send_command(const char *command) {
+    char buffer[RESPONSE_SIZE];
+
+    // Connect to server
+    int sock = connect_server();
+    if (sock < 0) {
         perror("connect");
         fprintf(stderr, "Error: Could not connect to audio player. Is it running?\n");
-        close(sock);
         return EXIT_FAILURE;
     }
 
@@ -92,10 +153,15 @@ static int send_command(const char *command) {
         return EXIT_FAILURE;
     }
 
-    // Receive response
-    ssize_t bytes_read = read(sock, buffer, sizeof(buffer) - 1);
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
+    // Receive response, the server closes the connection when done
+    size_t total = 0;
+    ssize_t bytes_read;
+    while (total < sizeof(buffer) - 1 &&
+           (bytes_read = read(sock, buffer + total, sizeof(buffer) - 1 - total)) > 0) {
+        total += bytes_read;
+    }
+    if (total > 0) {
+        buffer[total] = '\0';
         printf("%s\n", buffer);
     }
 
@@ -107,6 +173,16 @@ static int send_command(const char *command) {
 int main(int argc, char *argv[]) {
     int option_index = 0;
     int c;
+    const char *ramp = NULL;
+    const char *at = NULL;
+    const char *quantize = NULL;
+    const char *azimuth = NULL;
+    const char *elevation = NULL;
+    const char *path = NULL;
+    const char *device = NULL;
+    const char *channel = NULL;
+    const char *band = NULL;
+    const char *gain = NULL;
 
     // Handle help command early
     if (argc <= 1) {
@@ -115,14 +191,15 @@ int main(int argc, char *argv[]) {
     }
 
     // Parse command line arguments
-    while ((c = getopt_long(argc, argv, "lp:s:arth", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "lp:s:aP:R:m:q:n:b:N:z:e:M:T:O:V:C:Y:K:E:D:B:u:U:g:G:A:rthS", long_options, &option_index)) != -1) {
         switch (c) {
             case 'l':
                 return send_command("list");
             case 'p':
                 if (optarg) {
                     char command[BUFFER_SIZE];
-                    snprintf(command, sizeof(command), "play %s", optarg);
+                    snprintf(command, sizeof(command), "play %s%s%s", optarg,
+                             quantize ? " " : "", quantize ? quantize : "");
                     return send_command(command);
                 }
                 fprintf(stderr, "Error: --play requires a track ID\n");
@@ -137,19 +214,146 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
             case 'a':
                 return send_command("stop-all");
+            case 'm':
+                ramp = optarg;
+                break;
+            case 'q':
+                quantize = optarg;
+                break;
+            case 'P':
+            case 'R': {
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "%s %s%s%s", c == 'P' ? "pause" : "resume",
+                         optarg, ramp ? " " : "", ramp ? ramp : "");
+                return send_command(command);
+            }
+            case 'n':
+            case 'b': {
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "%s %s", c == 'n' ? "next" : "prev", optarg);
+                return send_command(command);
+            }
+            case 'z':
+                azimuth = optarg;
+                break;
+            case 'e':
+                elevation = optarg;
+                break;
+            case 'N': {
+                if (!azimuth) {
+                    fprintf(stderr, "Error: --pan requires a preceding --azimuth\n");
+                    return EXIT_FAILURE;
+                }
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "pan %s %s %s", optarg, azimuth, elevation ? elevation : "0");
+                return send_command(command);
+            }
+            case 'T':
+                path = optarg;
+                break;
+            case 'M': {
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "move %s%s%s", optarg, path ? " " : "", path ? path : "");
+                return send_command(command);
+            }
+            case 'O': {
+                if (!azimuth) {
+                    fprintf(stderr, "Error: --rotate requires a preceding --azimuth\n");
+                    return EXIT_FAILURE;
+                }
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "yaw %s %s", optarg, azimuth);
+                return send_command(command);
+            }
+            case 'V':
+                device = optarg;
+                break;
+            case 'C':
+                channel = optarg;
+                break;
+            case 'Y': {
+                if (!device || !channel) {
+                    fprintf(stderr, "Error: --delay requires a preceding --device and --channel\n");
+                    return EXIT_FAILURE;
+                }
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "delay %s %s %s", device, channel, optarg);
+                return send_command(command);
+            }
+            case 'K':
+                band = optarg;
+                break;
+            case 'E': {
+                if (!band) {
+                    fprintf(stderr, "Error: --eq requires a preceding --band\n");
+                    return EXIT_FAILURE;
+                }
+                char settings[128];
+                snprintf(settings, sizeof(settings), "%s", band);
+                for (char *p = settings; *p; p++) {
+                    if (*p == ':') *p = ' ';
+                }
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "eq %s %s", optarg, settings);
+                return send_command(command);
+            }
+            case 'D':
+                gain = optarg;
+                break;
+            case 'B': {
+                if (!gain) {
+                    fprintf(stderr, "Error: --bus requires a preceding --gain\n");
+                    return EXIT_FAILURE;
+                }
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "bus-gain %s %s", optarg, gain);
+                return send_command(command);
+            }
+            case 'u':
+            case 'U': {
+                char command[BUFFER_SIZE];
+                snprintf(command, sizeof(command), "%s %s", c == 'u' ? "mute" : "unmute", optarg);
+                return send_command(command);
+            }
+            case 'A':
+                at = optarg;
+                break;
+            case 'g':
+            case 'G': {
+                if (c == 'G' && !at) {
+                    fprintf(stderr, "Error: --goto requires a preceding --at\n");
+                    return EXIT_FAILURE;
+                }
+                char command[BUFFER_SIZE];
+                if (c == 'g')
+                    snprintf(command, sizeof(command), "go %s", optarg);
+                else
+                    snprintf(command, sizeof(command), "goto %s %s", optarg, at);
+                return send_command(command);
+            }
             case 'r':
                 return send_command("reload");
             case 't':
                 return send_command("status");
+            case 'S':
+                return send_command("stats");
             case 'h':
                 print_help(argv[0]);
                 return EXIT_SUCCESS;
             case '?':
                 print_help(argv[0]);
                 return EXIT_FAILURE;
-            case 'd':
+            case 'd': {
+                // The daemon keeps a live device cache, only enumerate
+                // ourselves when it is not running
+                int sock = connect_server();
+                if (sock >= 0) {
+                    close(sock);
+                    return send_command("devices");
+                }
                 list_audio_devices();
                 return EXIT_SUCCESS;
+            }
         }
     }
 
@@ -0,0 +1,418 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ambisonic.h"
+#include "log.h"
+
+// Ridge added to the speaker harmonics before inverting them, relative to
+// their mean power
+#define AMBISONIC_REGULARIZATION 1e-3
+
+static uint32_t channels_of(const uint32_t order) {
+    return (order + 1) * (order + 1);
+}
+
+// Order of an ACN channel
+static uint32_t degree_of(const uint32_t channel) {
+    uint32_t n = 0;
+    while ((n + 1) * (n + 1) <= channel) n++;
+    return n;
+}
+
+// Real spherical harmonics of a unit direction up to order, ACN and N3D
+static void harmonics(const uint32_t order, const float *dir, float *y) {
+    const float x = dir[0], yy = dir[1], z = dir[2];
+
+    // SN3D (AmbiX) first
+    y[0] = 1.0f;
+    if (order >= 1) {
+        y[1] = yy;
+        y[2] = z;
+        y[3] = x;
+    }
+    if (order >= 2) {
+        const float s3 = sqrtf(3.0f);
+        y[4] = s3 * x * yy;
+        y[5] = s3 * yy * z;
+        y[6] = 0.5f * (3.0f * z * z - 1.0f);
+        y[7] = s3 * x * z;
+        y[8] = 0.5f * s3 * (x * x - yy * yy);
+    }
+    if (order >= 3) {
+        const float s58 = sqrtf(5.0f / 8.0f);
+        const float s38 = sqrtf(3.0f / 8.0f);
+        const float s15 = sqrtf(15.0f);
+        y[9] = s58 * yy * (3.0f * x * x - yy * yy);
+        y[10] = s15 * x * yy * z;
+        y[11] = s38 * yy * (5.0f * z * z - 1.0f);
+        y[12] = 0.5f * z * (5.0f * z * z - 3.0f);
+        y[13] = s38 * x * (5.0f * z * z - 1.0f);
+        y[14] = 0.5f * s15 * z * (x * x - yy * yy);
+        y[15] = s58 * x * (x * x - 3.0f * yy * yy);
+    }
+
+    for (uint32_t k = 1; k < channels_of(order); k++) {
+        y[k] *= sqrtf((float) (2 * degree_of(k) + 1));
+    }
+}
+
+// Near uniform directions on the sphere, a Fibonacci lattice
+static void grid_point(const uint32_t i, float *dir) {
+    const float golden = (float) M_PI * (3.0f - sqrtf(5.0f));
+    const float z = 1.0f - (2.0f * (float) i + 1.0f) / (float) AMBISONIC_GRID_POINTS;
+    const float r = sqrtf(1.0f - z * z);
+
+    dir[0] = r * cosf(golden * (float) i);
+    dir[1] = r * sinf(golden * (float) i);
+    dir[2] = z;
+}
+
+// Max-rE weight of each order, narrows the energy of a source to its
+// direction at the cost of a flat response
+static void max_re_weights(const uint32_t order, float *weights) {
+    const float r = cosf(2.4068f / ((float) order + 1.51f));
+
+    weights[0] = 1.0f;
+    weights[1] = r;
+    weights[2] = 0.5f * (3.0f * r * r - 1.0f);
+    weights[3] = 0.5f * (5.0f * r * r * r - 3.0f * r);
+}
+
+// A dome has nothing to pan the virtual speakers under it to, AllRAD adds
+// an imaginary speaker there, and overhead when it has no top either,
+// whose signal is dropped. Only a 3D VBAP layout needs them.
+static bool imaginary_panner(const device_config_t *config, const panner_t *panner, panner_t *out) {
+    speaker_config_t speakers[PANNER_MAX_SPEAKERS];
+    char names[PANNER_MAX_SPEAKERS][DEVICE_CHANNEL_NAME_MAX];
+    char name[128];
+    float low = 1.0f, high = -1.0f;
+    uint32_t n = 0;
+
+    for (; n < panner->n_speakers; n++) {
+        const float *v = panner->positions[n];
+        snprintf(names[n], DEVICE_CHANNEL_NAME_MAX, "S%u", n);
+        speakers[n] = (speaker_config_t) {
+            .channel = names[n],
+            .position = { .set = true, .x = v[0], .y = v[1], .z = v[2] }
+        };
+        low = fminf(low, v[2]);
+        high = fmaxf(high, v[2]);
+    }
+    if (low > -0.5f && n < PANNER_MAX_SPEAKERS) {
+        snprintf(names[n], DEVICE_CHANNEL_NAME_MAX, "S%u", n);
+        speakers[n] = (speaker_config_t) { .channel = names[n], .position = { .set = true, .z = -1.0f } };
+        n++;
+    }
+    if (high < 0.5f && n < PANNER_MAX_SPEAKERS) {
+        snprintf(names[n], DEVICE_CHANNEL_NAME_MAX, "S%u", n);
+        speakers[n] = (speaker_config_t) { .channel = names[n], .position = { .set = true, .z = 1.0f } };
+        n++;
+    }
+
+    snprintf(name, sizeof(name), "%s (AllRAD)", config->name);
+    const device_config_t virtual = {
+        .name = name,
+        .speakers = speakers,
+        .speaker_count = (int) n,
+        .pan_method = PAN_VBAP
+    };
+    return panner_init(out, &virtual, (const char (*)[DEVICE_CHANNEL_NAME_MAX]) names, n);
+}
+
+// Decode the virtual layout by sampling and pan every virtual speaker onto
+// the first n_speakers of panner, the real ones
+static void allrad(const panner_t *panner, const uint32_t n_speakers, const uint32_t order, float *matrix) {
+    const uint32_t k_max = channels_of(order);
+    uint32_t set = 0;
+
+    for (uint32_t i = 0; i < AMBISONIC_GRID_POINTS; i++) {
+        float dir[3];
+        float y[AMBISONIC_MAX_CHANNELS];
+        float gains[PANNER_MAX_SPEAKERS];
+        grid_point(i, dir);
+        harmonics(order, dir, y);
+
+        const pan_position_t position = { .set = true, .x = dir[0], .y = dir[1], .z = dir[2] };
+        panner_gains(panner, &position, &set, gains);
+
+        for (uint32_t s = 0; s < n_speakers; s++) {
+            if (gains[s] == 0.0f) continue;
+            float *row = matrix + (size_t) s * AMBISONIC_MAX_CHANNELS;
+            for (uint32_t k = 0; k < k_max; k++) {
+                row[k] += gains[s] * y[k] / (float) AMBISONIC_GRID_POINTS;
+            }
+        }
+    }
+}
+
+// In place Gauss-Jordan with partial pivoting, false when singular
+static bool invert(double *a, double *inverse, const uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < n; j++) {
+            inverse[i * n + j] = i == j ? 1.0 : 0.0;
+        }
+    }
+
+    for (uint32_t col = 0; col < n; col++) {
+        uint32_t pivot = col;
+        for (uint32_t r = col + 1; r < n; r++) {
+            if (fabs(a[r * n + col]) > fabs(a[pivot * n + col])) pivot = r;
+        }
+        if (fabs(a[pivot * n + col]) < 1e-12) return false;
+
+        if (pivot != col) {
+            for (uint32_t j = 0; j < n; j++) {
+                double t = a[col * n + j];
+                a[col * n + j] = a[pivot * n + j];
+                a[pivot * n + j] = t;
+                t = inverse[col * n + j];
+                inverse[col * n + j] = inverse[pivot * n + j];
+                inverse[pivot * n + j] = t;
+            }
+        }
+
+        const double scale = 1.0 / a[col * n + col];
+        for (uint32_t j = 0; j < n; j++) {
+            a[col * n + j] *= scale;
+            inverse[col * n + j] *= scale;
+        }
+        for (uint32_t r = 0; r < n; r++) {
+            const double f = a[r * n + col];
+            if (r == col || f == 0.0) continue;
+            for (uint32_t j = 0; j < n; j++) {
+                a[r * n + j] -= f * a[col * n + j];
+                inverse[r * n + j] -= f * inverse[col * n + j];
+            }
+        }
+    }
+    return true;
+}
+
+// Regularised pseudo-inverse of the harmonics at the speakers. A layout at
+// ear height only decodes the horizontal harmonics.
+static bool mode_matching(const panner_t *panner, const uint32_t order, float *matrix) {
+    const uint32_t k_max = channels_of(order);
+    const uint32_t n = panner->n_speakers;
+    float y[PANNER_MAX_SPEAKERS][AMBISONIC_MAX_CHANNELS];
+    double a[AMBISONIC_MAX_CHANNELS * AMBISONIC_MAX_CHANNELS] = { 0.0 };
+    double inverse[AMBISONIC_MAX_CHANNELS * AMBISONIC_MAX_CHANNELS];
+
+    for (uint32_t s = 0; s < n; s++) {
+        float dir[3] = { panner->positions[s][0], panner->positions[s][1], panner->positions[s][2] };
+        const float norm = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        if (norm < 1e-6f) {
+            memset(y[s], 0, sizeof(y[s]));
+            continue;
+        }
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] /= norm;
+        }
+        harmonics(order, dir, y[s]);
+
+        if (panner->dimensions == 2) {
+            for (uint32_t k = 0; k < k_max; k++) {
+                const uint32_t degree = degree_of(k);
+                if (k != degree * degree && k != degree * degree + 2 * degree) y[s][k] = 0.0f;
+            }
+        }
+    }
+
+    double trace = 0.0;
+    for (uint32_t i = 0; i < k_max; i++) {
+        for (uint32_t j = 0; j < k_max; j++) {
+            for (uint32_t s = 0; s < n; s++) {
+                a[i * k_max + j] += (double) y[s][i] * y[s][j];
+            }
+        }
+        trace += a[i * k_max + i];
+    }
+    for (uint32_t i = 0; i < k_max; i++) {
+        a[i * k_max + i] += AMBISONIC_REGULARIZATION * trace / k_max;
+    }
+    if (!invert(a, inverse, k_max)) return false;
+
+    for (uint32_t s = 0; s < n; s++) {
+        float *row = matrix + (size_t) s * AMBISONIC_MAX_CHANNELS;
+        for (uint32_t k = 0; k < k_max; k++) {
+            double g = 0.0;
+            for (uint32_t j = 0; j < k_max; j++) {
+                g += y[s][j] * inverse[j * k_max + k];
+            }
+            row[k] = (float) g;
+        }
+    }
+    return true;
+}
+
+// Weight the orders and level the decoder so a plane wave from anywhere
+// reaches the speakers at unit power on average
+static void finish(const uint32_t n_speakers, const uint32_t order, float *matrix) {
+    const uint32_t k_max = channels_of(order);
+    float weights[AMBISONIC_MAX_ORDER + 1];
+    max_re_weights(order, weights);
+
+    for (uint32_t s = 0; s < n_speakers; s++) {
+        float *row = matrix + (size_t) s * AMBISONIC_MAX_CHANNELS;
+        for (uint32_t k = 0; k < k_max; k++) {
+            row[k] *= weights[degree_of(k)];
+        }
+    }
+
+    double energy = 0.0;
+    for (uint32_t i = 0; i < AMBISONIC_GRID_POINTS; i++) {
+        float dir[3];
+        float y[AMBISONIC_MAX_CHANNELS];
+        grid_point(i, dir);
+        harmonics(order, dir, y);
+
+        for (uint32_t s = 0; s < n_speakers; s++) {
+            const float *row = matrix + (size_t) s * AMBISONIC_MAX_CHANNELS;
+            float g = 0.0f;
+            for (uint32_t k = 0; k < k_max; k++) {
+                g += row[k] * y[k];
+            }
+            energy += (double) g * g;
+        }
+    }
+    if (energy <= 0.0) return;
+
+    const float scale = (float) (1.0 / sqrt(energy / AMBISONIC_GRID_POINTS));
+    for (uint32_t s = 0; s < n_speakers; s++) {
+        float *row = matrix + (size_t) s * AMBISONIC_MAX_CHANNELS;
+        for (uint32_t k = 0; k < k_max; k++) {
+            row[k] *= scale;
+        }
+    }
+}
+
+uint32_t ambisonic_order(const ambisonic_config_t *config, const uint32_t channels) {
+    if (config->order > 0) return channels == channels_of((uint32_t) config->order) ? (uint32_t) config->order : 0;
+
+    for (uint32_t order = 1; order <= AMBISONIC_MAX_ORDER; order++) {
+        if (channels == channels_of(order)) return order;
+    }
+    return 0;
+}
+
+bool ambisonic_decoder_init(ambisonic_decoder_t *d, const device_config_t *config, const panner_t *panner) {
+    memset(d, 0, sizeof(*d));
+    if (panner->n_speakers == 0) return false;
+
+    bool matched = config->decoder == DECODER_MODE_MATCHING;
+    panner_t imaginary = { 0 };
+    const panner_t *virtual = NULL;
+
+    for (uint32_t order = 1; order <= AMBISONIC_MAX_ORDER; order++) {
+        float *matrix = calloc((size_t) panner->n_speakers * AMBISONIC_MAX_CHANNELS, sizeof(float));
+        if (!matrix) {
+            log_error("Failed to allocate ambisonic decoders");
+            panner_clear(&imaginary);
+            ambisonic_decoder_clear(d);
+            return false;
+        }
+        d->matrices[order] = matrix;
+
+        if (matched && !mode_matching(panner, order, matrix)) {
+            log_warn("Speaker layout too sparse to match modes, decoding with AllRAD");
+            memset(matrix, 0, (size_t) panner->n_speakers * AMBISONIC_MAX_CHANNELS * sizeof(float));
+            matched = false;
+        }
+        if (!matched) {
+            if (!virtual) {
+                const bool dome = panner->method == PAN_VBAP && panner->dimensions == 3;
+                virtual = dome && imaginary_panner(config, panner, &imaginary) ? &imaginary : panner;
+            }
+            allrad(virtual, panner->n_speakers, order, matrix);
+        }
+        finish(panner->n_speakers, order, matrix);
+    }
+
+    panner_clear(&imaginary);
+    d->n_speakers = panner->n_speakers;
+    return true;
+}
+
+void ambisonic_decoder_clear(ambisonic_decoder_t *d) {
+    for (uint32_t order = 0; order <= AMBISONIC_MAX_ORDER; order++) {
+        free(d->matrices[order]);
+        d->matrices[order] = NULL;
+    }
+    d->n_speakers = 0;
+}
+
+void ambisonic_stream_init(ambisonic_stream_t *stream, const ambisonic_config_t *config, const uint32_t order) {
+    stream->order = order;
+    stream->channels = channels_of(order);
+    for (uint32_t k = 0; k < stream->channels; k++) {
+        stream->scale[k] = config->normalization == AMBISONIC_SN3D ? sqrtf((float) (2 * degree_of(k) + 1)) : 1.0f;
+    }
+
+    ambisonic_set_yaw(stream, config->yaw);
+    memcpy(stream->rotation, stream->target, sizeof(stream->rotation));
+}
+
+void ambisonic_set_yaw(ambisonic_stream_t *stream, const float degrees) {
+    const float yaw = degrees * (float) M_PI / 180.0f;
+
+    for (uint32_t m = 1; m <= stream->order; m++) {
+        stream->target[m - 1][0] = cosf((float) m * yaw);
+        stream->target[m - 1][1] = sinf((float) m * yaw);
+    }
+}
+
+void ambisonic_rotate(ambisonic_stream_t *stream, const uint32_t n) {
+    assert(n <= AMBISONIC_BLOCK_FRAMES);
+
+    for (uint32_t m = 1; m <= stream->order; m++) {
+        const float c0 = stream->rotation[m - 1][0], s0 = stream->rotation[m - 1][1];
+        const float c1 = stream->target[m - 1][0], s1 = stream->target[m - 1][1];
+        if (c0 == 1.0f && c1 == 1.0f) continue;
+
+        const float dc = (c1 - c0) / (float) n;
+        const float ds = (s1 - s0) / (float) n;
+
+        // Turning the field by yaw turns the cosine and sine harmonics of
+        // degree m by m times yaw, in every order from m up
+        for (uint32_t degree = m; degree <= stream->order; degree++) {
+            float *restrict cos_part = stream->planar[degree * degree + degree + m];
+            float *restrict sin_part = stream->planar[degree * degree + degree - m];
+            for (uint32_t i = 0; i < n; i++) {
+                const float c = c0 + dc * (float) i;
+                const float s = s0 + ds * (float) i;
+                const float a = cos_part[i];
+                const float b = sin_part[i];
+                cos_part[i] = a * c - b * s;
+                sin_part[i] = b * c + a * s;
+            }
+        }
+        stream->rotation[m - 1][0] = c1;
+        stream->rotation[m - 1][1] = s1;
+    }
+}
+
+// Frames summed in registers before they are added onto the bus
+#define DECODE_TILE 64
+
+void ambisonic_decode(const ambisonic_stream_t *stream, const float *gains, float *dst, const uint32_t n) {
+    float *restrict out = dst;
+
+    assert(n <= AMBISONIC_BLOCK_FRAMES);
+    for (uint32_t start = 0; start < n; start += DECODE_TILE) {
+        const uint32_t len = SPA_MIN(n - start, DECODE_TILE);
+        float acc[DECODE_TILE] = { 0.0f };
+
+        for (uint32_t k = 0; k < stream->channels; k++) {
+            const float g = gains[k];
+            if (g == 0.0f) continue;
+            const float *restrict in = stream->planar[k] + start;
+            for (uint32_t i = 0; i < len; i++) {
+                acc[i] += g * in[i];
+            }
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            out[start + i] += acc[i];
+        }
+    }
+}
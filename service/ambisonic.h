@@ -0,0 +1,61 @@
+#ifndef ASYNC_AUDIO_PLAYER_AMBISONIC_H
+#define ASYNC_AUDIO_PLAYER_AMBISONIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "panner.h"
+
+#define AMBISONIC_MAX_ORDER 3
+#define AMBISONIC_MAX_CHANNELS ((AMBISONIC_MAX_ORDER + 1) * (AMBISONIC_MAX_ORDER + 1))
+
+// Frames of the planar scratch of a stream, a mixer block must fit
+#define AMBISONIC_BLOCK_FRAMES 256
+
+// Directions of the virtual layout AllRAD decodes to, and the decoders are
+// levelled over
+#define AMBISONIC_GRID_POINTS 240
+
+// Decoders of a device for every order, worked out once its speaker layout
+// is known. A row per speaker of N3D channel gains, AMBISONIC_MAX_CHANNELS
+// wide whatever the order.
+typedef struct {
+    uint32_t n_speakers;                           // 0 when the device has no layout
+    float *matrices[AMBISONIC_MAX_ORDER + 1];      // By order, [0] unused
+} ambisonic_decoder_t;
+
+// Ambisonic content of a track on its way to the decoder. Allocated at
+// load, owned by the process thread while the track plays.
+typedef struct ambisonic_stream {
+    uint32_t order;
+    uint32_t channels;
+    float scale[AMBISONIC_MAX_CHANNELS];           // File channel to N3D
+    float rotation[AMBISONIC_MAX_ORDER][2];        // Cosine and sine of m * yaw, reached at the end of the last block
+    float target[AMBISONIC_MAX_ORDER][2];          // Set through invoke
+    float planar[AMBISONIC_MAX_CHANNELS][AMBISONIC_BLOCK_FRAMES];
+} ambisonic_stream_t;
+
+// Order of a track with channels file channels, 0 when they do not make one
+uint32_t ambisonic_order(const ambisonic_config_t *config, uint32_t channels);
+
+// Decoders of every order for the speaker layout of a device, false when it
+// has none
+bool ambisonic_decoder_init(ambisonic_decoder_t *decoder, const device_config_t *config, const panner_t *panner);
+
+void ambisonic_decoder_clear(ambisonic_decoder_t *decoder);
+
+// Start a stream at its configured yaw
+void ambisonic_stream_init(ambisonic_stream_t *stream, const ambisonic_config_t *config, uint32_t order);
+
+// Turn the sound field to yaw degrees to the left, reached over the next block
+void ambisonic_set_yaw(ambisonic_stream_t *stream, float degrees);
+
+// Rotate the first n frames of the planar block, gliding to the target yaw.
+// n is at most AMBISONIC_BLOCK_FRAMES.
+void ambisonic_rotate(ambisonic_stream_t *stream, uint32_t n);
+
+// Add the first n frames of the planar block onto one speaker, gains being
+// its row of the decoder. n is at most AMBISONIC_BLOCK_FRAMES.
+void ambisonic_decode(const ambisonic_stream_t *stream, const float *gains, float *dst, uint32_t n);
+
+#endif // ASYNC_AUDIO_PLAYER_AMBISONIC_H
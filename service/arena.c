@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "log.h"
+
+bool arena_init(arena_t *arena, const size_t size) {
+    memset(arena, 0, sizeof(*arena));
+    if (size == 0) return true;
+
+    void *base;
+    if (posix_memalign(&base, ARENA_ALIGN, ARENA_SIZE(size)) != 0) {
+        log_error("Failed to reserve %zu bytes", size);
+        return false;
+    }
+
+    arena->base = base;
+    arena->size = ARENA_SIZE(size);
+    return true;
+}
+
+void arena_wrap(arena_t *arena, void *storage, const size_t size) {
+    arena->base = storage;
+    arena->size = size;
+    arena->used = 0;
+}
+
+void *arena_alloc(arena_t *arena, const size_t size) {
+    const size_t aligned = ARENA_SIZE(size);
+
+    if (aligned > arena->size - arena->used) {
+        log_error("Arena of %zu bytes exhausted", arena->size);
+        return NULL;
+    }
+
+    void *p = arena->base + arena->used;
+    arena->used += aligned;
+    memset(p, 0, aligned);
+    return p;
+}
+
+void arena_clear(arena_t *arena) {
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void slab_init(slab_t *slab, void *storage, const size_t obj_size, const uint32_t count) {
+    uint8_t *p = storage;
+
+    // Link back to front, so objects are handed out in storage order
+    slab->free_list = NULL;
+    for (uint32_t i = count; i > 0; i--) {
+        void **obj = (void **) (p + (size_t) (i - 1) * obj_size);
+        *obj = slab->free_list;
+        slab->free_list = obj;
+    }
+    slab->n_free = count;
+}
+
+void *slab_alloc(slab_t *slab) {
+    void **obj = slab->free_list;
+    if (!obj) return NULL;
+
+    slab->free_list = *obj;
+    slab->n_free--;
+    return obj;
+}
+
+void slab_free(slab_t *slab, void *obj) {
+    *(void **) obj = slab->free_list;
+    slab->free_list = obj;
+    slab->n_free++;
+}
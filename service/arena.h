@@ -0,0 +1,50 @@
+#ifndef ASYNC_AUDIO_PLAYER_ARENA_H
+#define ASYNC_AUDIO_PLAYER_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache line, so blocks used by different threads never share one
+#define ARENA_ALIGN 64
+#define ARENA_SIZE(size) (((size) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+// One allocation made when the configuration is loaded and carved up from
+// there. Nothing is handed back until the whole arena goes, so the footprint
+// is fixed once loading is done.
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} arena_t;
+
+// Reserve size bytes, sum ARENA_SIZE() of every later allocation
+bool arena_init(arena_t *arena, size_t size);
+
+// Carve from storage of the caller instead, aligned to ARENA_ALIGN. Such an
+// arena is never cleared.
+void arena_wrap(arena_t *arena, void *storage, size_t size);
+
+// Zeroed and aligned to ARENA_ALIGN, NULL once the arena is used up
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Release the arena, everything carved from it goes with it
+void arena_clear(arena_t *arena);
+
+// Objects of one size kept on a free list, taken and returned in constant
+// time without the system allocator
+typedef struct {
+    void *free_list;
+    uint32_t n_free;
+} slab_t;
+
+// Put count objects of obj_size bytes from storage on the free list
+void slab_init(slab_t *slab, void *storage, size_t obj_size, uint32_t count);
+
+// Take an object, NULL when all are in use. Its contents are undefined.
+void *slab_alloc(slab_t *slab);
+
+// Return an object taken from this slab
+void slab_free(slab_t *slab, void *obj);
+
+#endif // ASYNC_AUDIO_PLAYER_ARENA_H
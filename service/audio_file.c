@@ -3,34 +3,14 @@
 #include "audio_file.h"
 #include "log.h"
 
-#define BUFFER_FRAMES 4096
-
-audio_file_t *audio_file_open(const char *path, const bool loop, const float volume) {
-    audio_file_t *af = calloc(1, sizeof(audio_file_t));
-    if (!af) {
-        log_error("Failed to allocate audio file structure");
-        return NULL;
-    }
-
-    // Initialize SF_INFO structure
-    memset(&af->info, 0, sizeof(SF_INFO));
+bool audio_file_init(audio_file_t *af, const char *path, const bool loop, const float volume) {
+    memset(af, 0, sizeof(*af));
 
     // Open the sound file
     af->file = sf_open(path, SFM_READ, &af->info);
     if (!af->file) {
         log_error("Failed to open audio file: %s (%s)", path, sf_strerror(NULL));
-        free(af);
-        return NULL;
-    }
-
-    // Allocate buffer
-    af->buffer_size = BUFFER_FRAMES * af->info.channels;
-    af->buffer = malloc(af->buffer_size * sizeof(float));
-    if (!af->buffer) {
-        log_error("Failed to allocate audio buffer");
-        sf_close(af->file);
-        free(af);
-        return NULL;
+        return false;
     }
 
     af->loop = loop;
@@ -40,6 +20,20 @@ audio_file_t *audio_file_open(const char *path, const bool loop, const float vol
     log_info("Opened audio file: %s (channels: %d, rate: %d)",
              path, af->info.channels, af->info.samplerate);
 
+    return true;
+}
+
+audio_file_t *audio_file_open(const char *path, const bool loop, const float volume) {
+    audio_file_t *af = malloc(sizeof(audio_file_t));
+    if (!af) {
+        log_error("Failed to allocate audio file structure");
+        return NULL;
+    }
+
+    if (!audio_file_init(af, path, loop, volume)) {
+        free(af);
+        return NULL;
+    }
     return af;
 }
 
@@ -56,8 +50,9 @@ size_t audio_file_read(audio_file_t *af, float *output, const size_t frames) {
     }
 
     // Handle looping
-    if (frames_read < frames && af->loop) {
+    if (frames_read < frames && (af->loop || af->loop_count < af->repeat)) {
         sf_seek(af->file, 0, SEEK_SET);
+        af->loop_count++;
         const size_t remaining = frames - frames_read;
         const size_t additional = sf_readf_float(af->file, output + (frames_read * af->info.channels), remaining);
         frames_read += additional;
@@ -67,6 +62,14 @@ size_t audio_file_read(audio_file_t *af, float *output, const size_t frames) {
     return frames_read;
 }
 
+sf_count_t audio_file_remaining(const audio_file_t *af) {
+    if (!af || af->loop) return -1;
+
+    // Position counts every frame read since the last rewind
+    const sf_count_t total = af->info.frames * (sf_count_t) (af->repeat + 1);
+    return total > af->position ? total - af->position : 0;
+}
+
 bool audio_file_seek(audio_file_t *af, const sf_count_t position) {
     if (!af) return false;
 
@@ -80,12 +83,23 @@ bool audio_file_seek(audio_file_t *af, const sf_count_t position) {
     return true;
 }
 
-void audio_file_close(audio_file_t *af) {
+bool audio_file_rewind(audio_file_t *af) {
+    if (!audio_file_seek(af, 0)) return false;
+
+    af->loop_count = 0;
+    return true;
+}
+
+void audio_file_clear(audio_file_t *af) {
     if (!af) return;
 
     if (af->file) {
         sf_close(af->file);
+        af->file = NULL;
     }
-    free(af->buffer);
+}
+
+void audio_file_close(audio_file_t *af) {
+    audio_file_clear(af);
     free(af);
 }
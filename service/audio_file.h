@@ -8,16 +8,25 @@
 typedef struct {
     SNDFILE *file;
     SF_INFO info;
-    float *buffer;
-    size_t buffer_size;
     bool loop;
     float volume;
     sf_count_t position;
+    unsigned int loop_count;   // Number of times playback wrapped around
+    unsigned int repeat;       // Wraps before a file that does not loop ends
 } audio_file_t;
 
 // Open audio file and prepare for reading
 audio_file_t* audio_file_open(const char *path, bool loop, float volume);
 
+// Open an audio file into storage owned by the caller
+bool audio_file_init(audio_file_t *af, const char *path, bool loop, float volume);
+
+// Start over from the first frame, as freshly opened
+bool audio_file_rewind(audio_file_t *af);
+
+// Frames left to read before the file ends, -1 when it loops
+sf_count_t audio_file_remaining(const audio_file_t *af);
+
 // Read next chunk of audio data
 size_t audio_file_read(audio_file_t *af, float *output, size_t frames);
 
@@ -27,4 +36,7 @@ bool audio_file_seek(audio_file_t *af, sf_count_t position);
 // Close audio file and free resources
 void audio_file_close(audio_file_t *af);
 
+// Close an audio file opened with audio_file_init
+void audio_file_clear(audio_file_t *af);
+
 #endif // ASYNC_AUDIO_PLAYER_AUDIO_FILE_H
@@ -1,8 +1,13 @@
 #include <yaml.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include "config.h"
 #include "log.h"
+#include "trajectory.h"
+#include "delay_line.h"
+#include "insert_chain.h"
+#include "submix.h"
 
 static void parse_logging(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
     if (node->type != YAML_MAPPING_NODE) return;
@@ -17,6 +22,43 @@ static void parse_logging(yaml_document_t *doc, const yaml_node_t *node, global_
     }
 }
 
+static void parse_engine(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+        if (strcmp((char *) key->data.scalar.value, "mode") == 0) {
+            if (strcmp((char *) value->data.scalar.value, "filter") == 0) {
+                config->engine.mode = ENGINE_MODE_FILTER;
+            } else if (strcmp((char *) value->data.scalar.value, "streams") == 0) {
+                config->engine.mode = ENGINE_MODE_STREAMS;
+            } else {
+                log_warn("Unknown engine mode %s, using streams", (char *) value->data.scalar.value);
+            }
+        }
+    }
+}
+
+static void parse_tempo(yaml_document_t *doc, const yaml_node_t *node, tempo_config_t *tempo) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "bpm") == 0) {
+            tempo->bpm = atof((char *) value->data.scalar.value);
+            if (tempo->bpm < 0.0) tempo->bpm = 0.0;
+        } else if (strcmp((char *) key->data.scalar.value, "beats_per_bar") == 0) {
+            const int beats = atoi((char *) value->data.scalar.value);
+            tempo->beats_per_bar = beats > 0 ? (uint32_t) beats : 0;
+        }
+    }
+}
+
 static void parse_track_output(yaml_document_t *doc, const yaml_node_t *node, output_config_t *output) {
     if (node->type != YAML_MAPPING_NODE) return;
 
@@ -25,7 +67,21 @@ static void parse_track_output(yaml_document_t *doc, const yaml_node_t *node, ou
         const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
 
         if (strcmp((char *) key->data.scalar.value, "device") == 0) {
-            output->device = strdup((char *) value->data.scalar.value);
+            // Either a single device or a failover list
+            if (value->type == YAML_SCALAR_NODE) {
+                output->device_count = 1;
+                output->devices = malloc(sizeof(char *));
+                output->devices[0] = strdup((char *) value->data.scalar.value);
+            } else if (value->type == YAML_SEQUENCE_NODE) {
+                output->device_count = value->data.sequence.items.top - value->data.sequence.items.start;
+                output->devices = malloc(sizeof(char *) * output->device_count);
+
+                int i = 0;
+                for (const yaml_node_item_t *item = value->data.sequence.items.start; item < value->data.sequence.items.top; item++) {
+                    const yaml_node_t *device_value = yaml_document_get_node(doc, *item);
+                    output->devices[i++] = strdup((char *) device_value->data.scalar.value);
+                }
+            }
         } else if (strcmp((char *) key->data.scalar.value, "mapping") == 0) {
             // Parse mapping array
             if (value->type == YAML_SEQUENCE_NODE) {
@@ -42,6 +98,662 @@ static void parse_track_output(yaml_document_t *doc, const yaml_node_t *node, ou
     }
 }
 
+// Either azimuth and elevation in degrees with an optional distance, or x, y and z
+static void parse_position(yaml_document_t *doc, const yaml_node_t *node, pan_position_t *position) {
+    double azimuth = 0.0;
+    double elevation = 0.0;
+    double distance = 1.0;
+    bool polar = false;
+
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        const double number = atof((char *) value->data.scalar.value);
+        if (strcmp((char *) key->data.scalar.value, "azimuth") == 0) {
+            azimuth = number;
+            polar = true;
+        } else if (strcmp((char *) key->data.scalar.value, "elevation") == 0) {
+            elevation = number;
+            polar = true;
+        } else if (strcmp((char *) key->data.scalar.value, "distance") == 0) {
+            distance = number;
+        } else if (strcmp((char *) key->data.scalar.value, "x") == 0) {
+            position->x = (float) number;
+        } else if (strcmp((char *) key->data.scalar.value, "y") == 0) {
+            position->y = (float) number;
+        } else if (strcmp((char *) key->data.scalar.value, "z") == 0) {
+            position->z = (float) number;
+        } else {
+            continue;
+        }
+        position->set = true;
+    }
+
+    if (polar) {
+        const double a = azimuth * M_PI / 180.0;
+        const double e = elevation * M_PI / 180.0;
+        position->x = (float) (distance * cos(e) * cos(a));
+        position->y = (float) (distance * cos(e) * sin(a));
+        position->z = (float) (distance * sin(e));
+    }
+}
+
+static void parse_speakers(yaml_document_t *doc, const yaml_node_t *node, device_config_t *device) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    device->speaker_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    device->speakers = calloc(device->speaker_count, sizeof(speaker_config_t));
+
+    int i = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *speaker_node = yaml_document_get_node(doc, *item);
+        if (speaker_node->type != YAML_MAPPING_NODE) continue;
+
+        speaker_config_t *speaker = &device->speakers[i];
+        for (const yaml_node_pair_t *pair = speaker_node->data.mapping.pairs.start; pair < speaker_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if (strcmp((char *) key->data.scalar.value, "channel") == 0 && value->type == YAML_SCALAR_NODE) {
+                speaker->channel = strdup((char *) value->data.scalar.value);
+            }
+        }
+        parse_position(doc, speaker_node, &speaker->position);
+
+        if (!speaker->channel || !speaker->position.set) {
+            log_warn("Speaker of device %s needs a channel and a position, left out",
+                     device->name ? device->name : "(unnamed)");
+            free(speaker->channel);
+            memset(speaker, 0, sizeof(*speaker));
+            continue;
+        }
+        i++;
+    }
+    device->speaker_count = i;
+}
+
+static void parse_delays(yaml_document_t *doc, const yaml_node_t *node, device_config_t *device) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    device->delay_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    device->delays = calloc(device->delay_count, sizeof(delay_config_t));
+
+    int i = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *delay_node = yaml_document_get_node(doc, *item);
+        if (delay_node->type != YAML_MAPPING_NODE) continue;
+
+        delay_config_t *delay = &device->delays[i];
+        bool given = false;
+        for (const yaml_node_pair_t *pair = delay_node->data.mapping.pairs.start; pair < delay_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if (value->type != YAML_SCALAR_NODE) continue;
+
+            if (strcmp((char *) key->data.scalar.value, "channel") == 0) {
+                delay->channel = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "ms") == 0) {
+                delay->delay = atof((char *) value->data.scalar.value) / 1000.0;
+                given = true;
+            } else if (strcmp((char *) key->data.scalar.value, "distance") == 0) {
+                delay->delay = atof((char *) value->data.scalar.value) / DELAY_SPEED_OF_SOUND;
+                given = true;
+            }
+        }
+
+        if (!delay->channel || !given || delay->delay < 0.0) {
+            log_warn("Delay of device %s needs a channel and ms or distance, left out",
+                     device->name ? device->name : "(unnamed)");
+            free(delay->channel);
+            memset(delay, 0, sizeof(*delay));
+            continue;
+        }
+        i++;
+    }
+    device->delay_count = i;
+}
+
+// Impulse responses of device channels, a file each
+static void parse_firs(yaml_document_t *doc, const yaml_node_t *node, device_config_t *device) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    device->fir_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    device->firs = calloc(device->fir_count, sizeof(fir_config_t));
+
+    int i = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *fir_node = yaml_document_get_node(doc, *item);
+        if (fir_node->type != YAML_MAPPING_NODE) continue;
+
+        fir_config_t *fir = &device->firs[i];
+        for (const yaml_node_pair_t *pair = fir_node->data.mapping.pairs.start; pair < fir_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if (value->type != YAML_SCALAR_NODE) continue;
+
+            if (strcmp((char *) key->data.scalar.value, "channel") == 0) {
+                fir->channel = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "file") == 0) {
+                fir->file = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "file_channel") == 0) {
+                fir->file_channel = atoi((char *) value->data.scalar.value);
+            }
+        }
+
+        if (!fir->channel || !fir->file || fir->file_channel < 0) {
+            log_warn("Impulse response of device %s needs a channel and a file, left out",
+                     device->name ? device->name : "(unnamed)");
+            free(fir->channel);
+            free(fir->file);
+            memset(fir, 0, sizeof(*fir));
+            continue;
+        }
+        i++;
+    }
+    device->fir_count = i;
+}
+
+// Inserts of a track or device, filters need a frequency
+static void parse_inserts(yaml_document_t *doc, const yaml_node_t *node, const char *owner,
+                          insert_config_t **inserts, int *count) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    *count = node->data.sequence.items.top - node->data.sequence.items.start;
+    *inserts = calloc(*count, sizeof(insert_config_t));
+
+    int i = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *insert_node = yaml_document_get_node(doc, *item);
+        if (insert_node->type != YAML_MAPPING_NODE) continue;
+
+        insert_config_t *insert = &(*inserts)[i];
+        insert->q = INSERT_DEFAULT_Q;
+        insert->threshold = -1.0f;
+        insert->lookahead = INSERT_DEFAULT_LOOKAHEAD_MS;
+        insert->release = INSERT_DEFAULT_RELEASE_MS;
+
+        bool typed = false;
+        for (const yaml_node_pair_t *pair = insert_node->data.mapping.pairs.start; pair < insert_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if (value->type != YAML_SCALAR_NODE) continue;
+
+            if (strcmp((char *) key->data.scalar.value, "type") == 0) {
+                typed = insert_parse_type((char *) value->data.scalar.value, &insert->type);
+                if (!typed) {
+                    log_warn("Unknown insert %s on %s, left out", (char *) value->data.scalar.value, owner);
+                }
+            } else if (strcmp((char *) key->data.scalar.value, "frequency") == 0) {
+                insert->frequency = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "gain") == 0) {
+                insert->gain = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "q") == 0) {
+                insert->q = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "threshold") == 0) {
+                insert->threshold = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "lookahead") == 0) {
+                insert->lookahead = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "release") == 0) {
+                insert->release = (float) atof((char *) value->data.scalar.value);
+            }
+        }
+
+        if (!typed) continue;
+        const bool filter = insert->type != INSERT_DC_BLOCKER && insert->type != INSERT_LIMITER;
+        if (filter && insert->frequency <= 0.0f) {
+            log_warn("Filter insert on %s needs a frequency, left out", owner);
+            continue;
+        }
+        if (insert->q <= 0.0f) insert->q = INSERT_DEFAULT_Q;
+        if (insert->lookahead <= 0.0f) insert->lookahead = INSERT_DEFAULT_LOOKAHEAD_MS;
+        if (insert->release <= 0.0f) insert->release = INSERT_DEFAULT_RELEASE_MS;
+        i++;
+    }
+    *count = i;
+}
+
+static void parse_devices(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    config->device_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    config->devices = calloc(config->device_count, sizeof(device_config_t));
+
+    int device_index = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *device_node = yaml_document_get_node(doc, *item);
+        device_config_t *device = &config->devices[device_index++];
+        device->rolloff = 6.0f;
+        if (device_node->type != YAML_MAPPING_NODE) continue;
+
+        for (const yaml_node_pair_t *pair = device_node->data.mapping.pairs.start; pair < device_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+            if (strcmp((char *) key->data.scalar.value, "name") == 0) {
+                device->name = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "keep_warm") == 0) {
+                device->keep_warm = strcmp((char *) value->data.scalar.value, "true") == 0;
+            } else if (strcmp((char *) key->data.scalar.value, "rate") == 0) {
+                device->rate = (uint32_t) atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "driver") == 0) {
+                device->driver = strcmp((char *) value->data.scalar.value, "true") == 0;
+            } else if (strcmp((char *) key->data.scalar.value, "quantum") == 0) {
+                device->quantum = (uint32_t) atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "driver_priority") == 0) {
+                device->driver_priority = (uint32_t) atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "workers") == 0) {
+                device->workers = (uint32_t) atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "group") == 0) {
+                device->group = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "speakers") == 0) {
+                parse_speakers(doc, value, device);
+            } else if (strcmp((char *) key->data.scalar.value, "panner") == 0) {
+                if (strcmp((char *) value->data.scalar.value, "dbap") == 0) {
+                    device->pan_method = PAN_DBAP;
+                } else if (strcmp((char *) value->data.scalar.value, "vbap") != 0) {
+                    log_warn("Unknown panner %s, using vbap", (char *) value->data.scalar.value);
+                }
+            } else if (strcmp((char *) key->data.scalar.value, "decoder") == 0) {
+                if (strcmp((char *) value->data.scalar.value, "mode_matching") == 0) {
+                    device->decoder = DECODER_MODE_MATCHING;
+                } else if (strcmp((char *) value->data.scalar.value, "allrad") != 0) {
+                    log_warn("Unknown decoder %s, using allrad", (char *) value->data.scalar.value);
+                }
+            } else if (strcmp((char *) key->data.scalar.value, "delays") == 0) {
+                parse_delays(doc, value, device);
+            } else if (strcmp((char *) key->data.scalar.value, "align_speakers") == 0) {
+                device->align_speakers = strcmp((char *) value->data.scalar.value, "true") == 0;
+            } else if (strcmp((char *) key->data.scalar.value, "inserts") == 0) {
+                parse_inserts(doc, value, device->name ? device->name : "device", &device->inserts, &device->insert_count);
+            } else if (strcmp((char *) key->data.scalar.value, "convolution") == 0) {
+                parse_firs(doc, value, device);
+            } else if (strcmp((char *) key->data.scalar.value, "rolloff") == 0) {
+                device->rolloff = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "channels") == 0 && value->type == YAML_SEQUENCE_NODE) {
+                device->channel_count = value->data.sequence.items.top - value->data.sequence.items.start;
+                device->channels = malloc(sizeof(char *) * device->channel_count);
+
+                int i = 0;
+                for (const yaml_node_item_t *channel = value->data.sequence.items.start; channel < value->data.sequence.items.top; channel++) {
+                    const yaml_node_t *channel_value = yaml_document_get_node(doc, *channel);
+                    device->channels[i++] = strdup((char *) channel_value->data.scalar.value);
+                }
+            }
+        }
+    }
+}
+
+static void parse_groups(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    config->group_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    config->groups = calloc(config->group_count, sizeof(group_config_t));
+
+    int group_index = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *group_node = yaml_document_get_node(doc, *item);
+        group_config_t *group = &config->groups[group_index++];
+        group->cpu = -1;
+        if (group_node->type != YAML_MAPPING_NODE) continue;
+
+        for (const yaml_node_pair_t *pair = group_node->data.mapping.pairs.start; pair < group_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+            if (strcmp((char *) key->data.scalar.value, "name") == 0) {
+                group->name = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "cpu") == 0) {
+                group->cpu = atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "rt_priority") == 0) {
+                group->rt_priority = atoi((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "tempo") == 0) {
+                parse_tempo(doc, value, &group->tempo);
+            }
+        }
+    }
+}
+
+static void parse_duck(yaml_document_t *doc, const yaml_node_t *node, duck_config_t *duck) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "by") == 0) {
+            free(duck->by);
+            duck->by = strdup((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "threshold") == 0) {
+            duck->threshold = (float) atof((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "depth") == 0) {
+            duck->depth = fabsf((float) atof((char *) value->data.scalar.value));
+        } else if (strcmp((char *) key->data.scalar.value, "attack") == 0) {
+            duck->attack = (float) atof((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "release") == 0) {
+            duck->release = (float) atof((char *) value->data.scalar.value);
+        }
+    }
+    if (duck->attack <= 0.0f) duck->attack = SUBMIX_DEFAULT_ATTACK_MS;
+    if (duck->release <= 0.0f) duck->release = SUBMIX_DEFAULT_RELEASE_MS;
+}
+
+static void parse_buses(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    config->bus_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    config->buses = calloc(config->bus_count, sizeof(bus_config_t));
+
+    int bus_index = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *bus_node = yaml_document_get_node(doc, *item);
+        bus_config_t *bus = &config->buses[bus_index++];
+        bus->duck.threshold = SUBMIX_DEFAULT_THRESHOLD_DB;
+        bus->duck.depth = SUBMIX_DEFAULT_DEPTH_DB;
+        bus->duck.attack = SUBMIX_DEFAULT_ATTACK_MS;
+        bus->duck.release = SUBMIX_DEFAULT_RELEASE_MS;
+        bus->duck.key_index = -1;
+        bus->output_index = -1;
+        bus->device_index = -1;
+        if (bus_node->type != YAML_MAPPING_NODE) continue;
+
+        for (const yaml_node_pair_t *pair = bus_node->data.mapping.pairs.start; pair < bus_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+            if (strcmp((char *) key->data.scalar.value, "duck") == 0) {
+                parse_duck(doc, value, &bus->duck);
+                continue;
+            }
+            if (value->type != YAML_SCALAR_NODE) continue;
+
+            if (strcmp((char *) key->data.scalar.value, "name") == 0) {
+                bus->name = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "output") == 0) {
+                bus->output = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "gain") == 0) {
+                bus->gain = (float) atof((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "mute") == 0) {
+                bus->mute = strcmp((char *) value->data.scalar.value, "true") == 0;
+            }
+        }
+    }
+}
+
+static void parse_cue(yaml_document_t *doc, const yaml_node_t *node, cue_config_t *cue) {
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "at") == 0) {
+            cue->at = atof((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "action") == 0) {
+            if (strcmp((char *) value->data.scalar.value, "start") == 0) {
+                cue->action = CUE_START;
+            } else if (strcmp((char *) value->data.scalar.value, "stop") == 0) {
+                cue->action = CUE_STOP;
+            } else if (strcmp((char *) value->data.scalar.value, "gain") == 0) {
+                cue->action = CUE_GAIN;
+            } else {
+                log_warn("Unknown cue action %s, using start", (char *) value->data.scalar.value);
+            }
+        } else if (strcmp((char *) key->data.scalar.value, "track") == 0) {
+            cue->track = strdup((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "gain") == 0) {
+            cue->gain = (float) atof((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "fade") == 0) {
+            cue->fade = atof((char *) value->data.scalar.value);
+        }
+    }
+}
+
+static void parse_cue_lists(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    config->cue_list_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    config->cue_lists = calloc(config->cue_list_count, sizeof(cue_list_config_t));
+
+    int list_index = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *list_node = yaml_document_get_node(doc, *item);
+        cue_list_config_t *list = &config->cue_lists[list_index++];
+        if (list_node->type != YAML_MAPPING_NODE) continue;
+
+        for (const yaml_node_pair_t *pair = list_node->data.mapping.pairs.start; pair < list_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+            if (strcmp((char *) key->data.scalar.value, "id") == 0) {
+                list->id = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "cues") == 0 && value->type == YAML_SEQUENCE_NODE) {
+                list->cue_count = value->data.sequence.items.top - value->data.sequence.items.start;
+                list->cues = calloc(list->cue_count, sizeof(cue_config_t));
+
+                int i = 0;
+                for (const yaml_node_item_t *cue = value->data.sequence.items.start; cue < value->data.sequence.items.top; cue++) {
+                    const yaml_node_t *cue_node = yaml_document_get_node(doc, *cue);
+                    cue_config_t *entry = &list->cues[i++];
+                    entry->gain = 1.0f;
+                    if (cue_node->type == YAML_MAPPING_NODE) {
+                        parse_cue(doc, cue_node, entry);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void parse_keyframe(yaml_document_t *doc, const yaml_node_t *node, keyframe_config_t *keyframe) {
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "duration") == 0) {
+            keyframe->duration = atof((char *) value->data.scalar.value);
+            if (keyframe->duration < 0.0) keyframe->duration = 0.0;
+        } else if (strcmp((char *) key->data.scalar.value, "easing") == 0) {
+            if (!trajectory_parse_easing((char *) value->data.scalar.value, &keyframe->easing)) {
+                log_warn("Unknown easing %s, using linear", (char *) value->data.scalar.value);
+            }
+        }
+    }
+    parse_position(doc, node, &keyframe->position);
+}
+
+static void parse_trajectories(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    config->trajectory_count = node->data.sequence.items.top - node->data.sequence.items.start;
+    config->trajectories = calloc(config->trajectory_count, sizeof(trajectory_config_t));
+
+    int path_index = 0;
+    for (const yaml_node_item_t *item = node->data.sequence.items.start; item < node->data.sequence.items.top; item++) {
+        const yaml_node_t *path_node = yaml_document_get_node(doc, *item);
+        trajectory_config_t *path = &config->trajectories[path_index++];
+        if (path_node->type != YAML_MAPPING_NODE) continue;
+
+        for (const yaml_node_pair_t *pair = path_node->data.mapping.pairs.start; pair < path_node->data.mapping.pairs.top; pair++) {
+            const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+            if (strcmp((char *) key->data.scalar.value, "id") == 0) {
+                path->id = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "loop") == 0) {
+                path->loop = strcmp((char *) value->data.scalar.value, "true") == 0;
+            } else if (strcmp((char *) key->data.scalar.value, "keyframes") == 0 && value->type == YAML_SEQUENCE_NODE) {
+                path->keyframe_count = value->data.sequence.items.top - value->data.sequence.items.start;
+                path->keyframes = calloc(path->keyframe_count, sizeof(keyframe_config_t));
+
+                int i = 0;
+                for (const yaml_node_item_t *frame = value->data.sequence.items.start; frame < value->data.sequence.items.top; frame++) {
+                    const yaml_node_t *frame_node = yaml_document_get_node(doc, *frame);
+                    if (frame_node->type != YAML_MAPPING_NODE) continue;
+
+                    keyframe_config_t *keyframe = &path->keyframes[i];
+                    parse_keyframe(doc, frame_node, keyframe);
+                    if (keyframe->position.set) {
+                        i++;
+                    } else {
+                        memset(keyframe, 0, sizeof(*keyframe));
+                    }
+                }
+                path->keyframe_count = i;
+            }
+        }
+    }
+}
+
+static void parse_on_end(yaml_document_t *doc, const yaml_node_t *node, follow_config_t *on_end) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "repeat") == 0) {
+            const int repeat = atoi((char *) value->data.scalar.value);
+            on_end->repeat = repeat > 0 ? (unsigned int) repeat : 0;
+        } else if (strcmp((char *) key->data.scalar.value, "play") == 0) {
+            on_end->track = strdup((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "cue") == 0) {
+            on_end->cue_list = strdup((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "cue_at") == 0) {
+            on_end->cue_at = atof((char *) value->data.scalar.value);
+        }
+    }
+}
+
+static void parse_playlist(yaml_document_t *doc, const yaml_node_t *node, track_config_t *track) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+        if (strcmp((char *) key->data.scalar.value, "files") == 0 && value->type == YAML_SEQUENCE_NODE) {
+            track->file_count = value->data.sequence.items.top - value->data.sequence.items.start;
+            track->files = calloc(track->file_count, sizeof(char *));
+
+            int i = 0;
+            for (const yaml_node_item_t *item = value->data.sequence.items.start; item < value->data.sequence.items.top; item++) {
+                const yaml_node_t *file_node = yaml_document_get_node(doc, *item);
+                if (file_node->type == YAML_SCALAR_NODE) {
+                    track->files[i++] = strdup((char *) file_node->data.scalar.value);
+                }
+            }
+            track->file_count = i;
+        } else if (value->type != YAML_SCALAR_NODE) {
+            continue;
+        } else if (strcmp((char *) key->data.scalar.value, "shuffle") == 0) {
+            track->shuffle = strcmp((char *) value->data.scalar.value, "true") == 0;
+        } else if (strcmp((char *) key->data.scalar.value, "crossfade") == 0) {
+            track->crossfade = atof((char *) value->data.scalar.value);
+            if (track->crossfade < 0.0) track->crossfade = 0.0;
+        }
+    }
+}
+
+static void parse_pool_member(yaml_document_t *doc, const yaml_node_t *node, pool_member_config_t *member) {
+    member->weight = 1.0f;
+    if (node->type == YAML_SCALAR_NODE) {
+        member->file = strdup((char *) node->data.scalar.value);
+        return;
+    }
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "file") == 0) {
+            member->file = strdup((char *) value->data.scalar.value);
+        } else if (strcmp((char *) key->data.scalar.value, "start") == 0) {
+            member->start = atof((char *) value->data.scalar.value);
+            if (member->start < 0.0) member->start = 0.0;
+        } else if (strcmp((char *) key->data.scalar.value, "length") == 0) {
+            member->length = atof((char *) value->data.scalar.value);
+            if (member->length < 0.0) member->length = 0.0;
+        } else if (strcmp((char *) key->data.scalar.value, "weight") == 0) {
+            member->weight = (float) atof((char *) value->data.scalar.value);
+            if (member->weight < 0.0f) member->weight = 0.0f;
+        }
+    }
+}
+
+static void parse_ambisonic(yaml_document_t *doc, const yaml_node_t *node, ambisonic_config_t *ambisonic) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    ambisonic->enabled = true;
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        if (strcmp((char *) key->data.scalar.value, "order") == 0) {
+            ambisonic->order = atoi((char *) value->data.scalar.value);
+            if (ambisonic->order < 1 || ambisonic->order > 3) {
+                log_warn("Ambisonic order %d not supported, taking it from the channel count", ambisonic->order);
+                ambisonic->order = 0;
+            }
+        } else if (strcmp((char *) key->data.scalar.value, "normalization") == 0) {
+            if (strcmp((char *) value->data.scalar.value, "n3d") == 0) {
+                ambisonic->normalization = AMBISONIC_N3D;
+            } else if (strcmp((char *) value->data.scalar.value, "sn3d") != 0) {
+                log_warn("Unknown normalization %s, using sn3d", (char *) value->data.scalar.value);
+            }
+        } else if (strcmp((char *) key->data.scalar.value, "yaw") == 0) {
+            ambisonic->yaw = (float) atof((char *) value->data.scalar.value);
+        }
+    }
+}
+
+static void parse_pool(yaml_document_t *doc, const yaml_node_t *node, pool_config_t *pool) {
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    for (const yaml_node_pair_t *pair = node->data.mapping.pairs.start; pair < node->data.mapping.pairs.top; pair++) {
+        const yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        const yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+
+        if (strcmp((char *) key->data.scalar.value, "members") == 0 && value->type == YAML_SEQUENCE_NODE) {
+            pool->member_count = value->data.sequence.items.top - value->data.sequence.items.start;
+            pool->members = calloc(pool->member_count, sizeof(pool_member_config_t));
+
+            int i = 0;
+            for (const yaml_node_item_t *item = value->data.sequence.items.start; item < value->data.sequence.items.top; item++) {
+                pool_member_config_t *member = &pool->members[i];
+                parse_pool_member(doc, yaml_document_get_node(doc, *item), member);
+                if (member->file) {
+                    i++;
+                }
+            }
+            pool->member_count = i;
+        } else if (value->type != YAML_SCALAR_NODE) {
+            continue;
+        } else if (strcmp((char *) key->data.scalar.value, "select") == 0) {
+            if (strcmp((char *) value->data.scalar.value, "round_robin") == 0) {
+                pool->select = POOL_SELECT_ROUND_ROBIN;
+            } else if (strcmp((char *) value->data.scalar.value, "random") == 0) {
+                pool->select = POOL_SELECT_RANDOM;
+            } else if (strcmp((char *) value->data.scalar.value, "weighted") == 0) {
+                pool->select = POOL_SELECT_WEIGHTED;
+            } else {
+                log_warn("Unknown pool selection %s, using round_robin", (char *) value->data.scalar.value);
+            }
+        } else if (strcmp((char *) key->data.scalar.value, "gain_jitter") == 0) {
+            pool->gain_jitter = fabsf((float) atof((char *) value->data.scalar.value));
+        } else if (strcmp((char *) key->data.scalar.value, "pitch_jitter") == 0) {
+            pool->pitch_jitter = fabsf((float) atof((char *) value->data.scalar.value));
+        }
+    }
+}
+
 static void parse_tracks(yaml_document_t *doc, const yaml_node_t *node, global_config_t *config) {
     if (node->type != YAML_SEQUENCE_NODE) return;
 
@@ -68,8 +780,342 @@ static void parse_tracks(yaml_document_t *doc, const yaml_node_t *node, global_c
                 track->volume = atof((char *) value->data.scalar.value);
             } else if (strcmp((char *) key->data.scalar.value, "output") == 0) {
                 parse_track_output(doc, value, &track->output);
+            } else if (strcmp((char *) key->data.scalar.value, "on_end") == 0) {
+                parse_on_end(doc, value, &track->on_end);
+            } else if (strcmp((char *) key->data.scalar.value, "playlist") == 0) {
+                parse_playlist(doc, value, track);
+            } else if (strcmp((char *) key->data.scalar.value, "pool") == 0) {
+                parse_pool(doc, value, &track->pool);
+            } else if (strcmp((char *) key->data.scalar.value, "pan") == 0) {
+                parse_position(doc, value, &track->pan);
+            } else if (strcmp((char *) key->data.scalar.value, "trajectory") == 0) {
+                track->trajectory = strdup((char *) value->data.scalar.value);
+            } else if (strcmp((char *) key->data.scalar.value, "ambisonic") == 0) {
+                parse_ambisonic(doc, value, &track->ambisonic);
+            } else if (strcmp((char *) key->data.scalar.value, "inserts") == 0) {
+                parse_inserts(doc, value, track->id ? track->id : "track", &track->inserts, &track->insert_count);
+            } else if (strcmp((char *) key->data.scalar.value, "bus") == 0) {
+                track->bus = strdup((char *) value->data.scalar.value);
             }
         }
+
+        // A playlist or pool shows as its first file
+        if (track->file_count > 0 && !track->file_path) {
+            track->file_path = strdup(track->files[0]);
+        }
+        if (track->pool.member_count > 0 && track->file_count > 0) {
+            log_warn("Track %s has both a playlist and a pool, using the pool", track->id);
+        }
+        if (track->pool.member_count > 0 && !track->file_path) {
+            track->file_path = strdup(track->pool.members[0].file);
+        }
+        if (track->ambisonic.enabled && (track->pan.set || track->trajectory)) {
+            log_warn("Track %s is ambisonic, its pan is left unused", track->id);
+            track->pan.set = false;
+            free(track->trajectory);
+            track->trajectory = NULL;
+        }
+    }
+}
+
+static bool has_device(const global_config_t *config, const char *name) {
+    for (int i = 0; i < config->device_count; i++) {
+        if (config->devices[i].name && strcmp(config->devices[i].name, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Point devices at their group, unknown groups fall back to the shared loop
+static void resolve_device_groups(global_config_t *config) {
+    for (int i = 0; i < config->device_count; i++) {
+        device_config_t *device = &config->devices[i];
+        device->group_index = -1;
+        if (!device->group) continue;
+
+        for (int j = 0; j < config->group_count; j++) {
+            if (config->groups[j].name && strcmp(config->groups[j].name, device->group) == 0) {
+                device->group_index = j;
+                break;
+            }
+        }
+        if (device->group_index < 0) {
+            log_warn("Device %s refers to unknown group %s", device->name ? device->name : "?", device->group);
+        }
+    }
+}
+
+static bool has_track(const global_config_t *config, const char *id) {
+    for (int i = 0; i < config->track_count; i++) {
+        if (config->tracks[i].id && strcmp(config->tracks[i].id, id) == 0) return true;
+    }
+    return false;
+}
+
+static bool has_cue_list(const global_config_t *config, const char *id) {
+    for (int i = 0; i < config->cue_list_count; i++) {
+        if (config->cue_lists[i].id && strcmp(config->cue_lists[i].id, id) == 0) return true;
+    }
+    return false;
+}
+
+// Drop follow actions that name nothing, a looping track never ends
+static bool has_trajectory(const global_config_t *config, const char *id) {
+    for (int i = 0; i < config->trajectory_count; i++) {
+        if (config->trajectories[i].id && strcmp(config->trajectories[i].id, id) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A path that loops without taking any time would never let go of the
+// process thread, and one without keyframes goes nowhere
+static void check_trajectories(global_config_t *config) {
+    for (int i = 0; i < config->trajectory_count; i++) {
+        trajectory_config_t *path = &config->trajectories[i];
+        const char *id = path->id ? path->id : "?";
+
+        double length = 0.0;
+        for (int j = 0; j < path->keyframe_count; j++) {
+            length += path->keyframes[j].duration;
+        }
+        if (path->keyframe_count == 0) {
+            log_warn("Trajectory %s has no keyframes", id);
+        }
+        if (path->loop && length <= 0.0) {
+            log_warn("Trajectory %s takes no time, it does not loop", id);
+            path->loop = false;
+        }
+    }
+
+    for (int i = 0; i < config->track_count; i++) {
+        track_config_t *track = &config->tracks[i];
+        if (track->trajectory && !has_trajectory(config, track->trajectory)) {
+            log_warn("Track %s follows unknown trajectory %s", track->id ? track->id : "?", track->trajectory);
+            free(track->trajectory);
+            track->trajectory = NULL;
+        }
+    }
+}
+
+static void check_follow_actions(global_config_t *config) {
+    for (int i = 0; i < config->track_count; i++) {
+        track_config_t *track = &config->tracks[i];
+        const char *id = track->id ? track->id : "?";
+
+        if (track->on_end.track && !has_track(config, track->on_end.track)) {
+            log_warn("Track %s follows with unknown track %s", id, track->on_end.track);
+            free(track->on_end.track);
+            track->on_end.track = NULL;
+        }
+        if (track->on_end.cue_list && !has_cue_list(config, track->on_end.cue_list)) {
+            log_warn("Track %s follows with unknown cue list %s", id, track->on_end.cue_list);
+            free(track->on_end.cue_list);
+            track->on_end.cue_list = NULL;
+        }
+        if (track->loop && (track->on_end.track || track->on_end.cue_list || track->on_end.repeat > 0)) {
+            log_warn("Track %s loops, its on_end is never reached", id);
+        }
+    }
+}
+
+// Entry with default settings for a device only named elsewhere, returns
+// its index or -1
+static int add_device(global_config_t *config, const char *name) {
+    device_config_t *devices = realloc(config->devices, sizeof(device_config_t) * (config->device_count + 1));
+    if (!devices) {
+        log_error("Failed to add device %s", name);
+        return -1;
+    }
+    config->devices = devices;
+    memset(&devices[config->device_count], 0, sizeof(device_config_t));
+    devices[config->device_count].name = strdup(name);
+    devices[config->device_count].group_index = -1;
+    return config->device_count++;
+}
+
+// In filter mode every device a track names gets a bus, add the ones
+// without a devices: entry with default settings
+static void add_track_devices(global_config_t *config) {
+    for (int i = 0; i < config->track_count; i++) {
+        const output_config_t *output = &config->tracks[i].output;
+
+        for (int j = 0; j < output->device_count; j++) {
+            const char *name = output->devices[j];
+            if (strcmp(name, "default") == 0 || has_device(config, name)) continue;
+            if (add_device(config, name) < 0) return;
+        }
+    }
+}
+
+static int find_device(const global_config_t *config, const char *name) {
+    for (int i = 0; i < config->device_count; i++) {
+        if (config->devices[i].name && strcmp(config->devices[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int find_bus(const global_config_t *config, const char *name) {
+    for (int i = 0; i < config->bus_count; i++) {
+        if (config->buses[i].name && strcmp(config->buses[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// Place buses one at a time once every bus playing into them and their key
+// are placed. Returns how many could be placed.
+static int sort_buses(const global_config_t *config, bool *placed, int *order) {
+    int n = 0;
+
+    memset(placed, 0, config->bus_count * sizeof(bool));
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (int i = 0; i < config->bus_count; i++) {
+            const bus_config_t *bus = &config->buses[i];
+            if (placed[i] || bus->device_index < 0) continue;
+
+            bool ready = bus->duck.key_index < 0 || placed[bus->duck.key_index];
+            for (int j = 0; ready && j < config->bus_count; j++) {
+                if (!placed[j] && config->buses[j].device_index >= 0 && config->buses[j].output_index == i) {
+                    ready = false;
+                }
+            }
+            if (!ready) continue;
+
+            placed[i] = true;
+            order[n++] = i;
+            progress = true;
+        }
+    }
+    return n;
+}
+
+// Buses play into another bus on the same device or into a named device.
+// A route that loops leaves its buses unused and a duck that loops is cut,
+// what is left is ordered so a block is mixed in a single pass. Tracks on a
+// bus play on its device.
+static void check_buses(global_config_t *config) {
+    if (config->bus_count == 0) return;
+
+    for (int i = 0; i < config->bus_count; i++) {
+        bus_config_t *bus = &config->buses[i];
+        if (!bus->name || !bus->output) {
+            log_warn("Bus %s needs a name and an output, left unused", bus->name ? bus->name : "?");
+            continue;
+        }
+        bus->output_index = find_bus(config, bus->output);
+        if (bus->output_index < 0 && strcmp(bus->output, "default") == 0) {
+            log_warn("Bus %s needs a named device to play into, left unused", bus->name);
+        } else if (bus->output_index < 0 && !has_device(config, bus->output)) {
+            add_device(config, bus->output);
+        }
+    }
+
+    // Follow every route down to its device
+    for (int i = 0; i < config->bus_count; i++) {
+        bus_config_t *bus = &config->buses[i];
+        if (!bus->name || !bus->output) continue;
+
+        int last = i;
+        int hops = 0;
+        while (config->buses[last].output_index >= 0 && hops++ < config->bus_count) {
+            last = config->buses[last].output_index;
+        }
+        if (hops >= config->bus_count) {
+            log_warn("Bus %s is routed round a loop, left unused", bus->name);
+            continue;
+        }
+        const bus_config_t *root = &config->buses[last];
+        bus->device_index = root->name && root->output ? find_device(config, root->output) : -1;
+        if (bus->device_index < 0 && last != i) {
+            log_warn("Bus %s plays into unusable bus %s, left unused", bus->name, bus->output);
+        }
+    }
+
+    for (int i = 0; i < config->bus_count; i++) {
+        bus_config_t *bus = &config->buses[i];
+        if (bus->device_index < 0 || !bus->duck.by) continue;
+
+        const int key = find_bus(config, bus->duck.by);
+        if (key < 0 || key == i || config->buses[key].device_index < 0) {
+            log_warn("Bus %s is ducked by unknown bus %s, left unducked", bus->name, bus->duck.by);
+            free(bus->duck.by);
+            bus->duck.by = NULL;
+            continue;
+        }
+        bus->duck.key_index = key;
+    }
+
+    bool *placed = calloc(config->bus_count, sizeof(bool));
+    config->bus_order = calloc(config->bus_count, sizeof(int));
+    if (!placed || !config->bus_order) {
+        log_error("Failed to order buses");
+        free(placed);
+        free(config->bus_order);
+        config->bus_order = NULL;
+        for (int i = 0; i < config->bus_count; i++) config->buses[i].device_index = -1;
+        return;
+    }
+
+    int usable = 0;
+    for (int i = 0; i < config->bus_count; i++) {
+        if (config->buses[i].device_index >= 0) usable++;
+    }
+    int n;
+    bool cut = true;
+    while ((n = sort_buses(config, placed, config->bus_order)) < usable && cut) {
+        // Only ducks can close a loop now, cut one on it and sort again
+        cut = false;
+        for (int i = 0; i < config->bus_count && !cut; i++) {
+            bus_config_t *bus = &config->buses[i];
+            if (placed[i] || bus->device_index < 0 || bus->duck.key_index < 0 || placed[bus->duck.key_index]) continue;
+
+            log_warn("Ducking bus %s by %s would loop, left out", bus->name, bus->duck.by);
+            free(bus->duck.by);
+            bus->duck.by = NULL;
+            bus->duck.key_index = -1;
+            cut = true;
+        }
+    }
+    // Unused buses last, no mixer takes them
+    for (int i = 0; i < config->bus_count; i++) {
+        if (!placed[i] && config->buses[i].device_index >= 0) {
+            log_warn("Bus %s could not be ordered, left unused", config->buses[i].name);
+            config->buses[i].device_index = -1;
+        }
+        if (config->buses[i].device_index < 0) config->bus_order[n++] = i;
+        else config->devices[config->buses[i].device_index].bus_count++;
+    }
+    free(placed);
+
+    for (int i = 0; i < config->track_count; i++) {
+        track_config_t *track = &config->tracks[i];
+        if (!track->bus) continue;
+
+        const int b = find_bus(config, track->bus);
+        if (b < 0 || config->buses[b].device_index < 0) {
+            log_warn("Track %s plays into unknown bus %s, straight onto its device instead",
+                     track->id ? track->id : "?", track->bus);
+            free(track->bus);
+            track->bus = NULL;
+            continue;
+        }
+
+        output_config_t *output = &track->output;
+        const char *device = config->devices[config->buses[b].device_index].name;
+        if (output->device_count == 1 && strcmp(output->devices[0], device) == 0) continue;
+        if (output->device_count > 0) {
+            log_warn("Track %s plays on %s, the device of its bus %s", track->id ? track->id : "?", device, track->bus);
+        }
+
+        char **devices = realloc(output->devices, sizeof(char *) * SPA_MAX(output->device_count, 1));
+        if (!devices) continue;
+        for (int j = 0; j < output->device_count; j++) free(devices[j]);
+        devices[0] = strdup(device);
+        output->devices = devices;
+        output->device_count = 1;
     }
 }
 
@@ -108,8 +1154,22 @@ global_config_t *config_load(const char *filename) {
 
             if (strcmp((char *) key->data.scalar.value, "logging") == 0) {
                 parse_logging(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "engine") == 0) {
+                parse_engine(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "tempo") == 0) {
+                parse_tempo(&document, value, &config->tempo);
             } else if (strcmp((char *) key->data.scalar.value, "tracks") == 0) {
                 parse_tracks(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "devices") == 0) {
+                parse_devices(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "groups") == 0) {
+                parse_groups(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "cue_lists") == 0) {
+                parse_cue_lists(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "trajectories") == 0) {
+                parse_trajectories(&document, value, config);
+            } else if (strcmp((char *) key->data.scalar.value, "buses") == 0) {
+                parse_buses(&document, value, config);
             }
         }
     }
@@ -118,6 +1178,14 @@ global_config_t *config_load(const char *filename) {
     yaml_parser_delete(&parser);
     fclose(file);
 
+    resolve_device_groups(config);
+    check_follow_actions(config);
+    check_trajectories(config);
+    check_buses(config);
+    if (config->engine.mode == ENGINE_MODE_FILTER) {
+        add_track_devices(config);
+    }
+
     return config;
 }
 
@@ -132,16 +1200,93 @@ void config_free(global_config_t *config) {
         const track_config_t *track = &config->tracks[i];
         free(track->id);
         free(track->file_path);
-        free(track->output.device);
+
+        // Free each failover device
+        for (int j = 0; j < track->output.device_count; j++) {
+            free(track->output.devices[j]);
+        }
+        free(track->output.devices);
 
         // Free each mapping string
         for (int j = 0; j < track->output.mapping_count; j++) {
             free(track->output.mapping[j]);
         }
         free(track->output.mapping);
+        free(track->on_end.track);
+        free(track->on_end.cue_list);
+        for (int j = 0; j < track->file_count; j++) {
+            free(track->files[j]);
+        }
+        free(track->files);
+        for (int j = 0; j < track->pool.member_count; j++) {
+            free(track->pool.members[j].file);
+        }
+        free(track->pool.members);
+        free(track->trajectory);
+        free(track->inserts);
+        free(track->bus);
     }
     free(config->tracks);
 
+    // Free devices
+    for (int i = 0; i < config->device_count; i++) {
+        const device_config_t *device = &config->devices[i];
+        free(device->name);
+        for (int j = 0; j < device->channel_count; j++) {
+            free(device->channels[j]);
+        }
+        free(device->channels);
+        free(device->group);
+        for (int j = 0; j < device->speaker_count; j++) {
+            free(device->speakers[j].channel);
+        }
+        free(device->speakers);
+        for (int j = 0; j < device->delay_count; j++) {
+            free(device->delays[j].channel);
+        }
+        free(device->delays);
+        free(device->inserts);
+        for (int j = 0; j < device->fir_count; j++) {
+            free(device->firs[j].channel);
+            free(device->firs[j].file);
+        }
+        free(device->firs);
+    }
+    free(config->devices);
+
+    // Free groups
+    for (int i = 0; i < config->group_count; i++) {
+        free(config->groups[i].name);
+    }
+    free(config->groups);
+
+    // Free cue lists
+    for (int i = 0; i < config->cue_list_count; i++) {
+        const cue_list_config_t *list = &config->cue_lists[i];
+        free(list->id);
+        for (int j = 0; j < list->cue_count; j++) {
+            free(list->cues[j].track);
+        }
+        free(list->cues);
+    }
+    free(config->cue_lists);
+
+    // Free trajectories
+    for (int i = 0; i < config->trajectory_count; i++) {
+        free(config->trajectories[i].id);
+        free(config->trajectories[i].keyframes);
+    }
+    free(config->trajectories);
+
+    // Free buses
+    for (int i = 0; i < config->bus_count; i++) {
+        free(config->buses[i].name);
+        free(config->buses[i].output);
+        free(config->buses[i].duck.by);
+    }
+    free(config->buses);
+    free(config->bus_order);
+
     free(config);
 }
 
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sndfile.h>
+#include "convolver.h"
+#include "log.h"
+
+#define HEAD_BINS (CONVOLVER_BLOCK_FRAMES + 1)
+#define TAIL_BINS (CONVOLVER_TAIL_FRAMES + 1)
+#define BLOCKS_PER_PERIOD (CONVOLVER_TAIL_FRAMES / CONVOLVER_BLOCK_FRAMES)
+#define HEAD_TAPS (2 * CONVOLVER_TAIL_FRAMES)
+
+_Static_assert(CONVOLVER_TAIL_FRAMES % CONVOLVER_BLOCK_FRAMES == 0, "tail partitions must hold whole blocks");
+_Static_assert((CONVOLVER_SLOTS & (CONVOLVER_SLOTS - 1)) == 0, "slots must stay in step as periods wrap");
+
+static void futex_wait(atomic_uint *addr, const uint32_t value) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// One channel of a file at rate, resampled linearly when the file differs
+static float *load_response(const fir_config_t *fir, const uint32_t rate, uint32_t *taps) {
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(fir->file, SFM_READ, &info);
+    if (!file) {
+        log_error("Failed to open impulse response %s: %s", fir->file, sf_strerror(NULL));
+        return NULL;
+    }
+    if (fir->file_channel >= info.channels || info.frames <= 0) {
+        log_error("Impulse response %s has no channel %d", fir->file, fir->file_channel);
+        sf_close(file);
+        return NULL;
+    }
+
+    const sf_count_t frames = SPA_MIN(info.frames, (sf_count_t) CONVOLVER_MAX_TAPS * 8);
+    float *data = malloc((size_t) frames * info.channels * sizeof(float));
+    float *mono = malloc((size_t) frames * sizeof(float));
+    if (!data || !mono) {
+        log_error("Failed to allocate impulse response %s", fir->file);
+        free(data);
+        free(mono);
+        sf_close(file);
+        return NULL;
+    }
+    const sf_count_t got = sf_readf_float(file, data, frames);
+    sf_close(file);
+    for (sf_count_t i = 0; i < got; i++) {
+        mono[i] = data[i * info.channels + fir->file_channel];
+    }
+    free(data);
+
+    const double step = (double) info.samplerate / rate;
+    uint32_t n = (uint32_t) SPA_MIN(ceil((double) got / step), (double) CONVOLVER_MAX_TAPS);
+    if ((double) got / step > CONVOLVER_MAX_TAPS) {
+        log_warn("Impulse response %s cut to %d taps", fir->file, CONVOLVER_MAX_TAPS);
+    }
+    if (info.samplerate == (int) rate) {
+        *taps = n;
+        return mono;
+    }
+
+    float *resampled = malloc(SPA_MAX(n, 1u) * sizeof(float));
+    if (!resampled) {
+        free(mono);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const double pos = i * step;
+        const sf_count_t j = (sf_count_t) pos;
+        const float f = (float) (pos - (double) j);
+        const float a = mono[j];
+        const float b = j + 1 < got ? mono[j + 1] : 0.0f;
+        // Scaled so a response keeps its gain at the new rate
+        resampled[i] = (a + (b - a) * f) * (float) step;
+    }
+    free(mono);
+    log_info("Impulse response %s resampled from %d to %u Hz", fir->file, info.samplerate, rate);
+    *taps = n;
+    return resampled;
+}
+
+// Partitions of size frames holding taps, at least one
+static uint32_t partitions(const uint32_t taps, const uint32_t size) {
+    return SPA_MAX((taps + size - 1) / size, 1u);
+}
+
+static size_t spectra_size(const uint32_t count, const uint32_t bins) {
+    return ARENA_SIZE(count * sizeof(convolver_spectrum_t)) + 2 * count * ARENA_SIZE(bins * sizeof(float));
+}
+
+static convolver_spectrum_t *alloc_spectra(arena_t *arena, const uint32_t count, const uint32_t bins) {
+    convolver_spectrum_t *spectra = arena_alloc(arena, count * sizeof(convolver_spectrum_t));
+    if (!spectra) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        spectra[i].re = arena_alloc(arena, bins * sizeof(float));
+        spectra[i].im = arena_alloc(arena, bins * sizeof(float));
+        if (!spectra[i].re || !spectra[i].im) return NULL;
+    }
+    return spectra;
+}
+
+// Spectrum of partition taps[0, len) zero padded to the FFT, scaled to
+// undo the gain of the inverse
+static void partition_spectrum(fft_t *fft, const float *taps, const uint32_t len, float *scratch,
+                               const convolver_spectrum_t *out) {
+    const float scale = 2.0f / (float) fft->size;
+    memset(scratch, 0, fft->size * sizeof(float));
+    for (uint32_t i = 0; i < len; i++) {
+        scratch[i] = taps[i] * scale;
+    }
+    fft_forward(fft, scratch, out->re, out->im);
+}
+
+static void reset_tail(convolver_t *c) {
+    for (uint32_t i = 0; i < c->n_channels; i++) {
+        convolver_channel_t *ch = &c->channels[i];
+        if (!ch->ir || ch->ir->n_tail == 0) continue;
+        memset(ch->tail_input, 0, 2 * CONVOLVER_TAIL_FRAMES * sizeof(float));
+        for (uint32_t k = 0; k < ch->ir->n_tail; k++) {
+            memset(ch->tail_fdl[k].re, 0, TAIL_BINS * sizeof(float));
+            memset(ch->tail_fdl[k].im, 0, TAIL_BINS * sizeof(float));
+        }
+    }
+}
+
+// Tail of one period, due two periods after the input it came from
+static void run_tail(convolver_t *c, const uint32_t period) {
+    const uint32_t in_slot = period % CONVOLVER_SLOTS;
+    const uint32_t out_slot = (period + 2) % CONVOLVER_SLOTS;
+
+    for (uint32_t i = 0; i < c->n_channels; i++) {
+        convolver_channel_t *ch = &c->channels[i];
+        if (!ch->ir || ch->ir->n_tail == 0) continue;
+        const convolver_ir_t *ir = ch->ir;
+
+        memmove(ch->tail_input, ch->tail_input + CONVOLVER_TAIL_FRAMES, CONVOLVER_TAIL_FRAMES * sizeof(float));
+        memcpy(ch->tail_input + CONVOLVER_TAIL_FRAMES, ch->tail_in[in_slot], CONVOLVER_TAIL_FRAMES * sizeof(float));
+        fft_forward(&c->tail_fft, ch->tail_input, ch->tail_fdl[ch->tail_pos].re, ch->tail_fdl[ch->tail_pos].im);
+
+        memset(c->tail_acc.re, 0, TAIL_BINS * sizeof(float));
+        memset(c->tail_acc.im, 0, TAIL_BINS * sizeof(float));
+        for (uint32_t k = 0; k < ir->n_tail; k++) {
+            const convolver_spectrum_t *x = &ch->tail_fdl[(ch->tail_pos + ir->n_tail - k) % ir->n_tail];
+            fft_multiply_add(x->re, x->im, ir->tail[k].re, ir->tail[k].im, c->tail_acc.re, c->tail_acc.im, TAIL_BINS);
+        }
+        fft_inverse(&c->tail_fft, c->tail_acc.re, c->tail_acc.im, c->tail_scratch);
+        memcpy(ch->tail_out[out_slot], c->tail_scratch + CONVOLVER_TAIL_FRAMES, CONVOLVER_TAIL_FRAMES * sizeof(float));
+        ch->tail_pos = (ch->tail_pos + 1) % ir->n_tail;
+    }
+    atomic_store_explicit(&c->ready[out_slot], period + 3, memory_order_release);
+}
+
+static void *tail_thread(void *arg) {
+    convolver_t *c = arg;
+
+    for (;;) {
+        uint32_t submitted = atomic_load_explicit(&c->submitted, memory_order_acquire);
+        while (submitted == c->consumed && !atomic_load(&c->stop)) {
+            futex_wait(&c->submitted, submitted);
+            submitted = atomic_load_explicit(&c->submitted, memory_order_acquire);
+        }
+        if (atomic_load(&c->stop)) break;
+
+        // Fallen so far behind that the input is being overwritten, start
+        // over from the newest period. Periods wrap, only their distance counts.
+        uint32_t period = c->consumed;
+        if (submitted - period >= CONVOLVER_SLOTS - 1) {
+            period = submitted - 1;
+            reset_tail(c);
+        }
+        run_tail(c, period);
+        c->consumed = period + 1;
+    }
+    return NULL;
+}
+
+convolver_t *convolver_new(const fir_config_t *firs, const int count, const int *bus_channels,
+                           const uint32_t n_channels, const uint32_t rate) {
+    convolver_t *c = calloc(1, sizeof(convolver_t));
+    float **taps = calloc(count > 0 ? count : 1, sizeof(float *));
+    uint32_t *lengths = calloc(count > 0 ? count : 1, sizeof(uint32_t));
+    int *ir_of = calloc(count > 0 ? count : 1, sizeof(int));
+    int *channel_fir = malloc(n_channels * sizeof(int));
+    if (!c || !taps || !lengths || !ir_of || !channel_fir) {
+        log_error("Failed to allocate convolver");
+        goto error;
+    }
+    c->n_channels = n_channels;
+
+    // A file channel is loaded once however many bus channels use it
+    for (uint32_t i = 0; i < n_channels; i++) channel_fir[i] = -1;
+    uint32_t n_irs = 0;
+    for (int i = 0; i < count; i++) {
+        ir_of[i] = -1;
+        if (bus_channels[i] < 0) continue;
+        if (channel_fir[bus_channels[i]] >= 0) {
+            log_warn("Channel %s has more than one impulse response, using the first", firs[i].channel);
+            continue;
+        }
+        for (int j = 0; j < i && ir_of[i] < 0; j++) {
+            if (ir_of[j] >= 0 && strcmp(firs[j].file, firs[i].file) == 0 && firs[j].file_channel == firs[i].file_channel) {
+                ir_of[i] = ir_of[j];
+            }
+        }
+        if (ir_of[i] < 0) {
+            taps[n_irs] = load_response(&firs[i], rate, &lengths[n_irs]);
+            if (!taps[n_irs]) continue;
+            ir_of[i] = (int) n_irs++;
+        }
+        channel_fir[bus_channels[i]] = i;
+    }
+    if (n_irs == 0) goto error;
+
+    // Everything the filters use from one arena
+    size_t size = ARENA_SIZE(n_channels * sizeof(convolver_channel_t)) +
+                  ARENA_SIZE(n_irs * sizeof(convolver_ir_t)) +
+                  spectra_size(1, HEAD_BINS) + ARENA_SIZE(2 * CONVOLVER_BLOCK_FRAMES * sizeof(float)) +
+                  spectra_size(1, TAIL_BINS) + ARENA_SIZE(2 * CONVOLVER_TAIL_FRAMES * sizeof(float));
+    for (uint32_t i = 0; i < n_irs; i++) {
+        size += spectra_size(partitions(SPA_MIN(lengths[i], (uint32_t) HEAD_TAPS), CONVOLVER_BLOCK_FRAMES), HEAD_BINS);
+        if (lengths[i] > HEAD_TAPS) {
+            size += spectra_size(partitions(lengths[i] - HEAD_TAPS, CONVOLVER_TAIL_FRAMES), TAIL_BINS);
+        }
+    }
+    for (uint32_t i = 0; i < n_channels; i++) {
+        size += 2 * ARENA_SIZE(CONVOLVER_BLOCK_FRAMES * sizeof(float));
+        if (channel_fir[i] < 0) continue;
+        const uint32_t len = lengths[ir_of[channel_fir[i]]];
+        const uint32_t n_head = partitions(SPA_MIN(len, (uint32_t) HEAD_TAPS), CONVOLVER_BLOCK_FRAMES);
+        size += ARENA_SIZE(2 * CONVOLVER_BLOCK_FRAMES * sizeof(float)) + spectra_size(n_head, HEAD_BINS);
+        if (len > HEAD_TAPS) {
+            const uint32_t n_tail = partitions(len - HEAD_TAPS, CONVOLVER_TAIL_FRAMES);
+            size += 2 * CONVOLVER_SLOTS * ARENA_SIZE(CONVOLVER_TAIL_FRAMES * sizeof(float)) +
+                    ARENA_SIZE(2 * CONVOLVER_TAIL_FRAMES * sizeof(float)) + spectra_size(n_tail, TAIL_BINS);
+        }
+    }
+    if (!arena_init(&c->arena, size) ||
+        !fft_init(&c->head_fft, 2 * CONVOLVER_BLOCK_FRAMES) || !fft_init(&c->tail_fft, 2 * CONVOLVER_TAIL_FRAMES)) {
+        log_error("Failed to allocate convolver");
+        goto error;
+    }
+
+    c->channels = arena_alloc(&c->arena, n_channels * sizeof(convolver_channel_t));
+    c->irs = arena_alloc(&c->arena, n_irs * sizeof(convolver_ir_t));
+    convolver_spectrum_t *head_acc = alloc_spectra(&c->arena, 1, HEAD_BINS);
+    c->head_out = arena_alloc(&c->arena, 2 * CONVOLVER_BLOCK_FRAMES * sizeof(float));
+    convolver_spectrum_t *tail_acc = alloc_spectra(&c->arena, 1, TAIL_BINS);
+    c->tail_scratch = arena_alloc(&c->arena, 2 * CONVOLVER_TAIL_FRAMES * sizeof(float));
+    if (!c->channels || !c->irs || !head_acc || !c->head_out || !tail_acc || !c->tail_scratch) goto error;
+    c->head_acc = *head_acc;
+    c->tail_acc = *tail_acc;
+    c->n_irs = n_irs;
+
+    // Partition spectra, worked out here once per response
+    for (int i = 0; i < count; i++) {
+        if (ir_of[i] < 0 || c->irs[ir_of[i]].file) continue;
+        convolver_ir_t *ir = &c->irs[ir_of[i]];
+        const float *h = taps[ir_of[i]];
+        ir->file = firs[i].file;
+        ir->file_channel = firs[i].file_channel;
+        ir->taps = lengths[ir_of[i]];
+        ir->n_head = partitions(SPA_MIN(ir->taps, (uint32_t) HEAD_TAPS), CONVOLVER_BLOCK_FRAMES);
+        ir->n_tail = ir->taps > HEAD_TAPS ? partitions(ir->taps - HEAD_TAPS, CONVOLVER_TAIL_FRAMES) : 0;
+        ir->head = alloc_spectra(&c->arena, ir->n_head, HEAD_BINS);
+        ir->tail = ir->n_tail > 0 ? alloc_spectra(&c->arena, ir->n_tail, TAIL_BINS) : NULL;
+        if (!ir->head || (ir->n_tail > 0 && !ir->tail)) goto error;
+
+        for (uint32_t k = 0; k < ir->n_head; k++) {
+            const uint32_t start = k * CONVOLVER_BLOCK_FRAMES;
+            const uint32_t len = start < ir->taps ? SPA_MIN(ir->taps - start, (uint32_t) CONVOLVER_BLOCK_FRAMES) : 0;
+            partition_spectrum(&c->head_fft, h + start, len, c->head_out, &ir->head[k]);
+        }
+        for (uint32_t k = 0; k < ir->n_tail; k++) {
+            const uint32_t start = HEAD_TAPS + k * CONVOLVER_TAIL_FRAMES;
+            const uint32_t len = SPA_MIN(ir->taps - start, (uint32_t) CONVOLVER_TAIL_FRAMES);
+            partition_spectrum(&c->tail_fft, h + start, len, c->tail_scratch, &ir->tail[k]);
+        }
+        if (ir->n_tail > 0) c->has_tail = true;
+    }
+
+    for (uint32_t i = 0; i < n_channels; i++) {
+        convolver_channel_t *ch = &c->channels[i];
+        ch->fifo_in = arena_alloc(&c->arena, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+        ch->fifo_out = arena_alloc(&c->arena, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+        if (!ch->fifo_in || !ch->fifo_out) goto error;
+        if (channel_fir[i] < 0) continue;
+
+        ch->ir = &c->irs[ir_of[channel_fir[i]]];
+        ch->head_input = arena_alloc(&c->arena, 2 * CONVOLVER_BLOCK_FRAMES * sizeof(float));
+        ch->head_fdl = alloc_spectra(&c->arena, ch->ir->n_head, HEAD_BINS);
+        if (!ch->head_input || !ch->head_fdl) goto error;
+        if (ch->ir->n_tail == 0) continue;
+
+        for (int s = 0; s < CONVOLVER_SLOTS; s++) {
+            ch->tail_in[s] = arena_alloc(&c->arena, CONVOLVER_TAIL_FRAMES * sizeof(float));
+            ch->tail_out[s] = arena_alloc(&c->arena, CONVOLVER_TAIL_FRAMES * sizeof(float));
+            if (!ch->tail_in[s] || !ch->tail_out[s]) goto error;
+        }
+        ch->tail_input = arena_alloc(&c->arena, 2 * CONVOLVER_TAIL_FRAMES * sizeof(float));
+        ch->tail_fdl = alloc_spectra(&c->arena, ch->ir->n_tail, TAIL_BINS);
+        if (!ch->tail_input || !ch->tail_fdl) goto error;
+    }
+
+    if (c->has_tail) {
+        const int res = pthread_create(&c->thread, NULL, tail_thread, c);
+        if (res != 0) {
+            log_error("Failed to start convolver thread: %s", strerror(res));
+            goto error;
+        }
+        c->started = true;
+        pthread_setname_np(c->thread, "papad-fir");
+    }
+
+    uint32_t n_filtered = 0;
+    for (uint32_t i = 0; i < n_channels; i++) {
+        if (channel_fir[i] >= 0) n_filtered++;
+    }
+    log_info("Convolving %u channels with %u impulse responses, %zu bytes", n_filtered, n_irs, c->arena.size);
+
+    for (uint32_t i = 0; i < n_irs; i++) free(taps[i]);
+    free(taps);
+    free(lengths);
+    free(ir_of);
+    free(channel_fir);
+    return c;
+
+error:
+    if (taps) {
+        for (int i = 0; i < count; i++) free(taps[i]);
+    }
+    free(taps);
+    free(lengths);
+    free(ir_of);
+    free(channel_fir);
+    convolver_destroy(c);
+    return NULL;
+}
+
+void convolver_destroy(convolver_t *c) {
+    if (!c) return;
+
+    if (c->started) {
+        atomic_store(&c->stop, true);
+        // A new count, so a thread about to sleep on the old one does not
+        atomic_fetch_add(&c->submitted, 1);
+        futex_wake(&c->submitted);
+        pthread_join(c->thread, NULL);
+    }
+    fft_clear(&c->head_fft);
+    fft_clear(&c->tail_fft);
+    arena_clear(&c->arena);
+    free(c);
+}
+
+// Head of one block of a channel, plus the tail of the period it is in
+static void run_head(convolver_t *c, convolver_channel_t *ch, const uint32_t slot, const uint32_t offset) {
+    const convolver_ir_t *ir = ch->ir;
+
+    memmove(ch->head_input, ch->head_input + CONVOLVER_BLOCK_FRAMES, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+    memcpy(ch->head_input + CONVOLVER_BLOCK_FRAMES, ch->fifo_in, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+    fft_forward(&c->head_fft, ch->head_input, ch->head_fdl[ch->head_pos].re, ch->head_fdl[ch->head_pos].im);
+
+    memset(c->head_acc.re, 0, HEAD_BINS * sizeof(float));
+    memset(c->head_acc.im, 0, HEAD_BINS * sizeof(float));
+    for (uint32_t k = 0; k < ir->n_head; k++) {
+        const convolver_spectrum_t *x = &ch->head_fdl[(ch->head_pos + ir->n_head - k) % ir->n_head];
+        fft_multiply_add(x->re, x->im, ir->head[k].re, ir->head[k].im, c->head_acc.re, c->head_acc.im, HEAD_BINS);
+    }
+    fft_inverse(&c->head_fft, c->head_acc.re, c->head_acc.im, c->head_out);
+    ch->head_pos = (ch->head_pos + 1) % ir->n_head;
+
+    float *restrict out = ch->fifo_out;
+    const float *restrict head = c->head_out + CONVOLVER_BLOCK_FRAMES;
+    if (ir->n_tail > 0 && c->tail_live) {
+        const float *restrict tail = ch->tail_out[slot] + offset;
+        for (uint32_t i = 0; i < CONVOLVER_BLOCK_FRAMES; i++) out[i] = head[i] + tail[i];
+    } else {
+        memcpy(out, head, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+    }
+    if (ir->n_tail > 0) {
+        memcpy(ch->tail_in[slot] + offset, ch->fifo_in, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+    }
+}
+
+static void run_block(convolver_t *c) {
+    // Periods count modulo 2^32, as submitted and ready do
+    const uint32_t period = (uint32_t) (c->blocks / BLOCKS_PER_PERIOD);
+    const uint32_t slot = period % CONVOLVER_SLOTS;
+    const uint32_t offset = (uint32_t) (c->blocks % BLOCKS_PER_PERIOD) * CONVOLVER_BLOCK_FRAMES;
+
+    // The tail of a period is settled as it starts, never waited for
+    if (offset == 0 && c->has_tail) {
+        c->tail_live = atomic_load_explicit(&c->ready[slot], memory_order_acquire) == period + 1;
+        if (!c->tail_live && c->blocks >= 2 * BLOCKS_PER_PERIOD) atomic_fetch_add(&c->overruns, 1);
+    }
+
+    for (uint32_t i = 0; i < c->n_channels; i++) {
+        convolver_channel_t *ch = &c->channels[i];
+        if (ch->ir) {
+            run_head(c, ch, slot, offset);
+        } else {
+            memcpy(ch->fifo_out, ch->fifo_in, CONVOLVER_BLOCK_FRAMES * sizeof(float));
+        }
+    }
+
+    c->blocks++;
+    if (c->has_tail && c->blocks % BLOCKS_PER_PERIOD == 0) {
+        atomic_store_explicit(&c->submitted, period + 1, memory_order_release);
+        futex_wake(&c->submitted);
+    }
+}
+
+void convolver_process(convolver_t *c, float *const *bus, const uint32_t n) {
+    for (uint32_t done = 0; done < n;) {
+        const uint32_t chunk = SPA_MIN(CONVOLVER_BLOCK_FRAMES - c->fill, n - done);
+        for (uint32_t i = 0; i < c->n_channels; i++) {
+            convolver_channel_t *ch = &c->channels[i];
+            float *samples = bus[i] + done;
+            memcpy(ch->fifo_in + c->fill, samples, chunk * sizeof(float));
+            memcpy(samples, ch->fifo_out + c->fill, chunk * sizeof(float));
+        }
+        c->fill += chunk;
+        done += chunk;
+        if (c->fill == CONVOLVER_BLOCK_FRAMES) {
+            run_block(c);
+            c->fill = 0;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef ASYNC_AUDIO_PLAYER_CONVOLVER_H
+#define ASYNC_AUDIO_PLAYER_CONVOLVER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "arena.h"
+#include "fft.h"
+
+// Partition of the head of a response, run on the process thread. Also the
+// latency the convolver adds to every bus channel.
+#define CONVOLVER_BLOCK_FRAMES 256
+
+// Partition of the tail, run on a thread of its own. The head covers the
+// first two of these, so the tail of a period has a whole period to be done.
+#define CONVOLVER_TAIL_FRAMES 1024
+
+// Longest response, taps at the bus rate
+#define CONVOLVER_MAX_TAPS 65536
+
+// Tail periods in flight between the process thread and the tail thread.
+// Period counts are 32 bits and wrap, a power of two keeps slots in step.
+#define CONVOLVER_SLOTS 4
+
+typedef struct {
+    float *re;
+    float *im;
+} convolver_spectrum_t;
+
+// Partitioned spectra of one response, shared by every channel using it
+typedef struct {
+    const char *file;
+    int file_channel;
+    uint32_t taps;
+    uint32_t n_head;                 // Partitions of CONVOLVER_BLOCK_FRAMES
+    uint32_t n_tail;                 // Partitions of CONVOLVER_TAIL_FRAMES, 0 for a short response
+    convolver_spectrum_t *head;
+    convolver_spectrum_t *tail;
+} convolver_ir_t;
+
+typedef struct {
+    const convolver_ir_t *ir;        // NULL for a channel that is only delayed
+    float *fifo_in;                  // Block being gathered
+    float *fifo_out;                 // Block being played, one block behind
+
+    // Head, owned by the process thread
+    float *head_input;               // Last two blocks
+    convolver_spectrum_t *head_fdl;  // Spectra of past blocks, n_head of them
+    uint32_t head_pos;
+
+    // Tail, input and output handed over by period
+    float *tail_in[CONVOLVER_SLOTS];
+    float *tail_out[CONVOLVER_SLOTS];
+    float *tail_input;               // Last two periods, owned by the tail thread
+    convolver_spectrum_t *tail_fdl;
+    uint32_t tail_pos;
+} convolver_channel_t;
+
+// FIR filters over the channels of a bus by uniformly partitioned FFT
+// convolution in two sizes. Built on the main loop with everything it will
+// use, the process thread runs the head and hands whole periods to the tail
+// thread without waiting on it.
+typedef struct convolver {
+    uint32_t n_channels;
+    convolver_channel_t *channels;
+    convolver_ir_t *irs;
+    uint32_t n_irs;
+    arena_t arena;
+
+    // Process thread
+    fft_t head_fft;
+    convolver_spectrum_t head_acc;
+    float *head_out;
+    uint32_t fill;                   // Frames of the block gathered
+    uint64_t blocks;                 // Blocks done
+    bool tail_live;                  // The tail of this period arrived in time
+
+    // Tail thread
+    bool has_tail;
+    fft_t tail_fft;
+    convolver_spectrum_t tail_acc;
+    float *tail_scratch;
+    uint32_t consumed;               // Periods done, modulo 2^32 as submitted
+    pthread_t thread;
+    bool started;
+    atomic_bool stop;
+
+    atomic_uint submitted;           // Periods handed to the tail thread
+    atomic_uint ready[CONVOLVER_SLOTS]; // Period + 1 whose tail a slot holds
+    atomic_uint overruns;            // Periods played without their tail
+} convolver_t;
+
+// Load the responses of firs and build the filters at rate. bus_channels
+// holds the bus channel of every entry, -1 to leave it out.
+convolver_t *convolver_new(const fir_config_t *firs, int count, const int *bus_channels,
+                           uint32_t n_channels, uint32_t rate);
+
+void convolver_destroy(convolver_t *convolver);
+
+// Filter n frames of every planar bus channel in place, from the process thread
+void convolver_process(convolver_t *convolver, float *const *bus, uint32_t n);
+
+#endif // ASYNC_AUDIO_PLAYER_CONVOLVER_H
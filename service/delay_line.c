@@ -0,0 +1,94 @@
+#include <math.h>
+#include <string.h>
+#include "delay_line.h"
+
+// Interpolation reads a frame on either side of the delay and one beyond
+#define DELAY_TAPS 3
+
+uint32_t delay_line_size(const uint32_t max_frames) {
+    uint32_t size = 4;
+    while (size < max_frames + DELAY_TAPS + 1) size <<= 1;
+    return size;
+}
+
+void delay_line_init(delay_line_t *line, float *ring, const uint32_t size) {
+    memset(line, 0, sizeof(*line));
+    line->ring = ring;
+    line->mask = size - 1;
+}
+
+double delay_line_max(const delay_line_t *line) {
+    return (double) (line->mask - DELAY_TAPS);
+}
+
+void delay_line_set(delay_line_t *line, double frames, const uint32_t fade_frames) {
+    frames = fmin(fmax(frames, 0.0), delay_line_max(line));
+    if (frames == line->delay) return;
+
+    if (fade_frames == 0) {
+        line->delay = frames;
+        line->fade = 0;
+        return;
+    }
+
+    // A change in the middle of a fade starts over from where it got to,
+    // the nearer of the two taps
+    if (line->fade > 0 && line->fade > line->fade_len / 2) line->delay = line->from;
+    line->from = line->delay;
+    line->delay = frames;
+    line->fade = fade_frames;
+    line->fade_len = fade_frames;
+}
+
+// The frame delay frames behind the one written last
+static float tap(const delay_line_t *line, const uint32_t newest, const double delay) {
+    const float *ring = line->ring;
+    const uint32_t mask = line->mask;
+    const uint32_t i = (uint32_t) delay;
+    const float f = (float) (delay - (double) i);
+
+    if (f == 0.0f) return ring[(newest - i) & mask];
+    if (i == 0) {
+        // Nothing newer to interpolate with, straight between the two
+        return ring[newest & mask] + (ring[(newest - 1) & mask] - ring[newest & mask]) * f;
+    }
+
+    const float a = ring[(newest - i + 1) & mask];
+    const float b = ring[(newest - i) & mask];
+    const float c = ring[(newest - i - 1) & mask];
+    const float d = ring[(newest - i - 2) & mask];
+    return a * (-f * (f - 1.0f) * (f - 2.0f) / 6.0f) +
+           b * ((f + 1.0f) * (f - 1.0f) * (f - 2.0f) / 2.0f) +
+           c * (-(f + 1.0f) * f * (f - 2.0f) / 2.0f) +
+           d * ((f + 1.0f) * f * (f - 1.0f) / 6.0f);
+}
+
+void delay_line_process(delay_line_t *line, float *samples, const uint32_t n) {
+    float *ring = line->ring;
+    const uint32_t mask = line->mask;
+    uint32_t w = line->write;
+    uint32_t i = 0;
+
+    // Fading between the old and the new delay
+    for (; i < n && line->fade > 0; i++, w++) {
+        ring[w & mask] = samples[i];
+        const float g = 1.0f - (float) line->fade / (float) line->fade_len;
+        samples[i] = tap(line, w, line->from) * (1.0f - g) + tap(line, w, line->delay) * g;
+        line->fade--;
+    }
+
+    const uint32_t whole = (uint32_t) line->delay;
+    if (line->delay == (double) whole) {
+        // Whole frames, a copy through the ring
+        for (; i < n; i++, w++) {
+            ring[w & mask] = samples[i];
+            samples[i] = ring[(w - whole) & mask];
+        }
+    } else {
+        for (; i < n; i++, w++) {
+            ring[w & mask] = samples[i];
+            samples[i] = tap(line, w, line->delay);
+        }
+    }
+    line->write = w & mask;
+}
@@ -0,0 +1,44 @@
+#ifndef ASYNC_AUDIO_PLAYER_DELAY_LINE_H
+#define ASYNC_AUDIO_PLAYER_DELAY_LINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Longest delay a device channel can be given, seconds
+#define DELAY_MAX_SECONDS 0.1
+
+// Crossfade from the old delay to a new one, seconds
+#define DELAY_FADE_SECONDS 0.02
+
+// Metres per second, turns speaker distances into delays
+#define DELAY_SPEED_OF_SOUND 343.0
+
+// Ring of the last frames of one bus channel read back some frames later.
+// Fractional delays read between frames with cubic Lagrange interpolation.
+// Owned by the process thread.
+typedef struct {
+    float *ring;         // Power of two frames, storage of the caller
+    uint32_t mask;
+    uint32_t write;      // Where the next frame goes
+    double delay;        // Frames behind the newest frame
+    double from;         // Delay faded out of
+    uint32_t fade;       // Frames of the crossfade left, 0 when steady
+    uint32_t fade_len;
+} delay_line_t;
+
+// Frames of ring a delay of max_frames needs, a power of two
+uint32_t delay_line_size(uint32_t max_frames);
+
+// Start on zeroed storage of delay_line_size() frames, without delay
+void delay_line_init(delay_line_t *line, float *ring, uint32_t size);
+
+// Longest delay the ring holds, frames
+double delay_line_max(const delay_line_t *line);
+
+// Move the tap to frames behind, crossfading over fade_frames, 0 to jump
+void delay_line_set(delay_line_t *line, double frames, uint32_t fade_frames);
+
+// Delay n frames of one channel in place
+void delay_line_process(delay_line_t *line, float *samples, uint32_t n);
+
+#endif // ASYNC_AUDIO_PLAYER_DELAY_LINE_H
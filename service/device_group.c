@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <spa/utils/result.h>
+#include "device_group.h"
+#include "log.h"
+
+struct pin_request {
+    const group_config_t *config;
+    int affinity_res;
+    int priority_res;
+};
+
+// Runs on the data loop thread, so it applies to that thread
+static int do_pin_thread(struct spa_loop *loop, bool async, uint32_t seq,
+                         const void *data, size_t size, void *user_data) {
+    struct pin_request *req = user_data;
+
+    if (req->config->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(req->config->cpu, &set);
+        req->affinity_res = -pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    if (req->config->rt_priority > 0) {
+        const struct sched_param param = {.sched_priority = req->config->rt_priority};
+        req->priority_res = -pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+    return 0;
+}
+
+bool device_group_init(device_group_t *group, const group_config_t *config, struct pw_loop *main_loop) {
+    memset(group, 0, sizeof(*group));
+    group->config = config;
+
+    group->context = pw_context_new(main_loop, NULL, 0);
+    if (!group->context) {
+        log_error("Failed to create PipeWire context for group %s", config->name);
+        return false;
+    }
+    group->data_loop = pw_data_loop_get_loop(pw_context_get_data_loop(group->context));
+
+    struct pin_request req = {.config = config};
+    pw_loop_invoke(group->data_loop, do_pin_thread, 0, NULL, 0, true, &req);
+
+    if (req.affinity_res < 0) {
+        log_warn("Failed to pin group %s to CPU %d: %s", config->name, config->cpu, spa_strerror(req.affinity_res));
+    }
+    if (req.priority_res < 0) {
+        log_warn("Failed to set RT priority %d for group %s: %s",
+                 config->rt_priority, config->name, spa_strerror(req.priority_res));
+    }
+
+    log_info("Device group %s: CPU %d, RT priority %d", config->name, config->cpu, config->rt_priority);
+    return true;
+}
+
+bool device_group_connect(device_group_t *group, const struct pw_core_events *events, void *data) {
+    if (group->core) return true;
+
+    group->core = pw_context_connect(group->context, NULL, 0);
+    if (!group->core) {
+        log_error("Failed to connect group %s to PipeWire: %s", group->config->name, strerror(errno));
+        return false;
+    }
+
+    spa_zero(group->core_listener);
+    pw_core_add_listener(group->core, &group->core_listener, events, data);
+    return true;
+}
+
+void device_group_disconnect(device_group_t *group) {
+    if (!group->core) return;
+
+    spa_hook_remove(&group->core_listener);
+    pw_core_disconnect(group->core);
+    group->core = NULL;
+}
+
+void device_group_clear(device_group_t *group) {
+    device_group_disconnect(group);
+    if (group->context) {
+        pw_context_destroy(group->context);
+        group->context = NULL;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef ASYNC_AUDIO_PLAYER_DEVICE_GROUP_H
+#define ASYNC_AUDIO_PLAYER_DEVICE_GROUP_H
+
+#include <stdbool.h>
+#include <pipewire/pipewire.h>
+#include "types.h"
+
+// Devices processed on a data loop of their own. Each group has its own
+// context so its streams never share a thread with another group.
+typedef struct device_group {
+    const group_config_t *config;
+    struct pw_context *context;
+    struct pw_loop *data_loop;
+    struct pw_core *core;            // NULL while disconnected
+    struct spa_hook core_listener;
+} device_group_t;
+
+// Create the context of a group on the shared main loop and pin its data
+// loop thread as configured
+bool device_group_init(device_group_t *group, const group_config_t *config, struct pw_loop *main_loop);
+
+// Connect the group to PipeWire, core events go to the given listener
+bool device_group_connect(device_group_t *group, const struct pw_core_events *events, void *data);
+
+// Drop the connection, every stream on it must be gone
+void device_group_disconnect(device_group_t *group);
+
+// Destroy the context of a group
+void device_group_clear(device_group_t *group);
+
+#endif // ASYNC_AUDIO_PLAYER_DEVICE_GROUP_H
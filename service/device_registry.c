@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "device_registry.h"
+#include "track_manager.h"
+#include "log.h"
+
+#define MAX_DEVICE_NODES 128
+#define MAX_DEVICE_PORTS 2048
+#define MAX_WATCHED_NODES 4
+
+struct device_registry {
+    struct pw_core *core;
+    struct pw_registry *registry;
+    struct spa_hook core_listener;
+    struct spa_hook registry_listener;
+    const device_registry_events_t *events;
+    void *data;
+    int sync_seq;
+    bool synced;
+
+    // Ports are kept for playback nodes and watched nodes only. Nodes whose
+    // ports were dropped are remembered, should one turn out to be wanted
+    // the registry is enumerated again to pick them up.
+    uint32_t watched[MAX_WATCHED_NODES];
+    uint32_t n_watched;
+    uint32_t *skipped;
+    uint32_t n_skipped;
+    uint32_t max_skipped;
+    bool reenumerate;            // A fresh registry is due at resync_seq
+    int resync_seq;
+    bool replaying;              // Globals are announced again until replay_seq
+    int replay_seq;
+
+    device_node_t nodes[MAX_DEVICE_NODES];
+    bool node_used[MAX_DEVICE_NODES];
+    bool node_seen[MAX_DEVICE_NODES];     // Announced again by the replay
+    device_port_t ports[MAX_DEVICE_PORTS];
+    bool port_used[MAX_DEVICE_PORTS];
+    bool port_seen[MAX_DEVICE_PORTS];
+};
+
+static bool is_playback_class(const char *media_class) {
+    return media_class &&
+           (strcmp(media_class, "Audio/Sink") == 0 || strcmp(media_class, "Audio/Duplex") == 0);
+}
+
+static device_node_t *lookup_node(device_registry_t *reg, const uint32_t id) {
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (reg->node_used[i] && reg->nodes[i].id == id) {
+            return &reg->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static int lookup_port(const device_registry_t *reg, const uint32_t id) {
+    for (int i = 0; i < MAX_DEVICE_PORTS; i++) {
+        if (reg->port_used[i] && reg->ports[i].id == id) return i;
+    }
+    return -1;
+}
+
+static bool is_watched(const device_registry_t *reg, const uint32_t node_id) {
+    for (uint32_t i = 0; i < reg->n_watched; i++) {
+        if (reg->watched[i] == node_id) return true;
+    }
+    return false;
+}
+
+// Note a node whose ports were dropped, once
+static void remember_skipped(device_registry_t *reg, const uint32_t node_id) {
+    for (uint32_t i = 0; i < reg->n_skipped; i++) {
+        if (reg->skipped[i] == node_id) return;
+    }
+    if (reg->n_skipped == reg->max_skipped) {
+        const uint32_t max = reg->max_skipped ? reg->max_skipped * 2 : 64;
+        uint32_t *skipped = realloc(reg->skipped, max * sizeof(uint32_t));
+        if (!skipped) {
+            log_warn("Device registry cannot track the ports of node %u", node_id);
+            return;
+        }
+        reg->skipped = skipped;
+        reg->max_skipped = max;
+    }
+    reg->skipped[reg->n_skipped++] = node_id;
+}
+
+// Forget a node whose ports were dropped, true if it was noted
+static bool forget_skipped(device_registry_t *reg, const uint32_t node_id) {
+    for (uint32_t i = 0; i < reg->n_skipped; i++) {
+        if (reg->skipped[i] == node_id) {
+            reg->skipped[i] = reg->skipped[--reg->n_skipped];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Enumerate again once out of the registry callbacks, the proxy cannot be
+// swapped safely from inside them
+static void request_reenumerate(device_registry_t *reg) {
+    if (reg->reenumerate) return;
+    reg->reenumerate = true;
+    reg->resync_seq = pw_core_sync(reg->core, PW_ID_CORE, 0);
+}
+
+// Rebuild the port count and channel positions of a node from the port table
+static void update_node_ports(device_registry_t *reg, device_node_t *node) {
+    const device_port_t *sorted[DEVICE_MAX_CHANNELS];
+    uint32_t n = 0;
+
+    for (int i = 0; i < MAX_DEVICE_PORTS && n < DEVICE_MAX_CHANNELS; i++) {
+        if (!reg->port_used[i] || reg->ports[i].output || reg->ports[i].node_id != node->id) continue;
+
+        // Insertion sort on port.id, nodes have few ports
+        uint32_t j = n++;
+        while (j > 0 && sorted[j - 1]->port_index > reg->ports[i].port_index) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = &reg->ports[i];
+    }
+
+    node->n_ports = n;
+    for (uint32_t i = 0; i < n; i++) {
+        node->positions[i] = get_channel_position(sorted[i]->channel);
+        memcpy(node->channels[i], sorted[i]->channel, DEVICE_CHANNEL_NAME_MAX);
+    }
+}
+
+static void notify_ports_changed(device_registry_t *reg, const uint32_t node_id) {
+    if (reg->synced && reg->events && reg->events->ports_changed) {
+        reg->events->ports_changed(reg->data, node_id);
+    }
+}
+
+static void copy_prop(char *dst, const size_t size, const struct spa_dict *props, const char *key) {
+    const char *value = spa_dict_lookup(props, key);
+    snprintf(dst, size, "%s", value ? value : "");
+}
+
+static void add_node(device_registry_t *reg, const uint32_t id, const struct spa_dict *props) {
+    const char *media_class = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+    if (!is_playback_class(media_class)) return;
+
+    // Announced again by a fresh registry
+    device_node_t *known = lookup_node(reg, id);
+    if (known) {
+        reg->node_seen[known - reg->nodes] = true;
+        return;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (!reg->node_used[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        log_warn("Device registry full, ignoring node %u", id);
+        return;
+    }
+
+    device_node_t *node = &reg->nodes[slot];
+    memset(node, 0, sizeof(*node));
+    node->id = id;
+
+    const char *serial = spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL);
+    node->serial = serial ? strtoull(serial, NULL, 10) : id;
+    copy_prop(node->name, sizeof(node->name), props, PW_KEY_NODE_NAME);
+    copy_prop(node->description, sizeof(node->description), props, PW_KEY_NODE_DESCRIPTION);
+    snprintf(node->media_class, sizeof(node->media_class), "%s", media_class);
+
+    reg->node_used[slot] = true;
+    reg->node_seen[slot] = true;
+    update_node_ports(reg, node);
+
+    log_debug("Device added: %u %s (%s)", id, node->name, node->description);
+
+    // Its ports came first and were dropped
+    if (forget_skipped(reg, id)) request_reenumerate(reg);
+
+    if (reg->events && reg->events->node_added) {
+        reg->events->node_added(reg->data, node);
+    }
+}
+
+static void add_port(device_registry_t *reg, const uint32_t id, const struct spa_dict *props) {
+    const char *direction = spa_dict_lookup(props, PW_KEY_PORT_DIRECTION);
+    const char *node_id = spa_dict_lookup(props, PW_KEY_NODE_ID);
+    const char *monitor = spa_dict_lookup(props, PW_KEY_PORT_MONITOR);
+
+    if (!direction || !node_id) return;
+    if (monitor && strcmp(monitor, "true") == 0) return;
+
+    const int known = lookup_port(reg, id);
+    if (known >= 0) {
+        reg->port_seen[known] = true;
+        return;
+    }
+
+    const uint32_t owner = (uint32_t) strtoul(node_id, NULL, 10);
+    if (!lookup_node(reg, owner) && !is_watched(reg, owner)) {
+        remember_skipped(reg, owner);
+        return;
+    }
+
+    for (int i = 0; i < MAX_DEVICE_PORTS; i++) {
+        if (reg->port_used[i]) continue;
+
+        device_port_t *port = &reg->ports[i];
+        memset(port, 0, sizeof(*port));
+        port->id = id;
+        port->node_id = owner;
+        port->output = strcmp(direction, "out") == 0;
+
+        const char *port_index = spa_dict_lookup(props, PW_KEY_PORT_ID);
+        port->port_index = port_index ? (uint32_t) strtoul(port_index, NULL, 10) : 0;
+        copy_prop(port->name, sizeof(port->name), props, PW_KEY_PORT_NAME);
+        copy_prop(port->channel, sizeof(port->channel), props, PW_KEY_AUDIO_CHANNEL);
+        reg->port_used[i] = true;
+        reg->port_seen[i] = true;
+
+        device_node_t *node = lookup_node(reg, port->node_id);
+        if (node) {
+            update_node_ports(reg, node);
+        }
+        notify_ports_changed(reg, port->node_id);
+        return;
+    }
+
+    log_warn("Device registry full, ignoring port %u", id);
+}
+
+static void registry_event_global(void *data, const uint32_t id, uint32_t permissions,
+                                  const char *type, uint32_t version, const struct spa_dict *props) {
+    device_registry_t *reg = data;
+    if (!props) return;
+
+    if (strcmp(type, PW_TYPE_INTERFACE_Node) == 0) {
+        add_node(reg, id, props);
+    } else if (strcmp(type, PW_TYPE_INTERFACE_Port) == 0) {
+        add_port(reg, id, props);
+    }
+}
+
+static void remove_port(device_registry_t *reg, const int i) {
+    reg->port_used[i] = false;
+    device_node_t *node = lookup_node(reg, reg->ports[i].node_id);
+    if (node) {
+        update_node_ports(reg, node);
+    }
+    notify_ports_changed(reg, reg->ports[i].node_id);
+}
+
+static void remove_node(device_registry_t *reg, const int i) {
+    log_debug("Device removed: %u %s", reg->nodes[i].id, reg->nodes[i].name);
+    reg->node_used[i] = false;
+    // The entry stays readable for the duration of the callback
+    if (reg->events && reg->events->node_removed) {
+        reg->events->node_removed(reg->data, &reg->nodes[i]);
+    }
+}
+
+static void registry_event_global_remove(void *data, const uint32_t id) {
+    device_registry_t *reg = data;
+
+    const int port = lookup_port(reg, id);
+    if (port >= 0) {
+        remove_port(reg, port);
+        return;
+    }
+
+    forget_skipped(reg, id);
+    for (uint32_t i = 0; i < reg->n_watched; i++) {
+        if (reg->watched[i] == id) reg->watched[i] = reg->watched[--reg->n_watched];
+    }
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (reg->node_used[i] && reg->nodes[i].id == id) {
+            remove_node(reg, i);
+            return;
+        }
+    }
+}
+
+static const struct pw_registry_events registry_events = {
+    PW_VERSION_REGISTRY_EVENTS,
+    .global = registry_event_global,
+    .global_remove = registry_event_global_remove,
+};
+
+// Swap in a fresh registry, which announces every global again. Removals
+// sent to the old one in the meantime are lost, whatever the replay does
+// not announce is dropped once it is in.
+static void restart_registry(device_registry_t *reg) {
+    spa_hook_remove(&reg->registry_listener);
+    pw_proxy_destroy((struct pw_proxy *) reg->registry);
+
+    reg->registry = pw_core_get_registry(reg->core, PW_VERSION_REGISTRY, 0);
+    if (!reg->registry) {
+        log_error("Failed to get PipeWire registry");
+        if (!reg->synced) reg->sync_seq = pw_core_sync(reg->core, PW_ID_CORE, 0);
+        return;
+    }
+
+    memset(reg->node_seen, 0, sizeof(reg->node_seen));
+    memset(reg->port_seen, 0, sizeof(reg->port_seen));
+    reg->n_skipped = 0;
+    spa_zero(reg->registry_listener);
+    pw_registry_add_listener(reg->registry, &reg->registry_listener, &registry_events, reg);
+    reg->replaying = true;
+    reg->replay_seq = pw_core_sync(reg->core, PW_ID_CORE, 0);
+    if (!reg->synced) reg->sync_seq = reg->replay_seq;
+}
+
+static void drop_unseen(device_registry_t *reg) {
+    for (int i = 0; i < MAX_DEVICE_PORTS; i++) {
+        if (reg->port_used[i] && !reg->port_seen[i]) remove_port(reg, i);
+    }
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (reg->node_used[i] && !reg->node_seen[i]) remove_node(reg, i);
+    }
+}
+
+static void on_core_done(void *data, const uint32_t id, const int seq) {
+    device_registry_t *reg = data;
+
+    if (id != PW_ID_CORE) return;
+
+    if (reg->reenumerate && seq == reg->resync_seq) {
+        reg->reenumerate = false;
+        restart_registry(reg);
+        return;
+    }
+    if (reg->replaying && seq == reg->replay_seq) {
+        reg->replaying = false;
+        drop_unseen(reg);
+    }
+
+    // Not synced while ports of a node are still to come in
+    if (seq != reg->sync_seq || reg->synced || reg->reenumerate || reg->replaying) return;
+
+    reg->synced = true;
+    log_debug("Device registry synced");
+
+    if (reg->events && reg->events->synced) {
+        reg->events->synced(reg->data);
+    }
+}
+
+static const struct pw_core_events core_events = {
+    PW_VERSION_CORE_EVENTS,
+    .done = on_core_done,
+};
+
+device_registry_t *device_registry_new(struct pw_core *core, const device_registry_events_t *events, void *data) {
+    device_registry_t *reg = calloc(1, sizeof(device_registry_t));
+    if (!reg) {
+        log_error("Failed to allocate device registry");
+        return NULL;
+    }
+
+    reg->core = core;
+    reg->events = events;
+    reg->data = data;
+
+    reg->registry = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+    if (!reg->registry) {
+        log_error("Failed to get PipeWire registry");
+        free(reg);
+        return NULL;
+    }
+
+    pw_registry_add_listener(reg->registry, &reg->registry_listener, &registry_events, reg);
+    pw_core_add_listener(core, &reg->core_listener, &core_events, reg);
+
+    // All existing globals are announced before this sync completes
+    reg->sync_seq = pw_core_sync(core, PW_ID_CORE, 0);
+
+    return reg;
+}
+
+void device_registry_destroy(device_registry_t *reg) {
+    if (!reg) return;
+
+    spa_hook_remove(&reg->core_listener);
+    if (reg->registry) {
+        spa_hook_remove(&reg->registry_listener);
+        pw_proxy_destroy((struct pw_proxy *) reg->registry);
+    }
+    free(reg->skipped);
+    free(reg);
+}
+
+bool device_registry_is_synced(const device_registry_t *reg) {
+    return reg && reg->synced;
+}
+
+const device_node_t *device_registry_find(const device_registry_t *reg, const char *device) {
+    if (!reg || !device) return NULL;
+
+    // Node names are unique, try them before anything else
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (reg->node_used[i] && strcmp(reg->nodes[i].name, device) == 0) {
+            return &reg->nodes[i];
+        }
+    }
+
+    char *end;
+    const unsigned long long number = strtoull(device, &end, 10);
+    const bool numeric = end != device && *end == '\0';
+
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (!reg->node_used[i]) continue;
+
+        const device_node_t *node = &reg->nodes[i];
+        if (numeric && (node->serial == number || node->id == number)) {
+            return node;
+        }
+        if (strcmp(node->description, device) == 0) {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+void device_registry_watch_ports(device_registry_t *reg, const uint32_t node_id) {
+    if (!reg || is_watched(reg, node_id)) return;
+
+    if (reg->n_watched == MAX_WATCHED_NODES) {
+        log_warn("Device registry watches %d nodes already, ignoring node %u", MAX_WATCHED_NODES, node_id);
+        return;
+    }
+    reg->watched[reg->n_watched++] = node_id;
+    if (forget_skipped(reg, node_id)) request_reenumerate(reg);
+}
+
+const device_node_t *device_registry_get(const device_registry_t *reg, const uint32_t id) {
+    if (!reg) return NULL;
+    return lookup_node((device_registry_t *) reg, id);
+}
+
+const device_port_t *device_registry_find_port(const device_registry_t *reg, const uint32_t node_id, const char *channel) {
+    if (!reg || !channel) return NULL;
+
+    for (int i = 0; i < MAX_DEVICE_PORTS; i++) {
+        if (reg->port_used[i] && !reg->ports[i].output && reg->ports[i].node_id == node_id &&
+            strcmp(reg->ports[i].channel, channel) == 0) {
+            return &reg->ports[i];
+        }
+    }
+    return NULL;
+}
+
+const device_port_t *device_registry_find_output_port(const device_registry_t *reg, const uint32_t node_id, const char *name) {
+    if (!reg || !name) return NULL;
+
+    for (int i = 0; i < MAX_DEVICE_PORTS; i++) {
+        if (reg->port_used[i] && reg->ports[i].output && reg->ports[i].node_id == node_id &&
+            strcmp(reg->ports[i].name, name) == 0) {
+            return &reg->ports[i];
+        }
+    }
+    return NULL;
+}
+
+int device_registry_format(const device_registry_t *reg, char *buffer, const size_t size) {
+    if (!buffer || size == 0) return 0;
+    buffer[0] = '\0';
+    if (!reg) return 0;
+
+    size_t used = 0;
+    int count = 0;
+
+    for (int i = 0; i < MAX_DEVICE_NODES; i++) {
+        if (!reg->node_used[i]) continue;
+
+        const device_node_t *node = &reg->nodes[i];
+        const int written = snprintf(buffer + used, size - used,
+                                     "ID: %-5u | Serial: %-6" PRIu64 " | Ports: %-3u | %-40s | %s\n",
+                                     node->id, node->serial, node->n_ports,
+                                     node->name, node->description);
+        if (written < 0 || (size_t) written >= size - used) {
+            break;
+        }
+        used += written;
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,74 @@
+#ifndef ASYNC_AUDIO_PLAYER_DEVICE_REGISTRY_H
+#define ASYNC_AUDIO_PLAYER_DEVICE_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/raw.h>
+
+#define DEVICE_NAME_MAX 128
+#define DEVICE_MAX_CHANNELS 256
+#define DEVICE_CHANNEL_NAME_MAX 16
+
+// Audio sink as seen through the registry
+typedef struct {
+    uint32_t id;                 // Global id, valid until the node is removed
+    uint64_t serial;             // object.serial, never reused
+    char name[DEVICE_NAME_MAX];
+    char description[DEVICE_NAME_MAX];
+    char media_class[32];
+    uint32_t n_ports;            // Playback (input) ports
+    uint32_t positions[DEVICE_MAX_CHANNELS]; // Channel of each port, in port order
+    char channels[DEVICE_MAX_CHANNELS][DEVICE_CHANNEL_NAME_MAX];
+} device_node_t;
+
+// Audio port of a node
+typedef struct {
+    uint32_t id;
+    uint32_t node_id;
+    uint32_t port_index;         // port.id, orders the ports of a node
+    bool output;                 // Direction, playback ports are inputs
+    char name[64];               // port.name, e.g. "playback_FL"
+    char channel[DEVICE_CHANNEL_NAME_MAX]; // audio.channel, e.g. "FL" or "AUX3"
+} device_port_t;
+
+typedef struct device_registry device_registry_t;
+
+// Change notifications, called from the PipeWire loop thread
+typedef struct {
+    void (*synced)(void *data);
+    void (*node_added)(void *data, const device_node_t *node);
+    void (*node_removed)(void *data, const device_node_t *node);
+    void (*ports_changed)(void *data, uint32_t node_id);
+} device_registry_events_t;
+
+// Start listening on the registry of a connected core
+device_registry_t *device_registry_new(struct pw_core *core, const device_registry_events_t *events, void *data);
+
+// Stop listening and drop the cache
+void device_registry_destroy(device_registry_t *reg);
+
+// True once the initial enumeration has completed
+bool device_registry_is_synced(const device_registry_t *reg);
+
+// Resolve a configured device by node name, description, serial or id
+const device_node_t *device_registry_find(const device_registry_t *reg, const char *device);
+
+// Keep the ports of a node that is not a playback node, such as our own
+// filter node. Watching ends when the node is removed.
+void device_registry_watch_ports(device_registry_t *reg, uint32_t node_id);
+
+// Look up a node by global id
+const device_node_t *device_registry_get(const device_registry_t *reg, uint32_t id);
+
+// Playback port of a node by channel name, NULL if not present
+const device_port_t *device_registry_find_port(const device_registry_t *reg, uint32_t node_id, const char *channel);
+
+// Output port of a playback or watched node by port name, NULL if not present
+const device_port_t *device_registry_find_output_port(const device_registry_t *reg, uint32_t node_id, const char *name);
+
+// Write a human readable device listing, returns the number of devices
+int device_registry_format(const device_registry_t *reg, char *buffer, size_t size);
+
+#endif // ASYNC_AUDIO_PLAYER_DEVICE_REGISTRY_H
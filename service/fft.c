@@ -0,0 +1,167 @@
+#include <math.h>
+#include <stdlib.h>
+#include "fft.h"
+
+bool fft_init(fft_t *fft, const uint32_t size) {
+    *fft = (fft_t) {0};
+    if (size < 4 || (size & (size - 1)) != 0) return false;
+
+    const uint32_t half = size / 2;
+    fft->size = size;
+    fft->half = half;
+    fft->bitrev = calloc(half, sizeof(uint32_t));
+    fft->cos = calloc(half, sizeof(float));
+    fft->sin = calloc(half, sizeof(float));
+    fft->post_cos = calloc(half, sizeof(float));
+    fft->post_sin = calloc(half, sizeof(float));
+    fft->re = calloc(half, sizeof(float));
+    fft->im = calloc(half, sizeof(float));
+    if (!fft->bitrev || !fft->cos || !fft->sin || !fft->post_cos || !fft->post_sin || !fft->re || !fft->im) {
+        fft_clear(fft);
+        return false;
+    }
+
+    uint32_t bits = 0;
+    while ((1u << bits) < half) bits++;
+    for (uint32_t i = 0; i < half; i++) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            if (i & (1u << b)) r |= 1u << (bits - 1 - b);
+        }
+        fft->bitrev[i] = r;
+    }
+    // Contiguous per stage, so the butterflies of a stage read them in order
+    for (uint32_t len = 2; len <= half; len <<= 1) {
+        for (uint32_t j = 0; j < len / 2; j++) {
+            fft->cos[len / 2 - 1 + j] = (float) cos(2.0 * M_PI * j / len);
+            fft->sin[len / 2 - 1 + j] = (float) sin(2.0 * M_PI * j / len);
+        }
+    }
+    for (uint32_t i = 0; i < half; i++) {
+        fft->post_cos[i] = (float) cos(2.0 * M_PI * i / size);
+        fft->post_sin[i] = (float) sin(2.0 * M_PI * i / size);
+    }
+    return true;
+}
+
+void fft_clear(fft_t *fft) {
+    free(fft->bitrev);
+    free(fft->cos);
+    free(fft->sin);
+    free(fft->post_cos);
+    free(fft->post_sin);
+    free(fft->re);
+    free(fft->im);
+    *fft = (fft_t) {0};
+}
+
+// In place radix 2 over the scratch, already in bit reversed order. sign is
+// -1 forward and 1 inverse.
+static void transform(const fft_t *fft, const float sign) {
+    float *restrict re = fft->re;
+    float *restrict im = fft->im;
+    const uint32_t n = fft->half;
+
+    // The first two stages at once, their twiddles are 1 and -i or i
+    if (n == 2) {
+        const float r = re[1], m = im[1];
+        re[1] = re[0] - r;
+        im[1] = im[0] - m;
+        re[0] += r;
+        im[0] += m;
+        return;
+    }
+    for (uint32_t i = 0; i < n; i += 4) {
+        const float r0 = re[i] + re[i + 1], i0 = im[i] + im[i + 1];
+        const float r1 = re[i] - re[i + 1], i1 = im[i] - im[i + 1];
+        const float r2 = re[i + 2] + re[i + 3], i2 = im[i + 2] + im[i + 3];
+        const float r3 = re[i + 2] - re[i + 3], i3 = im[i + 2] - im[i + 3];
+        const float tr = -sign * i3, ti = sign * r3;
+        re[i] = r0 + r2;
+        im[i] = i0 + i2;
+        re[i + 2] = r0 - r2;
+        im[i + 2] = i0 - i2;
+        re[i + 1] = r1 + tr;
+        im[i + 1] = i1 + ti;
+        re[i + 3] = r1 - tr;
+        im[i + 3] = i1 - ti;
+    }
+
+    for (uint32_t len = 8; len <= n; len <<= 1) {
+        const uint32_t mid = len / 2;
+        const float *restrict cs = fft->cos + mid - 1;
+        const float *restrict sn = fft->sin + mid - 1;
+        for (uint32_t i = 0; i < n; i += len) {
+            float *restrict ur = re + i, *restrict ui = im + i;
+            float *restrict vr = re + i + mid, *restrict vi = im + i + mid;
+            for (uint32_t j = 0; j < mid; j++) {
+                const float wr = cs[j];
+                const float wi = sign * sn[j];
+                const float tr = vr[j] * wr - vi[j] * wi;
+                const float ti = vr[j] * wi + vi[j] * wr;
+                vr[j] = ur[j] - tr;
+                vi[j] = ui[j] - ti;
+                ur[j] += tr;
+                ui[j] += ti;
+            }
+        }
+    }
+}
+
+void fft_forward(fft_t *fft, const float *in, float *re, float *im) {
+    const uint32_t n = fft->half;
+
+    // Even frames as real parts, odd ones as imaginary parts
+    for (uint32_t i = 0; i < n; i++) {
+        const uint32_t r = fft->bitrev[i];
+        fft->re[r] = in[2 * i];
+        fft->im[r] = in[2 * i + 1];
+    }
+    transform(fft, -1.0f);
+
+    // Split the spectra of the even and odd frames and join them
+    re[0] = fft->re[0] + fft->im[0];
+    im[0] = 0.0f;
+    re[n] = fft->re[0] - fft->im[0];
+    im[n] = 0.0f;
+    for (uint32_t k = 1; k < n; k++) {
+        const float ar = fft->re[k], ai = fft->im[k];
+        const float br = fft->re[n - k], bi = fft->im[n - k];
+        const float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+        const float or = 0.5f * (ai + bi), oi = -0.5f * (ar - br);
+        const float c = fft->post_cos[k], s = fft->post_sin[k];
+        re[k] = er + c * or + s * oi;
+        im[k] = ei + c * oi - s * or;
+    }
+}
+
+void fft_inverse(fft_t *fft, const float *re, const float *im, float *out) {
+    const uint32_t n = fft->half;
+
+    for (uint32_t k = 0; k < n; k++) {
+        const float ar = re[k], ai = im[k];
+        const float br = re[n - k], bi = im[n - k];
+        const float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+        const float tr = 0.5f * (ar - br), ti = 0.5f * (ai + bi);
+        const float c = fft->post_cos[k], s = fft->post_sin[k];
+        const float or = tr * c - ti * s, oi = tr * s + ti * c;
+        const uint32_t r = fft->bitrev[k];
+        fft->re[r] = er - oi;
+        fft->im[r] = ei + or;
+    }
+    transform(fft, 1.0f);
+
+    for (uint32_t i = 0; i < n; i++) {
+        out[2 * i] = fft->re[i];
+        out[2 * i + 1] = fft->im[i];
+    }
+}
+
+void fft_multiply_add(const float *restrict a_re, const float *restrict a_im,
+                      const float *restrict b_re, const float *restrict b_im,
+                      float *restrict acc_re, float *restrict acc_im, const uint32_t bins) {
+    for (uint32_t k = 0; k < bins; k++) {
+        acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+        acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+    }
+}
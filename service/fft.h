@@ -0,0 +1,37 @@
+#ifndef ASYNC_AUDIO_PLAYER_FFT_H
+#define ASYNC_AUDIO_PLAYER_FFT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Real FFT of a power of two size, done as a complex FFT of half the size.
+// Spectra are split into real and imaginary arrays of size / 2 + 1 bins so
+// products over bins run as plain float loops.
+typedef struct {
+    uint32_t size;           // Real frames
+    uint32_t half;           // Complex points of the inner FFT
+    uint32_t *bitrev;        // half entries
+    float *cos;              // Inner twiddles stage by stage, a stage of len
+    float *sin;              // points starting at len / 2 - 1
+    float *post_cos;         // Twiddles splitting the halves, half entries
+    float *post_sin;
+    float *re;               // Scratch of half points
+    float *im;
+} fft_t;
+
+// Tables for a real FFT of size frames, at least 4
+bool fft_init(fft_t *fft, uint32_t size);
+
+void fft_clear(fft_t *fft);
+
+// size frames of in to size / 2 + 1 bins
+void fft_forward(fft_t *fft, const float *in, float *re, float *im);
+
+// size / 2 + 1 bins back to size frames, scaled by size / 2
+void fft_inverse(fft_t *fft, const float *re, const float *im, float *out);
+
+// Multiply two spectra bin by bin and add onto acc
+void fft_multiply_add(const float *a_re, const float *a_im, const float *b_re, const float *b_im,
+                      float *acc_re, float *acc_im, uint32_t bins);
+
+#endif // ASYNC_AUDIO_PLAYER_FFT_H
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spa/param/audio/dsp.h>
+#include "filter_engine.h"
+#include "log.h"
+
+#define PORT_NAME_MAX 64
+
+// Port user data, allocated by the filter together with the port
+struct filter_port {
+    char name[PORT_NAME_MAX];
+};
+
+// Ports of one mixer on the filter node
+typedef struct {
+    mixer_t *mixer;
+    uint32_t n_ports;                            // Ports added so far
+    uint32_t rt_ports;                           // Ports the process thread renders
+    struct filter_port *ports[MIXER_MAX_CHANNELS];
+    struct pw_proxy *links[MIXER_MAX_CHANNELS];
+    uint32_t node_id;                            // Device linked to, SPA_ID_INVALID if none
+} engine_bus_t;
+
+struct filter_engine {
+    struct pw_core *core;
+    struct pw_loop *data_loop;
+    device_registry_t *registry;
+
+    struct pw_filter *filter;
+    struct spa_hook filter_listener;
+    uint32_t node_id;
+    bool running;
+
+    engine_bus_t *buses;
+    int n_buses;
+
+    // Rendered into when a port has no buffer this cycle
+    float scratch[MIXER_MAX_FRAMES];
+};
+
+static void on_filter_process(void *userdata, struct spa_io_position *position) {
+    filter_engine_t *e = userdata;
+    float *out[MIXER_MAX_CHANNELS];
+
+    uint32_t n_frames = position ? (uint32_t) position->clock.duration : MIXER_BLOCK_FRAMES;
+    n_frames = SPA_MIN(n_frames, MIXER_MAX_FRAMES);
+
+    for (int i = 0; i < e->n_buses; i++) {
+        engine_bus_t *bus = &e->buses[i];
+        if (bus->rt_ports == 0) continue;
+
+        // The filter follows the graph rate and clock, so does the bus
+        if (position) {
+            mixer_set_rate(bus->mixer, position->clock.rate.denom);
+            bus->mixer->clock_ns = position->clock.nsec;
+        }
+
+        for (uint32_t c = 0; c < bus->rt_ports; c++) {
+            float *buf = pw_filter_get_dsp_buffer(bus->ports[c], n_frames);
+            out[c] = buf ? buf : e->scratch;
+        }
+        mixer_render(bus->mixer, out, n_frames);
+    }
+}
+
+static void link_bus(filter_engine_t *e, engine_bus_t *bus) {
+    if (e->node_id == SPA_ID_INVALID || bus->node_id == SPA_ID_INVALID) return;
+
+    for (uint32_t c = 0; c < bus->n_ports; c++) {
+        // Both ends have to be in the registry, the rest follows on ports_changed
+        const device_port_t *out = device_registry_find_output_port(e->registry, e->node_id, bus->ports[c]->name);
+        const device_port_t *in = device_registry_find_port(e->registry, bus->node_id, bus->mixer->channel_names[c]);
+        if (!out || !in) {
+            // A port went away and took the link with it
+            if (bus->links[c]) {
+                pw_proxy_destroy(bus->links[c]);
+                bus->links[c] = NULL;
+            }
+            continue;
+        }
+        if (bus->links[c]) continue;
+
+        struct pw_properties *props = pw_properties_new(PW_KEY_OBJECT_LINGER, "false", NULL);
+        if (!props) continue;
+        pw_properties_setf(props, PW_KEY_LINK_OUTPUT_NODE, "%u", e->node_id);
+        pw_properties_setf(props, PW_KEY_LINK_OUTPUT_PORT, "%u", out->id);
+        pw_properties_setf(props, PW_KEY_LINK_INPUT_NODE, "%u", bus->node_id);
+        pw_properties_setf(props, PW_KEY_LINK_INPUT_PORT, "%u", in->id);
+
+        bus->links[c] = pw_core_create_object(e->core, "link-factory", PW_TYPE_INTERFACE_Link,
+                                              PW_VERSION_LINK, &props->dict, 0);
+        pw_properties_free(props);
+
+        if (!bus->links[c]) {
+            log_warn("Failed to link %s to %s", bus->ports[c]->name, in->name);
+        }
+    }
+}
+
+static void unlink_bus(engine_bus_t *bus) {
+    for (uint32_t c = 0; c < bus->n_ports; c++) {
+        if (bus->links[c]) {
+            pw_proxy_destroy(bus->links[c]);
+            bus->links[c] = NULL;
+        }
+    }
+}
+
+static void on_filter_state_changed(void *userdata, enum pw_filter_state old,
+                                    enum pw_filter_state state, const char *error) {
+    filter_engine_t *e = userdata;
+
+    log_debug("Filter state changed from %s to %s",
+              pw_filter_state_as_string(old), pw_filter_state_as_string(state));
+
+    switch (state) {
+        case PW_FILTER_STATE_ERROR:
+            log_error("Filter error: %s", error ? error : "Unknown error");
+            e->running = false;
+            break;
+        case PW_FILTER_STATE_PAUSED:
+        case PW_FILTER_STATE_STREAMING:
+            e->running = state == PW_FILTER_STATE_STREAMING;
+            if (e->node_id == SPA_ID_INVALID) {
+                e->node_id = pw_filter_get_node_id(e->filter);
+                device_registry_watch_ports(e->registry, e->node_id);
+                for (int i = 0; i < e->n_buses; i++) {
+                    link_bus(e, &e->buses[i]);
+                }
+            }
+            break;
+        case PW_FILTER_STATE_UNCONNECTED:
+            e->running = false;
+            e->node_id = SPA_ID_INVALID;
+            break;
+        default:
+            break;
+    }
+}
+
+static const struct pw_filter_events filter_events = {
+    PW_VERSION_FILTER_EVENTS,
+    .process = on_filter_process,
+    .state_changed = on_filter_state_changed,
+};
+
+filter_engine_t *filter_engine_new(struct pw_core *core, struct pw_loop *data_loop, const char *name,
+                                   device_registry_t *registry, mixer_t **mixers, const int n_mixers) {
+    filter_engine_t *e = calloc(1, sizeof(filter_engine_t));
+    if (!e) {
+        log_error("Failed to allocate filter engine");
+        return NULL;
+    }
+
+    e->core = core;
+    e->data_loop = data_loop;
+    e->registry = registry;
+    e->node_id = SPA_ID_INVALID;
+
+    e->buses = calloc(n_mixers > 0 ? n_mixers : 1, sizeof(engine_bus_t));
+    if (!e->buses) {
+        log_error("Failed to allocate filter buses");
+        free(e);
+        return NULL;
+    }
+    e->n_buses = n_mixers;
+    for (int i = 0; i < n_mixers; i++) {
+        e->buses[i].mixer = mixers[i];
+        e->buses[i].node_id = SPA_ID_INVALID;
+    }
+
+    struct pw_properties *props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio",
+        PW_KEY_MEDIA_CATEGORY, "Playback",
+        PW_KEY_MEDIA_ROLE, "Music",
+        PW_KEY_NODE_NAME, name,
+        PW_KEY_NODE_ALWAYS_PROCESS, "true",
+        NULL);
+    if (!props) {
+        log_error("Failed to create filter properties");
+        filter_engine_destroy(e);
+        return NULL;
+    }
+
+    pw_properties_setf(props, PW_KEY_NODE_DESCRIPTION, "%s output", name);
+
+    e->filter = pw_filter_new(core, name, props);
+    if (!e->filter) {
+        log_error("Failed to create filter");
+        filter_engine_destroy(e);
+        return NULL;
+    }
+
+    spa_zero(e->filter_listener);
+    pw_filter_add_listener(e->filter, &e->filter_listener, &filter_events, e);
+
+    if (pw_filter_connect(e->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0) < 0) {
+        log_error("Failed to connect filter");
+        filter_engine_destroy(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+void filter_engine_destroy(filter_engine_t *e) {
+    if (!e) return;
+
+    for (int i = 0; i < e->n_buses; i++) {
+        unlink_bus(&e->buses[i]);
+        if (e->buses[i].mixer) {
+            e->buses[i].mixer->target_id = SPA_ID_INVALID;
+        }
+    }
+    if (e->filter) {
+        spa_hook_remove(&e->filter_listener);
+        pw_filter_destroy(e->filter);
+    }
+    free(e->buses);
+    free(e);
+}
+
+static engine_bus_t *find_bus(filter_engine_t *e, const mixer_t *mixer) {
+    for (int i = 0; i < e->n_buses; i++) {
+        if (e->buses[i].mixer == mixer) {
+            return &e->buses[i];
+        }
+    }
+    return NULL;
+}
+
+static int do_publish_ports(struct spa_loop *loop, bool async, uint32_t seq,
+                            const void *data, size_t size, void *user_data) {
+    engine_bus_t *bus = user_data;
+
+    bus->rt_ports = bus->n_ports;
+    return 0;
+}
+
+// One DSP port per bus channel, named after the bus and its channel
+static bool add_ports(filter_engine_t *e, engine_bus_t *bus, const int index) {
+    const mixer_t *m = bus->mixer;
+
+    while (bus->n_ports < m->n_channels) {
+        const uint32_t c = bus->n_ports;
+
+        struct pw_properties *props = pw_properties_new(
+            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+            PW_KEY_AUDIO_CHANNEL, m->channel_names[c],
+            NULL);
+        if (!props) return false;
+        pw_properties_setf(props, PW_KEY_PORT_NAME, "bus%d_%u_%s", index, c, m->channel_names[c]);
+
+        struct filter_port *port = pw_filter_add_port(e->filter, PW_DIRECTION_OUTPUT,
+                                                      PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+                                                      sizeof(struct filter_port), props, NULL, 0);
+        if (!port) {
+            log_error("Failed to add filter port %u for %s", c, m->config->name);
+            return false;
+        }
+        snprintf(port->name, sizeof(port->name), "bus%d_%u_%s", index, c, m->channel_names[c]);
+
+        bus->ports[c] = port;
+        bus->n_ports++;
+    }
+
+    pw_loop_invoke(e->data_loop, do_publish_ports, 0, NULL, 0, true, bus);
+    return true;
+}
+
+bool filter_engine_attach(filter_engine_t *e, mixer_t *mixer, const device_node_t *node) {
+    engine_bus_t *bus = find_bus(e, mixer);
+    if (!bus) return false;
+
+    if (!mixer_set_layout(mixer, node, MIXER_MAX_CHANNELS) || !add_ports(e, bus, (int) (bus - e->buses))) {
+        return false;
+    }
+
+    unlink_bus(bus);
+    bus->node_id = node->id;
+    mixer->target_id = node->id;
+    link_bus(e, bus);
+
+    log_info("Filter bus for %s on %s (%u channels)", mixer->config->name, node->name, mixer->n_channels);
+    return true;
+}
+
+void filter_engine_detach(filter_engine_t *e, mixer_t *mixer) {
+    engine_bus_t *bus = find_bus(e, mixer);
+    if (!bus) return;
+
+    unlink_bus(bus);
+    bus->node_id = SPA_ID_INVALID;
+    mixer->target_id = SPA_ID_INVALID;
+}
+
+void filter_engine_relink(filter_engine_t *e, const uint32_t node_id) {
+    for (int i = 0; i < e->n_buses; i++) {
+        engine_bus_t *bus = &e->buses[i];
+        if (node_id == e->node_id || node_id == bus->node_id) {
+            link_bus(e, bus);
+        }
+    }
+}
+
+bool filter_engine_is_running(const filter_engine_t *e) {
+    return e && e->running;
+}
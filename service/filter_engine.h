@@ -0,0 +1,32 @@
+#ifndef ASYNC_AUDIO_PLAYER_FILTER_ENGINE_H
+#define ASYNC_AUDIO_PLAYER_FILTER_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pipewire/pipewire.h>
+#include "device_registry.h"
+#include "mixer.h"
+
+typedef struct filter_engine filter_engine_t;
+
+// Create a filter node on a connected core. Mixers are indexed like the
+// configured devices, NULL entries are skipped.
+filter_engine_t *filter_engine_new(struct pw_core *core, struct pw_loop *data_loop, const char *name,
+                                   device_registry_t *registry, mixer_t **mixers, int n_mixers);
+
+// Destroy the node with all its ports and links
+void filter_engine_destroy(filter_engine_t *engine);
+
+// Serve a mixer on a device node: adds a port per bus channel and links them
+bool filter_engine_attach(filter_engine_t *engine, mixer_t *mixer, const device_node_t *node);
+
+// Drop the links of a mixer whose device went away, its ports stay
+void filter_engine_detach(filter_engine_t *engine, mixer_t *mixer);
+
+// Link what is not linked yet, called when the ports of a node changed
+void filter_engine_relink(filter_engine_t *engine, uint32_t node_id);
+
+// True while the node is part of a running graph
+bool filter_engine_is_running(const filter_engine_t *engine);
+
+#endif // ASYNC_AUDIO_PLAYER_FILTER_ENGINE_H
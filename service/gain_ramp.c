@@ -0,0 +1,90 @@
+#include <math.h>
+#include <string.h>
+#include "gain_ramp.h"
+
+#define NSEC_PER_SEC 1000000000ull
+
+void gain_ramp_init(gain_ramp_t *ramp) {
+    ramp->gain = 1.0f;
+    ramp->target = 1.0f;
+    ramp->step = 0.0f;
+    ramp->n_events = 0;
+}
+
+void gain_ramp_set(gain_ramp_t *ramp, const float target, const uint32_t n_frames) {
+    ramp->target = target;
+    if (n_frames == 0 || ramp->gain == target) {
+        ramp->gain = target;
+        ramp->step = 0.0f;
+        return;
+    }
+
+    ramp->step = fabsf(target - ramp->gain) / (float) n_frames;
+}
+
+bool gain_ramp_is_unity(const gain_ramp_t *ramp) {
+    return ramp->gain == 1.0f && ramp->target == 1.0f;
+}
+
+bool gain_ramp_is_silent(const gain_ramp_t *ramp) {
+    return ramp->gain == 0.0f && ramp->target == 0.0f;
+}
+
+float gain_ramp_at(const gain_ramp_t *ramp, const uint32_t i) {
+    const float delta = ramp->step * (float) i;
+
+    if (ramp->gain < ramp->target) {
+        return ramp->gain + delta < ramp->target ? ramp->gain + delta : ramp->target;
+    }
+    return ramp->gain - delta > ramp->target ? ramp->gain - delta : ramp->target;
+}
+
+void gain_ramp_advance(gain_ramp_t *ramp, const uint32_t n_frames) {
+    ramp->gain = gain_ramp_at(ramp, n_frames);
+}
+
+void gain_ramp_apply(gain_ramp_t *ramp, float *frames, const uint32_t channels, const uint32_t n_frames) {
+    for (uint32_t i = 0; i < n_frames; i++) {
+        const float g = gain_ramp_at(ramp, i);
+        for (uint32_t c = 0; c < channels; c++) {
+            frames[i * channels + c] *= g;
+        }
+    }
+    gain_ramp_advance(ramp, n_frames);
+}
+
+bool gain_ramp_schedule(gain_ramp_t *ramp, const uint64_t at_ns, const float target, const uint32_t n_frames) {
+    if (ramp->n_events == GAIN_RAMP_MAX_EVENTS) return false;
+
+    // Changes due at the same time keep the order they were queued in
+    uint32_t i = ramp->n_events;
+    while (i > 0 && ramp->events[i - 1].at_ns > at_ns) i--;
+    memmove(&ramp->events[i + 1], &ramp->events[i], (ramp->n_events - i) * sizeof(gain_event_t));
+    ramp->events[i] = (gain_event_t) {.at_ns = at_ns, .target = target, .n_frames = n_frames};
+    ramp->n_events++;
+    return true;
+}
+
+uint32_t gain_ramp_next_event(const gain_ramp_t *ramp, const uint64_t now_ns, const uint32_t rate,
+                              const uint32_t max_frames) {
+    if (ramp->n_events == 0) return max_frames;
+
+    const uint64_t at_ns = ramp->events[0].at_ns;
+    if (at_ns <= now_ns) return 0;
+
+    // Anything further out than a second is beyond this cycle anyway
+    const uint64_t delta = at_ns - now_ns;
+    if (delta >= NSEC_PER_SEC) return max_frames;
+
+    const uint64_t frames = (delta * rate + NSEC_PER_SEC - 1) / NSEC_PER_SEC;
+    return frames < max_frames ? (uint32_t) frames : max_frames;
+}
+
+void gain_ramp_fire(gain_ramp_t *ramp) {
+    if (ramp->n_events == 0) return;
+
+    const gain_event_t event = ramp->events[0];
+    ramp->n_events--;
+    memmove(&ramp->events[0], &ramp->events[1], ramp->n_events * sizeof(gain_event_t));
+    gain_ramp_set(ramp, event.target, event.n_frames);
+}
@@ -0,0 +1,58 @@
+#ifndef ASYNC_AUDIO_PLAYER_GAIN_RAMP_H
+#define ASYNC_AUDIO_PLAYER_GAIN_RAMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GAIN_RAMP_MAX_EVENTS 8
+
+// Change of level due at a time on the graph clock
+typedef struct {
+    uint64_t at_ns;
+    float target;
+    uint32_t n_frames;   // Fade length, 0 to jump
+} gain_event_t;
+
+// Linear fade between levels, used on pause, resume and cues. Owned by the
+// process thread of the track it belongs to.
+typedef struct {
+    float gain;      // Gain of the next frame
+    float target;
+    float step;      // Change per frame towards target
+
+    // Scheduled changes, earliest first
+    gain_event_t events[GAIN_RAMP_MAX_EVENTS];
+    uint32_t n_events;
+} gain_ramp_t;
+
+// Settle at full level
+void gain_ramp_init(gain_ramp_t *ramp);
+
+// Head for target over n_frames, 0 to get there at once
+void gain_ramp_set(gain_ramp_t *ramp, float target, uint32_t n_frames);
+
+// Settled at full level, frames pass unchanged
+bool gain_ramp_is_unity(const gain_ramp_t *ramp);
+
+// Settled at silence
+bool gain_ramp_is_silent(const gain_ramp_t *ramp);
+
+// Gain of frame i counted from the next one
+float gain_ramp_at(const gain_ramp_t *ramp, uint32_t i);
+
+// Move past n_frames
+void gain_ramp_advance(gain_ramp_t *ramp, uint32_t n_frames);
+
+// Scale interleaved frames and move past them
+void gain_ramp_apply(gain_ramp_t *ramp, float *frames, uint32_t channels, uint32_t n_frames);
+
+// Queue a change at at_ns, false when the queue is full
+bool gain_ramp_schedule(gain_ramp_t *ramp, uint64_t at_ns, float target, uint32_t n_frames);
+
+// Frames at rate from now_ns until the next change is due, at most max_frames
+uint32_t gain_ramp_next_event(const gain_ramp_t *ramp, uint64_t now_ns, uint32_t rate, uint32_t max_frames);
+
+// Start the earliest queued change
+void gain_ramp_fire(gain_ramp_t *ramp);
+
+#endif // ASYNC_AUDIO_PLAYER_GAIN_RAMP_H
@@ -0,0 +1,317 @@
+#include <math.h>
+#include <string.h>
+#include "insert_chain.h"
+
+static const struct {
+    const char *name;
+    insert_type_t type;
+} insert_names[] = {
+    {"peaking", INSERT_PEAKING},
+    {"low_shelf", INSERT_LOW_SHELF},
+    {"high_shelf", INSERT_HIGH_SHELF},
+    {"lowpass", INSERT_LOWPASS},
+    {"highpass", INSERT_HIGHPASS},
+    {"dc_blocker", INSERT_DC_BLOCKER},
+    {"limiter", INSERT_LIMITER},
+};
+
+bool insert_parse_type(const char *name, insert_type_t *type) {
+    for (size_t i = 0; i < sizeof(insert_names) / sizeof(insert_names[0]); i++) {
+        if (strcmp(name, insert_names[i].name) == 0) {
+            *type = insert_names[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_filter(const insert_type_t type) {
+    return type != INSERT_DC_BLOCKER && type != INSERT_LIMITER;
+}
+
+static uint32_t lookahead_frames(const insert_config_t *config, const uint32_t rate) {
+    return SPA_MAX((uint32_t) (config->lookahead * 1e-3f * (float) rate), 1u);
+}
+
+// Audio EQ cookbook, normalised by a0
+static biquad_t biquad_for(const insert_config_t *config, const uint32_t rate) {
+    const double f = fmin(fmax(config->frequency, 1.0), 0.49 * rate);
+    const double q = config->q > 0.0f ? config->q : INSERT_DEFAULT_Q;
+    const double w0 = 2.0 * M_PI * f / rate;
+    const double cw = cos(w0);
+    const double alpha = sin(w0) / (2.0 * q);
+    const double a = pow(10.0, config->gain / 40.0);
+    const double sa = 2.0 * sqrt(a) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (config->type) {
+        case INSERT_LOW_SHELF:
+            b0 = a * ((a + 1) - (a - 1) * cw + sa);
+            b1 = 2 * a * ((a - 1) - (a + 1) * cw);
+            b2 = a * ((a + 1) - (a - 1) * cw - sa);
+            a0 = (a + 1) + (a - 1) * cw + sa;
+            a1 = -2 * ((a - 1) + (a + 1) * cw);
+            a2 = (a + 1) + (a - 1) * cw - sa;
+            break;
+        case INSERT_HIGH_SHELF:
+            b0 = a * ((a + 1) + (a - 1) * cw + sa);
+            b1 = -2 * a * ((a - 1) + (a + 1) * cw);
+            b2 = a * ((a + 1) + (a - 1) * cw - sa);
+            a0 = (a + 1) - (a - 1) * cw + sa;
+            a1 = 2 * ((a - 1) - (a + 1) * cw);
+            a2 = (a + 1) - (a - 1) * cw - sa;
+            break;
+        case INSERT_LOWPASS:
+            b0 = (1 - cw) / 2;
+            b1 = 1 - cw;
+            b2 = (1 - cw) / 2;
+            a0 = 1 + alpha;
+            a1 = -2 * cw;
+            a2 = 1 - alpha;
+            break;
+        case INSERT_HIGHPASS:
+            b0 = (1 + cw) / 2;
+            b1 = -(1 + cw);
+            b2 = (1 + cw) / 2;
+            a0 = 1 + alpha;
+            a1 = -2 * cw;
+            a2 = 1 - alpha;
+            break;
+        default:
+            b0 = 1 + alpha * a;
+            b1 = -2 * cw;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * cw;
+            a2 = 1 - alpha / a;
+            break;
+    }
+
+    return (biquad_t) {
+        .b0 = (float) (b0 / a0), .b1 = (float) (b1 / a0), .b2 = (float) (b2 / a0),
+        .a1 = (float) (a1 / a0), .a2 = (float) (a2 / a0)
+    };
+}
+
+// Work a stage out for the rate of its chain, no allocation
+static void tune_stage(insert_stage_t *stage, const uint32_t rate) {
+    const insert_config_t *config = &stage->config;
+
+    if (is_filter(config->type)) {
+        stage->coeffs = biquad_for(config, rate);
+    } else if (config->type == INSERT_DC_BLOCKER) {
+        stage->coeffs.a1 = 1.0f - 2.0f * (float) M_PI * INSERT_DC_CORNER / (float) rate;
+    } else if (stage->limiter) {
+        limiter_t *l = stage->limiter;
+        l->threshold = powf(10.0f, config->threshold / 20.0f);
+        l->release = expf(-1.0f / (config->release * 1e-3f * (float) rate));
+        l->lookahead = SPA_MIN(lookahead_frames(config, rate), l->capacity);
+    }
+}
+
+size_t insert_chain_arena_size(const insert_config_t *inserts, const int count, const uint32_t channels,
+                               const uint32_t max_rate) {
+    size_t size = ARENA_SIZE(sizeof(insert_chain_t)) + ARENA_SIZE(count * sizeof(insert_stage_t));
+
+    for (int i = 0; i < count; i++) {
+        if (inserts[i].type != INSERT_LIMITER) {
+            size += 2 * ARENA_SIZE(channels * sizeof(float));
+            continue;
+        }
+        const uint32_t capacity = lookahead_frames(&inserts[i], max_rate);
+        size += ARENA_SIZE(sizeof(limiter_t)) +
+                ARENA_SIZE((size_t) capacity * channels * sizeof(float)) +
+                ARENA_SIZE(capacity * sizeof(float)) +
+                ARENA_SIZE((capacity + 1) * sizeof(float)) +
+                ARENA_SIZE((capacity + 1) * sizeof(uint32_t));
+    }
+    return size;
+}
+
+insert_chain_t *insert_chain_new(arena_t *arena, const insert_config_t *inserts, const int count,
+                                 const uint32_t channels, const uint32_t rate, const uint32_t max_rate) {
+    insert_chain_t *chain = arena_alloc(arena, sizeof(insert_chain_t));
+    if (!chain) return NULL;
+
+    chain->stages = arena_alloc(arena, count * sizeof(insert_stage_t));
+    if (!chain->stages) return NULL;
+    chain->channels = channels;
+    chain->rate = rate;
+    chain->n_stages = (uint32_t) count;
+
+    for (int i = 0; i < count; i++) {
+        insert_stage_t *stage = &chain->stages[i];
+        stage->config = inserts[i];
+
+        if (inserts[i].type != INSERT_LIMITER) {
+            stage->s1 = arena_alloc(arena, channels * sizeof(float));
+            stage->s2 = arena_alloc(arena, channels * sizeof(float));
+            if (!stage->s1 || !stage->s2) return NULL;
+        } else {
+            const uint32_t capacity = lookahead_frames(&inserts[i], max_rate);
+            limiter_t *l = arena_alloc(arena, sizeof(limiter_t));
+            if (!l) return NULL;
+            l->capacity = capacity;
+            l->delay = arena_alloc(arena, (size_t) capacity * channels * sizeof(float));
+            l->box = arena_alloc(arena, capacity * sizeof(float));
+            l->hold_value = arena_alloc(arena, (capacity + 1) * sizeof(float));
+            l->hold_at = arena_alloc(arena, (capacity + 1) * sizeof(uint32_t));
+            if (!l->delay || !l->box || !l->hold_value || !l->hold_at) return NULL;
+            stage->limiter = l;
+        }
+        tune_stage(stage, rate);
+    }
+
+    insert_chain_reset(chain);
+    return chain;
+}
+
+static void reset_limiter(limiter_t *l, const uint32_t channels) {
+    memset(l->delay, 0, (size_t) l->capacity * channels * sizeof(float));
+    for (uint32_t i = 0; i < l->capacity; i++) {
+        l->box[i] = 1.0f;
+    }
+    l->box_sum = l->lookahead;
+    l->hold_head = 0;
+    l->hold_len = 0;
+    l->pos = 0;
+    l->frame = 0;
+    l->gain = 1.0f;
+}
+
+void insert_chain_reset(insert_chain_t *chain) {
+    for (uint32_t i = 0; i < chain->n_stages; i++) {
+        insert_stage_t *stage = &chain->stages[i];
+        if (stage->limiter) {
+            reset_limiter(stage->limiter, chain->channels);
+        } else {
+            memset(stage->s1, 0, chain->channels * sizeof(float));
+            memset(stage->s2, 0, chain->channels * sizeof(float));
+        }
+    }
+}
+
+void insert_chain_set_rate(insert_chain_t *chain, const uint32_t rate) {
+    if (rate == 0 || rate == chain->rate) return;
+
+    chain->rate = rate;
+    for (uint32_t i = 0; i < chain->n_stages; i++) {
+        tune_stage(&chain->stages[i], rate);
+    }
+    insert_chain_reset(chain);
+}
+
+bool insert_chain_prepare(const insert_chain_t *chain, const uint32_t index, const insert_config_t *config,
+                          insert_tuning_t *tuning) {
+    if (index >= chain->n_stages || !is_filter(chain->stages[index].config.type)) return false;
+
+    tuning->index = index;
+    tuning->config = chain->stages[index].config;
+    tuning->config.frequency = config->frequency;
+    tuning->config.gain = config->gain;
+    tuning->config.q = config->q;
+    tuning->coeffs = biquad_for(&tuning->config, chain->rate);
+    return true;
+}
+
+void insert_chain_apply(insert_chain_t *chain, const insert_tuning_t *tuning) {
+    insert_stage_t *stage = &chain->stages[tuning->index];
+    stage->config = tuning->config;
+    stage->coeffs = tuning->coeffs;
+}
+
+// Frames outer and channels inner, every channel of a frame goes through
+// the same coefficients side by side, a lane each
+static void run_biquad(insert_stage_t *stage, float *frames, const uint32_t channels, const uint32_t n) {
+    const biquad_t k = stage->coeffs;
+    float *restrict s1 = stage->s1;
+    float *restrict s2 = stage->s2;
+
+    for (uint32_t i = 0; i < n; i++) {
+        float *restrict x = frames + (size_t) i * channels;
+        for (uint32_t c = 0; c < channels; c++) {
+            const float in = x[c];
+            const float y = k.b0 * in + s1[c];
+            s1[c] = k.b1 * in - k.a1 * y + s2[c];
+            s2[c] = k.b2 * in - k.a2 * y;
+            x[c] = y;
+        }
+    }
+}
+
+static void run_dc_blocker(insert_stage_t *stage, float *frames, const uint32_t channels, const uint32_t n) {
+    const float r = stage->coeffs.a1;
+    float *restrict last_in = stage->s1;
+    float *restrict last_out = stage->s2;
+
+    for (uint32_t i = 0; i < n; i++) {
+        float *restrict x = frames + (size_t) i * channels;
+        for (uint32_t c = 0; c < channels; c++) {
+            const float y = x[c] - last_in[c] + r * last_out[c];
+            last_in[c] = x[c];
+            last_out[c] = y;
+            x[c] = y;
+        }
+    }
+}
+
+static void run_limiter(limiter_t *l, float *frames, const uint32_t channels, const uint32_t n) {
+    const uint32_t window = l->lookahead + 1;
+    const uint32_t ring = l->capacity + 1;
+
+    for (uint32_t i = 0; i < n; i++, l->frame++) {
+        float *restrict x = frames + (size_t) i * channels;
+
+        float peak = 0.0f;
+        for (uint32_t c = 0; c < channels; c++) {
+            peak = fmaxf(peak, fabsf(x[c]));
+        }
+        const float wanted = peak > l->threshold ? l->threshold / peak : 1.0f;
+
+        // Lowest gain wanted within the lookahead, kept as a rising queue
+        while (l->hold_len > 0 && l->hold_value[(l->hold_head + l->hold_len - 1) % ring] >= wanted) {
+            l->hold_len--;
+        }
+        l->hold_value[(l->hold_head + l->hold_len) % ring] = wanted;
+        l->hold_at[(l->hold_head + l->hold_len) % ring] = l->frame;
+        l->hold_len++;
+        while (l->frame - l->hold_at[l->hold_head] >= window) {
+            l->hold_head = (l->hold_head + 1) % ring;
+            l->hold_len--;
+        }
+        const float held = l->hold_value[l->hold_head];
+
+        // Down at once, the lookahead smooths it, back up on the release
+        l->gain = held < l->gain ? held : held + (l->gain - held) * l->release;
+
+        // Averaged over the lookahead, so the gain is down in time and ramps
+        l->box_sum += l->gain - l->box[l->pos];
+        l->box[l->pos] = l->gain;
+        const float gain = (float) (l->box_sum / l->lookahead);
+
+        float *restrict delayed = l->delay + (size_t) l->pos * channels;
+        for (uint32_t c = 0; c < channels; c++) {
+            const float in = x[c];
+            x[c] = delayed[c] * gain;
+            delayed[c] = in;
+        }
+        l->pos = l->pos + 1 == l->lookahead ? 0 : l->pos + 1;
+    }
+}
+
+void insert_chain_process(insert_chain_t *chain, float *frames, const uint32_t n) {
+    for (uint32_t i = 0; i < chain->n_stages; i++) {
+        insert_stage_t *stage = &chain->stages[i];
+        switch (stage->config.type) {
+            case INSERT_DC_BLOCKER:
+                run_dc_blocker(stage, frames, chain->channels, n);
+                break;
+            case INSERT_LIMITER:
+                run_limiter(stage->limiter, frames, chain->channels, n);
+                break;
+            default:
+                run_biquad(stage, frames, chain->channels, n);
+                break;
+        }
+    }
+}
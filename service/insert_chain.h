@@ -0,0 +1,93 @@
+#ifndef ASYNC_AUDIO_PLAYER_INSERT_CHAIN_H
+#define ASYNC_AUDIO_PLAYER_INSERT_CHAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+#include "arena.h"
+
+// Corner of the DC blocker, Hz
+#define INSERT_DC_CORNER 5.0f
+
+#define INSERT_DEFAULT_Q 0.7071f
+#define INSERT_DEFAULT_LOOKAHEAD_MS 1.5f
+#define INSERT_DEFAULT_RELEASE_MS 50.0f
+
+// Normalised biquad, transposed direct form II
+typedef struct {
+    float b0, b1, b2;
+    float a1, a2;
+} biquad_t;
+
+// Look-ahead peak limiter linked over all channels. The gain reaches what
+// the loudest frame needs by the time that frame leaves the delay.
+typedef struct {
+    float threshold;     // Linear
+    float release;       // Coefficient per frame
+    uint32_t lookahead;  // Frames, the latency it adds
+    uint32_t capacity;   // Longest lookahead the storage holds
+    float *delay;        // capacity frames of every channel
+    float *box;          // Held gains averaged over the lookahead
+    double box_sum;
+    float *hold_value;   // Gains still to leave the hold window, rising
+    uint32_t *hold_at;
+    uint32_t hold_head;
+    uint32_t hold_len;
+    uint32_t pos;        // Frame of delay and box written next
+    uint32_t frame;
+    float gain;          // After release
+} limiter_t;
+
+typedef struct {
+    insert_config_t config;
+    biquad_t coeffs;
+    float *s1;           // Per channel, biquad state or the last input of the DC blocker
+    float *s2;           // Per channel, biquad state or the last output of the DC blocker
+    limiter_t *limiter;
+} insert_stage_t;
+
+// Inserts of a track or a device bus on interleaved frames. Carved from an
+// arena at load, coefficients are worked out on the main loop and handed
+// over, the process thread runs it.
+typedef struct insert_chain {
+    uint32_t channels;
+    uint32_t rate;
+    insert_stage_t *stages;
+    uint32_t n_stages;
+} insert_chain_t;
+
+// New coefficients for one stage, worked out off the process thread
+typedef struct {
+    uint32_t index;
+    insert_config_t config;
+    biquad_t coeffs;
+} insert_tuning_t;
+
+// Parse "peaking", "low_shelf", "high_shelf", "lowpass", "highpass",
+// "dc_blocker" or "limiter"
+bool insert_parse_type(const char *name, insert_type_t *type);
+
+// Arena a chain takes, its limiters sized for rates up to max_rate
+size_t insert_chain_arena_size(const insert_config_t *inserts, int count, uint32_t channels, uint32_t max_rate);
+
+insert_chain_t *insert_chain_new(arena_t *arena, const insert_config_t *inserts, int count,
+                                 uint32_t channels, uint32_t rate, uint32_t max_rate);
+
+// Forget what went through, before the chain runs on something new
+void insert_chain_reset(insert_chain_t *chain);
+
+// Work every stage out again for a new rate, safe on the process thread
+void insert_chain_set_rate(insert_chain_t *chain, uint32_t rate);
+
+// Retune filter stage index to config. False when it is not a filter.
+bool insert_chain_prepare(const insert_chain_t *chain, uint32_t index, const insert_config_t *config,
+                          insert_tuning_t *tuning);
+
+// Take a tuning over, from the process thread
+void insert_chain_apply(insert_chain_t *chain, const insert_tuning_t *tuning);
+
+// Run n interleaved frames through the chain in place
+void insert_chain_process(insert_chain_t *chain, float *frames, uint32_t n);
+
+#endif // ASYNC_AUDIO_PLAYER_INSERT_CHAIN_H
@@ -0,0 +1,1349 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/builder.h>
+#include "mixer.h"
+#include "track_manager.h"
+#include "track_desc.h"
+#include "playlist.h"
+#include "tempo_grid.h"
+#include "track_reader.h"
+#include "trajectory.h"
+#include "log.h"
+
+#define MIXER_DEFAULT_RATE 48000
+#define MIXER_DEFAULT_QUANTUM 256
+// Above the ALSA nodes and the dummy driver, so the node it targets does not
+// keep the graph
+#define MIXER_DEFAULT_DRIVER_PRIORITY 30000
+
+_Static_assert(MIXER_BLOCK_FRAMES <= TRACK_BLOCK_FRAMES, "a mixer block must fit the scratch of a track");
+_Static_assert(MIXER_BLOCK_FRAMES <= AMBISONIC_BLOCK_FRAMES, "a mixer block must fit the scratch of an ambisonic stream");
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * SPA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+// Graph time of a frame, half a frame early so rounding on either side lands
+// a change scheduled for it on that very frame
+static uint64_t frame_time_ns(const uint64_t clock_ns, const uint64_t frame, const uint32_t rate) {
+    if (frame == 0) return clock_ns;
+    return clock_ns + (frame * SPA_NSEC_PER_SEC - SPA_NSEC_PER_SEC / 2) / rate;
+}
+
+// Make sure an unread source frame is buffered, false once the file ended
+static bool voice_fill(mixer_voice_t *v) {
+    if (v->frames_pos < v->frames_len) return true;
+    if (v->finished) return false;
+
+    track_instance_t *track = v->track;
+    v->frames_len = track_read(track, v->frames, MIXER_BLOCK_FRAMES);
+    v->frames_pos = 0;
+    if (v->frames_len == 0) {
+        v->finished = true;
+        return false;
+    }
+    return true;
+}
+
+// Speaker gains of a panned voice for a source at position, per route
+static void voice_pan_gains(const mixer_t *m, const mixer_voice_t *v, const pan_position_t *position,
+                            uint32_t *set, float *targets) {
+    float gains[PANNER_MAX_SPEAKERS];
+
+    panner_gains(&m->panner, position, set, gains);
+    for (uint32_t r = 0; r < v->n_routes; r++) {
+        targets[r] = gains[v->route_src[r]];
+    }
+}
+
+// Add the mono block of a panned voice onto its speakers. Gains glide from
+// where the last block left them to their targets across this one.
+static void pan_block(mixer_voice_t *v, float *const *out, const uint32_t offset, const uint32_t n) {
+    const float *restrict mono = v->mono;
+
+    for (uint32_t r = 0; r < v->n_routes; r++) {
+        float *restrict dst = out[v->route_dst[r]] + offset;
+        const float from = v->pan_gain[r];
+        const float to = v->pan_target[r];
+
+        if (from == to) {
+            if (to == 0.0f) continue;
+            for (uint32_t i = 0; i < n; i++) {
+                dst[i] += mono[i] * to;
+            }
+        } else {
+            const float slope = (to - from) / (float) n;
+            for (uint32_t i = 0; i < n; i++) {
+                dst[i] += mono[i] * (from + slope * (float) i);
+            }
+            v->pan_gain[r] = to;
+        }
+    }
+}
+
+// Rotate the planar block of an ambisonic voice and decode it onto the
+// speakers, one row of the decoder per speaker
+static void decode_block(mixer_voice_t *v, float *const *out, const uint32_t offset, const uint32_t n) {
+    ambisonic_rotate(v->ambisonic, n);
+    for (uint32_t r = 0; r < v->n_routes; r++) {
+        ambisonic_decode(v->ambisonic, v->decoder + (size_t) v->route_src[r] * AMBISONIC_MAX_CHANNELS,
+                         out[v->route_dst[r]] + offset, n);
+    }
+}
+
+// Same rate: add the routed file channels straight onto the bus. A fading
+// voice is scaled by ramp, NULL at full level.
+static uint32_t mix_direct(mixer_voice_t *v, float *const *out, const uint32_t offset, const uint32_t n_frames,
+                           const gain_ramp_t *ramp) {
+    const uint32_t src_channels = v->track->audio_file->info.channels;
+    uint32_t done = 0;
+
+    while (done < n_frames && voice_fill(v)) {
+        const uint32_t n = SPA_MIN(n_frames - done, v->frames_len - v->frames_pos);
+        const float *src = v->frames + (size_t) v->frames_pos * src_channels;
+
+        if (v->ambisonic) {
+            // Split the channels into the planar block, scaled to N3D
+            ambisonic_stream_t *a = v->ambisonic;
+            for (uint32_t i = 0; i < n; i++) {
+                const float g = ramp ? gain_ramp_at(ramp, done + i) : 1.0f;
+                for (uint32_t c = 0; c < src_channels; c++) {
+                    a->planar[c][i] = src[i * src_channels + c] * a->scale[c] * g;
+                }
+            }
+            decode_block(v, out, offset + done, n);
+            v->frames_pos += n;
+            done += n;
+            continue;
+        }
+
+        if (v->panned) {
+            // Downmix the file channels, then spread them over the speakers
+            const float scale = 1.0f / (float) src_channels;
+            for (uint32_t i = 0; i < n; i++) {
+                float sum = 0.0f;
+                for (uint32_t c = 0; c < src_channels; c++) {
+                    sum += src[i * src_channels + c];
+                }
+                v->mono[i] = sum * scale * (ramp ? gain_ramp_at(ramp, done + i) : 1.0f);
+            }
+            pan_block(v, out, offset + done, n);
+            v->frames_pos += n;
+            done += n;
+            continue;
+        }
+
+        for (uint32_t r = 0; r < v->n_routes; r++) {
+            const uint32_t s = v->route_src[r];
+            float *dst = out[v->route_dst[r]] + offset + done;
+            if (!ramp) {
+                for (uint32_t i = 0; i < n; i++) {
+                    dst[i] += src[i * src_channels + s];
+                }
+            } else {
+                for (uint32_t i = 0; i < n; i++) {
+                    dst[i] += src[i * src_channels + s] * gain_ramp_at(ramp, done + i);
+                }
+            }
+        }
+
+        v->frames_pos += n;
+        done += n;
+    }
+    return done;
+}
+
+// Different rate: linear interpolation between consecutive source frames
+static uint32_t mix_resampled(mixer_voice_t *v, float *const *out, const uint32_t offset, const uint32_t n_frames,
+                              const gain_ramp_t *ramp) {
+    const uint32_t src_channels = v->track->audio_file->info.channels;
+
+    if (!v->primed) {
+        if (!voice_fill(v)) return 0;
+        memcpy(v->next, v->frames + (size_t) v->frames_pos * src_channels, src_channels * sizeof(float));
+        v->frames_pos++;
+        v->phase = 1.0;
+        v->primed = true;
+    }
+
+    uint32_t i = 0;
+    for (; i < n_frames; i++) {
+        bool more = true;
+        while (v->phase >= 1.0 && more) {
+            memcpy(v->prev, v->next, src_channels * sizeof(float));
+            more = voice_fill(v);
+            if (more) {
+                memcpy(v->next, v->frames + (size_t) v->frames_pos * src_channels, src_channels * sizeof(float));
+                v->frames_pos++;
+                v->phase -= 1.0;
+            }
+        }
+        if (!more) break;
+
+        const float t = (float) v->phase;
+        const float g = ramp ? gain_ramp_at(ramp, i) : 1.0f;
+        if (v->ambisonic) {
+            ambisonic_stream_t *a = v->ambisonic;
+            for (uint32_t c = 0; c < src_channels; c++) {
+                a->planar[c][i] = (v->prev[c] + (v->next[c] - v->prev[c]) * t) * a->scale[c] * g;
+            }
+        } else if (v->panned) {
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < src_channels; c++) {
+                sum += v->prev[c] + (v->next[c] - v->prev[c]) * t;
+            }
+            v->mono[i] = sum / (float) src_channels * g;
+        } else {
+            for (uint32_t r = 0; r < v->n_routes; r++) {
+                const uint32_t s = v->route_src[r];
+                out[v->route_dst[r]][offset + i] += (v->prev[s] + (v->next[s] - v->prev[s]) * t) * g;
+            }
+        }
+        v->phase += v->step;
+    }
+
+    if (v->ambisonic && i > 0) decode_block(v, out, offset, i);
+    if (v->panned && i > 0) pan_block(v, out, offset, i);
+    return i;
+}
+
+// Mix a voice whose first frame plays at clock_ns on the graph clock
+static void mix_voice(const mixer_t *m, mixer_voice_t *v, float *const *out, const uint32_t n_frames,
+                      const uint64_t clock_ns) {
+    track_instance_t *track = v->track;
+    const bool on_grid = track->grid_period_ns > 0;
+    if ((v->finished && !on_grid) || track->state != TRACK_STATE_PLAYING) return;
+
+    // A moving source is placed once per block, its gains glide there
+    // across the block
+    if (v->panned && track->motion && trajectory_step(track->motion, clock_ns, &track->pan)) {
+        voice_pan_gains(m, v, &track->pan, &v->pan_set, v->pan_target);
+    }
+
+    const unsigned int loops = track_boundaries(track);
+    bool ended = false;
+    uint32_t done = 0;
+
+    while (done < n_frames && !ended) {
+        // Panned and ambisonic voices go through a scratch of one block,
+        // longer cycles are mixed a block at a time
+        uint32_t n = n_frames - done;
+        if (v->panned || v->ambisonic) n = SPA_MIN(n, MIXER_BLOCK_FRAMES);
+
+        // Level changes due in this cycle split it at their exact frame
+        if (track->ramp.n_events > 0) {
+            const uint64_t now_ns = clock_ns + (uint64_t) done * SPA_NSEC_PER_SEC / m->rate;
+            n = gain_ramp_next_event(&track->ramp, now_ns, m->rate, n);
+            if (n == 0) {
+                gain_ramp_fire(&track->ramp);
+                continue;
+            }
+        }
+
+        // A track looping on the tempo grid starts every pass on the grid
+        if (on_grid) {
+            const uint64_t now_ns = clock_ns + (uint64_t) done * SPA_NSEC_PER_SEC / m->rate;
+            n = tempo_grid_frames_until(track->grid_wrap_ns, now_ns, m->rate, n);
+            if (n == 0) {
+                if (tempo_grid_wrap(track, now_ns)) mixer_voice_restart(v);
+                continue;
+            }
+        }
+
+        // Faded out or not started yet, the voice holds its position
+        if (gain_ramp_is_silent(&track->ramp)) {
+            done += n;
+            continue;
+        }
+
+        gain_ramp_t *ramp = gain_ramp_is_unity(&track->ramp) ? NULL : &track->ramp;
+        const uint32_t mixed = v->step == 1.0 ?
+                               mix_direct(v, out, done, n, ramp) :
+                               mix_resampled(v, out, done, n, ramp);
+        if (ramp) gain_ramp_advance(ramp, mixed);
+
+        // Short of a grid pass, silence until the next one begins
+        ended = mixed < n && !on_grid;
+        done += on_grid ? n : mixed;
+    }
+
+    // Close to the end, tell the main loop the frame the file runs out on so
+    // the follow action starts right there
+    const follow_config_t *on_end = &track->config->on_end;
+    if ((on_end->track || on_end->cue_list) && !track->follow_armed && !track->paused && !track->stopping &&
+        !on_grid && !gain_ramp_is_silent(&track->ramp)) {
+        const sf_count_t left = track_remaining(track);
+        if (left >= 0) {
+            const double source_left = (double) left + (v->frames_len - v->frames_pos);
+            const uint64_t end_frame = ended ? done : n_frames + (uint64_t) (source_left / v->step);
+            const uint64_t end_ns = frame_time_ns(clock_ns, end_frame, m->rate);
+            if (end_ns <= clock_ns + (uint64_t) n_frames * SPA_NSEC_PER_SEC / m->rate + TRACK_FOLLOW_LEAD_NS) {
+                track->follow_ns = end_ns;
+                track->follow_armed = true;
+                pw_loop_signal_event(m->main_loop, m->notify);
+            }
+        }
+    }
+
+    // A stop cue faded the track out, the main loop releases it
+    if (track->stopping && !track->faded_out && track->ramp.n_events == 0 &&
+        gain_ramp_is_silent(&track->ramp)) {
+        track->faded_out = true;
+        pw_loop_signal_event(m->main_loop, m->notify);
+    }
+
+    // Loop boundary, a pending move back to the preferred device can go now
+    if (track->failback_pending && track_boundaries(track) != loops) {
+        track->failback_pending = false;
+        track->failback_ready = true;
+        pw_loop_signal_event(m->main_loop, m->notify);
+    }
+
+    // On to the next playlist item, the main loop decodes the one after it
+    if (track->playlist && track->playlist->switched) {
+        track->playlist->switched = false;
+        pw_loop_signal_event(m->main_loop, m->notify);
+    }
+
+    if (ended && !track->audio_file->loop) {
+        v->finished = true;
+        track->state = TRACK_STATE_STOPPED;
+        track->ended = true;
+        if (track->follow_armed) pw_loop_signal_event(m->main_loop, m->notify);
+    }
+}
+
+// One block mixed by all workers of the pool
+typedef struct {
+    mixer_t *mixer;
+    float *out[MIXER_MAX_CHANNELS];
+    uint32_t n_frames;
+    uint64_t clock_ns;                       // Graph time of the first frame of the block
+    atomic_uint next_voice;
+    bool used[WORKER_POOL_MAX_THREADS + 1];  // Worker mixed into its partial buses
+} mix_job_t;
+
+// Channels a voice is mixed into, its submix bus or the device bus
+static float *const *voice_target(const mixer_t *m, const mixer_voice_t *v, float *const *out) {
+    return v->bus < 0 ? out : m->buses[v->bus].channels;
+}
+
+// Workers claim voices one at a time, so a few expensive voices do not hold
+// up one worker while the others idle. Worker 0 mixes straight into the
+// device and submix buses, the others into partial buses in their scratch
+// space, the device bus first and then one per submix bus. After the barrier
+// every worker adds the partial buses up for its share of channels.
+static void mix_block_job(void *data, const uint32_t worker, const uint32_t n_workers) {
+    mix_job_t *job = data;
+    mixer_t *m = job->mixer;
+    const uint32_t n_targets = 1 + m->n_buses;
+    float *scratch = worker > 0 ? worker_pool_scratch(m->pool, worker) : NULL;
+    float *partial[MIXER_MAX_CHANNELS];
+    int partial_bus = -2;
+    uint32_t i;
+
+    job->used[worker] = false;
+    while ((i = atomic_fetch_add(&job->next_voice, 1)) < m->n_active) {
+        mixer_voice_t *v = m->active[i];
+        float *const *out = voice_target(m, v, job->out);
+
+        if (worker > 0) {
+            if (!job->used[worker]) {
+                for (uint32_t k = 0; k < n_targets * m->n_channels; k++) {
+                    memset(scratch + (size_t) k * MIXER_BLOCK_FRAMES, 0, job->n_frames * sizeof(float));
+                }
+            }
+            if (v->bus != partial_bus) {
+                const size_t base = (size_t) (v->bus + 1) * m->n_channels;
+                for (uint32_t c = 0; c < m->n_channels; c++) {
+                    partial[c] = scratch + (base + c) * MIXER_BLOCK_FRAMES;
+                }
+                partial_bus = v->bus;
+            }
+            out = partial;
+        }
+        job->used[worker] = true;
+        mix_voice(m, v, out, job->n_frames, job->clock_ns);
+    }
+
+    worker_pool_barrier(m->pool);
+
+    const uint32_t first = m->n_channels * worker / n_workers;
+    const uint32_t last = m->n_channels * (worker + 1) / n_workers;
+    for (uint32_t w = 1; w < n_workers; w++) {
+        if (!job->used[w]) continue;
+
+        const float *src_scratch = worker_pool_scratch(m->pool, w);
+        for (uint32_t t = 0; t < n_targets; t++) {
+            float *const *target = t == 0 ? job->out : m->buses[t - 1].channels;
+            for (uint32_t c = first; c < last; c++) {
+                const float *src = src_scratch + ((size_t) t * m->n_channels + c) * MIXER_BLOCK_FRAMES;
+                float *dst = target[c];
+                for (uint32_t f = 0; f < job->n_frames; f++) {
+                    dst[f] += src[f];
+                }
+            }
+        }
+    }
+}
+
+void mixer_render(mixer_t *m, float *const *out, const uint32_t n_frames) {
+    // Silence keeps the device open even when nothing plays
+    for (uint32_t c = 0; c < m->n_channels; c++) {
+        memset(out[c], 0, n_frames * sizeof(float));
+    }
+
+    // Waking the workers costs more than a few voices take to mix
+    const bool parallel = m->pool && m->n_active >= MIXER_PARALLEL_MIN_VOICES;
+    if (!parallel && m->n_buses == 0) {
+        for (uint32_t i = 0; i < m->n_active; i++) {
+            mix_voice(m, m->active[i], out, n_frames, m->clock_ns);
+        }
+    } else {
+        // Partial and submix buses hold one block, longer cycles are mixed
+        // block by block
+        mix_job_t job = {.mixer = m};
+        for (uint32_t done = 0; done < n_frames; done += MIXER_BLOCK_FRAMES) {
+            job.n_frames = SPA_MIN(n_frames - done, MIXER_BLOCK_FRAMES);
+            job.clock_ns = m->clock_ns + (uint64_t) done * SPA_NSEC_PER_SEC / m->rate;
+            for (uint32_t c = 0; c < m->n_channels; c++) {
+                job.out[c] = out[c] + done;
+            }
+            for (uint32_t b = 0; b < m->n_buses; b++) {
+                for (uint32_t c = 0; c < m->n_channels; c++) {
+                    memset(m->buses[b].channels[c], 0, job.n_frames * sizeof(float));
+                }
+            }
+
+            if (parallel) {
+                atomic_store(&job.next_voice, 0);
+                worker_pool_run(m->pool, mix_block_job, &job);
+            } else {
+                for (uint32_t i = 0; i < m->n_active; i++) {
+                    mixer_voice_t *v = m->active[i];
+                    mix_voice(m, v, voice_target(m, v, job.out), job.n_frames, job.clock_ns);
+                }
+            }
+
+            // Every bus is complete by the time it is mixed down, the ones
+            // playing into it and its key come before it
+            for (uint32_t b = 0; b < m->n_buses; b++) {
+                const mixer_bus_t *bus = &m->buses[b];
+                float *const *dst = bus->output < 0 ? job.out : m->buses[bus->output].channels;
+                submix_process(bus->submix, bus->channels, dst, m->n_channels, job.n_frames, m->rate);
+            }
+        }
+    }
+
+    // Bus inserts run across the channels of a frame, a block at a time
+    if (m->inserts) {
+        const uint32_t channels = m->n_channels;
+        for (uint32_t done = 0; done < n_frames; done += MIXER_BLOCK_FRAMES) {
+            const uint32_t n = SPA_MIN(n_frames - done, MIXER_BLOCK_FRAMES);
+            float *frames = m->insert_frames;
+            for (uint32_t c = 0; c < channels; c++) {
+                const float *src = out[c] + done;
+                for (uint32_t i = 0; i < n; i++) frames[i * channels + c] = src[i];
+            }
+            insert_chain_process(m->inserts, frames, n);
+            for (uint32_t c = 0; c < channels; c++) {
+                float *dst = out[c] + done;
+                for (uint32_t i = 0; i < n; i++) dst[i] = frames[i * channels + c];
+            }
+        }
+    }
+
+    // Room correction, then the alignment on top of it
+    if (m->convolver) convolver_process(m->convolver, out, n_frames);
+
+    // Bus channels lined up for the speakers they feed
+    if (m->delays) {
+        for (uint32_t c = 0; c < m->n_channels; c++) {
+            delay_line_process(&m->delays[c], out[c], n_frames);
+        }
+    }
+
+    m->clock_ns += (uint64_t) n_frames * SPA_NSEC_PER_SEC / m->rate;
+}
+
+void mixer_set_rate(mixer_t *m, const uint32_t rate) {
+    if (rate == 0 || rate == m->rate) return;
+
+    m->rate = rate;
+    for (uint32_t i = 0; i < m->n_active; i++) {
+        m->active[i]->step = (double) m->active[i]->source_rate / rate;
+    }
+    for (uint32_t c = 0; m->delays && c < m->n_channels; c++) {
+        delay_line_set(&m->delays[c], m->delay_seconds[c] * rate, 0);
+    }
+    if (m->inserts) insert_chain_set_rate(m->inserts, rate);
+}
+
+static void render_stream(mixer_t *m) {
+    struct pw_buffer *b;
+
+    if ((b = pw_stream_dequeue_buffer(m->stream)) == NULL) {
+        return;
+    }
+
+    struct spa_buffer *buf = b->buffer;
+    const sample_kernel_t *kernel = m->format.kernel;
+
+    // Cues are timed on the graph clock, the cycle says where it stands
+    struct pw_time t;
+    if (pw_stream_get_time_n(m->stream, &t, sizeof(t)) == 0 && t.now > 0) {
+        m->clock_ns = (uint64_t) t.now;
+    }
+    void *dst[MIXER_MAX_CHANNELS];
+
+    // The quantum can change at any time, requested says how much is wanted now
+    const uint32_t n_frames = kernel ? sample_buffer_map(kernel, buf, m->n_channels, dst, b->requested) : 0;
+    if (n_frames == 0) {
+        pw_stream_queue_buffer(m->stream, b);
+        return;
+    }
+
+    if (kernel->format == SPA_AUDIO_FORMAT_F32P) {
+        // Planar float on both sides, mix straight into the stream buffers
+        mixer_render(m, (float *const *) dst, n_frames);
+    } else {
+        // Render in blocks and let the kernel interleave and convert
+        for (uint32_t done = 0; done < n_frames; done += MIXER_BLOCK_FRAMES) {
+            const uint32_t n = SPA_MIN(n_frames - done, MIXER_BLOCK_FRAMES);
+            mixer_render(m, m->bus, n);
+            kernel->from_planar(dst, m->n_channels, done, (const float *const *) m->bus, n);
+        }
+    }
+
+    sample_buffer_finish(kernel, buf, m->n_channels, n_frames);
+    pw_stream_queue_buffer(m->stream, b);
+}
+
+static void on_mixer_process(void *userdata) {
+    mixer_t *m = userdata;
+
+    if (!m->driver_timer) {
+        render_stream(m);
+        return;
+    }
+
+    const uint64_t start = get_time_ns();
+    render_stream(m);
+    const uint64_t duration = get_time_ns() - start;
+
+    m->stats.cycle_last_ns = duration;
+    m->stats.cycle_sum_ns += duration;
+    m->stats.cycle_max_ns = SPA_MAX(m->stats.cycle_max_ns, duration);
+}
+
+static uint64_t driver_period_ns(const mixer_t *m) {
+    return (uint64_t) m->quantum * SPA_NSEC_PER_SEC / m->rate;
+}
+
+static void arm_driver_timer(mixer_t *m) {
+    struct timespec value = {
+        .tv_sec = (time_t) (m->driver_next_ns / SPA_NSEC_PER_SEC),
+        .tv_nsec = (long) (m->driver_next_ns % SPA_NSEC_PER_SEC)
+    };
+    pw_loop_update_timer(m->data_loop, m->driver_timer, &value, NULL, true);
+}
+
+// Cycle start of a driving mixer, runs on the data loop
+static void on_driver_timer(void *userdata, uint64_t expirations) {
+    mixer_t *m = userdata;
+    const uint64_t now = get_time_ns();
+    const uint64_t period = driver_period_ns(m);
+
+    m->stats.driving = m->stream && pw_stream_is_driving(m->stream);
+    if (!m->stats.driving) {
+        m->stats.idle++;
+    } else {
+        mixer_driver_stats_t *s = &m->stats;
+        const uint64_t jitter = now > m->driver_next_ns ? now - m->driver_next_ns : 0;
+
+        s->cycles++;
+        s->jitter_last_ns = jitter;
+        s->jitter_sum_ns += jitter;
+        s->jitter_max_ns = SPA_MAX(s->jitter_max_ns, jitter);
+        if (jitter > period) {
+            s->late++;
+        }
+        pw_stream_trigger_process(m->stream);
+    }
+
+    // Schedule from the previous deadline so wakeup errors do not add up,
+    // after a stall start over from now instead of catching up
+    m->driver_next_ns += period;
+    if (m->driver_next_ns <= now) {
+        m->driver_next_ns = now + period;
+    }
+    arm_driver_timer(m);
+}
+
+static int do_start_driver(struct spa_loop *loop, bool async, uint32_t seq,
+                           const void *data, size_t size, void *user_data) {
+    mixer_t *m = user_data;
+
+    m->driver_timer = pw_loop_add_timer(m->data_loop, on_driver_timer, m);
+    if (!m->driver_timer) return -errno;
+
+    memset(&m->stats, 0, sizeof(m->stats));
+    m->driver_next_ns = get_time_ns() + driver_period_ns(m);
+    arm_driver_timer(m);
+    return 0;
+}
+
+static int do_stop_driver(struct spa_loop *loop, bool async, uint32_t seq,
+                          const void *data, size_t size, void *user_data) {
+    mixer_t *m = user_data;
+
+    pw_loop_destroy_source(m->data_loop, m->driver_timer);
+    m->driver_timer = NULL;
+    return 0;
+}
+
+static void on_mixer_state_changed(void *userdata, enum pw_stream_state old,
+                                   enum pw_stream_state state, const char *error) {
+    mixer_t *m = userdata;
+
+    log_debug("Mixer %s state changed from %s to %s", m->config->name,
+              pw_stream_state_as_string(old), pw_stream_state_as_string(state));
+
+    switch (state) {
+        case PW_STREAM_STATE_ERROR:
+            log_error("Mixer %s stream error: %s", m->config->name, error ? error : "Unknown error");
+            m->streaming = false;
+            break;
+        case PW_STREAM_STATE_STREAMING:
+            log_info("Mixer running on %s", m->config->name);
+            m->streaming = true;
+            break;
+        case PW_STREAM_STATE_UNCONNECTED:
+            m->streaming = false;
+            break;
+        default:
+            break;
+    }
+}
+
+static int do_set_format(struct spa_loop *loop, bool async, uint32_t seq,
+                         const void *data, size_t size, void *user_data) {
+    mixer_t *m = user_data;
+    const stream_format_t *format = data;
+
+    m->format = *format;
+    mixer_set_rate(m, format->rate);
+    return 0;
+}
+
+// A format was negotiated or cleared. Parsing happens here, the process
+// thread only sees the finished state and switches between two cycles.
+static void on_mixer_param_changed(void *userdata, const uint32_t id, const struct spa_pod *param) {
+    mixer_t *m = userdata;
+    stream_format_t format;
+
+    if (id != SPA_PARAM_Format) return;
+
+    if (param && !stream_format_parse(param, &format)) {
+        log_error("Mixer %s: negotiated an unsupported format", m->config->name);
+    } else if (param && format.channels != m->n_channels) {
+        log_error("Mixer %s: negotiated %u channels for a %u channel bus",
+                  m->config->name, format.channels, m->n_channels);
+        format.kernel = NULL;
+    } else if (!param) {
+        memset(&format, 0, sizeof(format));
+    }
+    if (format.rate == 0) {
+        format.rate = m->rate;
+    }
+
+    pw_loop_invoke(m->data_loop, do_set_format, 0, &format, sizeof(format), true, m);
+
+    if (format.kernel) {
+        log_info("Mixer %s negotiated %s, %u channels, %u Hz", m->config->name,
+                 sample_format_name(format.format), format.channels, format.rate);
+    }
+}
+
+static const struct pw_stream_events mixer_stream_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .process = on_mixer_process,
+    .param_changed = on_mixer_param_changed,
+    .state_changed = on_mixer_state_changed,
+};
+
+struct sched_request {
+    int policy;
+    struct sched_param param;
+};
+
+static int do_get_sched(struct spa_loop *loop, bool async, uint32_t seq,
+                        const void *data, size_t size, void *user_data) {
+    struct sched_request *req = user_data;
+
+    return -pthread_getschedparam(pthread_self(), &req->policy, &req->param);
+}
+
+// Workers run at the priority of the data loop thread they help out
+static worker_pool_t *start_workers(const mixer_t *m) {
+    struct sched_request req = {.policy = SCHED_OTHER};
+
+    if (pw_loop_invoke(m->data_loop, do_get_sched, 0, NULL, 0, true, &req) < 0) {
+        req.policy = SCHED_OTHER;
+    }
+
+    // A partial bus for the device and every submix bus
+    const size_t scratch = (size_t) (1 + m->config->bus_count) * MIXER_MAX_CHANNELS * MIXER_BLOCK_FRAMES;
+    worker_pool_t *pool = worker_pool_new(m->config->workers, scratch,
+                                          req.policy, req.param.sched_priority);
+    if (!pool) {
+        log_error("Failed to start mixing workers for %s", m->config->name);
+        return NULL;
+    }
+
+    log_info("Mixer %s mixes on %u threads", m->config->name, worker_pool_size(pool));
+    return pool;
+}
+
+mixer_t *mixer_new(const device_config_t *config, struct pw_loop *data_loop,
+                   struct pw_loop *main_loop, struct spa_source *notify) {
+    mixer_t *m = calloc(1, sizeof(mixer_t));
+    if (!m) {
+        log_error("Failed to allocate mixer");
+        return NULL;
+    }
+
+    m->config = config;
+    m->data_loop = data_loop;
+    m->main_loop = main_loop;
+    m->notify = notify;
+    m->target_id = SPA_ID_INVALID;
+    m->rate = config->rate ? config->rate : MIXER_DEFAULT_RATE;
+    m->quantum = config->quantum ? config->quantum : MIXER_DEFAULT_QUANTUM;
+    slab_init(&m->free_voices, m->voice_pool, sizeof(mixer_voice_t), MIXER_MAX_VOICES);
+
+    if (config->bus_count > 0) {
+        m->buses = calloc(config->bus_count, sizeof(mixer_bus_t));
+        if (!m->buses) {
+            log_error("Failed to allocate buses for %s", config->name);
+            free(m);
+            return NULL;
+        }
+    }
+
+    if (config->workers > 0) {
+        m->pool = start_workers(m);
+        if (!m->pool) {
+            free(m->buses);
+            free(m);
+            return NULL;
+        }
+    }
+
+    return m;
+}
+
+static int find_channel(const mixer_t *m, const char *name) {
+    for (uint32_t c = 0; c < m->n_channels; c++) {
+        if (strcmp(m->channel_names[c], name) == 0) return (int) c;
+    }
+    return -1;
+}
+
+bool mixer_add_bus(mixer_t *m, submix_t *submix) {
+    if (m->n_channels > 0 || m->n_buses >= (uint32_t) m->config->bus_count) return false;
+
+    m->buses[m->n_buses].submix = submix;
+    m->buses[m->n_buses].output = -1;
+    m->n_buses++;
+    return true;
+}
+
+// A block of every channel for each submix bus, and where each one plays
+static bool setup_buses(mixer_t *m) {
+    if (m->n_buses == 0) return true;
+
+    m->bus_block_data = calloc((size_t) m->n_buses * m->n_channels * MIXER_BLOCK_FRAMES, sizeof(float));
+    if (!m->bus_block_data) {
+        log_error("Failed to allocate submix buses for %s", m->config->name);
+        return false;
+    }
+    for (uint32_t b = 0; b < m->n_buses; b++) {
+        mixer_bus_t *bus = &m->buses[b];
+        for (uint32_t c = 0; c < m->n_channels; c++) {
+            bus->channels[c] = m->bus_block_data + ((size_t) b * m->n_channels + c) * MIXER_BLOCK_FRAMES;
+        }
+        for (uint32_t o = b + 1; o < m->n_buses && bus->submix->output; o++) {
+            if (m->buses[o].submix == bus->submix->output) bus->output = (int) o;
+        }
+    }
+    log_info("Device %s mixes %u submix buses", m->config->name, m->n_buses);
+    return true;
+}
+
+// Delay lines for every bus channel of a device that delays any. Speakers
+// nearer than the furthest one wait for its sound to catch up.
+static bool setup_delays(mixer_t *m) {
+    const device_config_t *config = m->config;
+    if (config->delay_count == 0 && !config->align_speakers) return true;
+
+    // Room for the longest delay at twice the rate the bus starts at
+    const uint32_t size = delay_line_size((uint32_t) (DELAY_MAX_SECONDS * SPA_MAX(m->rate, 48000u) * 2));
+    m->delays = calloc(m->n_channels, sizeof(delay_line_t));
+    m->delay_data = calloc((size_t) m->n_channels * size, sizeof(float));
+    if (!m->delays || !m->delay_data) {
+        log_error("Failed to allocate delay lines for %s", config->name);
+        free(m->delays);
+        free(m->delay_data);
+        m->delays = NULL;
+        m->delay_data = NULL;
+        return false;
+    }
+    for (uint32_t c = 0; c < m->n_channels; c++) {
+        delay_line_init(&m->delays[c], m->delay_data + (size_t) c * size, size);
+    }
+
+    if (config->align_speakers) {
+        double furthest = 0.0;
+        for (int i = 0; i < config->speaker_count; i++) {
+            const pan_position_t *p = &config->speakers[i].position;
+            furthest = fmax(furthest, sqrt(p->x * p->x + p->y * p->y + p->z * p->z));
+        }
+        for (int i = 0; i < config->speaker_count; i++) {
+            const pan_position_t *p = &config->speakers[i].position;
+            const int c = find_channel(m, config->speakers[i].channel);
+            if (c < 0) continue;
+            m->delay_seconds[c] += (furthest - sqrt(p->x * p->x + p->y * p->y + p->z * p->z)) / DELAY_SPEED_OF_SOUND;
+        }
+    }
+    for (int i = 0; i < config->delay_count; i++) {
+        const int c = find_channel(m, config->delays[i].channel);
+        if (c < 0) {
+            log_warn("Device %s has no %s channel to delay", config->name, config->delays[i].channel);
+            continue;
+        }
+        m->delay_seconds[c] += config->delays[i].delay;
+    }
+
+    for (uint32_t c = 0; c < m->n_channels; c++) {
+        if (m->delay_seconds[c] > DELAY_MAX_SECONDS) {
+            log_warn("Delay of %s on %s capped at %.0f ms", m->channel_names[c], config->name, DELAY_MAX_SECONDS * 1e3);
+            m->delay_seconds[c] = DELAY_MAX_SECONDS;
+        }
+        delay_line_set(&m->delays[c], m->delay_seconds[c] * m->rate, 0);
+        if (m->delay_seconds[c] > 0.0) {
+            log_info("Device %s delays %s by %.3f ms", config->name, m->channel_names[c], m->delay_seconds[c] * 1e3);
+        }
+    }
+    return true;
+}
+
+// Insert chain of the bus and its interleaved scratch, from an arena of its
+// own. Limiters have room for twice the rate the bus starts at.
+static bool setup_inserts(mixer_t *m) {
+    const device_config_t *config = m->config;
+    if (config->insert_count == 0) return true;
+
+    const uint32_t max_rate = SPA_MAX(m->rate, 48000u) * 2;
+    const size_t scratch = (size_t) m->n_channels * MIXER_BLOCK_FRAMES * sizeof(float);
+    if (!arena_init(&m->insert_arena, ARENA_SIZE(scratch) +
+                    insert_chain_arena_size(config->inserts, config->insert_count, m->n_channels, max_rate))) {
+        log_error("Failed to allocate inserts for %s", config->name);
+        return false;
+    }
+    m->insert_frames = arena_alloc(&m->insert_arena, scratch);
+    m->inserts = insert_chain_new(&m->insert_arena, config->inserts, config->insert_count,
+                                  m->n_channels, m->rate, max_rate);
+    if (!m->insert_frames || !m->inserts) {
+        log_error("Failed to set up inserts for %s", config->name);
+        arena_clear(&m->insert_arena);
+        m->insert_frames = NULL;
+        m->inserts = NULL;
+        return false;
+    }
+    log_info("Device %s runs %d inserts on its bus", config->name, config->insert_count);
+    return true;
+}
+
+// Filters of the channels given an impulse response. They are built for
+// the rate the bus starts at.
+static bool setup_convolver(mixer_t *m) {
+    const device_config_t *config = m->config;
+    if (config->fir_count == 0) return true;
+
+    int bus_channels[MIXER_MAX_CHANNELS];
+    const int count = SPA_MIN(config->fir_count, MIXER_MAX_CHANNELS);
+    for (int i = 0; i < count; i++) {
+        bus_channels[i] = find_channel(m, config->firs[i].channel);
+        if (bus_channels[i] < 0) {
+            log_warn("Device %s has no %s channel to filter", config->name, config->firs[i].channel);
+        }
+    }
+
+    m->convolver = convolver_new(config->firs, count, bus_channels, m->n_channels, m->rate);
+    if (!m->convolver) {
+        log_warn("Device %s plays without its impulse responses", config->name);
+        return true;
+    }
+    log_info("Device %s convolves at %u Hz, %d frames later", config->name, m->rate, CONVOLVER_BLOCK_FRAMES);
+    return true;
+}
+
+// Undo a layout that was not set up in full, so the next call starts over
+static void clear_layout(mixer_t *m) {
+    panner_clear(&m->panner);
+    ambisonic_decoder_clear(&m->decoder);
+    free(m->delays);
+    free(m->delay_data);
+    m->delays = NULL;
+    m->delay_data = NULL;
+    memset(m->delay_seconds, 0, sizeof(m->delay_seconds));
+    arena_clear(&m->insert_arena);
+    m->insert_frames = NULL;
+    m->inserts = NULL;
+    convolver_destroy(m->convolver);
+    m->convolver = NULL;
+    free(m->bus_block_data);
+    m->bus_block_data = NULL;
+    free(m->bus_data);
+    m->bus_data = NULL;
+    m->n_channels = 0;
+}
+
+bool mixer_set_layout(mixer_t *m, const device_node_t *node, const uint32_t max_channels) {
+    if (m->n_channels > 0) return true;
+
+    uint32_t n;
+    if (m->config->channel_count > 0) {
+        n = SPA_MIN((uint32_t) m->config->channel_count, MIXER_MAX_CHANNELS);
+        for (uint32_t i = 0; i < n; i++) {
+            snprintf(m->channel_names[i], DEVICE_CHANNEL_NAME_MAX, "%s", m->config->channels[i]);
+        }
+    } else if (node && node->n_ports > 0) {
+        n = node->n_ports;
+        for (uint32_t i = 0; i < n; i++) {
+            if (node->channels[i][0] != '\0') {
+                memcpy(m->channel_names[i], node->channels[i], DEVICE_CHANNEL_NAME_MAX);
+            } else {
+                snprintf(m->channel_names[i], DEVICE_CHANNEL_NAME_MAX, "AUX%u", i);
+            }
+        }
+    } else {
+        n = 2;
+        snprintf(m->channel_names[0], DEVICE_CHANNEL_NAME_MAX, "FL");
+        snprintf(m->channel_names[1], DEVICE_CHANNEL_NAME_MAX, "FR");
+    }
+
+    // Cut before anything per channel is built for the ones dropped
+    if (n > max_channels) {
+        log_warn("Mixer %s has %u channels, only the first %u are mixed", m->config->name, n, max_channels);
+        n = max_channels;
+    }
+
+    m->bus_data = calloc((size_t) n * MIXER_BLOCK_FRAMES, sizeof(float));
+    if (!m->bus_data) {
+        log_error("Failed to allocate mixer bus for %s", m->config->name);
+        return false;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        m->positions[i] = get_channel_position(m->channel_names[i]);
+        m->bus[i] = m->bus_data + (size_t) i * MIXER_BLOCK_FRAMES;
+    }
+    m->n_channels = n;
+
+    if (m->config->speaker_count > 0 &&
+        !panner_init(&m->panner, m->config, (const char (*)[DEVICE_CHANNEL_NAME_MAX]) m->channel_names, n)) {
+        log_warn("None of the speakers of %s are on its bus, tracks play unpanned", m->config->name);
+    }
+    if (m->panner.n_speakers > 0 && ambisonic_decoder_init(&m->decoder, m->config, &m->panner)) {
+        log_info("Device %s decodes ambisonics up to order %d with %s", m->config->name, AMBISONIC_MAX_ORDER,
+                 m->config->decoder == DECODER_MODE_MATCHING ? "mode matching" : "AllRAD");
+    }
+
+    if (!setup_buses(m) || !setup_inserts(m) || !setup_convolver(m) || !setup_delays(m)) {
+        clear_layout(m);
+        return false;
+    }
+    return true;
+}
+
+bool mixer_connect(mixer_t *m, struct pw_core *core, const device_node_t *node) {
+    if (m->stream) return true;
+
+    // A stream carries at most SPA_AUDIO_MAX_CHANNELS, the filter engine has no such limit
+    if (!mixer_set_layout(m, node, SPA_AUDIO_MAX_CHANNELS)) return false;
+
+    struct pw_properties *props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio",
+        PW_KEY_MEDIA_CATEGORY, "Playback",
+        PW_KEY_MEDIA_ROLE, "Music",
+        PW_KEY_NODE_ALWAYS_PROCESS, "true",
+        NULL);
+    if (!props) {
+        log_error("Failed to create mixer stream properties");
+        return false;
+    }
+    pw_properties_setf(props, PW_KEY_NODE_NAME, "papad.mixer.%s", node->name);
+    pw_properties_setf(props, PW_KEY_NODE_DESCRIPTION, "papad mixer (%s)", node->description);
+    pw_properties_setf(props, PW_KEY_TARGET_OBJECT, "%" PRIu64, node->serial);
+    pw_properties_setf(props, PW_KEY_AUDIO_CHANNELS, "%u", m->n_channels);
+    if (m->config->driver) {
+        // The graph runs at our quantum, whoever else joins it
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", m->quantum, m->rate);
+        pw_properties_setf(props, PW_KEY_NODE_FORCE_QUANTUM, "%u", m->quantum);
+        pw_properties_setf(props, PW_KEY_PRIORITY_DRIVER, "%u",
+                           m->config->driver_priority ? m->config->driver_priority : MIXER_DEFAULT_DRIVER_PRIORITY);
+    }
+
+    m->stream = pw_stream_new(core, "papad-mixer", props);
+    if (!m->stream) {
+        log_error("Failed to create mixer stream for %s", m->config->name);
+        return false;
+    }
+
+    spa_zero(m->stream_listener);
+    pw_stream_add_listener(m->stream, &m->stream_listener, &mixer_stream_events, m);
+
+    uint8_t buffer[4096];
+    struct spa_pod_builder b;
+    spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+    struct spa_audio_info_raw audio_info = {
+        .channels = m->n_channels,
+        .rate = m->rate
+    };
+    memcpy(audio_info.position, m->positions, m->n_channels * sizeof(uint32_t));
+
+    // The bus is planar, offering F32P first skips the interleave pass and,
+    // on DSP devices, the deinterleave of the adapter
+    static const uint32_t formats[] = {
+        SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S16
+    };
+    const struct spa_pod *params[SPA_N_ELEMENTS(formats)];
+    const uint32_t n_params = sample_format_build_enum(&b, formats, SPA_N_ELEMENTS(formats), &audio_info, params);
+
+    enum pw_stream_flags flags = PW_STREAM_FLAG_AUTOCONNECT |
+                                 PW_STREAM_FLAG_MAP_BUFFERS |
+                                 PW_STREAM_FLAG_RT_PROCESS;
+    if (m->config->driver) {
+        flags |= PW_STREAM_FLAG_DRIVER;
+    }
+
+    if (pw_stream_connect(m->stream, PW_DIRECTION_OUTPUT, PW_ID_ANY, flags, params, n_params) < 0) {
+        log_error("Failed to connect mixer stream for %s", m->config->name);
+        mixer_disconnect(m);
+        return false;
+    }
+
+    if (m->config->driver &&
+        pw_loop_invoke(m->data_loop, do_start_driver, 0, NULL, 0, true, m) < 0) {
+        log_error("Failed to start the driver timer for %s", m->config->name);
+        mixer_disconnect(m);
+        return false;
+    }
+
+    m->target_id = node->id;
+    log_info("Mixer for %s connected to %s (%u channels, %u Hz)",
+             m->config->name, node->name, m->n_channels, m->rate);
+    return true;
+}
+
+void mixer_disconnect(mixer_t *m) {
+    if (!m || !m->stream) return;
+
+    if (m->driver_timer) {
+        pw_loop_invoke(m->data_loop, do_stop_driver, 0, NULL, 0, true, m);
+    }
+    spa_hook_remove(&m->stream_listener);
+    pw_stream_destroy(m->stream);
+    m->stream = NULL;
+    m->streaming = false;
+    memset(&m->format, 0, sizeof(m->format));
+    m->target_id = SPA_ID_INVALID;
+}
+
+void mixer_destroy(mixer_t *m) {
+    if (!m) return;
+
+    mixer_disconnect(m);
+    worker_pool_destroy(m->pool);
+    panner_clear(&m->panner);
+    ambisonic_decoder_clear(&m->decoder);
+    free(m->delays);
+    free(m->delay_data);
+    arena_clear(&m->insert_arena);
+    convolver_destroy(m->convolver);
+    free(m->buses);
+    free(m->bus_block_data);
+    free(m->bus_data);
+    free(m);
+}
+
+int mixer_format_stats(const mixer_t *m, char *buffer, const size_t size) {
+    const mixer_driver_stats_t *s = &m->stats;
+    const uint64_t cycles = s->cycles ? s->cycles : 1;
+    int written;
+
+    if (!m->driver_timer) {
+        written = snprintf(buffer, size, "Mixer %s: not driving\n", m->config->name);
+    } else if (!s->driving) {
+        written = snprintf(buffer, size,
+                           "Mixer %s: another node drives the graph\n"
+                           "  Cycles: %" PRIu64 ", ticks not driving: %" PRIu64 "\n",
+                           m->config->name, s->cycles, s->idle);
+    } else {
+        written = snprintf(buffer, size,
+                           "Mixer %s: driving, quantum %u at %u Hz (%.2f ms)\n"
+                           "  Cycles: %" PRIu64 ", late wakeups: %" PRIu64 ", ticks not driving: %" PRIu64 "\n"
+                           "  Wakeup jitter: last %.1f us, avg %.1f us, max %.1f us\n"
+                           "  Cycle duration: last %.1f us, avg %.1f us, max %.1f us\n",
+                           m->config->name, m->quantum, m->rate,
+                           (double) driver_period_ns(m) / 1e6,
+                           s->cycles, s->late, s->idle,
+                           (double) s->jitter_last_ns / 1e3,
+                           (double) s->jitter_sum_ns / cycles / 1e3,
+                           (double) s->jitter_max_ns / 1e3,
+                           (double) s->cycle_last_ns / 1e3,
+                           (double) s->cycle_sum_ns / cycles / 1e3,
+                           (double) s->cycle_max_ns / 1e3);
+    }
+
+    if (written < 0) return 0;
+    return (size_t) written >= size ? (int) (size ? size - 1 : 0) : written;
+}
+
+static int do_add_voice(struct spa_loop *loop, bool async, uint32_t seq,
+                        const void *data, size_t size, void *user_data) {
+    mixer_t *m = user_data;
+    mixer_voice_t *voice = *(mixer_voice_t *const *) data;
+
+    // The bus rate is only stable here, the process thread may follow the graph
+    voice->step = (double) voice->source_rate / m->rate;
+    m->active[m->n_active++] = voice;
+    return 0;
+}
+
+static int do_remove_voice(struct spa_loop *loop, bool async, uint32_t seq,
+                           const void *data, size_t size, void *user_data) {
+    mixer_t *m = user_data;
+    const mixer_voice_t *voice = *(mixer_voice_t *const *) data;
+
+    for (uint32_t i = 0; i < m->n_active; i++) {
+        if (m->active[i] == voice) {
+            m->active[i] = m->active[--m->n_active];
+            break;
+        }
+    }
+    return 0;
+}
+
+mixer_voice_t *mixer_add_voice(mixer_t *m, track_instance_t *track) {
+    if (!track->block || !track->desc) {
+        log_error("Track %s was not prepared for mixing", track->config->id);
+        return NULL;
+    }
+
+    mixer_voice_t *v = slab_alloc(&m->free_voices);
+    if (!v) {
+        log_error("No free voice on mixer %s", m->config->name);
+        return NULL;
+    }
+
+    const audio_file_t *af = track->audio_file;
+    const output_config_t *output = &track->config->output;
+    const track_desc_t *desc = track->desc;
+
+    memset(v, 0, sizeof(*v));
+    v->track = track;
+    v->frames = track->block;
+
+    // Ambisonic and panned tracks feed every speaker, mapped names are
+    // looked up on the bus, unmapped files go 1:1
+    if (track->ambisonic && m->decoder.n_speakers > 0) {
+        for (uint32_t i = 0; i < m->panner.n_speakers; i++) {
+            if (m->panner.channels[i] >= m->n_channels) continue;
+            v->route_src[v->n_routes] = i;
+            v->route_dst[v->n_routes] = m->panner.channels[i];
+            v->n_routes++;
+        }
+        v->ambisonic = track->ambisonic;
+        v->decoder = m->decoder.matrices[track->ambisonic->order];
+    } else if (track->pan.set && m->panner.n_speakers > 0) {
+        float gains[PANNER_MAX_SPEAKERS];
+        panner_gains(&m->panner, &track->pan, &v->pan_set, gains);
+        for (uint32_t i = 0; i < m->panner.n_speakers; i++) {
+            if (m->panner.channels[i] >= m->n_channels) continue;
+            v->route_src[v->n_routes] = i;
+            v->route_dst[v->n_routes] = m->panner.channels[i];
+            v->pan_gain[v->n_routes] = gains[i];
+            v->pan_target[v->n_routes] = gains[i];
+            v->n_routes++;
+        }
+        v->panned = true;
+    } else if (output->mapping_count > 0) {
+        for (int i = 0; i < (int) desc->n_channels && i < af->info.channels; i++) {
+            const uint32_t position = desc->positions[i];
+            uint32_t dst = 0;
+            while (dst < m->n_channels && m->positions[dst] != position) dst++;
+
+            if (dst == m->n_channels) {
+                log_warn("Mixer %s has no %s channel (track %s)",
+                         m->config->name, output->mapping[i], track->config->id);
+                continue;
+            }
+            v->route_src[v->n_routes] = i;
+            v->route_dst[v->n_routes] = dst;
+            v->n_routes++;
+        }
+    } else {
+        for (uint32_t i = 0; i < (uint32_t) af->info.channels && i < m->n_channels; i++) {
+            v->route_src[v->n_routes] = i;
+            v->route_dst[v->n_routes] = i;
+            v->n_routes++;
+        }
+    }
+
+    if (track->pan.set && !v->panned) {
+        log_warn("Mixer %s has no speaker layout, track %s plays unpanned", m->config->name, track->config->id);
+    }
+    if (track->ambisonic && !v->ambisonic) {
+        log_warn("Mixer %s has no speaker layout, track %s plays undecoded", m->config->name, track->config->id);
+    }
+
+    v->bus = -1;
+    for (uint32_t b = 0; track->config->bus && b < m->n_buses && v->bus < 0; b++) {
+        if (strcmp(m->buses[b].submix->config->name, track->config->bus) == 0) v->bus = (int) b;
+    }
+    if (track->config->bus && v->bus < 0) {
+        log_warn("Mixer %s has no bus %s, track %s plays straight onto it", m->config->name, track->config->bus,
+                 track->config->id);
+    }
+    v->source_rate = af->info.samplerate;
+
+    pw_loop_invoke(m->data_loop, do_add_voice, 0, &v, sizeof(v), true, m);
+
+    log_debug("Track %s mixed into %s with %u routes", track->config->id, m->config->name, v->n_routes);
+    return v;
+}
+
+void mixer_remove_voice(mixer_t *m, mixer_voice_t *v) {
+    if (!m || !v) return;
+
+    pw_loop_invoke(m->data_loop, do_remove_voice, 0, &v, sizeof(v), true, m);
+    slab_free(&m->free_voices, v);
+}
+
+// New speaker gains handed to the process thread in one piece
+struct pan_update {
+    mixer_voice_t *voice;
+    float gains[PANNER_MAX_SPEAKERS];
+};
+
+static int do_set_pan(struct spa_loop *loop, bool async, uint32_t seq,
+                      const void *data, size_t size, void *user_data) {
+    const struct pan_update *update = user_data;
+    mixer_voice_t *v = update->voice;
+
+    memcpy(v->pan_target, update->gains, v->n_routes * sizeof(float));
+    return 0;
+}
+
+bool mixer_set_pan(mixer_t *m, mixer_voice_t *v, const pan_position_t *position) {
+    if (!m || !v || !v->panned) return false;
+
+    // The process thread owns the set a moving voice was last found in
+    struct pan_update update = { .voice = v };
+    voice_pan_gains(m, v, position, NULL, update.gains);
+
+    pw_loop_invoke(m->data_loop, do_set_pan, 0, NULL, 0, true, &update);
+    return true;
+}
+
+// New delay of a bus channel handed to the process thread
+struct delay_update {
+    mixer_t *mixer;
+    uint32_t channel;
+    double seconds;
+};
+
+static int do_set_delay(struct spa_loop *loop, bool async, uint32_t seq,
+                        const void *data, size_t size, void *user_data) {
+    const struct delay_update *update = user_data;
+    mixer_t *m = update->mixer;
+
+    m->delay_seconds[update->channel] = update->seconds;
+    delay_line_set(&m->delays[update->channel], update->seconds * m->rate,
+                   (uint32_t) (DELAY_FADE_SECONDS * m->rate));
+    return 0;
+}
+
+bool mixer_set_delay(mixer_t *m, const char *channel, const double seconds) {
+    if (!m || !m->delays) return false;
+
+    const int c = find_channel(m, channel);
+    if (c < 0) return false;
+
+    struct delay_update update = { .mixer = m, .channel = (uint32_t) c, .seconds = SPA_CLAMP(seconds, 0.0, DELAY_MAX_SECONDS) };
+    pw_loop_invoke(m->data_loop, do_set_delay, 0, NULL, 0, true, &update);
+    return true;
+}
+
+// New coefficients of a bus insert handed to the process thread
+struct tune_update {
+    insert_chain_t *chain;
+    insert_tuning_t tuning;
+};
+
+static int do_tune(struct spa_loop *loop, bool async, uint32_t seq,
+                   const void *data, size_t size, void *user_data) {
+    const struct tune_update *update = user_data;
+    insert_chain_apply(update->chain, &update->tuning);
+    return 0;
+}
+
+bool mixer_tune(mixer_t *m, const uint32_t index, const insert_config_t *config) {
+    if (!m || !m->inserts) return false;
+
+    struct tune_update update = { .chain = m->inserts };
+    if (!insert_chain_prepare(m->inserts, index, config, &update.tuning)) return false;
+    pw_loop_invoke(m->data_loop, do_tune, 0, NULL, 0, true, &update);
+    return true;
+}
+
+// New gain stage settings of a submix bus handed to the process thread
+struct bus_update {
+    submix_t *submix;
+    float fader;
+    bool mute;
+};
+
+static int do_set_bus(struct spa_loop *loop, bool async, uint32_t seq,
+                      const void *data, size_t size, void *user_data) {
+    const struct bus_update *update = user_data;
+
+    update->submix->fader = update->fader;
+    update->submix->mute = update->mute;
+    return 0;
+}
+
+void mixer_set_bus(mixer_t *m, submix_t *submix, const float fader, const bool mute) {
+    struct bus_update update = { .submix = submix, .fader = fader, .mute = mute };
+    pw_loop_invoke(m->data_loop, do_set_bus, 0, NULL, 0, true, &update);
+}
+
+void mixer_voice_restart(mixer_voice_t *v) {
+    v->frames_len = 0;
+    v->frames_pos = 0;
+    v->finished = false;
+    v->primed = false;
+}
@@ -0,0 +1,206 @@
+#ifndef ASYNC_AUDIO_PLAYER_MIXER_H
+#define ASYNC_AUDIO_PLAYER_MIXER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/raw.h>
+#include "types.h"
+#include "device_registry.h"
+#include "sample_format.h"
+#include "worker_pool.h"
+#include "arena.h"
+#include "panner.h"
+#include "ambisonic.h"
+#include "delay_line.h"
+#include "insert_chain.h"
+#include "convolver.h"
+#include "submix.h"
+
+#define MIXER_MAX_VOICES 512
+#define MIXER_BLOCK_FRAMES 256
+#define MIXER_MAX_CHANNELS DEVICE_MAX_CHANNELS
+#define MIXER_MAX_FRAMES 8192
+#define MIXER_PARALLEL_MIN_VOICES 16
+
+// A track mixed into a device bus instead of owning a stream
+typedef struct mixer_voice {
+    track_instance_t *track;
+
+    // File channel route_src[i] is added to bus channel route_dst[i]
+    uint32_t n_routes;
+    uint32_t route_src[SPA_AUDIO_MAX_CHANNELS];
+    uint32_t route_dst[SPA_AUDIO_MAX_CHANNELS];
+
+    // Decoded source block, interleaved file channels, the scratch of the track
+    float *frames;
+    uint32_t frames_len;
+    uint32_t frames_pos;
+    bool finished;
+
+    // Linear interpolation when the file rate differs from the bus rate
+    uint32_t source_rate;
+    double step;                 // Source frames per bus frame
+    double phase;
+    bool primed;
+    float prev[SPA_AUDIO_MAX_CHANNELS];
+    float next[SPA_AUDIO_MAX_CHANNELS];
+
+    // A panned voice spreads a mono downmix over the speakers of the device,
+    // route_src[i] is then the speaker route i feeds
+    bool panned;
+    float pan_gain[SPA_AUDIO_MAX_CHANNELS];    // Reached at the end of the last block
+    float pan_target[SPA_AUDIO_MAX_CHANNELS];  // Set from the main loop
+    uint32_t pan_set;                          // Speaker set of the panner the source was last in
+    float mono[MIXER_BLOCK_FRAMES];
+
+    // An ambisonic voice is decoded onto the speakers instead, route_src[i]
+    // is again the speaker route i feeds
+    struct ambisonic_stream *ambisonic;
+    const float *decoder;                      // Decoder of its order, a row per speaker
+
+    int bus;                     // Submix bus it plays into, -1 for the device bus
+} mixer_voice_t;
+
+// Submix bus on a mixer, holding one block of every bus channel
+typedef struct {
+    submix_t *submix;
+    int output;                  // Bus it plays into, always a later one, -1 for the device bus
+    float *channels[MIXER_MAX_CHANNELS];
+} mixer_bus_t;
+
+// Timing of a mixer driving its graph, written by the process thread
+typedef struct {
+    bool driving;                // The stream held the driver role at the last tick
+    uint64_t cycles;             // Cycles triggered
+    uint64_t idle;               // Ticks while another node drove the graph
+    uint64_t late;               // Wakeups more than a period late
+    uint64_t jitter_last_ns;     // Wakeup time minus scheduled time
+    uint64_t jitter_max_ns;
+    uint64_t jitter_sum_ns;
+    uint64_t cycle_last_ns;      // Time spent in the process callback
+    uint64_t cycle_max_ns;
+    uint64_t cycle_sum_ns;
+} mixer_driver_stats_t;
+
+// Mix bus of one device. It either drives a stream of its own on the
+// device or is rendered into the ports of the filter engine.
+typedef struct mixer {
+    const device_config_t *config;
+    struct pw_loop *data_loop;       // Loop the process callback runs on
+    struct pw_loop *main_loop;
+    struct spa_source *notify;       // Signalled when a voice hit a loop boundary or faded out
+
+    struct pw_stream *stream;        // Own stream, NULL in filter mode
+    struct spa_hook stream_listener;
+    uint32_t target_id;              // Node served, SPA_ID_INVALID while absent
+    bool streaming;
+    stream_format_t format;          // Negotiated stream format, owned by the process thread
+
+    // Driver mode, the timer lives on the data loop
+    uint32_t quantum;
+    struct spa_source *driver_timer;
+    uint64_t driver_next_ns;         // Scheduled time of the next cycle
+    mixer_driver_stats_t stats;
+
+    // Threads joining the process thread when many voices play, NULL if none
+    worker_pool_t *pool;
+
+    uint32_t rate;
+    uint64_t clock_ns;               // Graph time of the next frame rendered
+    uint32_t n_channels;             // 0 until the layout is known
+    uint32_t positions[MIXER_MAX_CHANNELS];
+    char channel_names[MIXER_MAX_CHANNELS][DEVICE_CHANNEL_NAME_MAX];
+    panner_t panner;                 // Speaker layout, empty when the device has none
+    ambisonic_decoder_t decoder;     // Ambisonic decoders for that layout
+
+    // Alignment of the bus channels, NULL when the device has no delays.
+    // Owned by the process thread, seconds are kept across rate changes.
+    delay_line_t *delays;
+    float *delay_data;
+    double delay_seconds[MIXER_MAX_CHANNELS];
+
+    // Inserts of the whole bus, NULL when the device has none. Run on
+    // interleaved blocks of insert_frames, owned by the process thread.
+    insert_chain_t *inserts;
+    arena_t insert_arena;
+    float *insert_frames;
+
+    // Room correction filters of the bus channels, NULL when the device has
+    // none. Delays every channel by CONVOLVER_BLOCK_FRAMES.
+    convolver_t *convolver;
+
+    // Submix buses in mixing order, so a single pass over them mixes every
+    // bus down after the ones playing into it. Added before the layout is
+    // set, their blocks come with the layout.
+    mixer_bus_t *buses;
+    uint32_t n_buses;
+    float *bus_block_data;
+
+    // Planar scratch bus for the stream backend
+    float *bus_data;
+    float *bus[MIXER_MAX_CHANNELS];
+
+    mixer_voice_t voice_pool[MIXER_MAX_VOICES];
+    slab_t free_voices;
+
+    // Owned by the data loop, changed through invoke only
+    mixer_voice_t *active[MIXER_MAX_VOICES];
+    uint32_t n_active;
+} mixer_t;
+
+// Create a mixer for a configured device, it is not connected yet
+mixer_t *mixer_new(const device_config_t *config, struct pw_loop *data_loop,
+                   struct pw_loop *main_loop, struct spa_source *notify);
+
+// Add a submix bus, before the layout is set and in mixing order. False
+// when the device was not configured with room for it.
+bool mixer_add_bus(mixer_t *mixer, submix_t *submix);
+
+// Hand a new fader level and mute of a submix bus to the process thread
+void mixer_set_bus(mixer_t *mixer, submix_t *submix, float fader, bool mute);
+
+// Fix the bus layout: configured channels win, then the ports of the node,
+// the first max_channels of them kept. Does nothing once a layout is set.
+bool mixer_set_layout(mixer_t *mixer, const device_node_t *node, uint32_t max_channels);
+
+// Change the bus rate, safe to call from the process thread
+void mixer_set_rate(mixer_t *mixer, uint32_t rate);
+
+// Mix all voices into planar bus buffers, called from the process thread
+void mixer_render(mixer_t *mixer, float *const *out, uint32_t n_frames);
+
+// Connect the mixer stream to a device node, the bus takes the node layout
+bool mixer_connect(mixer_t *mixer, struct pw_core *core, const device_node_t *node);
+
+// Destroy the stream, voices stay attached
+void mixer_disconnect(mixer_t *mixer);
+
+// Destroy a mixer, all voices must have been removed
+void mixer_destroy(mixer_t *mixer);
+
+// Write the driver timing of a mixer, returns the number of bytes written
+int mixer_format_stats(const mixer_t *mixer, char *buffer, size_t size);
+
+// Route a track onto the bus, fails when no voice is free
+mixer_voice_t *mixer_add_voice(mixer_t *mixer, track_instance_t *track);
+
+// Take a voice off the bus, returns once the process thread let go of it
+void mixer_remove_voice(mixer_t *mixer, mixer_voice_t *voice);
+
+// Move a panned voice, the gains are worked out on the calling thread and
+// glide to their new values over the next block. False if it is not panned.
+bool mixer_set_pan(mixer_t *mixer, mixer_voice_t *voice, const pan_position_t *position);
+
+// Delay a bus channel by seconds, crossfading from its old delay. False if
+// the device has no delays or no such channel.
+bool mixer_set_delay(mixer_t *mixer, const char *channel, double seconds);
+
+// Retune filter insert index of the bus to config, the coefficients are
+// worked out on the calling thread. False if there is no such filter.
+bool mixer_tune(mixer_t *mixer, uint32_t index, const insert_config_t *config);
+
+// Drop what a voice buffered so it reads its track afresh, from the process thread
+void mixer_voice_restart(mixer_voice_t *voice);
+
+#endif // ASYNC_AUDIO_PLAYER_MIXER_H
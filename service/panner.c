@@ -0,0 +1,413 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panner.h"
+#include "log.h"
+
+// Smallest determinant of a speaker set that is not treated as degenerate
+#define PANNER_MIN_DET 1e-3f
+
+static float azimuth_of(const float *v) {
+    return atan2f(v[1], v[0]);
+}
+
+// Adjacent speakers around the listener, sorted by azimuth. A pair more than
+// half a turn apart has nothing between them worth panning over.
+static uint32_t build_pairs(panner_t *p) {
+    uint32_t order[PANNER_MAX_SPEAKERS];
+
+    for (uint32_t i = 0; i < p->n_speakers; i++) {
+        uint32_t j = i;
+        while (j > 0 && azimuth_of(p->positions[order[j - 1]]) > azimuth_of(p->positions[i])) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < p->n_speakers; k++) {
+        const uint32_t a = order[k];
+        const uint32_t b = order[(k + 1) % p->n_speakers];
+        float span = azimuth_of(p->positions[b]) - azimuth_of(p->positions[a]);
+        if (span <= 0.0f) span += 2.0f * (float) M_PI;
+        if (a == b || span >= (float) M_PI - 1e-3f) continue;
+
+        const float *va = p->positions[a];
+        const float *vb = p->positions[b];
+        const float det = va[0] * vb[1] - vb[0] * va[1];
+        if (fabsf(det) < PANNER_MIN_DET) continue;
+
+        panner_set_t *set = &p->sets[n++];
+        set->speakers[0] = a;
+        set->speakers[1] = b;
+        set->inverse[0][0] = vb[1] / det;
+        set->inverse[0][1] = -vb[0] / det;
+        set->inverse[1][0] = -va[1] / det;
+        set->inverse[1][1] = va[0] / det;
+    }
+    return n;
+}
+
+// Inverse of the matrix with a, b and c as its columns, false when singular
+static bool invert3(const float *a, const float *b, const float *c, float inverse[3][3]) {
+    const float det = a[0] * (b[1] * c[2] - c[1] * b[2]) -
+                      b[0] * (a[1] * c[2] - c[1] * a[2]) +
+                      c[0] * (a[1] * b[2] - b[1] * a[2]);
+    if (fabsf(det) < PANNER_MIN_DET) return false;
+
+    inverse[0][0] = (b[1] * c[2] - c[1] * b[2]) / det;
+    inverse[0][1] = (c[0] * b[2] - b[0] * c[2]) / det;
+    inverse[0][2] = (b[0] * c[1] - c[0] * b[1]) / det;
+    inverse[1][0] = (c[1] * a[2] - a[1] * c[2]) / det;
+    inverse[1][1] = (a[0] * c[2] - c[0] * a[2]) / det;
+    inverse[1][2] = (c[0] * a[1] - a[0] * c[1]) / det;
+    inverse[2][0] = (a[1] * b[2] - b[1] * a[2]) / det;
+    inverse[2][1] = (b[0] * a[2] - a[0] * b[2]) / det;
+    inverse[2][2] = (a[0] * b[1] - b[0] * a[1]) / det;
+    return true;
+}
+
+static void apply_set(const panner_set_t *set, const uint32_t dimensions, const float *dir, float *g) {
+    for (uint32_t r = 0; r < dimensions; r++) {
+        g[r] = 0.0f;
+        for (uint32_t c = 0; c < dimensions; c++) {
+            g[r] += set->inverse[r][c] * dir[c];
+        }
+    }
+}
+
+static float dot3(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross3(const float *a, const float *b, float *out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Whether q, on the great circle of a and b with normal a x b, lies strictly
+// between them
+static bool on_arc(const float *a, const float *b, const float *normal, const float *q) {
+    float t[3];
+    cross3(a, q, t);
+    if (dot3(t, normal) <= 1e-6f) return false;
+    cross3(q, b, t);
+    return dot3(t, normal) > 1e-6f;
+}
+
+// Whether the shorter great circle arcs from a to b and from c to d cross
+static bool arcs_cross(const float *a, const float *b, const float *c, const float *d) {
+    float n1[3], n2[3], q[3];
+    cross3(a, b, n1);
+    cross3(c, d, n2);
+    cross3(n1, n2, q);
+    const float norm = sqrtf(dot3(q, q));
+    if (norm < 1e-6f) return false;
+
+    // The circles meet at q and its opposite, the arcs cross at either
+    for (int side = 0; side < 2; side++) {
+        const float scale = (side == 0 ? 1.0f : -1.0f) / norm;
+        const float at[3] = { q[0] * scale, q[1] * scale, q[2] * scale };
+        if (on_arc(a, b, n1, at) && on_arc(c, d, n2, at)) return true;
+    }
+    return false;
+}
+
+// Empty triplets overlap exactly when a side of one crosses a side of the
+// other away from the speakers they share
+static bool triplets_overlap(const panner_t *p, const panner_set_t *s, const panner_set_t *t) {
+    for (uint32_t i = 0; i < 3; i++) {
+        const uint32_t a = s->speakers[i], b = s->speakers[(i + 1) % 3];
+        for (uint32_t j = 0; j < 3; j++) {
+            const uint32_t c = t->speakers[j], d = t->speakers[(j + 1) % 3];
+            if (a == c || a == d || b == c || b == d) continue;
+            if (arcs_cross(p->positions[a], p->positions[b], p->positions[c], p->positions[d])) return true;
+        }
+    }
+    return false;
+}
+
+// Sum of the angles a triplet spans along its sides
+static float perimeter(const panner_t *p, const panner_set_t *set) {
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < 3; i++) {
+        const float d = dot3(p->positions[set->speakers[i]], p->positions[set->speakers[(i + 1) % 3]]);
+        sum += acosf(fmaxf(-1.0f, fminf(1.0f, d)));
+    }
+    return sum;
+}
+
+typedef struct {
+    float perimeter;
+    uint32_t set;
+} ranked_set_t;
+
+static int compare_ranked(const void *a, const void *b) {
+    const float pa = ((const ranked_set_t *) a)->perimeter;
+    const float pb = ((const ranked_set_t *) b)->perimeter;
+    return (pa > pb) - (pa < pb);
+}
+
+// Of triplets that overlap keep the one with the shortest sides, shortest
+// first, which leaves a triangulation of the layout. Kept as they are when
+// there is no memory to rank them.
+static uint32_t drop_overlapping(panner_t *p, const uint32_t n) {
+    if (n == 0) return 0;
+
+    ranked_set_t *ranked = malloc(n * sizeof(ranked_set_t));
+    panner_set_t *kept = malloc(n * sizeof(panner_set_t));
+    if (!ranked || !kept) {
+        log_warn("No memory to triangulate the speakers, overlapping triplets are kept");
+        free(ranked);
+        free(kept);
+        return n;
+    }
+
+    for (uint32_t s = 0; s < n; s++) {
+        ranked[s] = (ranked_set_t) { .perimeter = perimeter(p, &p->sets[s]), .set = s };
+    }
+    qsort(ranked, n, sizeof(ranked_set_t), compare_ranked);
+
+    uint32_t n_kept = 0;
+    for (uint32_t r = 0; r < n; r++) {
+        const panner_set_t *set = &p->sets[ranked[r].set];
+        bool overlaps = false;
+        for (uint32_t k = 0; k < n_kept && !overlaps; k++) {
+            overlaps = triplets_overlap(p, set, &kept[k]);
+        }
+        if (!overlaps) kept[n_kept++] = *set;
+    }
+
+    memcpy(p->sets, kept, n_kept * sizeof(panner_set_t));
+    free(kept);
+    free(ranked);
+    return n_kept;
+}
+
+// Every triplet with no other speaker inside it, then those that do not
+// overlap
+static uint32_t build_triplets(panner_t *p) {
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < p->n_speakers; i++) {
+        for (uint32_t j = i + 1; j < p->n_speakers; j++) {
+            for (uint32_t k = j + 1; k < p->n_speakers; k++) {
+                panner_set_t *set = &p->sets[n];
+                if (!invert3(p->positions[i], p->positions[j], p->positions[k], set->inverse)) continue;
+
+                bool empty = true;
+                for (uint32_t o = 0; o < p->n_speakers && empty; o++) {
+                    if (o == i || o == j || o == k) continue;
+                    float g[3];
+                    apply_set(set, 3, p->positions[o], g);
+                    empty = g[0] < -1e-4f || g[1] < -1e-4f || g[2] < -1e-4f;
+                }
+                if (!empty) continue;
+
+                set->speakers[0] = i;
+                set->speakers[1] = j;
+                set->speakers[2] = k;
+                n++;
+            }
+        }
+    }
+    return drop_overlapping(p, n);
+}
+
+// Where a source crosses a side of its set, the set on the other side
+static void link_sets(panner_t *p) {
+    for (uint32_t s = 0; s < p->n_sets; s++) {
+        panner_set_t *set = &p->sets[s];
+        for (uint32_t r = 0; r < 3; r++) {
+            set->neighbours[r] = -1;
+        }
+
+        for (uint32_t r = 0; r < p->dimensions; r++) {
+            for (uint32_t t = 0; t < p->n_sets && set->neighbours[r] < 0; t++) {
+                if (t == s) continue;
+                uint32_t shared = 0;
+                for (uint32_t i = 0; i < p->dimensions; i++) {
+                    if (i == r) continue;
+                    for (uint32_t j = 0; j < p->dimensions; j++) {
+                        if (set->speakers[i] == p->sets[t].speakers[j]) shared++;
+                    }
+                }
+                if (shared == p->dimensions - 1) set->neighbours[r] = (int) t;
+            }
+        }
+    }
+}
+
+bool panner_init(panner_t *p, const device_config_t *config,
+                 const char (*channel_names)[DEVICE_CHANNEL_NAME_MAX], const uint32_t n_channels) {
+    memset(p, 0, sizeof(*p));
+    p->method = config->pan_method;
+    p->dimensions = 2;
+
+    for (int i = 0; i < config->speaker_count; i++) {
+        const speaker_config_t *speaker = &config->speakers[i];
+        uint32_t channel = 0;
+        while (channel < n_channels && strcmp(channel_names[channel], speaker->channel) != 0) channel++;
+
+        if (channel == n_channels) {
+            log_warn("Device %s has no %s channel for its speaker", config->name, speaker->channel);
+            continue;
+        }
+        if (p->n_speakers == PANNER_MAX_SPEAKERS) {
+            log_warn("Device %s has more than %d speakers, the rest are left out", config->name, PANNER_MAX_SPEAKERS);
+            break;
+        }
+
+        float *v = p->positions[p->n_speakers];
+        v[0] = speaker->position.x;
+        v[1] = speaker->position.y;
+        v[2] = speaker->position.z;
+        if (p->method == PAN_VBAP) {
+            const float norm = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (norm < 1e-6f) {
+                log_warn("Speaker %s of device %s has no direction, left out", speaker->channel, config->name);
+                continue;
+            }
+            v[0] /= norm;
+            v[1] /= norm;
+            v[2] /= norm;
+        }
+        if (fabsf(v[2]) > 1e-3f) p->dimensions = 3;
+        p->channels[p->n_speakers++] = channel;
+    }
+
+    if (p->n_speakers == 0) return false;
+
+    if (p->method == PAN_DBAP) {
+        p->exponent = config->rolloff / (20.0f * log10f(2.0f));
+        log_info("Device %s pans over %u speakers by distance", config->name, p->n_speakers);
+        return true;
+    }
+
+    if (p->dimensions == 3 && p->n_speakers < 3) p->dimensions = 2;
+
+    const size_t n = p->n_speakers;
+    const size_t max_sets = p->dimensions == 3 ? n * (n - 1) * (n - 2) / 6 : n;
+    if (max_sets > 0) {
+        p->sets = calloc(max_sets, sizeof(panner_set_t));
+        if (!p->sets) {
+            log_error("Failed to allocate speaker sets for %s", config->name);
+            p->n_speakers = 0;
+            return false;
+        }
+        p->n_sets = p->dimensions == 3 ? build_triplets(p) : build_pairs(p);
+        link_sets(p);
+    }
+
+    log_info("Device %s pans over %u speakers in %u %s", config->name, p->n_speakers, p->n_sets,
+             p->dimensions == 3 ? "triplets" : "pairs");
+    return true;
+}
+
+void panner_clear(panner_t *p) {
+    free(p->sets);
+    p->sets = NULL;
+    p->n_sets = 0;
+    p->n_speakers = 0;
+}
+
+// Normalise to constant power, all speakers equally when nothing is set
+static void normalise(const panner_t *p, float *gains) {
+    float power = 0.0f;
+
+    for (uint32_t i = 0; i < p->n_speakers; i++) {
+        power += gains[i] * gains[i];
+    }
+    if (power < 1e-12f) {
+        const float even = 1.0f / sqrtf((float) p->n_speakers);
+        for (uint32_t i = 0; i < p->n_speakers; i++) {
+            gains[i] = even;
+        }
+        return;
+    }
+
+    const float scale = 1.0f / sqrtf(power);
+    for (uint32_t i = 0; i < p->n_speakers; i++) {
+        gains[i] *= scale;
+    }
+}
+
+static void dbap_gains(const panner_t *p, const pan_position_t *position, float *gains) {
+    for (uint32_t i = 0; i < p->n_speakers; i++) {
+        const float dx = position->x - p->positions[i][0];
+        const float dy = position->y - p->positions[i][1];
+        const float dz = position->z - p->positions[i][2];
+        const float distance = sqrtf(dx * dx + dy * dy + dz * dz + PANNER_DBAP_BLUR * PANNER_DBAP_BLUR);
+        gains[i] = powf(distance, -p->exponent);
+    }
+}
+
+// Gains of a set for dir, returns the smallest, negative when dir is outside
+static float set_gains(const panner_t *p, const panner_set_t *set, const float *dir, float *g) {
+    apply_set(set, p->dimensions, dir, g);
+
+    float min = g[0];
+    for (uint32_t r = 1; r < p->dimensions; r++) {
+        min = fminf(min, g[r]);
+    }
+    return min;
+}
+
+static void vbap_gains(const panner_t *p, const pan_position_t *position, uint32_t *hint, float *gains) {
+    float dir[3] = { position->x, position->y, p->dimensions == 3 ? position->z : 0.0f };
+    const float norm = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+    // Right at the listener or a single speaker, nothing to pan between
+    if (norm < 1e-6f || p->n_sets == 0) {
+        if (p->n_speakers == 1) gains[0] = 1.0f;
+        return;
+    }
+    for (uint32_t c = 0; c < 3; c++) {
+        dir[c] /= norm;
+    }
+
+    const panner_set_t *best = NULL;
+    float best_g[3] = { 0.0f, 0.0f, 0.0f };
+
+    // A moving source is most likely still in the set it was last found in,
+    // or has just crossed into a neighbour of it
+    if (hint && *hint < p->n_sets) {
+        const panner_set_t *last = &p->sets[*hint];
+        const int near[4] = { (int) *hint, last->neighbours[0], last->neighbours[1], last->neighbours[2] };
+        for (uint32_t i = 0; i <= p->dimensions && !best; i++) {
+            if (near[i] >= 0 && set_gains(p, &p->sets[near[i]], dir, best_g) >= 0.0f) best = &p->sets[near[i]];
+        }
+    }
+
+    // Otherwise the set the direction lies deepest inside, outside of every
+    // set the one it is closest to
+    if (!best) {
+        float best_min = -INFINITY;
+        for (uint32_t s = 0; s < p->n_sets; s++) {
+            float g[3] = { 0.0f, 0.0f, 0.0f };
+            const float min = set_gains(p, &p->sets[s], dir, g);
+            if (min > best_min) {
+                best_min = min;
+                best = &p->sets[s];
+                memcpy(best_g, g, sizeof(g));
+            }
+        }
+    }
+    if (hint) *hint = (uint32_t) (best - p->sets);
+
+    for (uint32_t r = 0; r < p->dimensions; r++) {
+        gains[best->speakers[r]] = fmaxf(best_g[r], 0.0f);
+    }
+}
+
+void panner_gains(const panner_t *p, const pan_position_t *position, uint32_t *set, float *gains) {
+    memset(gains, 0, p->n_speakers * sizeof(float));
+    if (p->method == PAN_DBAP) {
+        dbap_gains(p, position, gains);
+    } else {
+        vbap_gains(p, position, set, gains);
+    }
+    normalise(p, gains);
+}
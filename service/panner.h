@@ -0,0 +1,50 @@
+#ifndef ASYNC_AUDIO_PLAYER_PANNER_H
+#define ASYNC_AUDIO_PLAYER_PANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <spa/param/audio/raw.h>
+#include "types.h"
+#include "device_registry.h"
+
+// A panned voice routes to every speaker, a voice holds this many routes
+#define PANNER_MAX_SPEAKERS SPA_AUDIO_MAX_CHANNELS
+
+// Keeps a source right on a DBAP speaker from collapsing onto it alone, metres
+#define PANNER_DBAP_BLUR 0.2f
+
+// Speakers a VBAP gain set is spread over, with the inverse of the matrix of
+// their unit vectors, gains are the inverse times the source direction
+typedef struct {
+    uint32_t speakers[3];
+    float inverse[3][3];
+    int neighbours[3];           // Set sharing all speakers but speakers[i], -1 for none
+} panner_set_t;
+
+// Speaker layout of a device bus, built once its channels are known. Gains
+// are worked out on the main loop, or on the process thread for a source
+// that moves, which only reads the layout.
+typedef struct {
+    pan_method_t method;
+    uint32_t n_speakers;                           // 0 when the device has no layout
+    uint32_t channels[PANNER_MAX_SPEAKERS];        // Bus channel of each speaker
+    float positions[PANNER_MAX_SPEAKERS][3];       // Unit vectors under VBAP
+    uint32_t dimensions;                           // 2 when every speaker is at ear height
+    panner_set_t *sets;                            // VBAP pairs, or triplets that do not overlap
+    uint32_t n_sets;
+    float exponent;                                // DBAP distance exponent
+} panner_t;
+
+// Take the speakers of a device that are on its bus. False when none are,
+// the panner is then left empty.
+bool panner_init(panner_t *panner, const device_config_t *config,
+                 const char (*channel_names)[DEVICE_CHANNEL_NAME_MAX], uint32_t n_channels);
+
+void panner_clear(panner_t *panner);
+
+// Gain of each speaker for a source at position, power normalised. set holds
+// the VBAP set the source was last found in, the search starts there and it
+// is updated; NULL searches every set.
+void panner_gains(const panner_t *panner, const pan_position_t *position, uint32_t *set, float *gains);
+
+#endif // ASYNC_AUDIO_PLAYER_PANNER_H
@@ -0,0 +1,380 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "playlist.h"
+#include "log.h"
+
+// Queued item handed to the process thread in one piece
+struct queue_update {
+    playlist_t *pl;
+    playlist_cursor_t next;
+    bool last;
+    bool jump;
+};
+
+static int do_queue(struct spa_loop *loop, bool async, uint32_t seq,
+                    const void *data, size_t size, void *user_data) {
+    struct queue_update *update = user_data;
+    playlist_t *pl = update->pl;
+
+    pl->next = update->next;
+    pl->last = update->last;
+    pl->jump = update->jump;
+    return 0;
+}
+
+// Take back the queued item, not while it is fading in
+static int do_unqueue(struct spa_loop *loop, bool async, uint32_t seq,
+                      const void *data, size_t size, void *user_data) {
+    playlist_t *pl = user_data;
+
+    if (pl->fading) return -EBUSY;
+    pl->next.file = NULL;
+    pl->jump = false;
+    return 0;
+}
+
+static int do_jump(struct spa_loop *loop, bool async, uint32_t seq,
+                   const void *data, size_t size, void *user_data) {
+    playlist_t *pl = user_data;
+
+    if (pl->fading) return -EBUSY;
+    if (!pl->next.file) return -ENOENT;
+    pl->jump = true;
+    return 0;
+}
+
+// Run on the process thread, directly while the track has no output
+static int invoke(struct pw_loop *data_loop, spa_invoke_func_t func, void *data) {
+    if (data_loop) return pw_loop_invoke(data_loop, func, 0, NULL, 0, true, data);
+    return func(NULL, false, 0, NULL, 0, data);
+}
+
+// Rewind an item and decode its first frames into head
+static bool decode_head(playlist_t *pl, const uint32_t item, float *head, playlist_cursor_t *cursor) {
+    audio_file_t *file = &pl->items[item];
+
+    memset(cursor, 0, sizeof(*cursor));
+    if (!audio_file_rewind(file)) {
+        log_error("Playlist item not available: %s", pl->paths[item]);
+        return false;
+    }
+
+    cursor->file = file;
+    cursor->head = head;
+    cursor->head_len = (uint32_t) audio_file_read(file, head, pl->head_frames);
+    return true;
+}
+
+// Head the current item is not draining
+static float *free_head(const playlist_t *pl) {
+    return pl->current.head == pl->heads[0] ? pl->heads[1] : pl->heads[0];
+}
+
+// New play order, never starting with the item that just played
+static void shuffle_order(playlist_t *pl, const uint32_t playing) {
+    for (uint32_t i = pl->n_items - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t) rand_r(&pl->seed) % (i + 1);
+        const uint32_t item = pl->order[i];
+        pl->order[i] = pl->order[j];
+        pl->order[j] = item;
+    }
+
+    if (pl->order[0] == playing) {
+        pl->order[0] = pl->order[pl->n_items - 1];
+        pl->order[pl->n_items - 1] = playing;
+    }
+}
+
+// Queue the entry of order after the current one, or mark the list ending.
+// False when nothing follows.
+static bool queue_following(playlist_t *pl, struct pw_loop *data_loop, const bool jump) {
+    struct queue_update update = { .pl = pl, .jump = jump };
+    const uint32_t playing = pl->order[pl->cur_index];
+    uint32_t index = pl->cur_index + 1;
+
+    if (pl->n_items == 1 || (index == pl->n_items && !pl->loop)) {
+        update.last = true;
+        update.jump = false;
+    } else {
+        if (index == pl->n_items) {
+            if (pl->shuffle) shuffle_order(pl, playing);
+            index = 0;
+        }
+        pl->next_index = index;
+        update.last = !decode_head(pl, pl->order[index], free_head(pl), &update.next);
+    }
+
+    invoke(data_loop, do_queue, &update);
+    return update.next.file != NULL;
+}
+
+playlist_t *playlist_open(const track_config_t *config) {
+    playlist_t *pl = calloc(1, sizeof(playlist_t));
+    if (!pl) {
+        log_error("Failed to allocate playlist");
+        return NULL;
+    }
+
+    pl->items = calloc(config->file_count, sizeof(audio_file_t));
+    pl->paths = calloc(config->file_count, sizeof(char *));
+    if (!pl->items || !pl->paths) {
+        log_error("Failed to allocate playlist");
+        playlist_close(pl);
+        return NULL;
+    }
+
+    for (int i = 0; i < config->file_count; i++) {
+        audio_file_t *item = &pl->items[pl->n_items];
+        if (!audio_file_init(item, config->files[i], false, config->volume)) continue;
+
+        // One stream carries every item, its format is that of the first
+        if (pl->n_items > 0 &&
+            ((uint32_t) item->info.channels != pl->channels || (uint32_t) item->info.samplerate != pl->rate)) {
+            log_warn("Playlist %s: %s has %d channels at %d Hz instead of %u at %u, left out",
+                     config->id, config->files[i], item->info.channels, item->info.samplerate,
+                     pl->channels, pl->rate);
+            audio_file_clear(item);
+            continue;
+        }
+
+        pl->channels = (uint32_t) item->info.channels;
+        pl->rate = (uint32_t) item->info.samplerate;
+        pl->paths[pl->n_items++] = config->files[i];
+    }
+
+    if (pl->n_items == 0) {
+        playlist_close(pl);
+        return NULL;
+    }
+
+    pl->loop = config->loop;
+    pl->shuffle = config->shuffle;
+    pl->fade_frames = (uint32_t) (config->crossfade * pl->rate);
+    pl->head_frames = pl->fade_frames + pl->rate * PLAYLIST_HEAD_MS / 1000;
+    pl->seed = (unsigned int) time(NULL) ^ (unsigned int) (uintptr_t) pl;
+
+    // A single item loops inside the decoder
+    if (pl->n_items == 1) pl->items[0].loop = pl->loop;
+
+    log_info("Playlist %s: %u items, %s, crossfade %.1f s", config->id, pl->n_items,
+             pl->shuffle ? "shuffled" : "in order", config->crossfade);
+    return pl;
+}
+
+size_t playlist_arena_size(const playlist_t *pl) {
+    const size_t frame = pl->channels * sizeof(float);
+
+    return 2 * ARENA_SIZE(pl->head_frames * frame) +
+           ARENA_SIZE(TRACK_BLOCK_FRAMES * frame) +
+           ARENA_SIZE(pl->n_items * sizeof(uint32_t));
+}
+
+bool playlist_alloc(playlist_t *pl, arena_t *arena) {
+    const size_t frame = pl->channels * sizeof(float);
+
+    pl->heads[0] = arena_alloc(arena, pl->head_frames * frame);
+    pl->heads[1] = arena_alloc(arena, pl->head_frames * frame);
+    pl->scratch = arena_alloc(arena, TRACK_BLOCK_FRAMES * frame);
+    pl->order = arena_alloc(arena, pl->n_items * sizeof(uint32_t));
+    return pl->heads[0] && pl->heads[1] && pl->scratch && pl->order;
+}
+
+void playlist_close(playlist_t *pl) {
+    if (!pl) return;
+
+    for (uint32_t i = 0; i < pl->n_items; i++) {
+        audio_file_clear(&pl->items[i]);
+    }
+    free(pl->items);
+    free(pl->paths);
+    free(pl);
+}
+
+bool playlist_rewind(playlist_t *pl) {
+    for (uint32_t i = 0; i < pl->n_items; i++) {
+        pl->order[i] = i;
+    }
+    if (pl->shuffle) shuffle_order(pl, UINT32_MAX);
+
+    memset(&pl->current, 0, sizeof(pl->current));
+    memset(&pl->next, 0, sizeof(pl->next));
+    pl->cur_index = 0;
+    pl->next_index = 0;
+    pl->last = false;
+    pl->jump = false;
+    pl->fading = false;
+    pl->changes = 0;
+    pl->want_next = false;
+    pl->switched = false;
+
+    if (!decode_head(pl, pl->order[0], pl->heads[0], &pl->current)) return false;
+    queue_following(pl, NULL, false);
+    return true;
+}
+
+void playlist_queue(playlist_t *pl, struct pw_loop *data_loop) {
+    pl->want_next = false;
+    pl->cur_index = pl->next_index;
+    queue_following(pl, data_loop, false);
+}
+
+bool playlist_skip(playlist_t *pl, struct pw_loop *data_loop, const bool forward) {
+    if (forward) {
+        int res = invoke(data_loop, do_jump, pl);
+
+        // Moved on just now, the following item is not queued yet
+        if (res == -ENOENT && pl->want_next) {
+            pl->want_next = false;
+            pl->cur_index = pl->next_index;
+            res = queue_following(pl, data_loop, true) ? 0 : -ENOENT;
+        }
+        if (res < 0) {
+            log_warn("Cannot skip ahead: %s", res == -EBUSY ? "crossfade in progress" : "end of playlist");
+            return false;
+        }
+        return true;
+    }
+
+    if (pl->n_items == 1) {
+        log_warn("Cannot skip back: single item");
+        return false;
+    }
+    if (invoke(data_loop, do_unqueue, pl) < 0) {
+        log_warn("Cannot skip back: crossfade in progress");
+        return false;
+    }
+    if (pl->want_next) {
+        pl->want_next = false;
+        pl->cur_index = pl->next_index;
+    }
+
+    struct queue_update update = { .pl = pl, .jump = true };
+    if (pl->cur_index == 0 && !pl->loop) {
+        // Nothing before the first item, queue what comes after it again
+        log_warn("Cannot skip back: first item of the playlist");
+        queue_following(pl, data_loop, false);
+        return false;
+    }
+
+    pl->next_index = pl->cur_index == 0 ? pl->n_items - 1 : pl->cur_index - 1;
+    if (!decode_head(pl, pl->order[pl->next_index], free_head(pl), &update.next)) {
+        queue_following(pl, data_loop, false);
+        return false;
+    }
+    invoke(data_loop, do_queue, &update);
+    return true;
+}
+
+const char *playlist_current_path(const playlist_t *pl) {
+    return pl->paths[pl->order[pl->cur_index]];
+}
+
+// Read from the head decoded ahead, then on from the file
+static size_t cursor_read(playlist_cursor_t *cursor, float *out, const uint32_t channels, const size_t frames) {
+    size_t done = 0;
+
+    if (cursor->head_pos < cursor->head_len) {
+        done = SPA_MIN(frames, (size_t) (cursor->head_len - cursor->head_pos));
+        memcpy(out, cursor->head + (size_t) cursor->head_pos * channels, done * channels * sizeof(float));
+        cursor->head_pos += (uint32_t) done;
+    }
+    if (done < frames) {
+        done += audio_file_read(cursor->file, out + done * channels, frames - done);
+    }
+    return done;
+}
+
+static sf_count_t cursor_remaining(const playlist_cursor_t *cursor) {
+    const sf_count_t left = audio_file_remaining(cursor->file);
+    return left < 0 ? -1 : left + (cursor->head_len - cursor->head_pos);
+}
+
+size_t playlist_read(playlist_t *pl, float *out, const size_t frames) {
+    const uint32_t channels = pl->channels;
+    size_t done = 0;
+
+    while (done < frames) {
+        float *dst = out + done * channels;
+
+        // The queued item takes over a crossfade before the current one
+        // ends, or right away on a skip
+        if (!pl->fading && pl->next.file) {
+            const sf_count_t left = cursor_remaining(&pl->current);
+            if (pl->jump || (left >= 0 && left <= pl->fade_frames)) {
+                pl->fade_len = pl->jump ? pl->fade_frames : (uint32_t) left;
+                pl->fade_pos = 0;
+                pl->fading = true;
+                pl->jump = false;
+            }
+        }
+
+        if (pl->fading) {
+            if (pl->fade_pos == pl->fade_len) {
+                pl->current = pl->next;
+                pl->next.file = NULL;
+                pl->fading = false;
+                pl->changes++;
+                pl->want_next = true;
+                pl->switched = true;
+                continue;
+            }
+
+            const size_t n = SPA_MIN(SPA_MIN(frames - done, (size_t) (pl->fade_len - pl->fade_pos)),
+                                     (size_t) TRACK_BLOCK_FRAMES);
+            const size_t out_got = cursor_read(&pl->current, dst, channels, n);
+            memset(dst + out_got * channels, 0, (n - out_got) * channels * sizeof(float));
+            const size_t in_got = cursor_read(&pl->next, pl->scratch, channels, n);
+            memset(pl->scratch + in_got * channels, 0, (n - in_got) * channels * sizeof(float));
+
+            // Equal power, the level holds over material that is not correlated
+            for (size_t i = 0; i < n; i++) {
+                const float t = ((float) (pl->fade_pos + i) + 0.5f) / (float) pl->fade_len * (float) M_PI_2;
+                const float gain_out = cosf(t);
+                const float gain_in = sinf(t);
+                for (uint32_t c = 0; c < channels; c++) {
+                    dst[i * channels + c] = dst[i * channels + c] * gain_out + pl->scratch[i * channels + c] * gain_in;
+                }
+            }
+            pl->fade_pos += (uint32_t) n;
+            done += n;
+            continue;
+        }
+
+        // Plain playback, up to where a crossfade has to begin
+        size_t n = frames - done;
+        if (pl->next.file) {
+            const sf_count_t left = cursor_remaining(&pl->current);
+            if (left >= 0) n = SPA_MIN(n, (size_t) (left - pl->fade_frames));
+        }
+
+        const size_t got = cursor_read(&pl->current, dst, channels, n);
+        done += got;
+        if (got < n) {
+            if (pl->next.file) {
+                // Shorter than its header said, cut over right here
+                pl->fade_len = 0;
+                pl->fade_pos = 0;
+                pl->fading = true;
+                continue;
+            }
+            if (pl->last) break;
+
+            // The next item is not decoded yet, hold silence until it is
+            memset(out + done * channels, 0, (frames - done) * channels * sizeof(float));
+            return frames;
+        }
+    }
+    return done;
+}
+
+sf_count_t playlist_remaining(const playlist_t *pl) {
+    if (!pl->last || pl->fading || pl->next.file) return -1;
+    return cursor_remaining(&pl->current);
+}
+
+unsigned int playlist_boundaries(const playlist_t *pl) {
+    return pl->changes + (pl->current.file ? pl->current.file->loop_count : 0);
+}
@@ -0,0 +1,99 @@
+#ifndef ASYNC_AUDIO_PLAYER_PLAYLIST_H
+#define ASYNC_AUDIO_PLAYER_PLAYLIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pipewire/pipewire.h>
+#include "types.h"
+#include "audio_file.h"
+#include "arena.h"
+
+// Decoded ahead of an item beyond its crossfade
+#define PLAYLIST_HEAD_MS 1000
+
+// An item being read, its first frames come from a head decoded ahead
+typedef struct {
+    audio_file_t *file;  // NULL when empty
+    float *head;
+    uint32_t head_len;
+    uint32_t head_pos;
+} playlist_cursor_t;
+
+// Files of a playlist track played back to back through one output. The
+// main loop decodes the start of the next item ahead, the process thread
+// joins it on to the current one at the exact frame.
+typedef struct playlist {
+    // Fixed at load, every item has the channel count and rate of the first
+    audio_file_t *items;
+    const char **paths;
+    uint32_t n_items;
+    uint32_t channels;
+    uint32_t rate;
+    bool loop;
+    bool shuffle;
+    uint32_t fade_frames;    // Crossfade, 0 for a straight cut
+    uint32_t head_frames;    // Capacity of each head
+    float *heads[2];         // The current item drains one while the next fills the other
+    float *scratch;          // TRACK_BLOCK_FRAMES frames of the incoming item in a crossfade
+
+    // Main loop side
+    uint32_t *order;         // Item indices in play order
+    uint32_t cur_index;      // Entry of order playing
+    uint32_t next_index;     // Entry of order queued
+    unsigned int seed;       // Shuffle state
+
+    // Owned by the process thread, changed through invoke only
+    playlist_cursor_t current;
+    playlist_cursor_t next;  // Empty until the main loop queued an item
+    bool last;               // Nothing follows the current item
+    bool jump;               // Move to the queued item now
+    bool fading;
+    uint32_t fade_len;
+    uint32_t fade_pos;
+    unsigned int changes;    // Items started, loop boundaries of the track
+
+    // Set from the process thread once it moved to the queued item
+    bool want_next;          // Cleared by the main loop when it queues the following one
+    bool switched;           // Cleared by the process thread once it signalled
+} playlist_t;
+
+// Open the files of a playlist track, items that do not match the first are
+// left out. NULL when none could be opened.
+playlist_t *playlist_open(const track_config_t *config);
+
+// Bytes the buffers of a playlist take, in ARENA_SIZE() units
+size_t playlist_arena_size(const playlist_t *pl);
+
+// Carve the buffers of a playlist from the arena
+bool playlist_alloc(playlist_t *pl, arena_t *arena);
+
+void playlist_close(playlist_t *pl);
+
+// The following are called from the main loop. data_loop is the loop the
+// process thread of the track runs on, NULL while it has no output.
+
+// Start over from the first item, the track must not be playing
+bool playlist_rewind(playlist_t *pl);
+
+// The process thread moved on, queue the item after the one now playing
+void playlist_queue(playlist_t *pl, struct pw_loop *data_loop);
+
+// Move to the next or previous item now, crossfading when one is set.
+// Fails at the end of a list that does not loop or during a crossfade.
+bool playlist_skip(playlist_t *pl, struct pw_loop *data_loop, bool forward);
+
+// Path of the item playing
+const char *playlist_current_path(const playlist_t *pl);
+
+// The following are called from the process thread
+
+// Read interleaved frames across items, fewer only once the list ended
+size_t playlist_read(playlist_t *pl, float *out, size_t frames);
+
+// Frames left before the list ends, -1 while more items follow
+sf_count_t playlist_remaining(const playlist_t *pl);
+
+// Changes whenever an item starts or a single item wraps around
+unsigned int playlist_boundaries(const playlist_t *pl);
+
+#endif // ASYNC_AUDIO_PLAYER_PLAYLIST_H
@@ -0,0 +1,210 @@
+#include <string.h>
+#include <spa/param/audio/format-utils.h>
+#include "sample_format.h"
+
+static inline int16_t f32_to_s16(float v) {
+    v = SPA_CLAMP(v, -1.0f, 1.0f);
+    return (int16_t) (v * 32767.0f);
+}
+
+static inline int32_t f32_to_s32(const float v) {
+    const double d = SPA_CLAMP((double) v, -1.0, 1.0);
+    return (int32_t) (d * 2147483647.0);
+}
+
+// F32P: one block per channel, the bus layout as is
+
+static void f32p_from_planar(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                             const float *const *src, const uint32_t n_frames) {
+    for (uint32_t c = 0; c < n_channels; c++) {
+        memcpy((float *) dst[c] + offset, src[c], n_frames * sizeof(float));
+    }
+}
+
+static void f32p_from_interleaved(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                                  const float *src, const uint32_t src_channels, const uint32_t n_frames) {
+    for (uint32_t c = 0; c < n_channels; c++) {
+        float *d = (float *) dst[c] + offset;
+        if (c >= src_channels) {
+            memset(d, 0, n_frames * sizeof(float));
+            continue;
+        }
+        for (uint32_t i = 0; i < n_frames; i++) {
+            d[i] = src[i * src_channels + c];
+        }
+    }
+}
+
+// F32: interleaved float
+
+static void f32_from_planar(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                            const float *const *src, const uint32_t n_frames) {
+    float *d = (float *) dst[0] + (size_t) offset * n_channels;
+    for (uint32_t c = 0; c < n_channels; c++) {
+        const float *s = src[c];
+        for (uint32_t i = 0; i < n_frames; i++) {
+            d[i * n_channels + c] = s[i];
+        }
+    }
+}
+
+static void f32_from_interleaved(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                                 const float *src, const uint32_t src_channels, const uint32_t n_frames) {
+    float *d = (float *) dst[0] + (size_t) offset * n_channels;
+    if (n_channels == src_channels) {
+        memcpy(d, src, (size_t) n_frames * n_channels * sizeof(float));
+        return;
+    }
+    for (uint32_t i = 0; i < n_frames; i++) {
+        for (uint32_t c = 0; c < n_channels; c++) {
+            d[i * n_channels + c] = c < src_channels ? src[i * src_channels + c] : 0.0f;
+        }
+    }
+}
+
+// S32: interleaved 32 bit integer
+
+static void s32_from_planar(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                            const float *const *src, const uint32_t n_frames) {
+    int32_t *d = (int32_t *) dst[0] + (size_t) offset * n_channels;
+    for (uint32_t c = 0; c < n_channels; c++) {
+        const float *s = src[c];
+        for (uint32_t i = 0; i < n_frames; i++) {
+            d[i * n_channels + c] = f32_to_s32(s[i]);
+        }
+    }
+}
+
+static void s32_from_interleaved(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                                 const float *src, const uint32_t src_channels, const uint32_t n_frames) {
+    int32_t *d = (int32_t *) dst[0] + (size_t) offset * n_channels;
+    for (uint32_t i = 0; i < n_frames; i++) {
+        for (uint32_t c = 0; c < n_channels; c++) {
+            d[i * n_channels + c] = c < src_channels ? f32_to_s32(src[i * src_channels + c]) : 0;
+        }
+    }
+}
+
+// S16: interleaved 16 bit integer
+
+static void s16_from_planar(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                            const float *const *src, const uint32_t n_frames) {
+    int16_t *d = (int16_t *) dst[0] + (size_t) offset * n_channels;
+    for (uint32_t c = 0; c < n_channels; c++) {
+        const float *s = src[c];
+        for (uint32_t i = 0; i < n_frames; i++) {
+            d[i * n_channels + c] = f32_to_s16(s[i]);
+        }
+    }
+}
+
+static void s16_from_interleaved(void *const *dst, const uint32_t n_channels, const uint32_t offset,
+                                 const float *src, const uint32_t src_channels, const uint32_t n_frames) {
+    int16_t *d = (int16_t *) dst[0] + (size_t) offset * n_channels;
+    for (uint32_t i = 0; i < n_frames; i++) {
+        for (uint32_t c = 0; c < n_channels; c++) {
+            d[i * n_channels + c] = c < src_channels ? f32_to_s16(src[i * src_channels + c]) : 0;
+        }
+    }
+}
+
+static const sample_kernel_t kernels[] = {
+    {SPA_AUDIO_FORMAT_F32P, true, sizeof(float), f32p_from_planar, f32p_from_interleaved},
+    {SPA_AUDIO_FORMAT_F32, false, sizeof(float), f32_from_planar, f32_from_interleaved},
+    {SPA_AUDIO_FORMAT_S32, false, sizeof(int32_t), s32_from_planar, s32_from_interleaved},
+    {SPA_AUDIO_FORMAT_S16, false, sizeof(int16_t), s16_from_planar, s16_from_interleaved},
+};
+
+const sample_kernel_t *sample_kernel_find(const uint32_t format) {
+    for (size_t i = 0; i < SPA_N_ELEMENTS(kernels); i++) {
+        if (kernels[i].format == format) {
+            return &kernels[i];
+        }
+    }
+    return NULL;
+}
+
+const char *sample_format_name(const uint32_t format) {
+    switch (format) {
+        case SPA_AUDIO_FORMAT_F32P: return "F32P";
+        case SPA_AUDIO_FORMAT_F32: return "F32";
+        case SPA_AUDIO_FORMAT_S32: return "S32";
+        case SPA_AUDIO_FORMAT_S16: return "S16";
+        default: return "unsupported";
+    }
+}
+
+bool stream_format_parse(const struct spa_pod *param, stream_format_t *format) {
+    struct spa_audio_info_raw info;
+    uint32_t media_type, media_subtype;
+
+    memset(format, 0, sizeof(*format));
+    if (!param || spa_format_parse(param, &media_type, &media_subtype) < 0) return false;
+    if (media_type != SPA_MEDIA_TYPE_audio || media_subtype != SPA_MEDIA_SUBTYPE_raw) return false;
+
+    spa_zero(info);
+    if (spa_format_audio_raw_parse(param, &info) < 0) return false;
+    if (info.channels == 0 || info.channels > SPA_AUDIO_MAX_CHANNELS) return false;
+
+    format->kernel = sample_kernel_find(info.format);
+    if (!format->kernel) return false;
+
+    format->format = info.format;
+    format->rate = info.rate;
+    format->channels = info.channels;
+    memcpy(format->positions, info.position, info.channels * sizeof(uint32_t));
+    return true;
+}
+
+uint32_t sample_format_build_enum(struct spa_pod_builder *b, const uint32_t *formats, const uint32_t n_formats,
+                                  const struct spa_audio_info_raw *info, const struct spa_pod **params) {
+    uint32_t n_params = 0;
+
+    for (uint32_t i = 0; i < n_formats; i++) {
+        struct spa_audio_info_raw format_info = *info;
+        format_info.format = formats[i];
+
+        const struct spa_pod *param = spa_format_audio_raw_build(b, SPA_PARAM_EnumFormat, &format_info);
+        if (param) {
+            params[n_params++] = param;
+        }
+    }
+    return n_params;
+}
+
+uint32_t sample_buffer_map(const sample_kernel_t *kernel, struct spa_buffer *buf, const uint32_t n_channels,
+                           void **dst, const uint32_t requested) {
+    uint32_t n_frames;
+
+    if (kernel->planar) {
+        if (buf->n_datas < n_channels) return 0;
+
+        n_frames = UINT32_MAX;
+        for (uint32_t c = 0; c < n_channels; c++) {
+            if (!buf->datas[c].data) return 0;
+            dst[c] = buf->datas[c].data;
+            n_frames = SPA_MIN(n_frames, buf->datas[c].maxsize / kernel->sample_size);
+        }
+    } else {
+        if (buf->n_datas < 1 || !buf->datas[0].data) return 0;
+        dst[0] = buf->datas[0].data;
+        n_frames = buf->datas[0].maxsize / (kernel->sample_size * n_channels);
+    }
+
+    if (requested && requested < n_frames) {
+        n_frames = requested;
+    }
+    return n_frames;
+}
+
+void sample_buffer_finish(const sample_kernel_t *kernel, struct spa_buffer *buf, const uint32_t n_channels,
+                          const uint32_t n_frames) {
+    const uint32_t n_datas = kernel->planar ? n_channels : 1;
+    const uint32_t stride = kernel->planar ? kernel->sample_size : kernel->sample_size * n_channels;
+
+    for (uint32_t d = 0; d < n_datas; d++) {
+        buf->datas[d].chunk->offset = 0;
+        buf->datas[d].chunk->stride = (int32_t) stride;
+        buf->datas[d].chunk->size = n_frames * stride;
+    }
+}
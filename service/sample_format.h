@@ -0,0 +1,59 @@
+#ifndef ASYNC_AUDIO_PLAYER_SAMPLE_FORMAT_H
+#define ASYNC_AUDIO_PLAYER_SAMPLE_FORMAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/audio/raw.h>
+#include <spa/pod/builder.h>
+
+// Writes float samples into a negotiated buffer format. dst holds one
+// pointer per channel for planar formats and a single pointer otherwise.
+typedef struct sample_kernel {
+    uint32_t format;             // SPA_AUDIO_FORMAT_*
+    bool planar;
+    uint32_t sample_size;        // Bytes per sample
+
+    // Planar float source, one block per destination channel
+    void (*from_planar)(void *const *dst, uint32_t n_channels, uint32_t offset,
+                        const float *const *src, uint32_t n_frames);
+
+    // Interleaved float source as decoded from a file. Destination channels
+    // beyond src_channels are silenced, extra source channels dropped.
+    void (*from_interleaved)(void *const *dst, uint32_t n_channels, uint32_t offset,
+                             const float *src, uint32_t src_channels, uint32_t n_frames);
+} sample_kernel_t;
+
+// Negotiated format of a stream, what its process callback renders for
+typedef struct stream_format {
+    const sample_kernel_t *kernel;   // NULL until a supported format is set
+    uint32_t format;
+    uint32_t rate;
+    uint32_t channels;
+    uint32_t positions[SPA_AUDIO_MAX_CHANNELS];
+} stream_format_t;
+
+// Parse a Format param, false unless it is raw audio in a supported format
+bool stream_format_parse(const struct spa_pod *param, stream_format_t *format);
+
+// Kernel for a negotiated format, NULL if the format is not supported
+const sample_kernel_t *sample_kernel_find(uint32_t format);
+
+// Short format name for logging
+const char *sample_format_name(uint32_t format);
+
+// Build one EnumFormat pod per format, most preferred first. Returns the
+// number of params written.
+uint32_t sample_format_build_enum(struct spa_pod_builder *b, const uint32_t *formats, uint32_t n_formats,
+                                  const struct spa_audio_info_raw *info, const struct spa_pod **params);
+
+// Collect destination pointers of a dequeued buffer, returns the number of
+// frames that fit or 0 when the buffer does not match the format
+uint32_t sample_buffer_map(const sample_kernel_t *kernel, struct spa_buffer *buf, uint32_t n_channels,
+                           void **dst, uint32_t requested);
+
+// Fill in the chunks of a buffer after n_frames were written
+void sample_buffer_finish(const sample_kernel_t *kernel, struct spa_buffer *buf, uint32_t n_channels,
+                          uint32_t n_frames);
+
+#endif // ASYNC_AUDIO_PLAYER_SAMPLE_FORMAT_H
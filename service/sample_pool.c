@@ -0,0 +1,264 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample_pool.h"
+#include "log.h"
+
+sample_pool_t *sample_pool_open(const track_config_t *config) {
+    const pool_config_t *pc = &config->pool;
+    sample_pool_t *pool = calloc(1, sizeof(sample_pool_t));
+    if (!pool) {
+        log_error("Failed to allocate sample pool");
+        return NULL;
+    }
+
+    pool->members = calloc(pc->member_count, sizeof(pool_member_t));
+    if (!pool->members) {
+        log_error("Failed to allocate sample pool");
+        sample_pool_close(pool);
+        return NULL;
+    }
+
+    sf_count_t longest = 0;
+    for (int i = 0; i < pc->member_count; i++) {
+        const pool_member_config_t *mc = &pc->members[i];
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+
+        SNDFILE *file = sf_open(mc->file, SFM_READ, &info);
+        if (!file) {
+            log_error("Failed to open audio file: %s (%s)", mc->file, sf_strerror(NULL));
+            continue;
+        }
+
+        // One stream carries every member, members at another rate are
+        // stepped through at the rate of the first
+        if (pool->n_members > 0 && (uint32_t) info.channels != pool->channels) {
+            log_warn("Pool %s: %s has %d channels instead of %u, left out",
+                     config->id, mc->file, info.channels, pool->channels);
+            sf_close(file);
+            continue;
+        }
+
+        const sf_count_t offset = (sf_count_t) (mc->start * info.samplerate);
+        sf_count_t n_frames = info.frames - offset;
+        if (mc->length > 0.0) n_frames = SPA_MIN(n_frames, (sf_count_t) (mc->length * info.samplerate));
+        if (n_frames <= 0 || n_frames > UINT32_MAX) {
+            log_warn("Pool %s: region of %s is empty or too long, left out", config->id, mc->file);
+            sf_close(file);
+            continue;
+        }
+
+        if (pool->n_members == 0) {
+            pool->channels = (uint32_t) info.channels;
+            pool->rate = (uint32_t) info.samplerate;
+            pool->format.info = info;
+        }
+
+        pool_member_t *member = &pool->members[pool->n_members++];
+        member->file = file;
+        member->offset = offset;
+        member->n_frames = (uint32_t) n_frames;
+        member->rate = (uint32_t) info.samplerate;
+        member->weight = mc->weight;
+        member->path = mc->file;
+        pool->total_weight += mc->weight;
+        longest = SPA_MAX(longest, n_frames);
+    }
+
+    if (pool->n_members == 0) {
+        sample_pool_close(pool);
+        return NULL;
+    }
+
+    pool->select = pc->select;
+    if (pool->select == POOL_SELECT_WEIGHTED && pool->total_weight <= 0.0f) {
+        log_warn("Pool %s has no weights, picking at random", config->id);
+        pool->select = POOL_SELECT_RANDOM;
+    }
+    pool->gain_jitter = pc->gain_jitter;
+    pool->pitch_jitter = pc->pitch_jitter;
+    pool->last = UINT32_MAX;
+    pool->seed = (unsigned int) time(NULL) ^ (unsigned int) (uintptr_t) pool;
+
+    // Sizes the stream and the grid like a file as long as the longest member
+    pool->format.info.frames = longest;
+    pool->format.volume = config->volume;
+
+    log_info("Pool %s: %u members, gain jitter %.1f dB, pitch jitter %.2f semitones", config->id,
+             pool->n_members, pool->gain_jitter, pool->pitch_jitter);
+    return pool;
+}
+
+size_t sample_pool_arena_size(const sample_pool_t *pool) {
+    size_t size = 0;
+
+    for (uint32_t i = 0; i < pool->n_members; i++) {
+        size += ARENA_SIZE((size_t) pool->members[i].n_frames * pool->channels * sizeof(float));
+    }
+    return size;
+}
+
+bool sample_pool_load(sample_pool_t *pool, arena_t *arena) {
+    const float volume = pool->format.volume;
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < pool->n_members; i++) {
+        pool_member_t member = pool->members[i];
+        const size_t samples = (size_t) member.n_frames * pool->channels;
+
+        member.frames = arena_alloc(arena, samples * sizeof(float));
+        if (!member.frames) return false;
+
+        sf_count_t got = 0;
+        if (sf_seek(member.file, member.offset, SEEK_SET) >= 0) {
+            got = sf_readf_float(member.file, member.frames, member.n_frames);
+        }
+        sf_close(member.file);
+        member.file = NULL;
+        pool->members[i].file = NULL;
+
+        // A short read keeps what was there, nothing at all leaves it out
+        if (got <= 0) {
+            log_warn("Could not decode %s, left out of the pool", member.path);
+            continue;
+        }
+        member.n_frames = (uint32_t) got;
+
+        if (volume != 1.0f) {
+            for (size_t s = 0; s < (size_t) member.n_frames * pool->channels; s++) {
+                member.frames[s] *= volume;
+            }
+        }
+        pool->members[kept++] = member;
+    }
+
+    pool->n_members = kept;
+    pool->total_weight = 0.0f;
+    for (uint32_t i = 0; i < kept; i++) {
+        pool->total_weight += pool->members[i].weight;
+    }
+    return kept > 0;
+}
+
+void sample_pool_close(sample_pool_t *pool) {
+    if (!pool) return;
+
+    for (uint32_t i = 0; i < pool->n_members; i++) {
+        if (pool->members[i].file) sf_close(pool->members[i].file);
+    }
+    free(pool->members);
+    free(pool);
+}
+
+// Uniform in [-1, 1)
+static float spread(sample_pool_t *pool) {
+    return (float) rand_r(&pool->seed) / ((float) RAND_MAX + 1.0f) * 2.0f - 1.0f;
+}
+
+static uint32_t pick(sample_pool_t *pool) {
+    const uint32_t n = pool->n_members;
+
+    if (n == 1) return 0;
+
+    switch (pool->select) {
+        case POOL_SELECT_RANDOM: {
+            if (pool->last >= n) return (uint32_t) rand_r(&pool->seed) % n;
+
+            // Any member but the last, the same one twice in a row stands out
+            const uint32_t i = (uint32_t) rand_r(&pool->seed) % (n - 1);
+            return i >= pool->last ? i + 1 : i;
+        }
+        case POOL_SELECT_WEIGHTED: {
+            float r = (spread(pool) + 1.0f) * 0.5f * pool->total_weight;
+            uint32_t i = 0;
+            for (; i < n - 1; i++) {
+                if (r < pool->members[i].weight) break;
+                r -= pool->members[i].weight;
+            }
+
+            // Rounding past the end lands on the last member that has a share
+            while (i > 0 && pool->members[i].weight <= 0.0f) i--;
+            return i;
+        }
+        default: {
+            const uint32_t i = pool->turn;
+            pool->turn = (i + 1) % n;
+            return i;
+        }
+    }
+}
+
+void sample_pool_trigger(sample_pool_t *pool) {
+    const uint32_t i = pick(pool);
+    const pool_member_t *member = &pool->members[i];
+
+    pool->last = i;
+    pool->current = member;
+    pool->pos = 0.0;
+    pool->step = (double) member->rate / pool->rate;
+    pool->gain = 1.0f;
+    if (pool->pitch_jitter > 0.0f) pool->step *= exp2(spread(pool) * pool->pitch_jitter / 12.0);
+    if (pool->gain_jitter > 0.0f) pool->gain = powf(10.0f, spread(pool) * pool->gain_jitter / 20.0f);
+    pool->picks++;
+}
+
+const char *sample_pool_current_path(const sample_pool_t *pool) {
+    return pool->current ? pool->current->path : pool->members[0].path;
+}
+
+size_t sample_pool_read(sample_pool_t *pool, float *out, const size_t frames) {
+    const uint32_t channels = pool->channels;
+    size_t done = 0;
+
+    while (done < frames) {
+        const pool_member_t *member = pool->current;
+        if (!member || pool->pos >= member->n_frames) {
+            if (!member || !pool->loop) break;
+            sample_pool_trigger(pool);
+            continue;
+        }
+
+        float *dst = out + done * channels;
+        const float gain = pool->gain;
+
+        if (pool->step == 1.0) {
+            // At the rate of the member, a straight copy
+            const size_t pos = (size_t) pool->pos;
+            const size_t n = SPA_MIN(frames - done, (size_t) member->n_frames - pos);
+            const float *src = member->frames + pos * channels;
+            if (gain == 1.0f) {
+                memcpy(dst, src, n * channels * sizeof(float));
+            } else {
+                for (size_t s = 0; s < n * channels; s++) {
+                    dst[s] = src[s] * gain;
+                }
+            }
+            pool->pos += (double) n;
+            done += n;
+            continue;
+        }
+
+        // Pitched, linear between neighbouring frames of the member
+        while (done < frames && pool->pos < member->n_frames) {
+            const size_t pos = (size_t) pool->pos;
+            const float frac = (float) (pool->pos - (double) pos);
+            const float *a = member->frames + pos * channels;
+            const float *b = pos + 1 < member->n_frames ? a + channels : a;
+            for (uint32_t c = 0; c < channels; c++) {
+                dst[c] = (a[c] + (b[c] - a[c]) * frac) * gain;
+            }
+            dst += channels;
+            pool->pos += pool->step;
+            done++;
+        }
+    }
+    return done;
+}
+
+sf_count_t sample_pool_remaining(const sample_pool_t *pool) {
+    if (pool->loop) return -1;
+    if (!pool->current || pool->pos >= pool->current->n_frames) return 0;
+    return (sf_count_t) ceil(((double) pool->current->n_frames - pool->pos) / pool->step);
+}
@@ -0,0 +1,77 @@
+#ifndef ASYNC_AUDIO_PLAYER_SAMPLE_POOL_H
+#define ASYNC_AUDIO_PLAYER_SAMPLE_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sndfile.h>
+#include "types.h"
+#include "audio_file.h"
+#include "arena.h"
+
+// A file or region decoded into the arena
+typedef struct {
+    float *frames;           // Interleaved, volume applied
+    uint32_t n_frames;
+    uint32_t rate;
+    float weight;
+    const char *path;
+    SNDFILE *file;           // Open from load until decoded
+    sf_count_t offset;       // First frame of the region in the file
+} pool_member_t;
+
+// Files of a variation pool track decoded whole at load. A trigger picks
+// one member and rolls its gain and pitch offsets, reading it is a walk
+// over memory, so neither touches the disk or the allocator.
+typedef struct sample_pool {
+    // Fixed at load, every member has the channel count of the first
+    audio_file_t format;     // Format of the output, no file behind it
+    pool_member_t *members;
+    uint32_t n_members;
+    uint32_t channels;
+    uint32_t rate;           // Rate of the first member, the others play at it
+    pool_select_t select;
+    float gain_jitter;
+    float pitch_jitter;
+    float total_weight;
+
+    // Selection, used by one thread at a time: the main loop before the
+    // track has an output, the process thread after
+    bool loop;               // Pick again at the end of every member
+    uint32_t last;           // Member picked last
+    uint32_t turn;           // Next member under round robin
+    unsigned int seed;
+    unsigned int picks;      // Members started, loop boundaries of the track
+
+    // Owned by the process thread
+    const pool_member_t *current;
+    double pos;              // Frame of current, fractional under a pitch offset
+    double step;             // Member frames per output frame
+    float gain;
+} sample_pool_t;
+
+// Open the files of a pool track, members that do not match the channel
+// count of the first are left out. NULL when none could be opened.
+sample_pool_t *sample_pool_open(const track_config_t *config);
+
+// Bytes the decoded members take, in ARENA_SIZE() units
+size_t sample_pool_arena_size(const sample_pool_t *pool);
+
+// Decode every member into the arena and close its file
+bool sample_pool_load(sample_pool_t *pool, arena_t *arena);
+
+void sample_pool_close(sample_pool_t *pool);
+
+// Pick the member the next read plays from the start. Safe on the process
+// thread, it neither blocks nor allocates.
+void sample_pool_trigger(sample_pool_t *pool);
+
+// Path of the member playing
+const char *sample_pool_current_path(const sample_pool_t *pool);
+
+// Read interleaved frames, fewer only once a pool that does not loop ended
+size_t sample_pool_read(sample_pool_t *pool, float *out, size_t frames);
+
+// Frames left of the member playing, -1 while the pool loops
+sf_count_t sample_pool_remaining(const sample_pool_t *pool);
+
+#endif // ASYNC_AUDIO_PLAYER_SAMPLE_POOL_H
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sequencer.h"
+#include "log.h"
+
+// A cue compiled against the graph clock
+typedef struct {
+    uint64_t offset_ns;          // From the start of the list
+    cue_action_t action;
+    const char *track;
+    float gain;
+    uint32_t fade_ms;
+    int order;                   // Position in the configuration, breaks ties
+} cue_event_t;
+
+typedef struct {
+    const cue_list_config_t *config;
+    cue_event_t *events;         // Sorted by offset
+    uint32_t n_events;
+    uint32_t next;               // First event not handed out yet
+    bool running;
+    int64_t origin_ns;           // Graph time the list started at
+} cue_list_t;
+
+struct sequencer {
+    track_manager_ctx_t *tracks;
+    struct pw_loop *loop;
+    struct spa_source *timer;
+    cue_list_t *lists;
+    int n_lists;
+};
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * SPA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_events(const void *a, const void *b) {
+    const cue_event_t *ea = a;
+    const cue_event_t *eb = b;
+
+    if (ea->offset_ns != eb->offset_ns) return ea->offset_ns < eb->offset_ns ? -1 : 1;
+    return ea->order - eb->order;
+}
+
+static bool has_track(const global_config_t *config, const char *id) {
+    for (int i = 0; i < config->track_count; i++) {
+        if (strcmp(config->tracks[i].id, id) == 0) return true;
+    }
+    return false;
+}
+
+static bool compile_list(cue_list_t *list, const global_config_t *config, const cue_list_config_t *list_config) {
+    list->config = list_config;
+    list->events = calloc(list_config->cue_count > 0 ? list_config->cue_count : 1, sizeof(cue_event_t));
+    if (!list->events) return false;
+
+    for (int i = 0; i < list_config->cue_count; i++) {
+        const cue_config_t *cue = &list_config->cues[i];
+        if (!cue->track || !has_track(config, cue->track)) {
+            log_warn("Cue %d of list %s refers to unknown track %s, skipped",
+                     i, list_config->id, cue->track ? cue->track : "(none)");
+            continue;
+        }
+
+        list->events[list->n_events++] = (cue_event_t) {
+            .offset_ns = (uint64_t) (SPA_MAX(cue->at, 0.0) * SPA_NSEC_PER_SEC),
+            .action = cue->action,
+            .track = cue->track,
+            .gain = cue->gain,
+            .fade_ms = (uint32_t) (SPA_MAX(cue->fade, 0.0) * 1000.0),
+            .order = i
+        };
+    }
+
+    qsort(list->events, list->n_events, sizeof(cue_event_t), compare_events);
+    return true;
+}
+
+static void dispatch(sequencer_t *seq, const cue_list_t *list, const cue_event_t *event) {
+    const uint64_t at_ns = (uint64_t) (list->origin_ns + (int64_t) event->offset_ns);
+    bool ok = false;
+
+    switch (event->action) {
+        case CUE_START:
+            ok = track_manager_start_at(seq->tracks, event->track, at_ns, event->fade_ms);
+            break;
+        case CUE_STOP:
+            ok = track_manager_stop_at(seq->tracks, event->track, at_ns, event->fade_ms);
+            break;
+        case CUE_GAIN:
+            ok = track_manager_set_gain_at(seq->tracks, event->track, event->gain, at_ns, event->fade_ms);
+            break;
+    }
+
+    if (!ok) {
+        log_warn("Cue at %.3f s of list %s on track %s failed",
+                 (double) event->offset_ns / SPA_NSEC_PER_SEC, list->config->id, event->track);
+    }
+}
+
+// Wake up when the earliest pending cue enters the lookahead window
+static void arm_timer(sequencer_t *seq) {
+    int64_t earliest = INT64_MAX;
+
+    for (int i = 0; i < seq->n_lists; i++) {
+        const cue_list_t *list = &seq->lists[i];
+        if (!list->running) continue;
+
+        const int64_t due = list->origin_ns + (int64_t) list->events[list->next].offset_ns -
+                            (int64_t) SEQUENCER_LOOKAHEAD_NS;
+        earliest = SPA_MIN(earliest, due);
+    }
+
+    if (earliest == INT64_MAX) {
+        pw_loop_update_timer(seq->loop, seq->timer, NULL, NULL, false);
+        return;
+    }
+
+    // Something already due fires right away, a zero time would disarm
+    earliest = SPA_MAX(earliest, 1);
+    struct timespec value = {
+        .tv_sec = (time_t) (earliest / SPA_NSEC_PER_SEC),
+        .tv_nsec = (long) (earliest % SPA_NSEC_PER_SEC)
+    };
+    pw_loop_update_timer(seq->loop, seq->timer, &value, NULL, true);
+}
+
+static void on_timer(void *data, uint64_t expirations) {
+    sequencer_t *seq = data;
+    const int64_t horizon = (int64_t) (get_time_ns() + SEQUENCER_LOOKAHEAD_NS);
+
+    for (int i = 0; i < seq->n_lists; i++) {
+        cue_list_t *list = &seq->lists[i];
+
+        while (list->running && list->origin_ns + (int64_t) list->events[list->next].offset_ns <= horizon) {
+            dispatch(seq, list, &list->events[list->next]);
+            if (++list->next == list->n_events) {
+                list->running = false;
+                log_info("Cue list %s handed out its last cue", list->config->id);
+            }
+        }
+    }
+
+    arm_timer(seq);
+}
+
+sequencer_t *sequencer_new(const global_config_t *config, track_manager_ctx_t *tracks, struct pw_loop *loop) {
+    sequencer_t *seq = calloc(1, sizeof(sequencer_t));
+    if (!seq) return NULL;
+
+    seq->tracks = tracks;
+    seq->loop = loop;
+    seq->timer = pw_loop_add_timer(loop, on_timer, seq);
+    if (!seq->timer) {
+        log_error("Failed to create sequencer timer");
+        free(seq);
+        return NULL;
+    }
+
+    seq->lists = calloc(config->cue_list_count > 0 ? config->cue_list_count : 1, sizeof(cue_list_t));
+    if (!seq->lists) {
+        sequencer_destroy(seq);
+        return NULL;
+    }
+
+    for (int i = 0; i < config->cue_list_count; i++) {
+        const cue_list_config_t *list_config = &config->cue_lists[i];
+        if (!list_config->id) {
+            log_warn("Cue list %d has no id, skipped", i);
+            continue;
+        }
+        if (has_track(config, list_config->id)) {
+            log_warn("Cue list %s shares its id with a track, stop refers to the cue list", list_config->id);
+        }
+        if (!compile_list(&seq->lists[seq->n_lists], config, list_config)) {
+            sequencer_destroy(seq);
+            return NULL;
+        }
+        seq->n_lists++;
+    }
+
+    return seq;
+}
+
+void sequencer_destroy(sequencer_t *seq) {
+    if (!seq) return;
+
+    if (seq->timer) {
+        pw_loop_destroy_source(seq->loop, seq->timer);
+    }
+    for (int i = 0; seq->lists && i < seq->n_lists; i++) {
+        free(seq->lists[i].events);
+    }
+    free(seq->lists);
+    free(seq);
+}
+
+static cue_list_t *find_list(const sequencer_t *seq, const char *list_id) {
+    for (int i = 0; i < seq->n_lists; i++) {
+        if (strcmp(seq->lists[i].config->id, list_id) == 0) return &seq->lists[i];
+    }
+    return NULL;
+}
+
+bool sequencer_has_list(const sequencer_t *seq, const char *list_id) {
+    return seq && find_list(seq, list_id);
+}
+
+bool sequencer_goto_at(sequencer_t *seq, const char *list_id, const double position, const uint64_t at_ns) {
+    cue_list_t *list = seq ? find_list(seq, list_id) : NULL;
+    if (!list) {
+        log_warn("Cue list not found: %s", list_id);
+        return false;
+    }
+
+    const uint64_t start_ns = (uint64_t) (SPA_MAX(position, 0.0) * SPA_NSEC_PER_SEC);
+    list->origin_ns = (int64_t) at_ns - (int64_t) start_ns;
+    list->next = 0;
+    while (list->next < list->n_events && list->events[list->next].offset_ns < start_ns) {
+        list->next++;
+    }
+    list->running = list->next < list->n_events;
+
+    log_info("Cue list %s running from %.3f s, %u cues ahead", list_id, position, list->n_events - list->next);
+    arm_timer(seq);
+    return true;
+}
+
+bool sequencer_goto(sequencer_t *seq, const char *list_id, const double position) {
+    // Position lies a lookahead ahead, so even its first cue reaches its
+    // track in time
+    return sequencer_goto_at(seq, list_id, position, get_time_ns() + SEQUENCER_LOOKAHEAD_NS);
+}
+
+bool sequencer_go(sequencer_t *seq, const char *list_id) {
+    return sequencer_goto(seq, list_id, 0.0);
+}
+
+bool sequencer_stop(sequencer_t *seq, const char *list_id) {
+    cue_list_t *list = seq ? find_list(seq, list_id) : NULL;
+    if (!list) {
+        log_warn("Cue list not found: %s", list_id);
+        return false;
+    }
+
+    list->running = false;
+    log_info("Cue list %s stopped", list_id);
+    arm_timer(seq);
+    return true;
+}
+
+int sequencer_format(const sequencer_t *seq, char *buffer, const size_t size) {
+    size_t used = 0;
+    const int64_t now = (int64_t) get_time_ns();
+
+    for (int i = 0; seq && i < seq->n_lists && used < size; i++) {
+        const cue_list_t *list = &seq->lists[i];
+        int written;
+
+        if (list->running) {
+            written = snprintf(buffer + used, size - used, "  Cue list %s: running at %.3f s, cue %u of %u\n",
+                               list->config->id, (double) (now - list->origin_ns) / SPA_NSEC_PER_SEC,
+                               list->next + 1, list->n_events);
+        } else {
+            written = snprintf(buffer + used, size - used, "  Cue list %s: stopped, %u cues\n",
+                               list->config->id, list->n_events);
+        }
+        if (written < 0) break;
+        used += (size_t) written;
+    }
+
+    return (int) SPA_MIN(used, size ? size - 1 : 0);
+}
@@ -0,0 +1,41 @@
+#ifndef ASYNC_AUDIO_PLAYER_SEQUENCER_H
+#define ASYNC_AUDIO_PLAYER_SEQUENCER_H
+
+#include <stdbool.h>
+#include <pipewire/pipewire.h>
+#include "types.h"
+#include "track_manager.h"
+
+// Cues are handed to their tracks this far ahead, so a track has time to
+// get its output up and the change lands on its exact frame
+#define SEQUENCER_LOOKAHEAD_NS (250 * SPA_NSEC_PER_MSEC)
+
+// Runs the configured cue lists on the main loop. Cue times are turned into
+// times on the graph clock, tracks apply them at the exact frame.
+typedef struct sequencer sequencer_t;
+
+// Compile the cue lists of a configuration, cues on unknown tracks are dropped
+sequencer_t *sequencer_new(const global_config_t *config, track_manager_ctx_t *tracks, struct pw_loop *loop);
+
+void sequencer_destroy(sequencer_t *seq);
+
+// The following are called with the main loop locked
+
+// Whether a cue list of that id exists
+bool sequencer_has_list(const sequencer_t *seq, const char *list_id);
+
+// Run a cue list from position seconds on, go starts it from the top
+bool sequencer_goto(sequencer_t *seq, const char *list_id, double position);
+
+// Same, with position reached at at_ns on the graph clock instead of a
+// lookahead from now
+bool sequencer_goto_at(sequencer_t *seq, const char *list_id, double position, uint64_t at_ns);
+bool sequencer_go(sequencer_t *seq, const char *list_id);
+
+// Halt a cue list, cues already handed to tracks still happen
+bool sequencer_stop(sequencer_t *seq, const char *list_id);
+
+// Write the state of every cue list, returns the number of bytes written
+int sequencer_format(const sequencer_t *seq, char *buffer, size_t size);
+
+#endif // ASYNC_AUDIO_PLAYER_SEQUENCER_H
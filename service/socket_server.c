@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +9,7 @@
 #include <sys/stat.h>
 #include "socket_server.h"
 #include "log.h"
+#include "insert_chain.h"
 
 // Socket command handling
 typedef struct
@@ -17,17 +19,33 @@ typedef struct
 } command_handler_t;
 
 // Command handlers
-static int handle_play(track_manager_ctx_t* mgr, const char* track_id, char* response, size_t resp_size)
+static int handle_play(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
 {
-    if (!track_id || !track_id[0])
+    char args[256];
+    char* saveptr = NULL;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const char* track_id = strtok_r(args, " ", &saveptr);
+    const char* grid = strtok_r(NULL, " ", &saveptr);
+    if (!track_id)
     {
         snprintf(response, resp_size, "ERROR: Missing track ID");
         return -1;
     }
 
-    if (track_manager_play(mgr, track_id))
+    quantize_t quantize = QUANTIZE_NONE;
+    if (grid && !tempo_grid_parse_quantize(grid, &quantize))
+    {
+        snprintf(response, resp_size, "ERROR: Usage: play <track_id> [bar|beat]");
+        return -1;
+    }
+
+    if (track_manager_play_quantized(mgr, track_id, quantize))
     {
-        snprintf(response, resp_size, "OK: Playing track %s", track_id);
+        if (quantize == QUANTIZE_NONE)
+            snprintf(response, resp_size, "OK: Playing track %s", track_id);
+        else
+            snprintf(response, resp_size, "OK: Playing track %s from the next %s", track_id, grid);
         return 0;
     }
 
@@ -43,6 +61,18 @@ static int handle_stop(track_manager_ctx_t* mgr, const char* track_id, char* res
         return -1;
     }
 
+    // A cue list of that name is halted instead
+    if (track_manager_has_cue_list(mgr, track_id))
+    {
+        if (track_manager_stop_cue_list(mgr, track_id))
+        {
+            snprintf(response, resp_size, "OK: Stopped cue list %s", track_id);
+            return 0;
+        }
+        snprintf(response, resp_size, "ERROR: Failed to stop cue list %s", track_id);
+        return -1;
+    }
+
     if (track_manager_stop(mgr, track_id))
     {
         snprintf(response, resp_size, "OK: Stopped track %s", track_id);
@@ -53,6 +83,431 @@ static int handle_stop(track_manager_ctx_t* mgr, const char* track_id, char* res
     return -1;
 }
 
+// Split "<track_id> [ramp_ms]" in place, false on a malformed fade
+static bool parse_ramp_args(char* args, const char** track_id, uint32_t* ramp_ms)
+{
+    char* saveptr = NULL;
+    *track_id = strtok_r(args, " ", &saveptr);
+    const char* ramp = strtok_r(NULL, " ", &saveptr);
+
+    *ramp_ms = TRACK_RAMP_DEFAULT_MS;
+    if (ramp)
+    {
+        char* end;
+        const unsigned long value = strtoul(ramp, &end, 10);
+        if (*end != '\0' || value > 10000)
+            return false;
+        *ramp_ms = (uint32_t)value;
+    }
+    return *track_id != NULL;
+}
+
+static int handle_pause(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    uint32_t ramp_ms;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    if (!parse_ramp_args(args, &track_id, &ramp_ms))
+    {
+        snprintf(response, resp_size, "ERROR: Usage: pause <track_id> [ramp_ms]");
+        return -1;
+    }
+
+    if (track_manager_pause(mgr, track_id, ramp_ms))
+    {
+        snprintf(response, resp_size, "OK: Paused track %s", track_id);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to pause track %s", track_id);
+    return -1;
+}
+
+static int handle_resume(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    uint32_t ramp_ms;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    if (!parse_ramp_args(args, &track_id, &ramp_ms))
+    {
+        snprintf(response, resp_size, "ERROR: Usage: resume <track_id> [ramp_ms]");
+        return -1;
+    }
+
+    if (track_manager_resume(mgr, track_id, ramp_ms))
+    {
+        snprintf(response, resp_size, "OK: Resumed track %s", track_id);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to resume track %s", track_id);
+    return -1;
+}
+
+static int handle_skip(track_manager_ctx_t* mgr, const char* track_id, bool forward, char* response, size_t resp_size)
+{
+    if (!track_id || !track_id[0])
+    {
+        snprintf(response, resp_size, "ERROR: Missing track ID");
+        return -1;
+    }
+
+    if (track_manager_skip(mgr, track_id, forward))
+    {
+        snprintf(response, resp_size, "OK: Skipped %s on track %s", forward ? "ahead" : "back", track_id);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to skip on track %s", track_id);
+    return -1;
+}
+
+static int handle_next(track_manager_ctx_t* mgr, const char* track_id, char* response, size_t resp_size)
+{
+    return handle_skip(mgr, track_id, true, response, resp_size);
+}
+
+static int handle_prev(track_manager_ctx_t* mgr, const char* track_id, char* response, size_t resp_size)
+{
+    return handle_skip(mgr, track_id, false, response, resp_size);
+}
+
+// Split "<track_id> <a> <b> [c]" in place into up to max numbers, returns
+// how many were given or -1 on anything malformed
+static int parse_pan_args(char* args, const char** track_id, double* values, int max)
+{
+    char* saveptr = NULL;
+    int n = 0;
+
+    *track_id = strtok_r(args, " ", &saveptr);
+    for (const char* token; (token = strtok_r(NULL, " ", &saveptr)) != NULL;)
+    {
+        char* end;
+        if (n == max)
+            return -1;
+        values[n] = strtod(token, &end);
+        if (*end != '\0')
+            return -1;
+        n++;
+    }
+    return *track_id ? n : -1;
+}
+
+static int handle_pan(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    double values[3] = { 0.0, 0.0, 0.0 };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const int n = parse_pan_args(args, &track_id, values, 3);
+    if (n < 1 || n > 2)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: pan <track_id> <azimuth> [elevation]");
+        return -1;
+    }
+
+    const double azimuth = values[0] * M_PI / 180.0;
+    const double elevation = values[1] * M_PI / 180.0;
+    const pan_position_t position = {
+        .set = true,
+        .x = (float)(cos(elevation) * cos(azimuth)),
+        .y = (float)(cos(elevation) * sin(azimuth)),
+        .z = (float)sin(elevation),
+    };
+
+    if (track_manager_set_pan(mgr, track_id, &position))
+    {
+        snprintf(response, resp_size, "OK: Panned track %s to %.1f/%.1f", track_id, values[0], values[1]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to pan track %s", track_id);
+    return -1;
+}
+
+static int handle_pan_xy(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    double values[3] = { 0.0, 0.0, 0.0 };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const int n = parse_pan_args(args, &track_id, values, 3);
+    if (n < 2)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: pan-xy <track_id> <x> <y> [z]");
+        return -1;
+    }
+
+    const pan_position_t position = {
+        .set = true,
+        .x = (float)values[0],
+        .y = (float)values[1],
+        .z = (float)values[2],
+    };
+
+    if (track_manager_set_pan(mgr, track_id, &position))
+    {
+        snprintf(response, resp_size, "OK: Placed track %s at %.2f, %.2f, %.2f", track_id, values[0], values[1], values[2]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to place track %s", track_id);
+    return -1;
+}
+
+static int handle_move(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    char* saveptr = NULL;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const char* track_id = strtok_r(args, " ", &saveptr);
+    const char* trajectory_id = strtok_r(NULL, " ", &saveptr);
+    if (!track_id)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: move <track_id> [trajectory_id]");
+        return -1;
+    }
+
+    if (track_manager_move(mgr, track_id, trajectory_id))
+    {
+        if (trajectory_id)
+            snprintf(response, resp_size, "OK: Track %s follows %s", track_id, trajectory_id);
+        else
+            snprintf(response, resp_size, "OK: Track %s stopped moving", track_id);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to move track %s", track_id);
+    return -1;
+}
+
+static int handle_keyframe(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    double values[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const int n = parse_pan_args(args, &track_id, values, 4);
+    if (n < 3 || values[0] < 0.0)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: keyframe <track_id> <seconds> <x> <y> [z]");
+        return -1;
+    }
+
+    const keyframe_config_t keyframe = {
+        .position = {
+            .set = true,
+            .x = (float)values[1],
+            .y = (float)values[2],
+            .z = (float)values[3],
+        },
+        .duration = values[0],
+        .easing = EASING_LINEAR,
+    };
+
+    if (track_manager_push_keyframe(mgr, track_id, &keyframe))
+    {
+        snprintf(response, resp_size, "OK: Track %s moves to %.2f, %.2f, %.2f in %.3f s",
+                 track_id, values[1], values[2], values[3], values[0]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to queue keyframe for track %s", track_id);
+    return -1;
+}
+
+static int handle_yaw(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* track_id;
+    double values[1] = { 0.0 };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    if (parse_pan_args(args, &track_id, values, 1) != 1)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: yaw <track_id> <degrees>");
+        return -1;
+    }
+
+    if (track_manager_set_yaw(mgr, track_id, (float)values[0]))
+    {
+        snprintf(response, resp_size, "OK: Turned track %s to %.1f", track_id, values[0]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to turn track %s", track_id);
+    return -1;
+}
+
+static int handle_delay(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    char* saveptr = NULL;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const char* device = strtok_r(args, " ", &saveptr);
+    const char* channel = strtok_r(NULL, " ", &saveptr);
+    const char* value = strtok_r(NULL, " ", &saveptr);
+    char* end = NULL;
+    const double ms = value ? strtod(value, &end) : -1.0;
+    if (!device || !channel || !value || *end != '\0' || ms < 0.0)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: delay <device> <channel> <ms>");
+        return -1;
+    }
+
+    if (track_manager_set_delay(mgr, device, channel, ms))
+    {
+        snprintf(response, resp_size, "OK: Delayed %s of %s by %.3f ms", channel, device, ms);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to delay %s of %s", channel, device);
+    return -1;
+}
+
+static int handle_eq(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* target;
+    double values[4] = { 0.0, 0.0, 0.0, INSERT_DEFAULT_Q };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const int n = parse_pan_args(args, &target, values, 4);
+    if (n < 3 || values[0] < 0.0 || values[1] <= 0.0 || values[3] <= 0.0)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: eq <target> <index> <freq> <gain_db> [q]");
+        return -1;
+    }
+
+    const insert_config_t insert = {
+        .frequency = (float)values[1],
+        .gain = (float)values[2],
+        .q = (float)values[3],
+    };
+    if (track_manager_tune(mgr, target, (uint32_t)values[0], &insert))
+    {
+        snprintf(response, resp_size, "OK: Tuned insert %u of %s to %.1f Hz, %.1f dB",
+                 (uint32_t)values[0], target, values[1], values[2]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to tune insert %u of %s", (uint32_t)values[0], target);
+    return -1;
+}
+
+static int handle_bus_gain(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    const char* bus;
+    double values[1] = { 0.0 };
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    if (parse_pan_args(args, &bus, values, 1) != 1)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: bus-gain <bus> <gain_db>");
+        return -1;
+    }
+
+    if (track_manager_set_bus_gain(mgr, bus, (float)values[0]))
+    {
+        snprintf(response, resp_size, "OK: Bus %s at %.1f dB", bus, values[0]);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to set the gain of bus %s", bus);
+    return -1;
+}
+
+static int handle_mute(track_manager_ctx_t* mgr, const char* bus, char* response, size_t resp_size)
+{
+    if (!bus || !bus[0])
+    {
+        snprintf(response, resp_size, "ERROR: Missing bus name");
+        return -1;
+    }
+
+    if (track_manager_set_bus_mute(mgr, bus, true))
+    {
+        snprintf(response, resp_size, "OK: Muted bus %s", bus);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to mute bus %s", bus);
+    return -1;
+}
+
+static int handle_unmute(track_manager_ctx_t* mgr, const char* bus, char* response, size_t resp_size)
+{
+    if (!bus || !bus[0])
+    {
+        snprintf(response, resp_size, "ERROR: Missing bus name");
+        return -1;
+    }
+
+    if (track_manager_set_bus_mute(mgr, bus, false))
+    {
+        snprintf(response, resp_size, "OK: Unmuted bus %s", bus);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to unmute bus %s", bus);
+    return -1;
+}
+
+static int handle_go(track_manager_ctx_t* mgr, const char* list_id, char* response, size_t resp_size)
+{
+    if (!list_id || !list_id[0])
+    {
+        snprintf(response, resp_size, "ERROR: Missing cue list ID");
+        return -1;
+    }
+
+    if (track_manager_go(mgr, list_id, 0.0))
+    {
+        snprintf(response, resp_size, "OK: Running cue list %s", list_id);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to run cue list %s", list_id);
+    return -1;
+}
+
+static int handle_goto(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    char args[256];
+    char* saveptr = NULL;
+
+    snprintf(args, sizeof(args), "%s", arg ? arg : "");
+    const char* list_id = strtok_r(args, " ", &saveptr);
+    const char* at = strtok_r(NULL, " ", &saveptr);
+
+    char* end = NULL;
+    const double position = at ? strtod(at, &end) : -1.0;
+    if (!list_id || !at || *end != '\0' || position < 0.0)
+    {
+        snprintf(response, resp_size, "ERROR: Usage: goto <list_id> <seconds>");
+        return -1;
+    }
+
+    if (track_manager_go(mgr, list_id, position))
+    {
+        snprintf(response, resp_size, "OK: Running cue list %s from %.3f s", list_id, position);
+        return 0;
+    }
+
+    snprintf(response, resp_size, "ERROR: Failed to run cue list %s", list_id);
+    return -1;
+}
+
 static int handle_stop_all(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
 {
     (void)arg; // Unused
@@ -99,14 +554,66 @@ static int handle_reload(track_manager_ctx_t* mgr, const char* arg, char* respon
     return 0;
 }
 
+static int handle_devices(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    (void)arg; // Unused
+
+    const int written = snprintf(response, resp_size, "OK: Available devices:\n");
+    if (written < 0 || (size_t)written >= resp_size)
+    {
+        return -1;
+    }
+
+    if (track_manager_format_devices(mgr, response + written, resp_size - written) == 0)
+    {
+        snprintf(response, resp_size, "OK: No devices available");
+    }
+    return 0;
+}
+
+static int handle_stats(track_manager_ctx_t* mgr, const char* arg, char* response, size_t resp_size)
+{
+    (void)arg; // Unused
+
+    const int written = snprintf(response, resp_size, "OK: Driver statistics:\n");
+    if (written < 0 || (size_t)written >= resp_size)
+    {
+        return -1;
+    }
+
+    if (track_manager_format_stats(mgr, response + written, resp_size - written) == 0)
+    {
+        snprintf(response, resp_size, "OK: No mixer is driving");
+    }
+    return 0;
+}
+
 // Command table
 static const command_handler_t COMMANDS[] = {
     {"play", handle_play},
     {"stop", handle_stop},
     {"stop-all", handle_stop_all},
+    {"pause", handle_pause},
+    {"resume", handle_resume},
+    {"next", handle_next},
+    {"prev", handle_prev},
+    {"pan", handle_pan},
+    {"pan-xy", handle_pan_xy},
+    {"move", handle_move},
+    {"keyframe", handle_keyframe},
+    {"yaw", handle_yaw},
+    {"delay", handle_delay},
+    {"eq", handle_eq},
+    {"bus-gain", handle_bus_gain},
+    {"mute", handle_mute},
+    {"unmute", handle_unmute},
+    {"go", handle_go},
+    {"goto", handle_goto},
     {"list", handle_list},
     {"status", handle_status},
     {"reload", handle_reload},
+    {"devices", handle_devices},
+    {"stats", handle_stats},
     {NULL, NULL} // Terminator
 };
 
@@ -145,7 +652,7 @@ static void* socket_server_thread(void* arg)
 {
     socket_server_ctx_t* ctx = (socket_server_ctx_t*)arg;
     char buffer[1024];
-    char response[1024];
+    char response[4096];
 
     log_info("Socket server thread started");
 
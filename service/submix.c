@@ -0,0 +1,72 @@
+#include <math.h>
+#include <string.h>
+#include "submix.h"
+
+float submix_fader(const float gain_db) {
+    return powf(10.0f, gain_db / 20.0f);
+}
+
+void submix_init(submix_t *s, const bus_config_t *config) {
+    memset(s, 0, sizeof(*s));
+    s->config = config;
+    s->fader = submix_fader(config->gain);
+    s->mute = config->mute;
+    s->gain = s->mute ? 0.0f : s->fader;
+    s->duck = 1.0f;
+    s->duck_floor = submix_fader(-config->duck.depth);
+    s->key_threshold = powf(10.0f, config->duck.threshold / 10.0f);
+    atomic_init(&s->level, 0);
+}
+
+float submix_level(const submix_t *s) {
+    const uint32_t bits = atomic_load_explicit(&s->level, memory_order_relaxed);
+    float level;
+    memcpy(&level, &bits, sizeof(level));
+    return level;
+}
+
+// One pole smoother stepped once per block of n frames, ms to cover 1 - 1/e
+static float block_coefficient(const float ms, const uint32_t n, const uint32_t rate) {
+    return 1.0f - expf(-(float) n * 1000.0f / (ms * (float) rate));
+}
+
+void submix_process(submix_t *s, float *const *in, float *const *out, const uint32_t n_channels,
+                    const uint32_t n, const uint32_t rate) {
+    if (n == 0 || n_channels == 0) return;
+
+    // The key is measured once per block, the duck follows it block by block
+    if (s->key) {
+        const float target = submix_level(s->key) > s->key_threshold ? s->duck_floor : 1.0f;
+        const float ms = target < s->duck ? s->config->duck.attack : s->config->duck.release;
+        s->duck += (target - s->duck) * block_coefficient(ms, n, rate);
+    }
+
+    const float from = s->gain;
+    const float to = (s->mute ? 0.0f : s->fader) * s->duck;
+    const float step = (to - from) / (float) n;
+    s->gain = to;
+
+    // The loudest channel sets the level, so a bus feeding few of the
+    // device channels ducks as hard as one feeding all of them
+    float loudest = 0.0f;
+    if (from != 0.0f || to != 0.0f) {
+        for (uint32_t c = 0; c < n_channels; c++) {
+            const float *restrict src = in[c];
+            float *restrict dst = out[c];
+            float sum = 0.0f;
+            for (uint32_t f = 0; f < n; f++) {
+                const float v = src[f] * (from + step * (float) (f + 1));
+                dst[f] += v;
+                sum += v * v;
+            }
+            loudest = fmaxf(loudest, sum);
+        }
+    }
+
+    s->mean_square += (loudest / (float) n - s->mean_square) * block_coefficient(SUBMIX_LEVEL_MS, n, rate);
+    if (s->mean_square < 1e-20f) s->mean_square = 0.0f;
+
+    uint32_t bits;
+    memcpy(&bits, &s->mean_square, sizeof(bits));
+    atomic_store_explicit(&s->level, bits, memory_order_relaxed);
+}
@@ -0,0 +1,50 @@
+#ifndef ASYNC_AUDIO_PLAYER_SUBMIX_H
+#define ASYNC_AUDIO_PLAYER_SUBMIX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+#define SUBMIX_DEFAULT_THRESHOLD_DB -40.0f
+#define SUBMIX_DEFAULT_DEPTH_DB 6.0f
+#define SUBMIX_DEFAULT_ATTACK_MS 10.0f
+#define SUBMIX_DEFAULT_RELEASE_MS 300.0f
+
+// Window of the level a bus ducks others with, ms
+#define SUBMIX_LEVEL_MS 50.0f
+
+// Gain stage of a bus. Blocks of the bus go through its fader, mute and duck
+// and are added to what it plays into, the gain glides across every block
+// so changes do not click. Owned by the process thread of its mixer.
+typedef struct submix {
+    const bus_config_t *config;
+    const struct submix *output;   // Bus played into, NULL for the device
+    const struct submix *key;      // Bus that ducks it, NULL for none
+
+    float fader;                   // Linear, changed through invoke only
+    bool mute;
+    float gain;                    // Reached at the end of the last block
+    float duck;                    // Duck gain reached, 1 when not ducked
+    float duck_floor;              // Duck gain while the key is loud
+    float key_threshold;           // Mean square of the key it ducks above
+    float mean_square;             // Of its loudest channel, smoothed over SUBMIX_LEVEL_MS
+    atomic_uint level;             // mean_square as float bits, read by the buses it ducks
+} submix_t;
+
+// Start at the configured gain and mute, not ducked
+void submix_init(submix_t *submix, const bus_config_t *config);
+
+// Fader level of a gain in dB
+float submix_fader(float gain_db);
+
+// Take n frames of every planar channel of in through the gain stage and
+// add them onto out
+void submix_process(submix_t *submix, float *const *in, float *const *out, uint32_t n_channels,
+                    uint32_t n, uint32_t rate);
+
+// Smoothed mean square of the loudest channel a bus played, from any
+// thread. One block behind when read from another mixer.
+float submix_level(const submix_t *submix);
+
+#endif // ASYNC_AUDIO_PLAYER_SUBMIX_H
@@ -0,0 +1,88 @@
+#include <math.h>
+#include <string.h>
+#include "tempo_grid.h"
+#include "sample_pool.h"
+
+#define NSEC_PER_SEC 1000000000ull
+
+void tempo_grid_init(tempo_grid_t *grid, const tempo_config_t *config, const uint64_t origin_ns) {
+    grid->origin_ns = origin_ns;
+    grid->beat_ns = config->bpm > 0.0 ? 60.0 * NSEC_PER_SEC / config->bpm : 0.0;
+    grid->beats_per_bar = config->beats_per_bar > 0 ? config->beats_per_bar : 4;
+}
+
+bool tempo_grid_active(const tempo_grid_t *grid) {
+    return grid->beat_ns > 0.0;
+}
+
+bool tempo_grid_parse_quantize(const char *name, quantize_t *quantize) {
+    if (strcmp(name, "beat") == 0) {
+        *quantize = QUANTIZE_BEAT;
+    } else if (strcmp(name, "bar") == 0) {
+        *quantize = QUANTIZE_BAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *tempo_grid_quantize_name(const quantize_t quantize) {
+    switch (quantize) {
+        case QUANTIZE_BEAT: return "beat";
+        case QUANTIZE_BAR: return "bar";
+        default: return "none";
+    }
+}
+
+static double unit_ns(const tempo_grid_t *grid, const quantize_t quantize) {
+    return quantize == QUANTIZE_BAR ? grid->beat_ns * grid->beats_per_bar : grid->beat_ns;
+}
+
+uint64_t tempo_grid_next(const tempo_grid_t *grid, const quantize_t quantize, const uint64_t at_ns) {
+    if (!tempo_grid_active(grid) || quantize == QUANTIZE_NONE || at_ns <= grid->origin_ns) return at_ns;
+
+    // Lines are counted from the origin so rounding never accumulates
+    const double unit = unit_ns(grid, quantize);
+    const double lines = ceil((double) (at_ns - grid->origin_ns) / unit);
+    return grid->origin_ns + (uint64_t) llround(lines * unit);
+}
+
+uint64_t tempo_grid_snap(const tempo_grid_t *grid, const quantize_t quantize, const uint64_t length_ns) {
+    if (!tempo_grid_active(grid) || quantize == QUANTIZE_NONE) return length_ns;
+
+    const double unit = unit_ns(grid, quantize);
+    const double units = fmax(1.0, round((double) length_ns / unit));
+    return (uint64_t) llround(units * unit);
+}
+
+uint32_t tempo_grid_frames_until(const uint64_t at_ns, const uint64_t now_ns, const uint32_t rate,
+                                 const uint32_t max_frames) {
+    if (at_ns <= now_ns) return 0;
+
+    const uint64_t delta = at_ns - now_ns;
+    if (delta >= NSEC_PER_SEC) return max_frames;
+
+    const uint64_t frames = (delta * rate + NSEC_PER_SEC - 1) / NSEC_PER_SEC;
+    return frames < max_frames ? (uint32_t) frames : max_frames;
+}
+
+bool tempo_grid_wrap(track_instance_t *track, const uint64_t now_ns) {
+    bool rewound = false;
+
+    // A silent track keeps its position, it lines up again at the next wrap
+    if (!gain_ramp_is_silent(&track->ramp) && track->pool) {
+        // A pool starts every pass on a fresh pick
+        sample_pool_trigger(track->pool);
+        rewound = true;
+    } else if (!gain_ramp_is_silent(&track->ramp)) {
+        audio_file_t *af = track->audio_file;
+        const unsigned int loops = af->loop_count;
+        rewound = audio_file_rewind(af);
+        af->loop_count = loops + 1;
+    }
+
+    do {
+        track->grid_wrap_ns += track->grid_period_ns;
+    } while (track->grid_wrap_ns <= now_ns);
+    return rewound;
+}
@@ -0,0 +1,46 @@
+#ifndef ASYNC_AUDIO_PLAYER_TEMPO_GRID_H
+#define ASYNC_AUDIO_PLAYER_TEMPO_GRID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Grid line a start is deferred to
+typedef enum {
+    QUANTIZE_NONE,
+    QUANTIZE_BEAT,
+    QUANTIZE_BAR
+} quantize_t;
+
+// Beats and bars laid over the graph clock from a fixed origin
+typedef struct {
+    uint64_t origin_ns;      // Graph time of the first downbeat
+    double beat_ns;          // 0 when no tempo is set
+    uint32_t beats_per_bar;
+} tempo_grid_t;
+
+void tempo_grid_init(tempo_grid_t *grid, const tempo_config_t *config, uint64_t origin_ns);
+
+// A tempo is set
+bool tempo_grid_active(const tempo_grid_t *grid);
+
+// Parse "beat" or "bar", false on anything else
+bool tempo_grid_parse_quantize(const char *name, quantize_t *quantize);
+
+const char *tempo_grid_quantize_name(quantize_t quantize);
+
+// First line of the grid at or after at_ns
+uint64_t tempo_grid_next(const tempo_grid_t *grid, quantize_t quantize, uint64_t at_ns);
+
+// Length rounded to whole beats or bars, at least one
+uint64_t tempo_grid_snap(const tempo_grid_t *grid, quantize_t quantize, uint64_t length_ns);
+
+// Frames at rate from now_ns until at_ns, at most max_frames. 0 once due.
+uint32_t tempo_grid_frames_until(uint64_t at_ns, uint64_t now_ns, uint32_t rate, uint32_t max_frames);
+
+// A pass of a track looping on the grid is over, called from the process
+// thread. Starts the file over and moves the next wrap past now_ns. Returns
+// true when the file was rewound.
+bool tempo_grid_wrap(track_instance_t *track, uint64_t now_ns);
+
+#endif // ASYNC_AUDIO_PLAYER_TEMPO_GRID_H
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <spa/pod/builder.h>
+#include "track_desc.h"
+#include "track_manager.h"
+#include "sample_format.h"
+#include "log.h"
+
+// Room for every EnumFormat pod of one track
+#define TRACK_DESC_POD_MAX 4096
+
+static void resolve_layout(track_desc_t *desc, const track_config_t *config, const SF_INFO *info,
+                           const bool test_tone) {
+    const output_config_t *output = &config->output;
+
+    memset(desc, 0, sizeof(*desc));
+    desc->rate = (uint32_t) info->samplerate;
+
+    if (!test_tone && output->mapping_count > 0) {
+        desc->n_channels = SPA_MIN((uint32_t) output->mapping_count, SPA_AUDIO_MAX_CHANNELS);
+        for (uint32_t i = 0; i < desc->n_channels; i++) {
+            desc->positions[i] = get_channel_position(output->mapping[i]);
+            if (desc->positions[i] == SPA_AUDIO_CHANNEL_UNKNOWN) {
+                log_warn("Unknown channel name '%s' in track %s, using UNKNOWN", output->mapping[i], config->id);
+            }
+        }
+    } else {
+        // The tone goes out on as many channels as it is mapped to, files
+        // without a mapping on as many as they have, on sequential AUX channels
+        const uint32_t n = test_tone ? (uint32_t) output->mapping_count : (uint32_t) info->channels;
+        desc->n_channels = SPA_MIN(n, SPA_AUDIO_MAX_CHANNELS);
+        for (uint32_t i = 0; i < desc->n_channels; i++) {
+            desc->positions[i] = SPA_AUDIO_CHANNEL_AUX0 + i;
+        }
+    }
+}
+
+static size_t channel_names_size(const output_config_t *output) {
+    size_t size = 0;
+
+    for (int i = 0; i < output->mapping_count; i++) {
+        size += strlen(output->mapping[i]) + 1;
+    }
+    return size;
+}
+
+static uint32_t build_params(struct spa_pod_builder *b, const track_desc_t *desc, const bool test_tone,
+                             const struct spa_pod **params) {
+    struct spa_audio_info_raw audio_info = {
+        .rate = desc->rate,
+        .channels = desc->n_channels
+    };
+    memcpy(audio_info.position, desc->positions, desc->n_channels * sizeof(uint32_t));
+
+    // Files decode to interleaved float, which is written without a copy.
+    // Planar and integer formats are fallbacks so the adapter needs no
+    // conversion stage when the device cannot take F32. The tone generator
+    // writes interleaved float only.
+    static const uint32_t formats[TRACK_DESC_MAX_FORMATS] = {
+        SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S16
+    };
+    return sample_format_build_enum(b, formats, test_tone ? 1 : TRACK_DESC_MAX_FORMATS, &audio_info, params);
+}
+
+static uint32_t params_size(const track_desc_t *desc, const bool test_tone) {
+    uint8_t buffer[TRACK_DESC_POD_MAX];
+    const struct spa_pod *params[TRACK_DESC_MAX_FORMATS];
+    struct spa_pod_builder b;
+
+    spa_pod_builder_init(&b, buffer, sizeof(buffer));
+    build_params(&b, desc, test_tone, params);
+    return b.state.offset;
+}
+
+size_t track_desc_arena_size(const track_config_t *config, const SF_INFO *info, const bool test_tone) {
+    track_desc_t desc;
+
+    resolve_layout(&desc, config, info, test_tone);
+    return ARENA_SIZE(channel_names_size(&config->output)) + ARENA_SIZE(params_size(&desc, test_tone));
+}
+
+bool track_desc_init(track_desc_t *desc, const track_config_t *config, const SF_INFO *info,
+                     const bool test_tone, arena_t *arena) {
+    const output_config_t *output = &config->output;
+    uint32_t n = 0;
+
+    resolve_layout(desc, config, info, test_tone);
+    snprintf(desc->channels_value, sizeof(desc->channels_value), "%u", desc->n_channels);
+
+    if (output->mapping_count > 0) {
+        char *names = arena_alloc(arena, channel_names_size(output));
+        if (!names) return false;
+
+        size_t used = 0;
+        for (int i = 0; i < output->mapping_count; i++) {
+            used += (size_t) sprintf(names + used, i > 0 ? ",%s" : "%s", output->mapping[i]);
+        }
+        desc->channel_names = names;
+    }
+
+    desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_TYPE, "Audio");
+    desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_CATEGORY, "Playback");
+    desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_ROLE, test_tone ? "Test" : "Music");
+    desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NAME, config->id);
+    desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_DESCRIPTION, test_tone ? "Test Tone Generator" : config->id);
+    if (desc->channel_names) {
+        desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_CHANNELNAMES, desc->channel_names);
+        desc->items[n++] = SPA_DICT_ITEM_INIT(PW_KEY_AUDIO_CHANNELS, desc->channels_value);
+    }
+    desc->props = SPA_DICT_INIT(desc->items, n);
+
+    // Built straight into the arena, the play path hands them to PipeWire as is
+    const uint32_t size = params_size(desc, test_tone);
+    void *data = arena_alloc(arena, size);
+    if (!data) return false;
+
+    struct spa_pod_builder b;
+    spa_pod_builder_init(&b, data, size);
+    desc->n_params = build_params(&b, desc, test_tone, desc->params);
+    if (desc->n_params == 0) {
+        log_error("Failed to build stream formats for track %s", config->id);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef ASYNC_AUDIO_PLAYER_TRACK_DESC_H
+#define ASYNC_AUDIO_PLAYER_TRACK_DESC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sndfile.h>
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/raw.h>
+#include "types.h"
+#include "arena.h"
+
+#define TRACK_DESC_MAX_FORMATS 4
+#define TRACK_DESC_MAX_PROPS 8
+
+// What a track stream needs from its configuration and file, resolved once
+// when the configuration is loaded and not changed after that
+typedef struct track_desc {
+    uint32_t rate;
+    uint32_t n_channels;                         // Channels of the stream
+    uint32_t positions[SPA_AUDIO_MAX_CHANNELS];  // Resolved mapping, AUX0 upwards without one
+    const char *channel_names;                   // Mapping joined by commas, NULL without one
+    char channels_value[12];                     // n_channels as a property value
+
+    // Stream properties, the target is added per play
+    struct spa_dict_item items[TRACK_DESC_MAX_PROPS];
+    struct spa_dict props;
+
+    // EnumFormat params, preferred format first
+    const struct spa_pod *params[TRACK_DESC_MAX_FORMATS];
+    uint32_t n_params;
+} track_desc_t;
+
+// Arena space track_desc_init takes for a track
+size_t track_desc_arena_size(const track_config_t *config, const SF_INFO *info, bool test_tone);
+
+// Resolve the stream parameters of a track playing a file with the given
+// info. The test tone writes interleaved float on AUX positions.
+bool track_desc_init(track_desc_t *desc, const track_config_t *config, const SF_INFO *info,
+                     bool test_tone, arena_t *arena);
+
+#endif // ASYNC_AUDIO_PLAYER_TRACK_DESC_H
@@ -1,29 +1,85 @@
 #include "track_manager.h"
+#include "device_registry.h"
+#include "mixer.h"
+#include "filter_engine.h"
+#include "device_group.h"
+#include "sample_format.h"
+#include "arena.h"
+#include "track_desc.h"
+#include "sequencer.h"
+#include "playlist.h"
+#include "sample_pool.h"
+#include "tempo_grid.h"
+#include "track_reader.h"
+#include "trajectory.h"
+#include "ambisonic.h"
+#include "insert_chain.h"
+#include "submix.h"
 #include "log.h"
+#include <inttypes.h>
 #include <math.h>
 #include <pipewire/pipewire.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/props.h>
 #include <spa/pod/builder.h>
+#include <spa/utils/result.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#define MAX_TRACKS 32
+#define MAX_TRACKS 512
 #define BUFFER_SIZE 4096
+#define RECONNECT_INTERVAL_MS 1000
+#define REGISTRY_SYNC_TIMEOUT_S 2
 
 #include <stdint.h>
 #include <spa/param/audio/raw.h>
 
+// File of a configured track, opened when the configuration is loaded so
+// that play only has to rewind it
+typedef struct
+{
+    audio_file_t file;
+    playlist_t* playlist;                // Items of a playlist track, file stays unused
+    sample_pool_t* pool;                 // Members of a pool track, file stays unused
+    ambisonic_stream_t* ambisonic;       // Of an ambisonic track, from the arena
+    uint32_t ambisonic_order;            // 0 unless the file makes an ambisonic track
+    insert_chain_t* inserts;             // Of a track with inserts, from the arena
+    bool open;
+    float* block;                        // Scratch of TRACK_BLOCK_FRAMES frames, from the arena
+    track_desc_t desc;                   // Stream parameters, names and pods in the arena
+} track_source_t;
+
 struct track_manager_ctx
 {
     global_config_t* config;
-    track_instance_t tracks[MAX_TRACKS];
+    track_instance_t tracks[MAX_TRACKS]; // Slots, a free slot has config == NULL
+    track_source_t* sources;             // Per configured track
+    arena_t arena;                       // Scratch blocks of all sources
     int active_tracks;
+    struct pw_thread_loop* pw_loop;
     struct pw_context* pw_context;
-    struct pw_main_loop* pw_loop;
+    struct pw_loop* data_loop;           // Loop the process callbacks run on
+    struct pw_core* pw_core;             // Shared by every stream
+    struct spa_hook core_listener;
+    device_registry_t* registry;         // Live sink cache, lives with the core
+    struct spa_source* reconnect_timer;
+    struct spa_source* maintenance_event; // Signalled from the process thread
+    mixer_t** mixers;                    // Per configured device, NULL unless keep_warm or filter mode
+    submix_t* buses;                     // Per configured bus, run by the mixer of its device
+    device_group_t* groups;              // Per configured group, own context and data loop
+    filter_engine_t** engines;           // Filter node per group slot in filter mode, live with the core
+    sequencer_t* sequencer;              // Runs the cue lists on the main loop
+    tempo_grid_t* grids;                 // Per group slot, the global grid at slot 0
+    trajectory_motion_t motions[MAX_TRACKS]; // Per track slot
+    int reconnect_attempts;
     bool initialized;
 };
 
+static bool setup_track_output(track_manager_ctx_t* ctx, track_instance_t* track);
+static void teardown_track_output(track_instance_t* track);
+
 // Standard channel position mapping
 static const struct channel_position
 {
@@ -83,13 +139,120 @@ enum spa_audio_channel get_channel_position(const char* port_name)
     return SPA_AUDIO_CHANNEL_UNKNOWN;
 }
 
+// Render frames [offset, offset + n_frames) of a cycle. A silent track holds
+// its decode position. Returns the frame of the cycle a file that does not
+// loop ran out on, -1 while it has not.
+static int64_t render_track(track_instance_t* track, void* const* dst, uint32_t offset, uint32_t n_frames)
+{
+    const sample_kernel_t* kernel = track->format.kernel;
+    const uint32_t stream_channels = track->format.channels;
+    const uint32_t channels = track->audio_file->info.channels;
+    const bool silent = gain_ramp_is_silent(&track->ramp);
+    size_t frames_read = 0;
+
+    if (!track->decode)
+    {
+        // Same layout as the file, decode straight into the stream buffer
+        float* out = (float*)dst[0] + (size_t)offset * channels;
+        frames_read = silent ? 0 : track_read(track, out, n_frames);
+        if (frames_read < n_frames)
+        {
+            // Fill remaining buffer with silence
+            memset(out + frames_read * channels, 0, (n_frames - frames_read) * channels * sizeof(float));
+        }
+        if (!silent && !gain_ramp_is_unity(&track->ramp))
+        {
+            gain_ramp_apply(&track->ramp, out, channels, n_frames);
+        }
+    }
+    else
+    {
+        // Decode in blocks and let the kernel deinterleave or convert
+        for (uint32_t done = 0; done < n_frames; done += TRACK_BLOCK_FRAMES)
+        {
+            const uint32_t n = SPA_MIN(n_frames - done, TRACK_BLOCK_FRAMES);
+            const size_t got = silent ? 0 : track_read(track, track->decode, n);
+            if (got < n)
+            {
+                memset(track->decode + got * channels, 0, (n - got) * channels * sizeof(float));
+            }
+            if (!silent && !gain_ramp_is_unity(&track->ramp))
+            {
+                gain_ramp_apply(&track->ramp, track->decode, channels, n);
+            }
+            kernel->from_interleaved(dst, stream_channels, offset + done, track->decode, channels, n);
+            frames_read += got;
+        }
+    }
+
+    // A track looping on the grid holds silence until its next pass
+    if (silent || frames_read == n_frames || track->audio_file->loop || track->grid_period_ns > 0)
+        return -1;
+    return (int64_t)offset + (int64_t)frames_read;
+}
+
+// Graph clock as read outside a cycle
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SPA_NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Graph time of the first frame of this cycle, cues are timed against it
+static uint64_t cycle_time_ns(struct pw_stream* stream)
+{
+    struct pw_time t;
+
+    if (pw_stream_get_time_n(stream, &t, sizeof(t)) == 0 && t.now > 0)
+        return (uint64_t)t.now;
+    return get_time_ns();
+}
+
+// Graph time of a frame, half a frame early so rounding on either side lands
+// a change scheduled for it on that very frame
+static uint64_t frame_time_ns(uint64_t clock_ns, uint64_t frame, uint32_t rate)
+{
+    if (frame == 0)
+        return clock_ns;
+    return clock_ns + (frame * SPA_NSEC_PER_SEC - SPA_NSEC_PER_SEC / 2) / rate;
+}
+
+// Close to the end of the file, tell the main loop the frame it runs out on
+// so the follow action starts right there. end_frame counts from the start
+// of the cycle, -1 while the file has not ended yet.
+static void arm_follow(track_instance_t* track, uint32_t n_frames, int64_t end_frame, uint64_t clock_ns)
+{
+    const follow_config_t* on_end = &track->config->on_end;
+    if ((!on_end->track && !on_end->cue_list) || track->follow_armed || track->paused || track->stopping ||
+        track->grid_period_ns > 0 || gain_ramp_is_silent(&track->ramp))
+        return;
+
+    const sf_count_t left = track_remaining(track);
+    const uint32_t rate = track->format.rate;
+    if (left < 0 || (uint64_t)left * SPA_NSEC_PER_SEC / rate > TRACK_FOLLOW_LEAD_NS)
+        return;
+
+    if (clock_ns == 0)
+        clock_ns = cycle_time_ns(track->stream);
+    const uint64_t frame = end_frame >= 0 ? (uint64_t)end_frame : n_frames + (uint64_t)left;
+    track->follow_ns = frame_time_ns(clock_ns, frame, rate);
+    track->follow_armed = true;
+    pw_loop_signal_event(
+        pw_thread_loop_get_loop(track->manager->pw_loop),
+        track->manager->maintenance_event
+    );
+}
+
 // PipeWire stream callback
 static void on_process(void* userdata)
 {
     track_instance_t* track = userdata;
+    const sample_kernel_t* kernel = track->format.kernel;
+    const uint32_t stream_channels = track->format.channels;
+    const uint32_t rate = track->format.rate;
     struct pw_buffer* b;
-    struct spa_buffer* buf;
-    float* dst;
+    void* dst[SPA_AUDIO_MAX_CHANNELS];
 
     if ((b = pw_stream_dequeue_buffer(track->stream)) == NULL)
     {
@@ -97,43 +260,228 @@ static void on_process(void* userdata)
         return;
     }
 
-    buf = b->buffer;
-    dst = buf->datas[0].data;
-    if (dst == NULL)
+    // Sized by what the graph asks for this cycle, follows quantum changes
+    const uint32_t n_frames =
+        kernel ? sample_buffer_map(kernel, b->buffer, stream_channels, dst, b->requested) : 0;
+    if (n_frames == 0)
+    {
+        pw_stream_queue_buffer(track->stream, b);
         return;
+    }
 
-    const size_t n_frames =
-        buf->datas[0].maxsize / sizeof(float) / track->audio_file->info.channels;
-
-    // Read audio data
-    const size_t frames_read = audio_file_read(track->audio_file, dst, n_frames);
+    // Read audio data, level changes and grid wraps due in this cycle split
+    // it at their exact frame
+    const unsigned int loops = track_boundaries(track);
+    const uint64_t clock_ns =
+        track->ramp.n_events > 0 || track->grid_period_ns > 0 ? cycle_time_ns(track->stream) : 0;
+    int64_t end_frame = -1;
 
-    if (frames_read < n_frames)
+    for (uint32_t done = 0; done < n_frames;)
     {
-        if (!track->audio_file->loop)
+        uint32_t n = n_frames - done;
+        if (track->ramp.n_events > 0)
+        {
+            n = gain_ramp_next_event(&track->ramp, clock_ns + (uint64_t)done * SPA_NSEC_PER_SEC / rate, rate, n);
+            if (n == 0)
+            {
+                gain_ramp_fire(&track->ramp);
+                continue;
+            }
+        }
+        if (track->grid_period_ns > 0)
         {
-            // End of file reached and not looping
-            track->state = TRACK_STATE_STOPPED;
-            log_info("Track finished: %s", track->config->id);
+            const uint64_t now_ns = clock_ns + (uint64_t)done * SPA_NSEC_PER_SEC / rate;
+            n = tempo_grid_frames_until(track->grid_wrap_ns, now_ns, rate, n);
+            if (n == 0)
+            {
+                tempo_grid_wrap(track, now_ns);
+                continue;
+            }
         }
-        // Fill remaining buffer with silence
-        memset(
-            dst + (frames_read * track->audio_file->info.channels),
-            0,
-            (n_frames - frames_read) * track->audio_file->info.channels *
-            sizeof(float)
+        const int64_t end = render_track(track, dst, done, n);
+        if (end_frame < 0)
+            end_frame = end;
+        done += n;
+    }
+
+    arm_follow(track, n_frames, end_frame, clock_ns);
+
+    // Faded out to pause or stop, the main loop takes it from here
+    if ((track->paused || track->stopping) && !track->faded_out &&
+        track->ramp.n_events == 0 && gain_ramp_is_silent(&track->ramp))
+    {
+        track->faded_out = true;
+        pw_loop_signal_event(
+            pw_thread_loop_get_loop(track->manager->pw_loop),
+            track->manager->maintenance_event
         );
     }
 
-    buf->datas[0].chunk->offset = 0;
-    buf->datas[0].chunk->stride =
-        track->audio_file->info.channels * sizeof(float);
-    buf->datas[0].chunk->size =
-        n_frames * track->audio_file->info.channels * sizeof(float);
+    // Loop boundary, a pending move back to the preferred device can go now
+    if (track->failback_pending && track_boundaries(track) != loops)
+    {
+        track->failback_pending = false;
+        track->failback_ready = true;
+        pw_loop_signal_event(
+            pw_thread_loop_get_loop(track->manager->pw_loop),
+            track->manager->maintenance_event
+        );
+    }
+
+    // On to the next playlist item, the main loop decodes the one after it
+    if (track->playlist && track->playlist->switched)
+    {
+        track->playlist->switched = false;
+        pw_loop_signal_event(
+            pw_thread_loop_get_loop(track->manager->pw_loop),
+            track->manager->maintenance_event
+        );
+    }
+
+    if (end_frame >= 0 && !track->ended)
+    {
+        // End of file reached and not looping
+        track->state = TRACK_STATE_STOPPED;
+        track->ended = true;
+        if (track->follow_armed)
+        {
+            pw_loop_signal_event(
+                pw_thread_loop_get_loop(track->manager->pw_loop),
+                track->manager->maintenance_event
+            );
+        }
+        log_info("Track finished: %s", track->config->id);
+    }
 
+    sample_buffer_finish(kernel, b->buffer, stream_channels, n_frames);
     pw_stream_queue_buffer(track->stream, b);
 }
 
+// Render state handed to the process thread in one piece
+struct format_update
+{
+    track_instance_t* track;
+    stream_format_t format;
+    float* decode;
+};
+
+static int do_update_format(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    struct format_update* update = user_data;
+    track_instance_t* track = update->track;
+
+    track->format = update->format;
+    track->decode = update->decode;
+    return 0;
+}
+
+// The format was negotiated, renegotiated or cleared. Everything the new
+// format needs is set up here and swapped in between two cycles, so a
+// rate or layout change does not restart the track.
+static void on_stream_param_changed(void* userdata, uint32_t id, const struct spa_pod* param)
+{
+    track_instance_t* track = userdata;
+    struct format_update update = { .track = track };
+
+    if (id != SPA_PARAM_Format)
+        return;
+
+    if (param && !stream_format_parse(param, &update.format))
+    {
+        log_error("Unsupported negotiated format for track %s", track->config->id);
+    }
+
+    const uint32_t channels = track->audio_file->info.channels;
+    if (update.format.kernel)
+    {
+        // Anything but F32 in the layout of the file goes through the scratch block
+        if (update.format.format != SPA_AUDIO_FORMAT_F32 || update.format.channels != channels)
+        {
+            update.decode = track->block;
+        }
+
+        if (update.format.rate != (uint32_t)track->audio_file->info.samplerate)
+        {
+            log_warn(
+                "Track %s runs at %u Hz, the file has %d Hz",
+                track->config->id,
+                update.format.rate,
+                track->audio_file->info.samplerate
+            );
+        }
+
+        log_debug(
+            "Track %s negotiated %s, %u channels, %u Hz",
+            track->config->id,
+            sample_format_name(update.format.format),
+            update.format.channels,
+            update.format.rate
+        );
+    }
+
+    pw_loop_invoke(track->data_loop, do_update_format, 0, NULL, 0, true, &update);
+}
+
+// Fade handed to the process thread of a track
+struct ramp_update
+{
+    track_instance_t* track;
+    float target;
+    uint32_t n_frames;
+};
+
+static int do_set_ramp(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    struct ramp_update* update = user_data;
+
+    // Pause and resume override whatever cues were still to come
+    update->track->ramp.n_events = 0;
+    gain_ramp_set(&update->track->ramp, update->target, update->n_frames);
+    update->track->faded_out = false;
+    return 0;
+}
+
+// Level change at a time on the graph clock, applied by the process thread
+struct gain_schedule
+{
+    track_instance_t* track;
+    uint64_t at_ns;
+    float target;
+    uint32_t n_frames;
+};
+
+static int do_schedule_gain(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    struct gain_schedule* schedule = user_data;
+    track_instance_t* track = schedule->track;
+
+    if (!gain_ramp_schedule(&track->ramp, schedule->at_ns, schedule->target, schedule->n_frames))
+        return -ENOSPC;
+    track->faded_out = false;
+    return 0;
+}
+
 static void on_stream_state_changed(
     void* userdata,
     enum pw_stream_state old,
@@ -153,11 +501,7 @@ static void on_stream_state_changed(
     {
     case PW_STREAM_STATE_ERROR:
         track->state = TRACK_STATE_ERROR;
-        if (track->error.message)
-        {
-            free(track->error.message);
-        }
-        track->error.message = error ? strdup(error) : strdup("Unknown error");
+        snprintf(track->error.message, sizeof(track->error.message), "%s", error ? error : "Unknown error");
         log_error("Stream error: %s", track->error.message);
         break;
 
@@ -198,57 +542,127 @@ static void on_stream_state_changed(
     }
 }
 
+static void on_test_tone_process(void* userdata);
+
 static const struct pw_stream_events stream_events = {
     PW_VERSION_STREAM_EVENTS,
     .process = on_process,
     .state_changed = on_stream_state_changed,
+    .param_changed = on_stream_param_changed,
+};
+
+static const struct pw_stream_events test_tone_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .process = on_test_tone_process,
+    .state_changed = on_stream_state_changed,
+};
+
+// Test tone configuration
+static track_config_t TEST_TONE_CONFIG = {
+    .id = "test_tone",
+    .loop = true,
+    .volume = 0.5f,
+    .output = {
+        .devices = NULL,
+        .device_count = 0,
+        .mapping = NULL,
+        .mapping_count = 0
+    }
 };
 
-// Initialize PipeWire for a track
+static bool is_test_tone(const track_instance_t* track)
+{
+    return track->config == &TEST_TONE_CONFIG;
+}
+
+// Find the slot of an active track, NULL if it is not active
+static track_instance_t* find_active_track(track_manager_ctx_t* ctx, const char* track_id)
+{
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        if (ctx->tracks[i].config && strcmp(ctx->tracks[i].config->id, track_id) == 0)
+        {
+            return &ctx->tracks[i];
+        }
+    }
+    return NULL;
+}
+
+static const trajectory_config_t* find_trajectory(track_manager_ctx_t* ctx, const char* trajectory_id)
+{
+    for (int i = 0; i < ctx->config->trajectory_count; i++)
+    {
+        const trajectory_config_t* path = &ctx->config->trajectories[i];
+        if (path->id && strcmp(path->id, trajectory_id) == 0)
+        {
+            return path;
+        }
+    }
+    return NULL;
+}
+
+// Find a free slot. Slots never move while in use because the stream
+// listener hook and the stream user data point into them.
+static track_instance_t* alloc_track_slot(track_manager_ctx_t* ctx)
+{
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        if (!ctx->tracks[i].config)
+        {
+            return &ctx->tracks[i];
+        }
+    }
+    return NULL;
+}
+
+// Per group arrays have the shared loop at slot 0 and group i at slot i + 1
+static int group_slot(track_manager_ctx_t* ctx, int group_index)
+{
+    if (group_index < 0 || group_index >= ctx->config->group_count || !ctx->groups[group_index].context)
+        return 0;
+    return group_index + 1;
+}
+
+static struct pw_core* slot_core(track_manager_ctx_t* ctx, int slot)
+{
+    return slot == 0 ? ctx->pw_core : ctx->groups[slot - 1].core;
+}
+
+static struct pw_loop* slot_data_loop(track_manager_ctx_t* ctx, int slot)
+{
+    return slot == 0 ? ctx->data_loop : ctx->groups[slot - 1].data_loop;
+}
+
+// Group slot of the device a track currently plays on
+static int track_group_slot(track_manager_ctx_t* ctx, const track_instance_t* track)
+{
+    if (track->device_index < 0)
+        return 0;
+
+    const char* device = track->config->output.devices[track->device_index];
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        if (ctx->config->devices[i].name && strcmp(ctx->config->devices[i].name, device) == 0)
+            return group_slot(ctx, ctx->config->devices[i].group_index);
+    }
+    return 0;
+}
+
+static filter_engine_t* mixer_engine(track_manager_ctx_t* ctx, const mixer_t* mixer)
+{
+    return ctx->engines[group_slot(ctx, mixer->config->group_index)];
+}
+
+// Create the stream for a track on the core of its device group
 static bool init_track_pipewire(
     track_manager_ctx_t* ctx,
     track_instance_t* track
 )
 {
     bool success = false; // Used for cleanup handling
-    struct pw_properties* props = NULL;
-    char channelNames[1024] = "";
-    // Build channel names string if mapping is specified
-    if (track->config->output.mapping_count > 0)
-    {
-        for (int i = 0; i < track->config->output.mapping_count; i++)
-        {
-            if (i > 0)
-            {
-                if (strlen(channelNames) + 1 >= sizeof(channelNames))
-                {
-                    log_error("Channel names string too long");
-                    return false;
-                }
-                strcat(channelNames, ",");
-            }
-            if (strlen(channelNames) + strlen(track->config->output.mapping[i]) >= sizeof(channelNames))
-            {
-                log_error("Channel names string too long");
-                return false;
-            }
-            strcat(channelNames, track->config->output.mapping[i]);
-        }
-    }
-
-    props = pw_properties_new(
-        PW_KEY_MEDIA_TYPE,
-        "Audio",
-        PW_KEY_MEDIA_CATEGORY,
-        "Playback",
-        PW_KEY_MEDIA_ROLE,
-        "Music",
-        PW_KEY_NODE_NAME,
-        track->config->id,
-        PW_KEY_NODE_DESCRIPTION,
-        track->config->id,
-        NULL
-    );
+
+    // Everything but the target was resolved when the configuration was loaded
+    struct pw_properties* props = pw_properties_new_dict(&track->desc->props);
 
     if (!props)
     {
@@ -256,45 +670,24 @@ static bool init_track_pipewire(
         goto cleanup;
     }
 
-    // Add device target if specified
-    if (track->config->output.device)
+    // Target the resolved node by serial so the session manager does not
+    // have to match names again
+    const device_node_t* target = device_registry_get(ctx->registry, track->target_id);
+    if (target)
     {
-        if (pw_properties_set(props, PW_KEY_TARGET_OBJECT, track->config->output.device) != 0)
+        if (pw_properties_setf(props, PW_KEY_TARGET_OBJECT, "%" PRIu64, target->serial) < 0)
         {
             log_error("Failed to set target device property");
             goto cleanup;
         }
     }
 
-    // Add channel mapping if specified
-    if (track->config->output.mapping_count > 0)
-    {
-        if (pw_properties_set(props, PW_KEY_NODE_CHANNELNAMES, channelNames) != 0)
-        {
-            log_error("Failed to set channel names property");
-            goto cleanup;
-        }
-        if (pw_properties_set(props, PW_KEY_MEDIA_TYPE, "Audio") != 0)
-        {
-            log_error("Failed to set media type property");
-            goto cleanup;
-        }
-        if (pw_properties_setf(props, PW_KEY_AUDIO_CHANNELS, "%d", track->config->output.mapping_count) != 0)
-        {
-            log_error("Failed to set audio channels property");
-            goto cleanup;
-        }
-    }
-
-    // Create stream
-    track->stream =
-        pw_stream_new_simple(
-            pw_main_loop_get_loop(ctx->pw_loop),
-            track->config->id,
-            props,
-            &stream_events,
-            track
-        );
+    // Create stream on the core of its device group, this takes ownership
+    // of the properties
+    const int slot = track_group_slot(ctx, track);
+    track->data_loop = slot_data_loop(ctx, slot);
+    track->stream = pw_stream_new(slot_core(ctx, slot), track->config->id, props);
+    props = NULL;
 
     if (!track->stream)
     {
@@ -302,6 +695,14 @@ static bool init_track_pipewire(
         goto cleanup;
     }
 
+    spa_zero(track->stream_listener);
+    pw_stream_add_listener(
+        track->stream,
+        &track->stream_listener,
+        is_test_tone(track) ? &test_tone_events : &stream_events,
+        track
+    );
+
     success = true;
 
 cleanup:
@@ -319,260 +720,1898 @@ cleanup:
     return success;
 }
 
-track_manager_ctx_t* track_manager_init(global_config_t* config)
+static bool is_default_device(const char* device)
 {
-    track_manager_ctx_t* ctx = calloc(1, sizeof(track_manager_ctx_t));
-    if (!ctx)
+    return strcmp(device, "default") == 0;
+}
+
+// Position of a node in the failover list of a track, -1 if not listed
+static int device_list_index(
+    track_manager_ctx_t* ctx,
+    const track_instance_t* track,
+    const device_node_t* node
+)
+{
+    if (is_test_tone(track))
+        return -1;
+
+    const output_config_t* output = &track->config->output;
+    for (int i = 0; i < output->device_count; i++)
     {
-        log_error("Failed to allocate track manager context");
-        return NULL;
+        if (!is_default_device(output->devices[i]) &&
+            device_registry_find(ctx->registry, output->devices[i]) == node)
+        {
+            return i;
+        }
     }
+    return -1;
+}
 
-    ctx->config = config;
-    ctx->active_tracks = 0;
+// Resolve the configured devices against the registry cache, picking the
+// first entry of the failover list that is present
+static bool resolve_track_target(track_manager_ctx_t* ctx, track_instance_t* track)
+{
+    const output_config_t* output = &track->config->output;
 
-    // Initialize PipeWire
-    pw_init(NULL, NULL);
+    track->target_id = SPA_ID_INVALID;
+    track->device_index = -1;
 
-    ctx->pw_loop = pw_main_loop_new(NULL);
-    if (!ctx->pw_loop)
+    // No explicit device, leave the choice to the session manager
+    if (is_test_tone(track) || output->device_count == 0)
+        return true;
+
+    for (int i = 0; i < output->device_count; i++)
     {
-        log_error("Failed to create PipeWire main loop");
-        free(ctx);
-        return NULL;
-    }
+        if (is_default_device(output->devices[i]))
+        {
+            track->device_index = i;
+            return true;
+        }
 
-    ctx->pw_context = pw_context_new(pw_main_loop_get_loop(ctx->pw_loop), NULL, 0);
+        const device_node_t* node = device_registry_find(ctx->registry, output->devices[i]);
+        if (!node)
+        {
+            log_debug("Output device not present: %s", output->devices[i]);
+            continue;
+        }
 
-    if (!ctx->pw_context)
-    {
-        log_error("Failed to create PipeWire context");
-        pw_main_loop_destroy(ctx->pw_loop);
-        free(ctx);
-        return NULL;
+        // Ports may still be arriving right after the node appeared
+        if (node->n_ports > 0)
+        {
+            for (int j = 0; j < output->mapping_count; j++)
+            {
+                const char* channel = output->mapping[j];
+                if (!device_registry_find_port(ctx->registry, node->id, channel))
+                {
+                    log_warn("Device %s has no %s channel (track %s)", node->name, channel, track->config->id);
+                }
+            }
+        }
+
+        if (i > 0)
+        {
+            log_warn("Track %s using fallback device %s", track->config->id, node->name);
+        }
+
+        track->target_id = node->id;
+        track->device_index = i;
+        return true;
     }
 
-    ctx->initialized = true;
-    return ctx;
+    log_error("No output device available for track %s", track->config->id);
+    return false;
 }
 
-void track_manager_cleanup(track_manager_ctx_t* ctx)
+// Mixer serving a node, NULL if that device has no bus
+static mixer_t* find_mixer(track_manager_ctx_t* ctx, uint32_t node_id)
 {
-    if (!ctx)
+    if (node_id == SPA_ID_INVALID)
+        return NULL;
+
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        if (ctx->mixers[i] && ctx->mixers[i]->target_id == node_id)
+        {
+            return ctx->mixers[i];
+        }
+    }
+    return NULL;
+}
+
+static bool has_output(const track_instance_t* track)
+{
+    return track->stream || track->voice;
+}
+
+static bool connect_track_stream(track_manager_ctx_t* ctx, track_instance_t* track);
+
+// Give a track its output: a voice on the mixer of its device or a stream
+// of its own. Called on play and again when the core connection was
+// re-established or its device came back.
+static bool setup_track_output(track_manager_ctx_t* ctx, track_instance_t* track)
+{
+    // A paused track fades out again on its new output before it is held
+    track->faded_out = false;
+
+    if (!resolve_track_target(ctx, track))
+        return false;
+
+    mixer_t* mixer = find_mixer(ctx, track->target_id);
+    if (mixer && track->audio_file)
+    {
+        track->voice = mixer_add_voice(mixer, track);
+        if (!track->voice)
+            return false;
+
+        track->mixer = mixer;
+        track->is_connected = true;
+        return true;
+    }
+
+    if (track->pan.set)
+        log_warn("Track %s is panned but its device has no speaker layout, playing it unpanned", track->config->id);
+    if (track->ambisonic)
+        log_warn("Track %s is ambisonic but its device has no speaker layout, playing it undecoded", track->config->id);
+    return connect_track_stream(ctx, track);
+}
+
+// Create and connect a stream of its own for a track
+static bool connect_track_stream(track_manager_ctx_t* ctx, track_instance_t* track)
+{
+    if (!init_track_pipewire(ctx, track))
+    {
+        log_error("Failed to initialize PipeWire for track: %s", track->config->id);
+        return false;
+    }
+
+    // Formats were built when the configuration was loaded
+    const track_desc_t* desc = track->desc;
+    const struct spa_pod* params[TRACK_DESC_MAX_FORMATS];
+    memcpy(params, desc->params, desc->n_params * sizeof(params[0]));
+
+    if (pw_stream_connect(
+        track->stream,
+        PW_DIRECTION_OUTPUT,
+        PW_ID_ANY,
+        PW_STREAM_FLAG_AUTOCONNECT |
+        PW_STREAM_FLAG_MAP_BUFFERS |
+        PW_STREAM_FLAG_RT_PROCESS,
+        params,
+        desc->n_params
+    ) < 0)
+    {
+        log_error("Failed to connect stream: %s", track->config->id);
+        teardown_track_output(track);
+        return false;
+    }
+
+    return true;
+}
+
+static void teardown_track_output(track_instance_t* track)
+{
+    if (track->voice)
+    {
+        mixer_remove_voice(track->mixer, track->voice);
+        track->voice = NULL;
+        track->mixer = NULL;
+        track->is_connected = false;
+    }
+
+    if (!track->stream)
         return;
 
-    // Stop all tracks
-    track_manager_stop_all(ctx);
+    spa_hook_remove(&track->stream_listener);
+    pw_stream_destroy(track->stream);
+    track->stream = NULL;
+    track->is_connected = false;
+    memset(&track->format, 0, sizeof(track->format));
+    track->decode = NULL;
+}
 
-    // Cleanup PipeWire
-    if (ctx->pw_context)
-        pw_context_destroy(ctx->pw_context);
-    if (ctx->pw_loop)
-        pw_main_loop_destroy(ctx->pw_loop);
+// File a track is set up from, the first item of a playlist or the format
+// of a pool
+static audio_file_t* source_file(track_source_t* source)
+{
+    if (source->pool)
+        return &source->pool->format;
+    return source->playlist ? &source->playlist->items[0] : &source->file;
+}
 
-    pw_deinit();
+// Open every configured file, resolve its stream parameters and carve the
+// scratch of each from one arena, so playing and stopping never reach the
+// system allocator and never parse names or build pods
+static bool open_sources(track_manager_ctx_t* ctx)
+{
+    const global_config_t* config = ctx->config;
+    size_t arena_size = 0;
+    int n_open = 0;
+
+    ctx->sources = calloc(config->track_count > 0 ? config->track_count : 1, sizeof(track_source_t));
+    if (!ctx->sources)
+    {
+        log_error("Failed to allocate track sources");
+        return false;
+    }
+
+    for (int i = 0; i < config->track_count; i++)
+    {
+        const track_config_t* track = &config->tracks[i];
+        track_source_t* source = &ctx->sources[i];
+
+        // A missing file fails its track on play, not the whole configuration
+        if (track->pool.member_count > 0)
+        {
+            source->pool = sample_pool_open(track);
+            source->open = source->pool != NULL;
+        }
+        else if (track->file_count > 0)
+        {
+            source->playlist = playlist_open(track);
+            source->open = source->playlist != NULL;
+        }
+        else
+        {
+            source->open = audio_file_init(&source->file, track->file_path, track->loop, track->volume);
+            source->file.repeat = track->on_end.repeat;
+        }
+        if (source->open)
+        {
+            const SF_INFO* info = &source_file(source)->info;
+            arena_size += ARENA_SIZE((size_t)TRACK_BLOCK_FRAMES * info->channels * sizeof(float));
+            arena_size += track_desc_arena_size(track, info, false);
+            if (source->playlist)
+                arena_size += playlist_arena_size(source->playlist);
+            if (source->pool)
+                arena_size += sample_pool_arena_size(source->pool);
+            if (track->ambisonic.enabled)
+            {
+                source->ambisonic_order = ambisonic_order(&track->ambisonic, (uint32_t)info->channels);
+                if (source->ambisonic_order > 0)
+                    arena_size += ARENA_SIZE(sizeof(ambisonic_stream_t));
+                else
+                    log_warn("Track %s has %d channels, not an ambisonic order up to %d, playing it as it is",
+                             track->id, info->channels, AMBISONIC_MAX_ORDER);
+            }
+            if (track->insert_count > 0)
+                arena_size += insert_chain_arena_size(track->inserts, track->insert_count,
+                                                      (uint32_t)info->channels, (uint32_t)info->samplerate);
+            n_open++;
+        }
+    }
+
+    if (!arena_init(&ctx->arena, arena_size))
+        return false;
+
+    for (int i = 0; i < config->track_count; i++)
+    {
+        track_source_t* source = &ctx->sources[i];
+        if (!source->open)
+            continue;
+
+        const SF_INFO* info = &source_file(source)->info;
+        source->block = arena_alloc(&ctx->arena, (size_t)TRACK_BLOCK_FRAMES * info->channels * sizeof(float));
+        if (!source->block)
+            return false;
+        if (!track_desc_init(&source->desc, &config->tracks[i], info, false, &ctx->arena))
+            return false;
+        if (source->playlist && !playlist_alloc(source->playlist, &ctx->arena))
+            return false;
+        if (source->pool && !sample_pool_load(source->pool, &ctx->arena))
+            source->open = false;
+        if (source->ambisonic_order > 0)
+        {
+            source->ambisonic = arena_alloc(&ctx->arena, sizeof(ambisonic_stream_t));
+            if (!source->ambisonic)
+                return false;
+        }
+        if (config->tracks[i].insert_count > 0)
+        {
+            source->inserts = insert_chain_new(&ctx->arena, config->tracks[i].inserts, config->tracks[i].insert_count,
+                                               (uint32_t)info->channels, (uint32_t)info->samplerate,
+                                               (uint32_t)info->samplerate);
+            if (!source->inserts)
+                return false;
+        }
+    }
+
+    log_info("Opened %d of %d track files, %zu bytes of scratch", n_open, config->track_count, ctx->arena.size);
+    return true;
+}
+
+static void close_sources(track_manager_ctx_t* ctx)
+{
+    if (ctx->sources)
+    {
+        for (int i = 0; i < ctx->config->track_count; i++)
+        {
+            playlist_close(ctx->sources[i].playlist);
+            sample_pool_close(ctx->sources[i].pool);
+            if (ctx->sources[i].open)
+                audio_file_clear(&ctx->sources[i].file);
+        }
+        free(ctx->sources);
+        ctx->sources = NULL;
+    }
+    arena_clear(&ctx->arena);
+}
+
+// Core connection handling
+
+static void schedule_reconnect(track_manager_ctx_t* ctx)
+{
+    struct timespec value = {
+        .tv_sec = RECONNECT_INTERVAL_MS / 1000,
+        .tv_nsec = (RECONNECT_INTERVAL_MS % 1000) * SPA_NSEC_PER_MSEC
+    };
+
+    pw_loop_update_timer(
+        pw_thread_loop_get_loop(ctx->pw_loop),
+        ctx->reconnect_timer,
+        &value,
+        NULL,
+        false
+    );
+}
+
+static void on_core_error(
+    void* data,
+    uint32_t id,
+    int seq,
+    int res,
+    const char* message
+)
+{
+    track_manager_ctx_t* ctx = data;
+
+    log_error(
+        "PipeWire error: id:%u seq:%d res:%d (%s): %s",
+        id,
+        seq,
+        res,
+        spa_strerror(res),
+        message ? message : ""
+    );
+
+    // A broken pipe on the core itself means the daemon went away. Tearing
+    // the core down from inside its own callback is not allowed, so defer.
+    if (id == PW_ID_CORE && res == -EPIPE)
+    {
+        schedule_reconnect(ctx);
+    }
+}
+
+static const struct pw_core_events core_events = {
+    PW_VERSION_CORE_EVENTS,
+    .error = on_core_error,
+};
+
+// Start the mixers, all of them or the ones on a new node. In filter mode
+// they get ports on the filter node, otherwise a stream of their own.
+static void connect_mixers(track_manager_ctx_t* ctx, const device_node_t* node)
+{
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        mixer_t* mixer = ctx->mixers[i];
+        if (!mixer || mixer->target_id != SPA_ID_INVALID)
+            continue;
+
+        const device_node_t* target = device_registry_find(ctx->registry, mixer->config->name);
+        if (!target || (node && target != node))
+            continue;
+
+        if (ctx->config->engine.mode == ENGINE_MODE_FILTER)
+        {
+            if (mixer_engine(ctx, mixer))
+                filter_engine_attach(mixer_engine(ctx, mixer), mixer, target);
+        }
+        else
+        {
+            mixer_connect(mixer, slot_core(ctx, group_slot(ctx, mixer->config->group_index)), target);
+        }
+    }
+}
+
+// Bring back every track that lost its output, decode positions are kept
+static void restore_tracks(track_manager_ctx_t* ctx, const device_node_t* node)
+{
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        track_instance_t* track = &ctx->tracks[i];
+        if (!track->config || has_output(track))
+            continue;
+
+        // On a device arrival only pick up the tracks that list that device
+        if (node && device_list_index(ctx, track, node) < 0)
+            continue;
+
+        if (!setup_track_output(ctx, track))
+        {
+            track->state = TRACK_STATE_DISCONNECTED;
+            continue;
+        }
+        track->state = TRACK_STATE_PLAYING;
+        log_info("Track %s connected to %s", track->config->id, node ? node->name : "PipeWire");
+    }
+}
+
+static void on_registry_synced(void* data)
+{
+    track_manager_ctx_t* ctx = data;
+
+    connect_mixers(ctx, NULL);
+    restore_tracks(ctx, NULL);
+
+    // Wake up track_manager_init() waiting for the first enumeration
+    pw_thread_loop_signal(ctx->pw_loop, false);
+}
+
+// Reconnect a track to the best device of its failover list that is
+// present. The file stays open so playback continues where it was.
+static void retarget_track(track_manager_ctx_t* ctx, track_instance_t* track)
+{
+    teardown_track_output(track);
+    track->failback_pending = false;
+    track->failback_ready = false;
+
+    if (!setup_track_output(ctx, track))
+    {
+        log_warn("Track %s waiting for one of its devices", track->config->id);
+        track->state = TRACK_STATE_DISCONNECTED;
+        return;
+    }
+    track->state = TRACK_STATE_PLAYING;
+}
+
+static void on_device_added(void* data, const device_node_t* node)
+{
+    track_manager_ctx_t* ctx = data;
+
+    // Before the initial sync restore_tracks() runs anyway
+    if (!device_registry_is_synced(ctx->registry))
+        return;
+
+    connect_mixers(ctx, node);
+    restore_tracks(ctx, node);
+
+    // Tracks running on a fallback move back at their next loop boundary
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        track_instance_t* track = &ctx->tracks[i];
+        if (!track->config || !has_output(track) || !track->audio_file)
+            continue;
+
+        const int index = device_list_index(ctx, track, node);
+        if (index < 0 || index >= track->device_index)
+            continue;
+
+        if (track->config->loop)
+        {
+            log_info("Device %s is back, moving track %s at its next loop", node->name, track->config->id);
+            track->failback_pending = true;
+        }
+        else
+        {
+            log_info("Device %s is back, track %s stays on its fallback until it ends", node->name, track->config->id);
+        }
+    }
+}
+
+static void on_device_removed(void* data, const device_node_t* node)
+{
+    track_manager_ctx_t* ctx = data;
+
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        track_instance_t* track = &ctx->tracks[i];
+        if (!track->config || track->target_id != node->id)
+            continue;
+
+        log_warn("Output device %s removed, failing over track %s", node->name, track->config->id);
+        retarget_track(ctx, track);
+    }
+
+    // Voices have moved off, the mixer comes back with its device
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        if (ctx->mixers[i] && ctx->mixers[i]->target_id == node->id)
+        {
+            log_warn("Output device %s removed, mixer stopped", node->name);
+            if (mixer_engine(ctx, ctx->mixers[i]))
+                filter_engine_detach(mixer_engine(ctx, ctx->mixers[i]), ctx->mixers[i]);
+            else
+                mixer_disconnect(ctx->mixers[i]);
+        }
+    }
+}
+
+static void on_ports_changed(void* data, uint32_t node_id)
+{
+    track_manager_ctx_t* ctx = data;
+
+    // Filter ports and device ports show up after their nodes
+    for (int i = 0; i <= ctx->config->group_count; i++)
+    {
+        if (ctx->engines[i])
+            filter_engine_relink(ctx->engines[i], node_id);
+    }
+}
+
+// Loop the process thread of a track runs on, NULL while it has no output
+static struct pw_loop* track_process_loop(const track_instance_t* track)
+{
+    if (track->voice)
+        return track->mixer->data_loop;
+    return track->stream ? track->data_loop : NULL;
+}
+
+// Take a track off its output and free its slot, the file stays open
+// for the next play
+static void release_track(track_manager_ctx_t* ctx, track_instance_t* track)
+{
+    teardown_track_output(track);
+    memset(track, 0, sizeof(track_instance_t));
+    ctx->active_tracks--;
+}
+
+// A track is about to run out, start its follow action on the frame it ends
+static void run_follow(track_manager_ctx_t* ctx, const track_instance_t* track)
+{
+    const follow_config_t* on_end = &track->config->on_end;
+
+    if (on_end->track)
+    {
+        log_info("Track %s ends, following with track %s", track->config->id, on_end->track);
+        track_manager_start_at(ctx, on_end->track, track->follow_ns, 0);
+    }
+    if (on_end->cue_list)
+    {
+        log_info("Track %s ends, following with cue list %s", track->config->id, on_end->cue_list);
+        sequencer_goto_at(ctx->sequencer, on_end->cue_list, on_end->cue_at, track->follow_ns);
+    }
+}
+
+// Work handed over from the process thread
+static void on_maintenance(void* data, uint64_t count)
+{
+    track_manager_ctx_t* ctx = data;
+
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        track_instance_t* track = &ctx->tracks[i];
+        if (!track->config)
+            continue;
+
+        // Faded out by a stop cue, the slot can go
+        if (track->stopping && track->faded_out)
+        {
+            log_info("Stopped track: %s", track->config->id);
+            release_track(ctx, track);
+            continue;
+        }
+
+        if (track->follow_armed && !track->follow_done)
+        {
+            track->follow_done = true;
+            run_follow(ctx, track);
+        }
+
+        // Ran out and handed over, the slot is free for whatever comes next
+        if (track->ended && track->follow_done)
+        {
+            log_info("Track %s handed over", track->config->id);
+            release_track(ctx, track);
+            continue;
+        }
+
+        // Faded out, the stream can stop asking for buffers
+        if (track->paused && track->faded_out && track->stream)
+        {
+            track->faded_out = false;
+            pw_stream_set_active(track->stream, false);
+            log_debug("Stream of track %s deactivated", track->config->id);
+        }
+
+        // Moved on to the next playlist item, decode the one after it
+        if (track->playlist && track->playlist->want_next)
+        {
+            playlist_queue(track->playlist, track_process_loop(track));
+            log_info("Track %s playing %s", track->config->id, playlist_current_path(track->playlist));
+        }
+
+        if (track->failback_ready)
+        {
+            log_info("Loop boundary reached, moving track %s back to its preferred device", track->config->id);
+            retarget_track(ctx, track);
+        }
+    }
+}
+
+static const device_registry_events_t registry_events = {
+    .synced = on_registry_synced,
+    .node_added = on_device_added,
+    .node_removed = on_device_removed,
+    .ports_changed = on_ports_changed,
+};
+
+static void disconnect_core(track_manager_ctx_t* ctx)
+{
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        if (ctx->tracks[i].config)
+        {
+            teardown_track_output(&ctx->tracks[i]);
+            ctx->tracks[i].state = TRACK_STATE_DISCONNECTED;
+        }
+    }
+
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        mixer_disconnect(ctx->mixers[i]);
+    }
+
+    for (int i = 0; i <= ctx->config->group_count; i++)
+    {
+        filter_engine_destroy(ctx->engines[i]);
+        ctx->engines[i] = NULL;
+    }
+
+    if (ctx->registry)
+    {
+        device_registry_destroy(ctx->registry);
+        ctx->registry = NULL;
+    }
+
+    for (int i = 0; i < ctx->config->group_count; i++)
+    {
+        device_group_disconnect(&ctx->groups[i]);
+    }
+
+    if (ctx->pw_core)
+    {
+        spa_hook_remove(&ctx->core_listener);
+        pw_core_disconnect(ctx->pw_core);
+        ctx->pw_core = NULL;
+    }
+}
+
+// One filter node per group slot that has devices, each on its own loop
+static bool connect_engines(track_manager_ctx_t* ctx)
+{
+    mixer_t** group_mixers = calloc(ctx->config->device_count > 0 ? ctx->config->device_count : 1, sizeof(mixer_t*));
+    if (!group_mixers)
+        return false;
+
+    bool success = true;
+    for (int slot = 0; slot <= ctx->config->group_count && success; slot++)
+    {
+        if (slot > 0 && !ctx->groups[slot - 1].context)
+            continue;
+
+        int n_mixers = 0;
+        for (int i = 0; i < ctx->config->device_count; i++)
+        {
+            const bool member = ctx->mixers[i] && group_slot(ctx, ctx->mixers[i]->config->group_index) == slot;
+            group_mixers[i] = member ? ctx->mixers[i] : NULL;
+            n_mixers += member;
+        }
+        if (n_mixers == 0)
+            continue;
+
+        char name[128];
+        if (slot == 0)
+            snprintf(name, sizeof(name), "papad");
+        else
+            snprintf(name, sizeof(name), "papad.%s", ctx->groups[slot - 1].config->name);
+
+        ctx->engines[slot] = filter_engine_new(
+            slot_core(ctx, slot),
+            slot_data_loop(ctx, slot),
+            name,
+            ctx->registry,
+            group_mixers,
+            ctx->config->device_count
+        );
+        success = ctx->engines[slot] != NULL;
+    }
+
+    free(group_mixers);
+    return success;
+}
+
+static bool connect_core(track_manager_ctx_t* ctx)
+{
+    ctx->pw_core = pw_context_connect(ctx->pw_context, NULL, 0);
+    if (!ctx->pw_core)
+    {
+        log_error("Failed to connect to PipeWire: %s", strerror(errno));
+        return false;
+    }
+
+    spa_zero(ctx->core_listener);
+    pw_core_add_listener(ctx->pw_core, &ctx->core_listener, &core_events, ctx);
+
+    ctx->registry = device_registry_new(ctx->pw_core, &registry_events, ctx);
+    if (!ctx->registry)
+    {
+        disconnect_core(ctx);
+        return false;
+    }
+
+    // Every group has a connection of its own, a broken one reconnects all
+    for (int i = 0; i < ctx->config->group_count; i++)
+    {
+        if (ctx->groups[i].context && !device_group_connect(&ctx->groups[i], &core_events, ctx))
+        {
+            disconnect_core(ctx);
+            return false;
+        }
+    }
+
+    if (ctx->config->engine.mode == ENGINE_MODE_FILTER && !connect_engines(ctx))
+    {
+        disconnect_core(ctx);
+        return false;
+    }
+    return true;
+}
+
+static void on_reconnect_timeout(void* data, uint64_t expirations)
+{
+    track_manager_ctx_t* ctx = data;
+
+    disconnect_core(ctx);
+
+    ctx->reconnect_attempts++;
+    log_info("Reconnecting to PipeWire (attempt %d)", ctx->reconnect_attempts);
+
+    if (!connect_core(ctx))
+    {
+        schedule_reconnect(ctx);
+        return;
+    }
+
+    ctx->reconnect_attempts = 0;
+    log_info("Reconnected to PipeWire");
+
+    // Active tracks are restored once the registry has been enumerated
+}
+
+track_manager_ctx_t* track_manager_init(global_config_t* config)
+{
+    track_manager_ctx_t* ctx = calloc(1, sizeof(track_manager_ctx_t));
+    if (!ctx)
+    {
+        log_error("Failed to allocate track manager context");
+        return NULL;
+    }
+
+    ctx->config = config;
+    ctx->active_tracks = 0;
+
+    if (!open_sources(ctx))
+        goto error;
+
+    // Initialize PipeWire
+    pw_init(NULL, NULL);
+
+    ctx->pw_loop = pw_thread_loop_new("papad", NULL);
+    if (!ctx->pw_loop)
+    {
+        log_error("Failed to create PipeWire thread loop");
+        goto error;
+    }
+
+    ctx->pw_context = pw_context_new(pw_thread_loop_get_loop(ctx->pw_loop), NULL, 0);
+    if (!ctx->pw_context)
+    {
+        log_error("Failed to create PipeWire context");
+        goto error;
+    }
+
+    ctx->data_loop = pw_data_loop_get_loop(pw_context_get_data_loop(ctx->pw_context));
+
+    ctx->reconnect_timer = pw_loop_add_timer(
+        pw_thread_loop_get_loop(ctx->pw_loop),
+        on_reconnect_timeout,
+        ctx
+    );
+    if (!ctx->reconnect_timer)
+    {
+        log_error("Failed to create PipeWire reconnect timer");
+        goto error;
+    }
+
+    ctx->maintenance_event = pw_loop_add_event(
+        pw_thread_loop_get_loop(ctx->pw_loop),
+        on_maintenance,
+        ctx
+    );
+    if (!ctx->maintenance_event)
+    {
+        log_error("Failed to create PipeWire maintenance event");
+        goto error;
+    }
+
+    // Device groups run on contexts of their own, sharing the main loop
+    ctx->groups = calloc(config->group_count > 0 ? config->group_count : 1, sizeof(device_group_t));
+    ctx->engines = calloc(config->group_count + 1, sizeof(filter_engine_t*));
+    if (!ctx->groups || !ctx->engines)
+    {
+        log_error("Failed to allocate device groups");
+        goto error;
+    }
+    for (int i = 0; i < config->group_count; i++)
+    {
+        if (!config->groups[i].name)
+            continue;
+        if (!device_group_init(&ctx->groups[i], &config->groups[i], pw_thread_loop_get_loop(ctx->pw_loop)))
+            goto error;
+    }
+
+    // Tempo grids share one origin, so groups at the same tempo stay in step
+    ctx->grids = calloc(config->group_count + 1, sizeof(tempo_grid_t));
+    if (!ctx->grids)
+    {
+        log_error("Failed to allocate tempo grids");
+        goto error;
+    }
+    const uint64_t grid_origin_ns = get_time_ns();
+    tempo_grid_init(&ctx->grids[0], &config->tempo, grid_origin_ns);
+    for (int i = 0; i < config->group_count; i++)
+    {
+        const tempo_config_t* tempo = config->groups[i].tempo.bpm > 0.0 ? &config->groups[i].tempo : &config->tempo;
+        tempo_grid_init(&ctx->grids[i + 1], tempo, grid_origin_ns);
+    }
+
+    // Warm devices get a mixer that runs for the lifetime of the daemon. In
+    // filter mode every device is mixed, each into its ports of the filter.
+    ctx->mixers = calloc(config->device_count > 0 ? config->device_count : 1, sizeof(mixer_t*));
+    if (!ctx->mixers)
+    {
+        log_error("Failed to allocate mixers");
+        goto error;
+    }
+    for (int i = 0; i < config->device_count; i++)
+    {
+        if (!config->devices[i].name)
+            continue;
+        if (!config->devices[i].keep_warm && config->devices[i].speaker_count == 0 &&
+            config->devices[i].delay_count == 0 && config->devices[i].insert_count == 0 &&
+            config->devices[i].fir_count == 0 && config->devices[i].bus_count == 0 &&
+            config->engine.mode != ENGINE_MODE_FILTER)
+            continue;
+
+        ctx->mixers[i] = mixer_new(
+            &config->devices[i],
+            slot_data_loop(ctx, group_slot(ctx, config->devices[i].group_index)),
+            pw_thread_loop_get_loop(ctx->pw_loop),
+            ctx->maintenance_event
+        );
+        if (!ctx->mixers[i])
+            goto error;
+    }
+
+    // Buses join the mixer of their device in mixing order
+    if (config->bus_count > 0 && config->bus_order)
+    {
+        ctx->buses = calloc(config->bus_count, sizeof(submix_t));
+        if (!ctx->buses)
+        {
+            log_error("Failed to allocate buses");
+            goto error;
+        }
+        for (int i = 0; i < config->bus_count; i++)
+            submix_init(&ctx->buses[i], &config->buses[i]);
+
+        for (int i = 0; i < config->bus_count; i++)
+        {
+            const int b = config->bus_order[i];
+            const bus_config_t* bus = &config->buses[b];
+            if (bus->device_index < 0)
+                continue;
+
+            if (bus->output_index >= 0)
+                ctx->buses[b].output = &ctx->buses[bus->output_index];
+            if (bus->duck.key_index >= 0)
+                ctx->buses[b].key = &ctx->buses[bus->duck.key_index];
+            mixer_add_bus(ctx->mixers[bus->device_index], &ctx->buses[b]);
+        }
+    }
+
+    ctx->sequencer = sequencer_new(config, ctx, pw_thread_loop_get_loop(ctx->pw_loop));
+    if (!ctx->sequencer)
+        goto error;
+
+    if (pw_thread_loop_start(ctx->pw_loop) < 0)
+    {
+        log_error("Failed to start PipeWire thread loop");
+        goto error;
+    }
+
+    // Connect once, every stream is created on this core. If the daemon is
+    // not up yet keep retrying in the background instead of failing.
+    pw_thread_loop_lock(ctx->pw_loop);
+    if (!connect_core(ctx))
+    {
+        log_warn("PipeWire not available, retrying every %d ms", RECONNECT_INTERVAL_MS);
+        schedule_reconnect(ctx);
+    }
+    else
+    {
+        // Devices must be known before the first play can resolve them
+        while (!device_registry_is_synced(ctx->registry))
+        {
+            if (pw_thread_loop_timed_wait(ctx->pw_loop, REGISTRY_SYNC_TIMEOUT_S) != 0)
+            {
+                log_warn("Timed out waiting for the PipeWire registry");
+                break;
+            }
+        }
+    }
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    ctx->initialized = true;
+    return ctx;
+
+error:
+    sequencer_destroy(ctx->sequencer);
+    if (ctx->mixers)
+    {
+        for (int i = 0; i < config->device_count; i++)
+            mixer_destroy(ctx->mixers[i]);
+        free(ctx->mixers);
+    }
+    free(ctx->buses);
+    if (ctx->groups)
+    {
+        for (int i = 0; i < config->group_count; i++)
+            device_group_clear(&ctx->groups[i]);
+        free(ctx->groups);
+    }
+    free(ctx->engines);
+    free(ctx->grids);
+    if (ctx->pw_context)
+        pw_context_destroy(ctx->pw_context);
+    if (ctx->pw_loop)
+        pw_thread_loop_destroy(ctx->pw_loop);
+    pw_deinit();
+    close_sources(ctx);
+    free(ctx);
+    return NULL;
+}
+
+void track_manager_cleanup(track_manager_ctx_t* ctx)
+{
+    if (!ctx)
+        return;
+
+    // No cue may start anything once tracks are being stopped
+    pw_thread_loop_lock(ctx->pw_loop);
+    sequencer_destroy(ctx->sequencer);
+    ctx->sequencer = NULL;
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    // Stop all tracks
+    track_manager_stop_all(ctx);
+
+    pw_thread_loop_lock(ctx->pw_loop);
+    disconnect_core(ctx);
+    pw_loop_destroy_source(pw_thread_loop_get_loop(ctx->pw_loop), ctx->reconnect_timer);
+    pw_loop_destroy_source(pw_thread_loop_get_loop(ctx->pw_loop), ctx->maintenance_event);
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        mixer_destroy(ctx->mixers[i]);
+    }
+    free(ctx->mixers);
+    free(ctx->buses);
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    // Cleanup PipeWire
+    pw_thread_loop_stop(ctx->pw_loop);
+    for (int i = 0; i < ctx->config->group_count; i++)
+    {
+        device_group_clear(&ctx->groups[i]);
+    }
+    free(ctx->groups);
+    free(ctx->engines);
+    free(ctx->grids);
+    if (ctx->pw_context)
+        pw_context_destroy(ctx->pw_context);
+    if (ctx->pw_loop)
+        pw_thread_loop_destroy(ctx->pw_loop);
+
+    pw_deinit();
+
+    close_sources(ctx);
+    free(ctx);
+}
+
+static track_config_t* find_track_config(track_manager_ctx_t* ctx, const char* track_id)
+{
+    for (int i = 0; i < ctx->config->track_count; i++)
+    {
+        if (strcmp(ctx->config->tracks[i].id, track_id) == 0)
+            return &ctx->config->tracks[i];
+    }
+    return NULL;
+}
+
+// Start a track with the main loop locked. A held track gets its output but
+// stays silent at the start of its file until a cue fades it in. Returns the
+// track, or the one already playing.
+static track_instance_t* start_track(track_manager_ctx_t* ctx, const char* track_id, bool held)
+{
+    track_config_t* config = find_track_config(ctx, track_id);
+    if (!config)
+    {
+        log_error("Track not found: %s", track_id);
+        return NULL;
+    }
+
+    // Check if track is already playing
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (track)
+    {
+        log_info("Track already playing: %s", track_id);
+        return track;
+    }
+
+    if (!ctx->pw_core)
+    {
+        log_error("Not connected to PipeWire, cannot play track: %s", track_id);
+        return NULL;
+    }
+
+    // Initialize new track instance
+    track = alloc_track_slot(ctx);
+    if (!track)
+    {
+        log_error("Maximum number of active tracks reached");
+        return NULL;
+    }
+
+    memset(track, 0, sizeof(track_instance_t));
+    track->manager = ctx;
+    track->state = TRACK_STATE_STOPPED;
+    track->target_id = SPA_ID_INVALID;
+    track->device_index = -1;
+    track->is_connected = false;
+    track->level = 1.0f;
+    track->pan = config->pan;
+    track->motion = &ctx->motions[track - ctx->tracks];
+    trajectory_reset(track->motion);
+    const trajectory_config_t* path = config->trajectory ? find_trajectory(ctx, config->trajectory) : NULL;
+    if (path && path->keyframe_count > 0)
+    {
+        // Without a position of its own the source starts where the path does
+        if (!track->pan.set)
+            track->pan = path->keyframes[0].position;
+        trajectory_follow(track->motion, path);
+    }
+    gain_ramp_init(&track->ramp);
+    if (held)
+        gain_ramp_set(&track->ramp, 0.0f, 0);
+
+    // The file was opened at load, starting over needs no allocation
+    track_source_t* source = &ctx->sources[config - ctx->config->tracks];
+    if (!source->open ||
+        !(source->pool || (source->playlist ? playlist_rewind(source->playlist) : audio_file_rewind(&source->file))))
+    {
+        log_error("Audio file not available: %s", config->file_path);
+        return NULL;
+    }
+    if (source->pool)
+    {
+        // Members are in memory, picking one is all a trigger does
+        source->pool->loop = config->loop;
+        sample_pool_trigger(source->pool);
+    }
+    track->audio_file = source_file(source);
+    track->playlist = source->playlist;
+    track->pool = source->pool;
+    track->ambisonic = source->ambisonic;
+    if (source->ambisonic)
+        ambisonic_stream_init(source->ambisonic, &config->ambisonic, source->ambisonic_order);
+    track->inserts = source->inserts;
+    if (source->inserts)
+        insert_chain_reset(source->inserts);
+    if (!source->playlist && !source->pool)
+        source->file.loop = config->loop;
+    track->block = source->block;
+    track->desc = &source->desc;
+
+    // Claim the slot only once the file is ready
+    track->config = config;
+
+    if (!setup_track_output(ctx, track))
+    {
+        memset(track, 0, sizeof(track_instance_t));
+        return NULL;
+    }
+
+    track->state = TRACK_STATE_PLAYING;
+    ctx->active_tracks++;
+    log_info("Started playback of track: %s", track_id);
+    return track;
+}
+
+// A pool track triggered again while up plays a fresh pick from the start
+static int do_retrigger(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    track_instance_t* track = user_data;
+
+    sample_pool_trigger(track->pool);
+    if (track->voice)
+        mixer_voice_restart(track->voice);
+    if (track->ended)
+    {
+        track->ended = false;
+        track->state = TRACK_STATE_PLAYING;
+    }
+    return 0;
+}
+
+bool track_manager_play(track_manager_ctx_t* ctx, const char* track_id)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (track && track->pool && !track->stopping)
+    {
+        // Stays on its output between triggers, nothing to set up again
+        struct pw_loop* loop = track_process_loop(track);
+        if (loop)
+            pw_loop_invoke(loop, do_retrigger, 0, NULL, 0, true, track);
+        else
+            do_retrigger(NULL, false, 0, NULL, 0, track);
+        log_info("Triggered track %s: %s", track_id, sample_pool_current_path(track->pool));
+        success = true;
+    }
+    else
+    {
+        success = start_track(ctx, track_id, false) != NULL;
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    return success;
+}
+
+bool track_manager_stop(track_manager_ctx_t* ctx, const char* track_id)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        pw_thread_loop_unlock(ctx->pw_loop);
+        log_warn("Track not playing: %s", track_id);
+        return false;
+    }
+
+    release_track(ctx, track);
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    log_info("Stopped track: %s", track_id);
+    return true;
+}
+
+bool track_manager_stop_all(track_manager_ctx_t* ctx)
+{
+    if (!ctx)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        if (ctx->tracks[i].config)
+        {
+            char track_id[256];
+            snprintf(track_id, sizeof(track_id), "%s", ctx->tracks[i].config->id);
+            track_manager_stop(ctx, track_id);
+        }
+    }
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    return true;
+}
+
+// Frames of a fade at the rate the track is rendered at
+static uint32_t fade_frames(const track_instance_t* track, uint32_t fade_ms)
+{
+    uint32_t rate = track->mixer ? track->mixer->rate : track->format.rate;
+    if (rate == 0)
+        rate = track->desc->rate;
+    return (uint32_t)((uint64_t)fade_ms * rate / 1000);
+}
+
+// Fade a track towards target on its process thread, directly while it has
+// no output
+static void set_track_ramp(track_instance_t* track, float target, uint32_t ramp_ms)
+{
+    struct ramp_update update = { .track = track, .target = target, .n_frames = fade_frames(track, ramp_ms) };
+
+    struct pw_loop* loop = track_process_loop(track);
+    if (loop)
+        pw_loop_invoke(loop, do_set_ramp, 0, NULL, 0, true, &update);
+    else
+        do_set_ramp(NULL, false, 0, NULL, 0, &update);
+}
+
+// Have a track fade to target starting at at_ns on the graph clock
+static bool schedule_track_gain(track_instance_t* track, uint64_t at_ns, float target, uint32_t fade_ms)
+{
+    struct gain_schedule schedule = {
+        .track = track, .at_ns = at_ns, .target = target, .n_frames = fade_frames(track, fade_ms)
+    };
+
+    struct pw_loop* loop = track_process_loop(track);
+    const int res = loop
+                        ? pw_loop_invoke(loop, do_schedule_gain, 0, NULL, 0, true, &schedule)
+                        : do_schedule_gain(NULL, false, 0, NULL, 0, &schedule);
+    if (res < 0)
+    {
+        log_warn("Too many pending cues on track %s", track->config->id);
+        return false;
+    }
+    return true;
+}
+
+bool track_manager_start_at(track_manager_ctx_t* ctx, const char* track_id, uint64_t at_ns, uint32_t fade_ms)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    // Get the output up now and hold the track silent until its time
+    bool success = false;
+    track_instance_t* track = start_track(ctx, track_id, true);
+    if (track)
+    {
+        track->stopping = false;
+        success = track->paused || schedule_track_gain(track, at_ns, track->level, fade_ms);
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_stop_at(track_manager_ctx_t* ctx, const char* track_id, uint64_t at_ns, uint32_t fade_ms)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else if (track->paused)
+    {
+        // Silent already, nothing to fade
+        log_info("Stopped track: %s", track_id);
+        release_track(ctx, track);
+        success = true;
+    }
+    else
+    {
+        // The process thread reports back once it faded out
+        track->stopping = true;
+        success = schedule_track_gain(track, at_ns, 0.0f, fade_ms);
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_set_gain_at(
+    track_manager_ctx_t* ctx,
+    const char* track_id,
+    float gain,
+    uint64_t at_ns,
+    uint32_t fade_ms
+)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else
+    {
+        // A paused track takes the level when it is resumed
+        track->level = gain;
+        success = track->paused || schedule_track_gain(track, at_ns, gain, fade_ms);
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+// Loop length on the grid handed to the process thread in one piece
+struct grid_update
+{
+    track_instance_t* track;
+    uint64_t period_ns;
+    uint64_t wrap_ns;
+};
+
+static int do_set_grid(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    struct grid_update* update = user_data;
+    track_instance_t* track = update->track;
+
+    // The track wraps itself from now on, the decoder stops at the end
+    track->audio_file->loop = false;
+    if (track->pool)
+        track->pool->loop = false;
+    track->grid_period_ns = update->period_ns;
+    track->grid_wrap_ns = update->wrap_ns;
+    return 0;
+}
+
+bool track_manager_play_quantized(track_manager_ctx_t* ctx, const char* track_id, quantize_t quantize)
+{
+    if (!ctx || !track_id)
+        return false;
+    if (quantize == QUANTIZE_NONE)
+        return track_manager_play(ctx, track_id);
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (track)
+    {
+        log_info("Track already playing: %s", track_id);
+        success = true;
+    }
+    else if ((track = start_track(ctx, track_id, true)) != NULL)
+    {
+        // The first line far enough out for the output to be up by then
+        const tempo_grid_t* grid = &ctx->grids[track_group_slot(ctx, track)];
+        if (!tempo_grid_active(grid))
+            log_warn("No tempo set for track %s, starting it unquantized", track_id);
+        const uint64_t at_ns = tempo_grid_next(grid, quantize, get_time_ns() + SEQUENCER_LOOKAHEAD_NS);
+
+        // Loops are snapped to whole units of the grid and every pass
+        // starts on it, so stems of slightly different lengths never drift
+        const SF_INFO* info = &track->audio_file->info;
+        if (track->config->loop && !track->playlist && tempo_grid_active(grid) && info->samplerate > 0)
+        {
+            const uint64_t length_ns = (uint64_t)info->frames * SPA_NSEC_PER_SEC / (uint64_t)info->samplerate;
+            struct grid_update update = { .track = track, .period_ns = tempo_grid_snap(grid, quantize, length_ns) };
+            update.wrap_ns = at_ns + update.period_ns;
+
+            struct pw_loop* loop = track_process_loop(track);
+            if (loop)
+                pw_loop_invoke(loop, do_set_grid, 0, NULL, 0, true, &update);
+            else
+                do_set_grid(NULL, false, 0, NULL, 0, &update);
+        }
+
+        success = schedule_track_gain(track, at_ns, track->level, 0);
+        log_info(
+            "Track %s starts on the next %s in %.3f s",
+            track_id,
+            tempo_grid_quantize_name(quantize),
+            (double)(int64_t)(at_ns - get_time_ns()) / SPA_NSEC_PER_SEC
+        );
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_skip(track_manager_ctx_t* ctx, const char* track_id, bool forward)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+        log_warn("Track not playing: %s", track_id);
+    else if (!track->playlist)
+        log_warn("Track %s is not a playlist", track_id);
+    else
+        success = playlist_skip(track->playlist, track_process_loop(track), forward);
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+// Movement handed to the process thread, a path to follow or a keyframe to
+// queue
+struct motion_update
+{
+    trajectory_motion_t* motion;
+    const trajectory_config_t* path;
+    const keyframe_config_t* keyframe;
+};
+
+static int do_move(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    struct motion_update* update = user_data;
+
+    if (update->keyframe)
+        return trajectory_push(update->motion, update->keyframe) ? 0 : -ENOSPC;
+    if (update->path)
+        trajectory_follow(update->motion, update->path);
+    else
+        trajectory_reset(update->motion);
+    return 0;
+}
+
+// Halt the track with neither a path nor a keyframe
+static int move_track(track_instance_t* track, const trajectory_config_t* path, const keyframe_config_t* keyframe)
+{
+    struct motion_update update = { .motion = track->motion, .path = path, .keyframe = keyframe };
+
+    struct pw_loop* loop = track_process_loop(track);
+    if (loop)
+        return pw_loop_invoke(loop, do_move, 0, NULL, 0, true, &update);
+    return do_move(NULL, false, 0, NULL, 0, &update);
+}
+
+bool track_manager_set_pan(track_manager_ctx_t* ctx, const char* track_id, const pan_position_t* position)
+{
+    if (!ctx || !track_id || !position)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else if (!track->voice || !track->voice->panned)
+    {
+        log_warn("Track %s is not on a speaker layout", track_id);
+    }
+    else
+    {
+        // A placed source stops moving, the process thread lets go of the
+        // position before it is written here
+        move_track(track, NULL, NULL);
+
+        // Kept with the track, a device move places it on the new layout
+        track->pan = *position;
+        track->pan.set = true;
+        success = mixer_set_pan(track->mixer, track->voice, &track->pan);
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_move(track_manager_ctx_t* ctx, const char* track_id, const char* trajectory_id)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    const trajectory_config_t* path = trajectory_id ? find_trajectory(ctx, trajectory_id) : NULL;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else if (!track->voice || !track->voice->panned)
+    {
+        log_warn("Track %s is not on a speaker layout", track_id);
+    }
+    else if (trajectory_id && (!path || path->keyframe_count == 0))
+    {
+        log_warn("Trajectory not found: %s", trajectory_id);
+    }
+    else
+    {
+        move_track(track, path, NULL);
+        if (path)
+            log_info("Track %s follows trajectory %s", track_id, path->id);
+        else
+            log_info("Track %s stops moving", track_id);
+        success = true;
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_push_keyframe(track_manager_ctx_t* ctx, const char* track_id, const keyframe_config_t* keyframe)
+{
+    if (!ctx || !track_id || !keyframe || !keyframe->position.set)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else if (!track->voice || !track->voice->panned)
+    {
+        log_warn("Track %s is not on a speaker layout", track_id);
+    }
+    else if (move_track(track, NULL, keyframe) < 0)
+    {
+        log_warn("Track %s has %d keyframes queued already", track_id, TRAJECTORY_QUEUE_MAX);
+    }
+    else
+    {
+        success = true;
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+// New rotation of an ambisonic track handed to the process thread
+struct yaw_update
+{
+    ambisonic_stream_t* stream;
+    float degrees;
+};
+
+static int do_set_yaw(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    const struct yaw_update* update = user_data;
+    ambisonic_set_yaw(update->stream, update->degrees);
+    return 0;
+}
+
+bool track_manager_set_yaw(track_manager_ctx_t* ctx, const char* track_id, float degrees)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        log_warn("Track not playing: %s", track_id);
+    }
+    else if (!track->ambisonic)
+    {
+        log_warn("Track %s is not ambisonic", track_id);
+    }
+    else
+    {
+        // Glides there over the next block
+        struct yaw_update update = { .stream = track->ambisonic, .degrees = degrees };
+        struct pw_loop* loop = track_process_loop(track);
+        if (loop)
+            pw_loop_invoke(loop, do_set_yaw, 0, NULL, 0, true, &update);
+        else
+            do_set_yaw(NULL, false, 0, NULL, 0, &update);
+        success = true;
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+bool track_manager_set_delay(track_manager_ctx_t* ctx, const char* device, const char* channel, double ms)
+{
+    if (!ctx || !device || !channel)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    int index = -1;
+    for (int i = 0; i < ctx->config->device_count && index < 0; i++)
+    {
+        if (ctx->config->devices[i].name && strcmp(ctx->config->devices[i].name, device) == 0)
+            index = i;
+    }
+
+    if (index < 0 || !ctx->mixers[index])
+    {
+        log_warn("Device %s has no mixer", device);
+    }
+    else if (!mixer_set_delay(ctx->mixers[index], channel, ms / 1000.0))
+    {
+        log_warn("Device %s has no delay on %s, it needs delays configured", device, channel);
+    }
+    else
+    {
+        log_info("Device %s delays %s by %.3f ms", device, channel, SPA_MIN(ms, DELAY_MAX_SECONDS * 1e3));
+        success = true;
+    }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+// New coefficients of a track insert handed to the process thread
+struct tune_update
+{
+    insert_chain_t* chain;
+    insert_tuning_t tuning;
+};
+
+static int do_tune(
+    struct spa_loop* loop,
+    bool async,
+    uint32_t seq,
+    const void* data,
+    size_t size,
+    void* user_data
+)
+{
+    const struct tune_update* update = user_data;
+    insert_chain_apply(update->chain, &update->tuning);
+    return 0;
+}
+
+// Retune a filter of a track, playing or not
+static bool tune_track(track_manager_ctx_t* ctx, const track_config_t* config, uint32_t index,
+                       const insert_config_t* insert)
+{
+    const track_source_t* source = &ctx->sources[config - ctx->config->tracks];
+    struct tune_update update = { .chain = source->inserts };
+    if (!source->inserts || !insert_chain_prepare(source->inserts, index, insert, &update.tuning))
+        return false;
 
-    free(ctx);
+    track_instance_t* track = find_active_track(ctx, config->id);
+    struct pw_loop* loop = track ? track_process_loop(track) : NULL;
+    if (loop)
+        pw_loop_invoke(loop, do_tune, 0, NULL, 0, true, &update);
+    else
+        do_tune(NULL, false, 0, NULL, 0, &update);
+    return true;
 }
 
-bool track_manager_play(track_manager_ctx_t* ctx, const char* track_id)
+bool track_manager_tune(track_manager_ctx_t* ctx, const char* target, uint32_t index, const insert_config_t* insert)
 {
-    if (!ctx || !track_id)
+    if (!ctx || !target || !insert)
         return false;
 
-    // Find track configuration
-    track_config_t* config = NULL;
-    for (int i = 0; i < ctx->config->track_count; i++)
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+    bool found = false;
+    const track_config_t* config = find_track_config(ctx, target);
+    if (config)
     {
-        if (strcmp(ctx->config->tracks[i].id, track_id) == 0)
+        found = true;
+        success = tune_track(ctx, config, index, insert);
+    }
+    for (int i = 0; !found && i < ctx->config->device_count; i++)
+    {
+        if (ctx->config->devices[i].name && strcmp(ctx->config->devices[i].name, target) == 0)
         {
-            config = &ctx->config->tracks[i];
-            break;
+            found = true;
+            success = mixer_tune(ctx->mixers[i], index, insert);
         }
     }
 
-    if (!config)
-    {
-        log_error("Track not found: %s", track_id);
-        return false;
-    }
+    if (!found)
+        log_warn("No track or device %s to tune", target);
+    else if (!success)
+        log_warn("%s has no filter insert %u", target, index);
+    else
+        log_info("%s insert %u at %.1f Hz, %.1f dB, q %.2f", target, index, insert->frequency, insert->gain, insert->q);
 
-    // Check if track is already playing
-    for (int i = 0; i < ctx->active_tracks; i++)
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
+}
+
+// Running bus by name and the mixer it is on, NULL if there is none
+static submix_t* find_bus(track_manager_ctx_t* ctx, const char* name, mixer_t** mixer)
+{
+    for (int i = 0; ctx->buses && i < ctx->config->bus_count; i++)
     {
-        if (strcmp(ctx->tracks[i].config->id, track_id) == 0)
+        const bus_config_t* bus = &ctx->config->buses[i];
+        if (bus->device_index >= 0 && bus->name && strcmp(bus->name, name) == 0)
         {
-            log_info("Track already playing: %s", track_id);
-            return true;
+            *mixer = ctx->mixers[bus->device_index];
+            return &ctx->buses[i];
         }
     }
+    log_warn("No bus %s", name);
+    return NULL;
+}
 
-    // Initialize new track instance
-    if (ctx->active_tracks >= MAX_TRACKS)
-    {
-        log_error("Maximum number of active tracks reached");
+bool track_manager_set_bus_gain(track_manager_ctx_t* ctx, const char* bus, float gain_db)
+{
+    if (!ctx || !bus)
         return false;
-    }
-
-    track_instance_t* track = &ctx->tracks[ctx->active_tracks];
-    memset(track, 0, sizeof(track_instance_t));
-    track->config = config;
-    track->state = TRACK_STATE_STOPPED;
-    track->is_connected = false;
-    track->error.message = NULL;
-    track->error.code = 0;
 
-    // Open audio file
-    track->audio_file =
-        audio_file_open(config->file_path, config->loop, config->volume);
-    if (!track->audio_file)
-    {
-        log_error("Failed to open audio file: %s", config->file_path);
-        return false;
-    }
+    pw_thread_loop_lock(ctx->pw_loop);
 
-    // Initialize PipeWire
-    if (!init_track_pipewire(ctx, track))
+    mixer_t* mixer = NULL;
+    submix_t* submix = find_bus(ctx, bus, &mixer);
+    if (submix)
     {
-        log_error("Failed to initialize PipeWire for track: %s", track_id);
-        audio_file_close(track->audio_file);
-        return false;
+        mixer_set_bus(mixer, submix, submix_fader(gain_db), submix->mute);
+        log_info("Bus %s at %.1f dB", bus, gain_db);
     }
 
-    // Set up stream parameters
-    uint8_t buffer[1024];
-    struct spa_pod_builder b;
-    spa_pod_builder_init(&b, buffer, sizeof(buffer));
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return submix != NULL;
+}
 
-    struct spa_audio_info_raw audio_info = {
-        .format = SPA_AUDIO_FORMAT_F32,
-        .channels = track->config->output.mapping_count > 0 ? track->config->output.mapping_count : track->audio_file->info.channels,
-        .rate = track->audio_file->info.samplerate
-    };
+bool track_manager_set_bus_mute(track_manager_ctx_t* ctx, const char* bus, bool mute)
+{
+    if (!ctx || !bus)
+        return false;
 
-    // Set channel positions
-    if (track->config->output.mapping_count > 0)
-    {
-        // Set default mapping first
-        for (uint8_t i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++)
-        {
-            audio_info.position[i] = SPA_AUDIO_CHANNEL_UNKNOWN;
-        }
+    pw_thread_loop_lock(ctx->pw_loop);
 
-        // Map each channel according to configuration
-        for (uint8_t i = 0;
-             i < track->config->output.mapping_count && i < SPA_AUDIO_MAX_CHANNELS;
-             i++)
-        {
-            const char* port_name = track->config->output.mapping[i];
-            audio_info.position[i] = get_channel_position(port_name);
-            if (audio_info.position[i] == SPA_AUDIO_CHANNEL_UNKNOWN)
-            {
-                log_warn("Unknown channel name '%s', using UNKNOWN", port_name);
-            }
-        }
-        audio_info.channels = track->config->output.mapping_count;
-    }
-    else
+    mixer_t* mixer = NULL;
+    submix_t* submix = find_bus(ctx, bus, &mixer);
+    if (submix)
     {
-        // If no mapping specified, use sequential AUX channels
-        audio_info.channels = track->audio_file->info.channels;
-        for (uint8_t i = 0; i < audio_info.channels && i < SPA_AUDIO_MAX_CHANNELS;
-             i++)
-        {
-            audio_info.position[i] = SPA_AUDIO_CHANNEL_AUX0 + i;
-        }
+        mixer_set_bus(mixer, submix, submix->fader, mute);
+        log_info("Bus %s %s", bus, mute ? "muted" : "unmuted");
     }
 
-    const struct spa_pod* params[1];
-    params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &audio_info);
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return submix != NULL;
+}
 
-    if (pw_stream_connect(
-        track->stream,
-        PW_DIRECTION_OUTPUT,
-        PW_ID_ANY,
-        PW_STREAM_FLAG_AUTOCONNECT |
-        PW_STREAM_FLAG_MAP_BUFFERS |
-        PW_STREAM_FLAG_RT_PROCESS,
-        params,
-        1
-    ) < 0)
-    {
-        log_error("Failed to connect stream");
-        pw_stream_destroy(track->stream);
-        audio_file_close(track->audio_file);
+bool track_manager_has_cue_list(track_manager_ctx_t* ctx, const char* list_id)
+{
+    if (!ctx || !list_id)
         return false;
-    }
 
-    track->state = TRACK_STATE_PLAYING;
-    ctx->active_tracks++;
-    log_info("Started playback of track: %s", track_id);
+    pw_thread_loop_lock(ctx->pw_loop);
+    const bool found = sequencer_has_list(ctx->sequencer, list_id);
+    pw_thread_loop_unlock(ctx->pw_loop);
 
-    return true;
+    return found;
 }
 
-bool track_manager_stop(track_manager_ctx_t* ctx, const char* track_id)
+bool track_manager_go(track_manager_ctx_t* ctx, const char* list_id, double position)
 {
-    if (!ctx || !track_id)
+    if (!ctx || !list_id)
         return false;
 
-    for (int i = 0; i < ctx->active_tracks; i++)
-    {
-        if (strcmp(ctx->tracks[i].config->id, track_id) == 0)
-        {
-            track_instance_t* track = &ctx->tracks[i];
+    pw_thread_loop_lock(ctx->pw_loop);
+    const bool success = sequencer_goto(ctx->sequencer, list_id, position);
+    pw_thread_loop_unlock(ctx->pw_loop);
 
-            // Clean up error message if any
-            if (track->error.message)
-            {
-                free(track->error.message);
-                track->error.message = NULL;
-            }
+    return success;
+}
 
-            // Destroy PipeWire stream
-            if (track->stream)
-            {
-                pw_stream_destroy(track->stream);
-                track->stream = NULL;
-            }
+bool track_manager_stop_cue_list(track_manager_ctx_t* ctx, const char* list_id)
+{
+    if (!ctx || !list_id)
+        return false;
 
-            // Close audio file if it exists
-            if (track->audio_file)
-            {
-                audio_file_close(track->audio_file);
-                track->audio_file = NULL;
-            }
+    pw_thread_loop_lock(ctx->pw_loop);
+    const bool success = sequencer_stop(ctx->sequencer, list_id);
+    pw_thread_loop_unlock(ctx->pw_loop);
 
-            // Remove track from active tracks
-            if (i < ctx->active_tracks - 1)
-            {
-                memmove(
-                    &ctx->tracks[i],
-                    &ctx->tracks[i + 1],
-                    sizeof(track_instance_t) * (ctx->active_tracks - i - 1)
-                );
-            }
-            ctx->active_tracks--;
+    return success;
+}
 
-            log_info("Stopped track: %s", track_id);
-            return true;
-        }
+bool track_manager_pause(track_manager_ctx_t* ctx, const char* track_id, uint32_t ramp_ms)
+{
+    if (!ctx || !track_id)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        pw_thread_loop_unlock(ctx->pw_loop);
+        log_warn("Track not playing: %s", track_id);
+        return false;
     }
 
-    log_warn("Track not playing: %s", track_id);
-    return false;
+    if (track->paused)
+    {
+        pw_thread_loop_unlock(ctx->pw_loop);
+        log_info("Track already paused: %s", track_id);
+        return true;
+    }
+
+    // The stream or voice stays, only the fade and the stream activity change.
+    // After a fade the process thread hands the stream back for deactivation.
+    track->paused = true;
+    set_track_ramp(track, 0.0f, ramp_ms);
+    if (ramp_ms == 0 && track->stream)
+        pw_stream_set_active(track->stream, false);
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    log_info("Paused track: %s", track_id);
+    return true;
 }
 
-bool track_manager_stop_all(track_manager_ctx_t* ctx)
+bool track_manager_resume(track_manager_ctx_t* ctx, const char* track_id, uint32_t ramp_ms)
 {
-    if (!ctx)
+    if (!ctx || !track_id)
         return false;
 
-    while (ctx->active_tracks > 0)
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    track_instance_t* track = find_active_track(ctx, track_id);
+    if (!track)
+    {
+        pw_thread_loop_unlock(ctx->pw_loop);
+        log_warn("Track not playing: %s", track_id);
+        return false;
+    }
+
+    if (!track->paused)
     {
-        track_manager_stop(ctx, ctx->tracks[0].config->id);
+        pw_thread_loop_unlock(ctx->pw_loop);
+        log_info("Track not paused: %s", track_id);
+        return true;
     }
 
+    // Picks up at the held position from the next cycle on
+    track->paused = false;
+    set_track_ramp(track, track->level, ramp_ms);
+    if (track->stream)
+        pw_stream_set_active(track->stream, true);
+
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    log_info("Resumed track: %s", track_id);
     return true;
 }
 
@@ -581,15 +2620,12 @@ bool track_manager_is_playing(track_manager_ctx_t* ctx, const char* track_id)
     if (!ctx || !track_id)
         return false;
 
-    for (int i = 0; i < ctx->active_tracks; i++)
-    {
-        if (strcmp(ctx->tracks[i].config->id, track_id) == 0)
-        {
-            return ctx->tracks[i].state == TRACK_STATE_PLAYING;
-        }
-    }
+    pw_thread_loop_lock(ctx->pw_loop);
+    const track_instance_t* track = find_active_track(ctx, track_id);
+    const bool playing = track && track->state == TRACK_STATE_PLAYING && !track->paused;
+    pw_thread_loop_unlock(ctx->pw_loop);
 
-    return false;
+    return playing;
 }
 
 void track_manager_list_tracks(track_manager_ctx_t* ctx)
@@ -616,10 +2652,76 @@ void track_manager_print_status(track_manager_ctx_t* ctx)
     if (!ctx)
         return;
 
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    printf("PipeWire: %s\n", ctx->pw_core ? "connected" : "disconnected");
+    for (int i = 0; i < ctx->config->group_count; i++)
+    {
+        const device_group_t* group = &ctx->groups[i];
+        if (!group->context)
+            continue;
+
+        printf(
+            "Group %s: CPU %d, RT priority %d, %s\n",
+            group->config->name,
+            group->config->cpu,
+            group->config->rt_priority,
+            group->core ? "connected" : "disconnected"
+        );
+    }
+    if (ctx->config->engine.mode == ENGINE_MODE_FILTER)
+    {
+        for (int i = 0; i <= ctx->config->group_count; i++)
+        {
+            if (ctx->engines[i])
+            {
+                printf(
+                    "Engine: filter %s (%s)\n",
+                    i == 0 ? "papad" : ctx->groups[i - 1].config->name,
+                    filter_engine_is_running(ctx->engines[i]) ? "running" : "idle"
+                );
+            }
+        }
+    }
+    for (int i = 0; i < ctx->config->device_count; i++)
+    {
+        const mixer_t* mixer = ctx->mixers[i];
+        if (!mixer)
+            continue;
+
+        const char* state;
+        if (mixer->target_id == SPA_ID_INVALID)
+            state = "waiting for device";
+        else if (ctx->config->engine.mode == ENGINE_MODE_FILTER || mixer->streaming)
+            state = "running";
+        else
+            state = "connecting";
+
+        printf(
+            "  Mixer %s: %s, %u channels, %u Hz, %u voices",
+            mixer->config->name,
+            state,
+            mixer->n_channels,
+            mixer->rate,
+            mixer->n_active
+        );
+        if (mixer->format.kernel)
+            printf(", %s", sample_format_name(mixer->format.format));
+        printf("\n");
+    }
+    if (ctx->config->cue_list_count > 0)
+    {
+        char cues[1024];
+        sequencer_format(ctx->sequencer, cues, sizeof(cues));
+        printf("%s", cues);
+    }
     printf("Active tracks: %d/%d\n", ctx->active_tracks, MAX_TRACKS);
-    for (int i = 0; i < ctx->active_tracks; i++)
+    for (int i = 0; i < MAX_TRACKS; i++)
     {
         const track_instance_t* track = &ctx->tracks[i];
+        if (!track->config)
+            continue;
+
         const char* state_str;
         switch (track->state)
         {
@@ -630,7 +2732,7 @@ void track_manager_print_status(track_manager_ctx_t* ctx)
             state_str = "stopped";
             break;
         case TRACK_STATE_ERROR:
-            state_str = track->error.message ? track->error.message : "error";
+            state_str = track->error.message[0] ? track->error.message : "error";
             break;
         case TRACK_STATE_CONNECTING:
             state_str = "connecting";
@@ -642,77 +2744,121 @@ void track_manager_print_status(track_manager_ctx_t* ctx)
             state_str = "unknown";
             break;
         }
-        printf("  %s: %s\n", track->config->id, state_str);
-        if (track->config->output.device)
+        printf("  %s: %s%s\n", track->config->id, state_str, track->paused ? " (paused)" : "");
+        if (track->playlist)
+        {
+            printf(
+                "    Item: %s (%u of %u)\n",
+                playlist_current_path(track->playlist),
+                track->playlist->cur_index + 1,
+                track->playlist->n_items
+            );
+        }
+        if (track->pool)
+        {
+            printf(
+                "    Member: %s (%u of %u)\n",
+                sample_pool_current_path(track->pool),
+                track->pool->last + 1,
+                track->pool->n_members
+            );
+        }
+        if (track->device_index >= 0)
+        {
+            printf(
+                "    Device: %s%s\n",
+                track->config->output.devices[track->device_index],
+                track->device_index > 0 ? " (fallback)" : ""
+            );
+        }
+        if (track->target_id != SPA_ID_INVALID)
+        {
+            printf("    Target node: %u\n", track->target_id);
+        }
+        printf("    Connected: %s%s\n", track->is_connected ? "yes" : "no", track->voice ? " (mixed)" : "");
+        if (track->format.kernel)
         {
-            printf("    Device: %s\n", track->config->output.device);
+            printf(
+                "    Format: %s, %u channels, %u Hz\n",
+                sample_format_name(track->format.format),
+                track->format.channels,
+                track->format.rate
+            );
         }
-        printf("    Connected: %s\n", track->is_connected ? "yes" : "no");
     }
+
+    pw_thread_loop_unlock(ctx->pw_loop);
 }
 
-// Test tone configuration
-static track_config_t TEST_TONE_CONFIG = {
-    .id = "test_tone",
-    .loop = true,
-    .volume = 0.5f,
-    .output = {
-        .device = "default",
-        .mapping = NULL,
-        .mapping_count = 0
-    }
-};
+int track_manager_format_devices(track_manager_ctx_t* ctx, char* buffer, size_t size)
+{
+    if (!ctx)
+        return 0;
 
-// Helper function to parse channel mapping string
-static bool parse_channel_mapping(const char* mapping_str, track_config_t* config)
+    pw_thread_loop_lock(ctx->pw_loop);
+    const int count = device_registry_format(ctx->registry, buffer, size);
+    pw_thread_loop_unlock(ctx->pw_loop);
+
+    return count;
+}
+
+// Write the driver timing of every driving mixer
+int track_manager_format_stats(track_manager_ctx_t* ctx, char* buffer, size_t size)
 {
-    if (!mapping_str || !config) return false;
+    if (!ctx || !buffer || size == 0)
+        return 0;
 
-    // Count commas to determine number of channels
-    int count = 1;
-    for (const char* p = mapping_str; *p; p++)
+    buffer[0] = '\0';
+    size_t used = 0;
+    int count = 0;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+    for (int i = 0; i < ctx->config->device_count; i++)
     {
-        if (*p == ',') count++;
+        const mixer_t* mixer = ctx->mixers[i];
+        if (!mixer || !mixer->config->driver)
+            continue;
+
+        used += mixer_format_stats(mixer, buffer + used, size - used);
+        count++;
     }
+    pw_thread_loop_unlock(ctx->pw_loop);
 
-    // Allocate space for channel names
-    char** mappings = calloc(count, sizeof(char*));
-    if (!mappings) return false;
+    return count;
+}
 
-    // Copy the string so we can modify it
-    char* str = strdup(mapping_str);
-    if (!str)
-    {
-        free(mappings);
+// Test tone mapping, parsed into fixed storage. The test tone is stopped
+// before its mapping is replaced, so nothing refers to the old one.
+static char test_tone_names[1024];
+static char* test_tone_mapping[SPA_AUDIO_MAX_CHANNELS];
+
+// Stream parameters of the test tone, rebuilt in fixed storage per request
+static track_desc_t test_tone_desc;
+static _Alignas(ARENA_ALIGN) uint8_t test_tone_storage[8192];
+
+// Helper function to parse channel mapping string
+static bool parse_channel_mapping(const char* mapping_str, track_config_t* config)
+{
+    if (!mapping_str || !config) return false;
+
+    if (snprintf(test_tone_names, sizeof(test_tone_names), "%s", mapping_str) >= (int)sizeof(test_tone_names))
         return false;
-    }
 
-    // Parse the channels
-    char* token = strtok(str, ",");
-    int i = 0;
-    while (token && i < count)
+    // Parse the channels in place
+    int count = 0;
+    char* saveptr = NULL;
+    for (char* token = strtok_r(test_tone_names, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
     {
-        mappings[i] = strdup(token);
-        if (!mappings[i])
-        {
-            // Cleanup on error
-            for (int j = 0; j < i; j++)
-            {
-                free(mappings[j]);
-            }
-            free(mappings);
-            free(str);
+        if (count == SPA_AUDIO_MAX_CHANNELS)
             return false;
-        }
-        i++;
-        token = strtok(NULL, ",");
+        test_tone_mapping[count++] = token;
     }
+    if (count == 0)
+        return false;
 
     // Update config
-    config->output.mapping = mappings;
+    config->output.mapping = test_tone_mapping;
     config->output.mapping_count = count;
-
-    free(str);
     return true;
 }
 
@@ -763,8 +2909,27 @@ static void on_test_tone_process(void* userdata)
     size_t n_frames = buf->datas[0].maxsize / sizeof(float) /
         track->config->output.mapping_count;
 
-    // Generate test tone
-    generate_test_tone(dst, n_frames, track->config->output.mapping_count, 48000);
+    // Generate test tone, or hold silence once faded out on pause
+    if (gain_ramp_is_silent(&track->ramp))
+    {
+        memset(dst, 0, n_frames * track->config->output.mapping_count * sizeof(float));
+        if (track->paused && !track->faded_out)
+        {
+            track->faded_out = true;
+            pw_loop_signal_event(
+                pw_thread_loop_get_loop(track->manager->pw_loop),
+                track->manager->maintenance_event
+            );
+        }
+    }
+    else
+    {
+        generate_test_tone(dst, n_frames, track->config->output.mapping_count, 48000);
+        if (!gain_ramp_is_unity(&track->ramp))
+        {
+            gain_ramp_apply(&track->ramp, dst, track->config->output.mapping_count, n_frames);
+        }
+    }
 
     buf->datas[0].chunk->offset = 0;
     buf->datas[0].chunk->stride =
@@ -777,6 +2942,19 @@ static void on_test_tone_process(void* userdata)
 
 bool track_manager_play_test_tone(track_manager_ctx_t* ctx, const char* channel_mapping)
 {
+    if (!ctx)
+        return false;
+
+    pw_thread_loop_lock(ctx->pw_loop);
+
+    bool success = false;
+
+    // Stop any existing test tone before its mapping is replaced
+    if (find_active_track(ctx, TEST_TONE_CONFIG.id))
+    {
+        track_manager_stop(ctx, TEST_TONE_CONFIG.id);
+    }
+
     // Reset test tone configuration
     TEST_TONE_CONFIG.output.mapping = NULL;
     TEST_TONE_CONFIG.output.mapping_count = 0;
@@ -787,7 +2965,7 @@ bool track_manager_play_test_tone(track_manager_ctx_t* ctx, const char* channel_
         if (!parse_channel_mapping(channel_mapping, &TEST_TONE_CONFIG))
         {
             log_error("Failed to parse channel mapping: %s", channel_mapping);
-            return false;
+            goto out;
         }
     }
     else
@@ -798,116 +2976,53 @@ bool track_manager_play_test_tone(track_manager_ctx_t* ctx, const char* channel_
         TEST_TONE_CONFIG.output.mapping_count = 2;
     }
 
-    if (!ctx)
-        return false;
+    const SF_INFO tone_info = {.samplerate = 48000, .channels = TEST_TONE_CONFIG.output.mapping_count};
+    arena_t tone_arena;
+    arena_wrap(&tone_arena, test_tone_storage, sizeof(test_tone_storage));
+    if (!track_desc_init(&test_tone_desc, &TEST_TONE_CONFIG, &tone_info, true, &tone_arena))
+    {
+        log_error("Failed to prepare the test tone stream");
+        goto out;
+    }
 
-    // Stop any existing test tone
-    track_manager_stop(ctx, TEST_TONE_CONFIG.id);
+    if (!ctx->pw_core)
+    {
+        log_error("Not connected to PipeWire, cannot play test tone");
+        goto out;
+    }
 
     // Initialize new track instance
-    if (ctx->active_tracks >= MAX_TRACKS)
+    track_instance_t* track = alloc_track_slot(ctx);
+    if (!track)
     {
         log_error("Maximum number of active tracks reached");
-        return false;
+        goto out;
     }
 
-    track_instance_t* track = &ctx->tracks[ctx->active_tracks];
     memset(track, 0, sizeof(track_instance_t));
+    track->manager = ctx;
     track->config = (track_config_t*)&TEST_TONE_CONFIG;
+    track->desc = &test_tone_desc;
     track->state = TRACK_STATE_STOPPED;
+    track->level = 1.0f;
+    gain_ramp_init(&track->ramp);
+    track->target_id = SPA_ID_INVALID;
+    track->device_index = -1;
 
-    // Set up PipeWire stream
-    struct pw_properties* props = pw_properties_new(
-        PW_KEY_MEDIA_TYPE,
-        "Audio",
-        PW_KEY_MEDIA_CATEGORY,
-        "Playback",
-        PW_KEY_MEDIA_ROLE,
-        "Test",
-        PW_KEY_NODE_NAME,
-        "test_tone",
-        PW_KEY_NODE_DESCRIPTION,
-        "Test Tone Generator",
-        NULL
-    );
-
-    if (!props)
-    {
-        log_error("Failed to create stream properties");
-        return false;
-    }
-
-    // Set up channel mapping
-    char channelNames[1024] = "";
-    for (int i = 0; i < track->config->output.mapping_count; i++)
-    {
-        if (i > 0)
-            strcat(channelNames, ",");
-        strcat(channelNames, track->config->output.mapping[i]);
-    }
-    pw_properties_set(props, PW_KEY_NODE_CHANNELNAMES, channelNames);
-
-    // Create stream with test tone process callback
-    struct pw_stream_events test_events = stream_events;
-    test_events.process = on_test_tone_process;
-
-    track->stream = pw_stream_new_simple(
-        pw_main_loop_get_loop(ctx->pw_loop),
-        "test_tone",
-        props,
-        &test_events,
-        track
-    );
-
-    if (!track->stream)
+    // Set up PipeWire stream with the test tone process callback
+    if (!setup_track_output(ctx, track))
     {
         log_error("Failed to create test tone stream");
-        pw_properties_free(props);
-        return false;
-    }
-
-    // Set up stream parameters
-    uint8_t buffer[1024];
-    struct spa_pod_builder b;
-    spa_pod_builder_init(&b, buffer, sizeof(buffer));
-
-    struct spa_audio_info_raw audio_info = {
-        .format = SPA_AUDIO_FORMAT_F32,
-        .channels = track->config->output.mapping_count,
-        .rate = 48000
-    };
-
-    // Set channel positions
-    for (uint8_t i = 0; i < audio_info.channels && i < SPA_AUDIO_MAX_CHANNELS;
-         i++)
-    {
-        audio_info.position[i] = SPA_AUDIO_CHANNEL_AUX0 + i;
-    }
-
-    const struct spa_pod* params[1];
-    params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &audio_info);
-
-    if (pw_stream_connect(
-        track->stream,
-        PW_DIRECTION_OUTPUT,
-        PW_ID_ANY,
-        PW_STREAM_FLAG_AUTOCONNECT |
-        PW_STREAM_FLAG_MAP_BUFFERS |
-        PW_STREAM_FLAG_RT_PROCESS,
-        params,
-        1
-    ) < 0)
-    {
-        log_error("Failed to connect test tone stream");
-        pw_stream_destroy(track->stream);
-        pw_properties_free(props);
-        return false;
+        memset(track, 0, sizeof(track_instance_t));
+        goto out;
     }
 
     track->state = TRACK_STATE_PLAYING;
     ctx->active_tracks++;
     log_info("Started test tone playback");
+    success = true;
 
-    pw_properties_free(props);
-    return true;
+out:
+    pw_thread_loop_unlock(ctx->pw_loop);
+    return success;
 }
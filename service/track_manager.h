@@ -2,8 +2,12 @@
 #define ASYNC_AUDIO_PLAYER_TRACK_MANAGER_H
 
 #include "types.h"
+#include "tempo_grid.h"
 #include <spa/param/audio/raw.h>
 
+// Fade applied on pause and resume unless the request gives one
+#define TRACK_RAMP_DEFAULT_MS 10
+
 // Track manager context
 typedef struct track_manager_ctx track_manager_ctx_t;
 
@@ -21,11 +25,67 @@ bool track_manager_play(track_manager_ctx_t *ctx, const char *track_id);
 bool track_manager_stop(track_manager_ctx_t *ctx, const char *track_id);
 bool track_manager_stop_all(track_manager_ctx_t *ctx);
 
+// Play from the next beat or bar of the tempo grid of the track's group. A
+// looping track starts every pass on the grid from then on.
+bool track_manager_play_quantized(track_manager_ctx_t *ctx, const char *track_id, quantize_t quantize);
+
+// Hold a track at its position and carry on from there, fading over
+// ramp_ms. Its stream or voice stays in place.
+bool track_manager_pause(track_manager_ctx_t *ctx, const char *track_id, uint32_t ramp_ms);
+bool track_manager_resume(track_manager_ctx_t *ctx, const char *track_id, uint32_t ramp_ms);
+
+// Move a playlist track to its next or previous item, crossfading when it
+// has a crossfade
+bool track_manager_skip(track_manager_ctx_t *ctx, const char *track_id, bool forward);
+
+// Move a panned track on the speaker layout of its device
+bool track_manager_set_pan(track_manager_ctx_t *ctx, const char *track_id, const pan_position_t *position);
+
+// Move a panned track along a configured trajectory, NULL stops it where it is
+bool track_manager_move(track_manager_ctx_t *ctx, const char *track_id, const char *trajectory_id);
+
+// Queue a keyframe for a panned track to move on to after those queued before
+bool track_manager_push_keyframe(track_manager_ctx_t *ctx, const char *track_id, const keyframe_config_t *keyframe);
+
+// Turn the sound field of an ambisonic track to yaw degrees to the left
+bool track_manager_set_yaw(track_manager_ctx_t *ctx, const char *track_id, float degrees);
+
+// Delay a channel of a device that has delays configured, crossfading to it
+bool track_manager_set_delay(track_manager_ctx_t *ctx, const char *device, const char *channel, double ms);
+
+// Retune filter insert index of a track or a device bus to the frequency,
+// gain and q of insert, the track is looked for first
+bool track_manager_tune(track_manager_ctx_t *ctx, const char *target, uint32_t index, const insert_config_t *insert);
+
+// Set the gain of a submix bus in dB, or mute and unmute it. Changes glide
+// over one mixer block.
+bool track_manager_set_bus_gain(track_manager_ctx_t *ctx, const char *bus, float gain_db);
+bool track_manager_set_bus_mute(track_manager_ctx_t *ctx, const char *bus, bool mute);
+
+// Cue entry points, at_ns is a time on the graph clock. Start gets the output
+// up at once and fades in from the start of the file at that time, stop fades
+// out and then releases the track.
+bool track_manager_start_at(track_manager_ctx_t *ctx, const char *track_id, uint64_t at_ns, uint32_t fade_ms);
+bool track_manager_stop_at(track_manager_ctx_t *ctx, const char *track_id, uint64_t at_ns, uint32_t fade_ms);
+bool track_manager_set_gain_at(track_manager_ctx_t *ctx, const char *track_id, float gain,
+                               uint64_t at_ns, uint32_t fade_ms);
+
+// Cue lists: run one from position seconds on, or halt it
+bool track_manager_has_cue_list(track_manager_ctx_t *ctx, const char *list_id);
+bool track_manager_go(track_manager_ctx_t *ctx, const char *list_id, double position);
+bool track_manager_stop_cue_list(track_manager_ctx_t *ctx, const char *list_id);
+
 // Status functions
 bool track_manager_is_playing(track_manager_ctx_t *ctx, const char *track_id);
 void track_manager_list_tracks(track_manager_ctx_t *ctx);
 void track_manager_print_status(track_manager_ctx_t *ctx);
 
+// Write the cached PipeWire sink list, returns the number of devices
+int track_manager_format_devices(track_manager_ctx_t *ctx, char *buffer, size_t size);
+
+// Write the timing statistics of driving mixers, returns how many there are
+int track_manager_format_stats(track_manager_ctx_t *ctx, char *buffer, size_t size);
+
 // Test tone functionality
 bool track_manager_play_test_tone(track_manager_ctx_t *ctx, const char *channel_mapping);
 
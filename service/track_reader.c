@@ -0,0 +1,28 @@
+#include "track_reader.h"
+#include "playlist.h"
+#include "sample_pool.h"
+#include "insert_chain.h"
+
+static size_t read_source(track_instance_t *track, float *out, const size_t frames) {
+    if (track->pool) return sample_pool_read(track->pool, out, frames);
+    if (track->playlist) return playlist_read(track->playlist, out, frames);
+    return audio_file_read(track->audio_file, out, frames);
+}
+
+size_t track_read(track_instance_t *track, float *out, const size_t frames) {
+    const size_t got = read_source(track, out, frames);
+    if (track->inserts && got > 0) insert_chain_process(track->inserts, out, (uint32_t) got);
+    return got;
+}
+
+sf_count_t track_remaining(const track_instance_t *track) {
+    if (track->pool) return sample_pool_remaining(track->pool);
+    if (track->playlist) return playlist_remaining(track->playlist);
+    return audio_file_remaining(track->audio_file);
+}
+
+unsigned int track_boundaries(const track_instance_t *track) {
+    if (track->pool) return track->pool->picks;
+    if (track->playlist) return playlist_boundaries(track->playlist);
+    return track->audio_file->loop_count;
+}
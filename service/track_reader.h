@@ -0,0 +1,19 @@
+#ifndef ASYNC_AUDIO_PLAYER_TRACK_READER_H
+#define ASYNC_AUDIO_PLAYER_TRACK_READER_H
+
+#include <sndfile.h>
+#include "types.h"
+
+// Reading a track from its process thread, whatever its frames come from:
+// a file, the items of a playlist or the members of a pool
+
+// Next interleaved frames, fewer only once the track ran out
+size_t track_read(track_instance_t *track, float *out, size_t frames);
+
+// Frames left before the track runs out, -1 while it loops or more follows
+sf_count_t track_remaining(const track_instance_t *track);
+
+// Changes at every loop boundary a device move may wait for
+unsigned int track_boundaries(const track_instance_t *track);
+
+#endif // ASYNC_AUDIO_PLAYER_TRACK_READER_H
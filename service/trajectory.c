@@ -0,0 +1,111 @@
+#include <string.h>
+#include "trajectory.h"
+
+static const struct {
+    const char *name;
+    easing_t easing;
+} easing_names[] = {
+    {"linear", EASING_LINEAR},
+    {"ease_in", EASING_IN},
+    {"ease_out", EASING_OUT},
+    {"ease_in_out", EASING_IN_OUT},
+    {"hold", EASING_HOLD},
+};
+
+bool trajectory_parse_easing(const char *name, easing_t *easing) {
+    for (size_t i = 0; i < sizeof(easing_names) / sizeof(easing_names[0]); i++) {
+        if (strcmp(name, easing_names[i].name) == 0) {
+            *easing = easing_names[i].easing;
+            return true;
+        }
+    }
+    return false;
+}
+
+void trajectory_reset(trajectory_motion_t *motion) {
+    memset(motion, 0, sizeof(*motion));
+}
+
+void trajectory_follow(trajectory_motion_t *motion, const trajectory_config_t *path) {
+    trajectory_reset(motion);
+    motion->path = path;
+}
+
+bool trajectory_push(trajectory_motion_t *motion, const keyframe_config_t *keyframe) {
+    if (motion->queue_len == TRAJECTORY_QUEUE_MAX) return false;
+
+    motion->path = NULL;
+    motion->queue[(motion->queue_head + motion->queue_len) % TRAJECTORY_QUEUE_MAX] = *keyframe;
+    motion->queue_len++;
+    return true;
+}
+
+// Start the segment to the next keyframe at start_ns, false when none follows
+static bool next_segment(trajectory_motion_t *motion, const uint64_t start_ns, const pan_position_t *position) {
+    const trajectory_config_t *path = motion->path;
+
+    if (path) {
+        if (motion->next == (uint32_t) path->keyframe_count) {
+            if (!path->loop) {
+                motion->path = NULL;
+                return false;
+            }
+            motion->next = 0;
+        }
+        motion->to = path->keyframes[motion->next++];
+    } else if (motion->queue_len > 0) {
+        motion->to = motion->queue[motion->queue_head];
+        motion->queue_head = (motion->queue_head + 1) % TRAJECTORY_QUEUE_MAX;
+        motion->queue_len--;
+    } else {
+        return false;
+    }
+
+    motion->from = *position;
+    motion->start_ns = start_ns;
+    motion->moving = true;
+    return true;
+}
+
+static float ease(const easing_t easing, const float t) {
+    switch (easing) {
+        case EASING_IN:
+            return t * t;
+        case EASING_OUT:
+            return 1.0f - (1.0f - t) * (1.0f - t);
+        case EASING_IN_OUT:
+            return t * t * (3.0f - 2.0f * t);
+        case EASING_HOLD:
+            return 0.0f;
+        default:
+            return t;
+    }
+}
+
+bool trajectory_step(trajectory_motion_t *motion, const uint64_t now_ns, pan_position_t *position) {
+    if (!motion->moving && !next_segment(motion, now_ns, position)) return false;
+
+    for (;;) {
+        const uint64_t length_ns = (uint64_t) (motion->to.duration * SPA_NSEC_PER_SEC);
+        const uint64_t end_ns = motion->start_ns + length_ns;
+
+        if (now_ns < end_ns) {
+            const float t = ease(motion->to.easing, (float) (now_ns - motion->start_ns) / (float) length_ns);
+            const pan_position_t *a = &motion->from;
+            const pan_position_t *b = &motion->to.position;
+            position->x = a->x + (b->x - a->x) * t;
+            position->y = a->y + (b->y - a->y) * t;
+            position->z = a->z + (b->z - a->z) * t;
+            position->set = true;
+            return true;
+        }
+
+        // Reached the keyframe, the next segment starts on the time it was
+        // due so a looping path keeps its period
+        *position = motion->to.position;
+        if (!next_segment(motion, end_ns, position)) {
+            motion->moving = false;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef ASYNC_AUDIO_PLAYER_TRAJECTORY_H
+#define ASYNC_AUDIO_PLAYER_TRAJECTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// Keyframes streamed over the control protocol a track can have queued
+#define TRAJECTORY_QUEUE_MAX 32
+
+// A track moving along a configured path or along keyframes streamed to
+// it. The process thread evaluates it once per block on the graph clock,
+// the main loop changes it through invoke only.
+typedef struct trajectory_motion {
+    const trajectory_config_t *path;   // Followed path, NULL for the streamed queue
+    uint32_t next;                     // Keyframe of the path after the one in progress
+
+    keyframe_config_t queue[TRAJECTORY_QUEUE_MAX];
+    uint32_t queue_head;
+    uint32_t queue_len;
+
+    bool moving;                       // A segment is in progress
+    pan_position_t from;               // Where the segment started
+    keyframe_config_t to;
+    uint64_t start_ns;                 // Graph time the segment started
+} trajectory_motion_t;
+
+// Parse "linear", "ease_in", "ease_out", "ease_in_out" or "hold"
+bool trajectory_parse_easing(const char *name, easing_t *easing);
+
+// Drop any movement, the source stays where it is
+void trajectory_reset(trajectory_motion_t *motion);
+
+// Follow a path from where the source is now, on to its first keyframe
+void trajectory_follow(trajectory_motion_t *motion, const trajectory_config_t *path);
+
+// Queue a streamed keyframe after those already queued, a followed path
+// ends with the segment in progress. False when the queue is full.
+bool trajectory_push(trajectory_motion_t *motion, const keyframe_config_t *keyframe);
+
+// Move position to where the source is at now_ns. False when it does not move.
+bool trajectory_step(trajectory_motion_t *motion, uint64_t now_ns, pan_position_t *position);
+
+#endif // ASYNC_AUDIO_PLAYER_TRAJECTORY_H
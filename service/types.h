@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <pipewire/pipewire.h>
+#include "sample_format.h"
 
 // Signal handling states
 typedef enum {
@@ -20,9 +21,17 @@ typedef enum {
     TRACK_STATE_DISCONNECTED
 } track_state_t;
 
+#define STREAM_ERROR_MAX 256
+
+// File frames decoded per block, the scratch of a track holds one block
+#define TRACK_BLOCK_FRAMES 1024
+
+// How long before its end a track hands over to its follow action
+#define TRACK_FOLLOW_LEAD_NS (250 * SPA_NSEC_PER_MSEC)
+
 // Stream error info
 typedef struct {
-    char *message;
+    char message[STREAM_ERROR_MAX];  // Empty when there is no error
     int code;
 } stream_error_t;
 
@@ -34,11 +43,145 @@ typedef struct {
 
 // Output mapping configuration
 typedef struct {
-    char *device;
+    char **devices;      // Failover list of devices, most preferred first
+    int device_count;    // Number of devices in the list
     char **mapping;      // Array of port names (e.g., "FL", "FR", "AUX0")
     int mapping_count;   // Number of channels in mapping
 } output_config_t;
 
+// What happens when a track that does not loop reaches its end
+typedef struct {
+    unsigned int repeat; // Extra passes through the file before it ends
+    char *track;         // Track started on the frame this one ends, NULL for none
+    char *cue_list;      // Cue list run from that frame, NULL for none
+    double cue_at;       // Position in the cue list, seconds
+} follow_config_t;
+
+// Place of a panned source or a speaker, x to the front, y to the left and
+// z up. A direction given as azimuth and elevation is a point at distance 1
+// unless a distance is given.
+typedef struct {
+    bool set;            // False when the track is not panned
+    float x;
+    float y;
+    float z;
+} pan_position_t;
+
+// How a device spreads a panned source over its speakers
+typedef enum {
+    PAN_VBAP,            // The pair or triplet of speakers around its direction
+    PAN_DBAP             // Every speaker by its distance to the source
+} pan_method_t;
+
+// Channel scaling of ambisonic content, channels are in ACN order
+typedef enum {
+    AMBISONIC_SN3D,      // AmbiX
+    AMBISONIC_N3D
+} ambisonic_norm_t;
+
+// Ambisonic track, decoded onto the speaker layout of its device
+typedef struct {
+    bool enabled;
+    int order;           // 1 to 3, 0 to take it from the channel count
+    ambisonic_norm_t normalization;
+    float yaw;           // Rotation of the sound field, degrees to the left
+} ambisonic_config_t;
+
+// How a device works out its ambisonic decoders
+typedef enum {
+    DECODER_ALLRAD,      // Onto a dense virtual layout, panned to the speakers
+    DECODER_MODE_MATCHING // Pseudo-inverse of the speaker harmonics
+} decoder_method_t;
+
+// A speaker of a device layout
+typedef struct {
+    char *channel;       // Bus channel it is on
+    pan_position_t position;
+} speaker_config_t;
+
+// Processing an insert of a chain applies
+typedef enum {
+    INSERT_PEAKING,
+    INSERT_LOW_SHELF,
+    INSERT_HIGH_SHELF,
+    INSERT_LOWPASS,
+    INSERT_HIGHPASS,
+    INSERT_DC_BLOCKER,
+    INSERT_LIMITER
+} insert_type_t;
+
+// One insert of a track or device chain, run in order
+typedef struct {
+    insert_type_t type;
+    float frequency;     // Hz, filters
+    float gain;          // dB, peaking and shelves
+    float q;             // Filters, the slope of shelves
+    float threshold;     // dBFS, limiter
+    float lookahead;     // ms, limiter
+    float release;       // ms, limiter
+} insert_config_t;
+
+// Impulse response a device channel is convolved with
+typedef struct {
+    char *channel;
+    char *file;          // WAV holding the response
+    int file_channel;    // Channel of the file to take, from 0
+} fir_config_t;
+
+// Extra delay of a device channel
+typedef struct {
+    char *channel;
+    double delay;        // Seconds
+} delay_config_t;
+
+// Curve a moving source follows from one keyframe to the next
+typedef enum {
+    EASING_LINEAR,
+    EASING_IN,           // Starts slow
+    EASING_OUT,          // Ends slow
+    EASING_IN_OUT,       // Starts and ends slow
+    EASING_HOLD          // Stays put, then jumps at the end
+} easing_t;
+
+// Point of a trajectory and how the source gets there
+typedef struct {
+    pan_position_t position;
+    double duration;     // Seconds from the previous keyframe, 0 to jump
+    easing_t easing;
+} keyframe_config_t;
+
+// Keyframed path panned tracks can move along
+typedef struct {
+    char *id;
+    keyframe_config_t *keyframes;
+    int keyframe_count;
+    bool loop;           // Back to the first keyframe after the last
+} trajectory_config_t;
+
+// How a variation pool picks the member a trigger plays
+typedef enum {
+    POOL_SELECT_ROUND_ROBIN,  // Each member in turn
+    POOL_SELECT_RANDOM,       // Any member but the one played last
+    POOL_SELECT_WEIGHTED      // Members by their share of the total weight
+} pool_select_t;
+
+// A file, or a region of one, in a variation pool
+typedef struct {
+    char *file;
+    double start;        // Seconds into the file
+    double length;       // Seconds, 0 for up to the end of the file
+    float weight;        // Share under weighted selection
+} pool_member_config_t;
+
+// Members of a variation pool track, one of them plays per trigger
+typedef struct {
+    pool_member_config_t *members; // NULL when the track is not a pool
+    int member_count;
+    pool_select_t select;
+    float gain_jitter;   // Random gain offset either way, dB
+    float pitch_jitter;  // Random pitch offset either way, semitones
+} pool_config_t;
+
 // Track configuration
 typedef struct {
     char *id;           // Unique track identifier
@@ -46,20 +189,165 @@ typedef struct {
     bool loop;          // Loop flag
     float volume;       // Volume level (0.0 - 1.0)
     output_config_t output;
+    follow_config_t on_end;
+    char **files;       // Playlist items, NULL for a single file
+    int file_count;
+    bool shuffle;       // Play the items in random order, reshuffled every pass
+    double crossfade;   // Seconds between playlist items, 0 for a straight cut
+    pool_config_t pool;
+    pan_position_t pan;  // Place on the speaker layout of its device, unset to map channels
+    char *trajectory;    // Path followed from the start, NULL to stay at pan
+    ambisonic_config_t ambisonic;
+    insert_config_t *inserts; // Run on the file frames, NULL for none
+    int insert_count;
+    char *bus;           // Submix bus it plays into, NULL for straight onto its device
 } track_config_t;
 
+// What a cue does to its track
+typedef enum {
+    CUE_START,           // Start the track, fading in
+    CUE_STOP,            // Fade the track out and stop it
+    CUE_GAIN             // Fade the track to a new level
+} cue_action_t;
+
+// One entry of a cue list
+typedef struct {
+    double at;           // Seconds from the start of the list
+    cue_action_t action;
+    char *track;         // Track the cue acts on
+    float gain;          // Level for CUE_GAIN
+    double fade;         // Seconds, 0 for none
+} cue_config_t;
+
+// Timeline of cues run by the sequencer
+typedef struct {
+    char *id;
+    cue_config_t *cues;
+    int cue_count;
+} cue_list_config_t;
+
+// How tracks reach their devices
+typedef enum {
+    ENGINE_MODE_STREAMS,    // A stream per track, or per warm device
+    ENGINE_MODE_FILTER      // One filter node with a port per device channel
+} engine_mode_t;
+
+// Per-device settings
+typedef struct {
+    char *name;          // Device as referenced from track outputs
+    bool keep_warm;      // Keep a silent mixer stream running on the device
+    uint32_t rate;       // Mixer sample rate, 0 for the default
+    bool driver;         // The mixer stream drives the graph from its own timer
+    uint32_t quantum;    // Frames per driver cycle, 0 for the default
+    uint32_t driver_priority; // priority.driver of the mixer stream, 0 for the default
+    uint32_t workers;    // Extra threads mixing alongside the data loop, 0 for none
+    char **channels;     // Bus layout, empty to take it from the device ports
+    int channel_count;
+    char *group;         // Device group, NULL for the shared data loop
+    int group_index;     // Resolved group, -1 for the shared data loop
+    speaker_config_t *speakers; // Layout panned tracks are spread over, NULL for none
+    int speaker_count;
+    pan_method_t pan_method;
+    float rolloff;       // DBAP level drop per doubling of distance, dB
+    decoder_method_t decoder;
+    delay_config_t *delays; // Per channel, on top of the speaker alignment
+    int delay_count;
+    bool align_speakers; // Delay nearer speakers to line up with the furthest
+    insert_config_t *inserts; // Run on the whole bus, NULL for none
+    int insert_count;
+    fir_config_t *firs;  // Per channel room correction, after the inserts
+    int fir_count;
+    int bus_count;       // Submix buses mixed on it, set when loading
+} device_config_t;
+
+// Sidechain of a bus, it drops while another bus is loud
+typedef struct {
+    char *by;            // Bus whose level ducks this one, NULL for none
+    float threshold;     // RMS of the loudest channel of that bus it ducks above, dBFS
+    float depth;         // Level taken off while ducked, dB
+    float attack;        // Time to duck, ms
+    float release;       // Time to come back up, ms
+    int key_index;       // Resolved bus, -1 for none
+} duck_config_t;
+
+// Named submix with a gain stage of its own, tracks and other buses play
+// into it and it plays into a bus or a device
+typedef struct {
+    char *name;
+    char *output;        // Bus or device it plays into
+    float gain;          // dB
+    bool mute;
+    duck_config_t duck;
+    int output_index;    // Bus it plays into, -1 for its device
+    int device_index;    // Device the whole chain ends on, -1 if unusable
+} bus_config_t;
+
+// Tempo of the grid quantized starts snap to
+typedef struct {
+    double bpm;                // 0 for no grid
+    uint32_t beats_per_bar;    // 0 for the default of 4
+} tempo_config_t;
+
+// Devices whose processing runs on a data loop thread of their own
+typedef struct {
+    char *name;
+    int cpu;             // CPU the data loop thread is pinned to, -1 for any
+    int rt_priority;     // SCHED_FIFO priority, 0 to keep the default
+    tempo_config_t tempo; // Grid of the group, bpm 0 to use the global one
+} group_config_t;
+
 #include "audio_file.h"
+#include "gain_ramp.h"
+
+struct track_manager_ctx;
+struct track_desc;
+struct mixer;
+struct mixer_voice;
+struct playlist;
+struct sample_pool;
+struct trajectory_motion;
+struct ambisonic_stream;
+struct insert_chain;
 
 // Active track instance
 typedef struct {
+    struct track_manager_ctx *manager; // Owning track manager
     track_config_t *config;
+    const struct track_desc *desc; // Stream parameters resolved at load
     track_state_t state;
-    struct pw_stream *stream;    // Pipewire stream
-    audio_file_t *audio_file;   // Audio file handler
+    struct pw_stream *stream;    // Pipewire stream, NULL when mixed
+    struct mixer *mixer;         // Device mixer the track is mixed into
+    struct mixer_voice *voice;   // Voice on that mixer
+    struct spa_hook stream_listener; // Stream event hook, slot must not move
+    stream_format_t format;    // Negotiated stream format, owned by the process thread
+    float *decode;             // Decode block when the stream is not F32 like the file
+    float *block;              // Scratch of TRACK_BLOCK_FRAMES file frames, preallocated per track
+    struct pw_loop *data_loop; // Loop its process callback runs on
+    audio_file_t *audio_file;   // Audio file handler, the first item of a playlist
+    struct playlist *playlist;  // Items read in place of audio_file, NULL for a single file
+    struct sample_pool *pool;   // Members read in place of audio_file, NULL unless a pool
+    pan_position_t pan;         // Where a panned track sits now, starts at its configured place
+    struct trajectory_motion *motion; // Movement of pan, owned by the process thread
+    struct ambisonic_stream *ambisonic; // Rotation and scratch of an ambisonic track, NULL otherwise
+    struct insert_chain *inserts; // Run on every frame read, NULL without inserts
     bool should_stop;          // Flag for graceful shutdown
     pthread_t thread;          // Playback thread
     stream_error_t error;      // Stream error information
     uint32_t target_id;       // Target node ID for connection
+    int device_index;         // Entry of the failover list in use, -1 if none
+    bool failback_pending;    // A preferred device is back, move at the next loop
+    bool failback_ready;      // Loop boundary reached, set from the process thread
+    bool paused;              // Held by pause, the stream or voice stays in place
+    bool stopping;            // Stops once a cue faded it out
+    float level;              // Gain set by cues, what resume fades back to
+    gain_ramp_t ramp;         // Fades and cue changes, owned by the process thread
+    bool faded_out;           // Faded out to pause or stop, set from the process thread
+    uint64_t grid_period_ns;  // Loop length snapped to the tempo grid, 0 when free running
+    uint64_t grid_wrap_ns;    // Graph time the next pass starts at
+    bool follow_armed;        // End time known, set once from the process thread
+    uint64_t follow_ns;       // Graph time the file ends at
+    bool follow_done;         // Follow action handed out by the main loop
+    bool ended;               // Ran out of file, set from the process thread
     bool is_connected;        // Stream connection state
 } track_instance_t;
 
@@ -69,8 +357,30 @@ typedef struct {
         char *level;
     } logging;
 
+    struct {
+        engine_mode_t mode;
+    } engine;
+
+    tempo_config_t tempo;
+
     track_config_t *tracks;
     int track_count;
+
+    device_config_t *devices;
+    int device_count;
+
+    group_config_t *groups;
+    int group_count;
+
+    cue_list_config_t *cue_lists;
+    int cue_list_count;
+
+    trajectory_config_t *trajectories;
+    int trajectory_count;
+
+    bus_config_t *buses;
+    int bus_count;
+    int *bus_order;      // Every bus after the buses playing into or ducking it
 } global_config_t;
 
 #endif // ASYNC_AUDIO_PLAYER_TYPES_H
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "worker_pool.h"
+#include "log.h"
+
+// Spins before a waiter goes to sleep, long enough to cover the gap
+// between the blocks of one cycle but not the gap between cycles
+#define WORKER_POOL_SPINS 4000
+
+struct worker_pool {
+    uint32_t n_workers;              // Threads plus the caller
+    int spins;                       // 0 when the workers share cores
+    pthread_t threads[WORKER_POOL_MAX_THREADS];
+    uint32_t n_started;
+
+    float *scratch;
+    size_t scratch_floats;
+
+    // Current job, published by the barrier that starts it
+    worker_pool_job_t job;
+    void *data;
+    bool stop;
+
+    // Reusable barrier: the last thread to arrive bumps the generation
+    atomic_uint arrived;
+    atomic_uint generation;
+    atomic_uint sleepers;
+};
+
+struct worker_start {
+    worker_pool_t *pool;
+    uint32_t index;
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+static void futex_wait(atomic_uint *addr, const uint32_t value) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void worker_pool_barrier(worker_pool_t *pool) {
+    const uint32_t generation = atomic_load(&pool->generation);
+
+    if (atomic_fetch_add(&pool->arrived, 1) + 1 == pool->n_workers) {
+        atomic_store(&pool->arrived, 0);
+        atomic_fetch_add(&pool->generation, 1);
+        // Sleepers count themselves before checking the generation, so
+        // either they see the new one or we see them
+        if (atomic_load(&pool->sleepers) > 0) {
+            futex_wake(&pool->generation);
+        }
+        return;
+    }
+
+    for (int i = 0; i < pool->spins; i++) {
+        if (atomic_load(&pool->generation) != generation) return;
+        cpu_relax();
+    }
+
+    atomic_fetch_add(&pool->sleepers, 1);
+    while (atomic_load(&pool->generation) == generation) {
+        futex_wait(&pool->generation, generation);
+    }
+    atomic_fetch_sub(&pool->sleepers, 1);
+}
+
+static void *worker_thread(void *arg) {
+    const struct worker_start *start = arg;
+    worker_pool_t *pool = start->pool;
+    const uint32_t index = start->index;
+
+    free(arg);
+
+    for (;;) {
+        worker_pool_barrier(pool);
+        if (pool->stop) break;
+
+        pool->job(pool->data, index, pool->n_workers);
+        worker_pool_barrier(pool);
+    }
+    return NULL;
+}
+
+worker_pool_t *worker_pool_new(uint32_t n_threads, const size_t scratch_floats, const int policy, const int priority) {
+    worker_pool_t *pool = calloc(1, sizeof(worker_pool_t));
+    if (!pool) {
+        log_error("Failed to allocate worker pool");
+        return NULL;
+    }
+
+    if (n_threads > WORKER_POOL_MAX_THREADS) {
+        log_warn("Limiting mixing workers to %d", WORKER_POOL_MAX_THREADS);
+        n_threads = WORKER_POOL_MAX_THREADS;
+    }
+    pool->n_workers = n_threads + 1;
+    pool->scratch_floats = scratch_floats;
+
+    // Spinning only pays off when the thread waited for can run meanwhile
+    const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pool->spins = n_cpus >= (long) pool->n_workers ? WORKER_POOL_SPINS : 0;
+
+    pool->scratch = calloc(pool->n_workers * scratch_floats, sizeof(float));
+    if (!pool->scratch) {
+        log_error("Failed to allocate worker scratch");
+        free(pool);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < n_threads; i++) {
+        struct worker_start *start = malloc(sizeof(*start));
+        if (!start) {
+            log_error("Failed to allocate worker start");
+            break;
+        }
+        start->pool = pool;
+        start->index = i + 1;
+
+        const int res = pthread_create(&pool->threads[i], NULL, worker_thread, start);
+        if (res != 0) {
+            log_error("Failed to start mixing worker: %s", strerror(res));
+            free(start);
+            break;
+        }
+        pool->n_started++;
+
+        char name[16];
+        snprintf(name, sizeof(name), "papad-mix%u", i + 1);
+        pthread_setname_np(pool->threads[i], name);
+
+        if (policy != SCHED_OTHER) {
+            const struct sched_param param = {.sched_priority = priority};
+            const int sched_res = pthread_setschedparam(pool->threads[i], policy, &param);
+            if (sched_res != 0) {
+                log_warn("Failed to set RT priority %d for mixing worker: %s", priority, strerror(sched_res));
+            }
+        }
+    }
+
+    // The barrier counts on every worker showing up
+    if (pool->n_started < n_threads) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void worker_pool_destroy(worker_pool_t *pool) {
+    if (!pool) return;
+
+    if (pool->n_started > 0) {
+        // Only the threads that did start take part in the last barrier
+        pool->n_workers = pool->n_started + 1;
+        pool->stop = true;
+        worker_pool_barrier(pool);
+        for (uint32_t i = 0; i < pool->n_started; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+    }
+    free(pool->scratch);
+    free(pool);
+}
+
+uint32_t worker_pool_size(const worker_pool_t *pool) {
+    return pool ? pool->n_workers : 1;
+}
+
+float *worker_pool_scratch(const worker_pool_t *pool, const uint32_t worker) {
+    return pool->scratch + (size_t) worker * pool->scratch_floats;
+}
+
+void worker_pool_run(worker_pool_t *pool, const worker_pool_job_t job, void *data) {
+    pool->job = job;
+    pool->data = data;
+
+    worker_pool_barrier(pool);
+    job(data, 0, pool->n_workers);
+    worker_pool_barrier(pool);
+}
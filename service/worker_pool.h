@@ -0,0 +1,37 @@
+#ifndef ASYNC_AUDIO_PLAYER_WORKER_POOL_H
+#define ASYNC_AUDIO_PLAYER_WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORKER_POOL_MAX_THREADS 15
+
+// Threads that join the calling thread inside one process cycle. The caller
+// always runs as worker 0, the pool adds its own threads as workers 1 and up.
+// Idle threads spin for a short while and then sleep on a futex.
+typedef struct worker_pool worker_pool_t;
+
+// Part of a job, called once on every worker
+typedef void (*worker_pool_job_t)(void *data, uint32_t worker, uint32_t n_workers);
+
+// Start n_threads threads with the given scheduling policy and priority. Each
+// worker, the caller included, gets scratch_floats floats of scratch space.
+worker_pool_t *worker_pool_new(uint32_t n_threads, size_t scratch_floats, int policy, int priority);
+
+// Stop and join the threads, no job may be running
+void worker_pool_destroy(worker_pool_t *pool);
+
+// Number of workers, the caller included
+uint32_t worker_pool_size(const worker_pool_t *pool);
+
+// Scratch space of a worker
+float *worker_pool_scratch(const worker_pool_t *pool, uint32_t worker);
+
+// Run a job on all workers, returns once every worker finished. RT safe.
+void worker_pool_run(worker_pool_t *pool, worker_pool_job_t job, void *data);
+
+// Wait inside a job until every worker got here
+void worker_pool_barrier(worker_pool_t *pool);
+
+#endif // ASYNC_AUDIO_PLAYER_WORKER_POOL_H
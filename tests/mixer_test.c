@@ -0,0 +1,195 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sndfile.h>
+#include <pipewire/pipewire.h>
+#include "mixer.h"
+#include "track_desc.h"
+#include "log.h"
+
+// Mixer checks without a PipeWire daemon, rendering into plain buffers as
+// the benchmark does. Quanta run longer than a mixer block, the voices
+// resample, so every path through the block scratch of a voice is taken.
+
+#define TEST_CHANNELS 4
+#define TEST_QUANTUM 1024
+#define TEST_CYCLES 8
+#define TEST_RATE 48000
+#define TEST_SOURCE_RATE 44100
+#define TEST_VOICES 2
+
+static char test_name[] = "test";
+
+// A second of a constant level on every channel
+static bool write_source(const char *path, const uint32_t channels) {
+    SF_INFO info = {.samplerate = TEST_SOURCE_RATE, .channels = (int) channels, .format = SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+    SNDFILE *file = sf_open(path, SFM_WRITE, &info);
+    if (!file) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, sf_strerror(NULL));
+        return false;
+    }
+
+    float block[AMBISONIC_MAX_CHANNELS * 441];
+    for (size_t i = 0; i < (size_t) channels * 441; i++) {
+        block[i] = 0.25f;
+    }
+    for (uint32_t done = 0; done < TEST_SOURCE_RATE; done += 441) {
+        sf_writef_float(file, block, 441);
+    }
+    sf_close(file);
+    return true;
+}
+
+// Render TEST_CYCLES quanta of voices panned, or decoded at order, onto a
+// ring of speakers. Every frame of every quantum has to carry signal and the
+// voices have to come out of it as they went in.
+static bool run(const char *path, const uint32_t order) {
+    const uint32_t source_channels = order > 0 ? (order + 1) * (order + 1) : 2;
+    char names[TEST_CHANNELS][DEVICE_CHANNEL_NAME_MAX];
+    char *channels[TEST_CHANNELS];
+    speaker_config_t speakers[TEST_CHANNELS];
+    track_config_t configs[TEST_VOICES] = {0};
+    track_instance_t tracks[TEST_VOICES] = {0};
+    track_desc_t descs[TEST_VOICES] = {0};
+    mixer_voice_t *voices[TEST_VOICES] = {0};
+    static float bus[TEST_CHANNELS][TEST_QUANTUM];
+    float *out[TEST_CHANNELS];
+    const size_t block_size = (size_t) TRACK_BLOCK_FRAMES * source_channels * sizeof(float);
+    arena_t arena = {0};
+    size_t arena_size = 0;
+    bool ok = false;
+
+    for (uint32_t c = 0; c < TEST_CHANNELS; c++) {
+        out[c] = bus[c];
+        snprintf(names[c], sizeof(names[c]), "AUX%u", c);
+        channels[c] = names[c];
+
+        const float azimuth = 2.0f * (float) M_PI * (float) c / TEST_CHANNELS;
+        speakers[c] = (speaker_config_t) {
+            .channel = names[c],
+            .position = { .set = true, .x = cosf(azimuth), .y = sinf(azimuth) }
+        };
+    }
+
+    device_config_t device = {
+        .name = test_name,
+        .rate = TEST_RATE,
+        .channels = channels,
+        .channel_count = TEST_CHANNELS,
+        .group_index = -1,
+        .speakers = speakers,
+        .speaker_count = TEST_CHANNELS
+    };
+
+    struct pw_loop *loop = pw_loop_new(NULL);
+    mixer_t *m = loop ? mixer_new(&device, loop, loop, NULL) : NULL;
+    if (!m || !mixer_set_layout(m, NULL, MIXER_MAX_CHANNELS)) {
+        fprintf(stderr, "Failed to create mixer\n");
+        goto done;
+    }
+
+    for (uint32_t i = 0; i < TEST_VOICES; i++) {
+        configs[i].id = test_name;
+        configs[i].file_path = (char *) path;
+        configs[i].loop = true;
+        configs[i].volume = 1.0f;
+        configs[i].ambisonic = (ambisonic_config_t) { .enabled = order > 0, .order = (int) order };
+
+        const float azimuth = 2.0f * (float) M_PI * ((float) i + 0.37f) / TEST_VOICES;
+        tracks[i].pan = (pan_position_t) { .set = order == 0, .x = cosf(azimuth), .y = sinf(azimuth) };
+        tracks[i].config = &configs[i];
+        tracks[i].state = TRACK_STATE_PLAYING;
+        gain_ramp_init(&tracks[i].ramp);
+        tracks[i].audio_file = audio_file_open(path, true, 1.0f);
+        if (!tracks[i].audio_file) {
+            fprintf(stderr, "Failed to open source for voice %u\n", i);
+            goto done;
+        }
+        arena_size += ARENA_SIZE(block_size) + ARENA_SIZE(sizeof(ambisonic_stream_t)) +
+                track_desc_arena_size(&configs[i], &tracks[i].audio_file->info, false);
+    }
+
+    if (!arena_init(&arena, arena_size)) goto done;
+    for (uint32_t i = 0; i < TEST_VOICES; i++) {
+        tracks[i].block = arena_alloc(&arena, block_size);
+        if (!track_desc_init(&descs[i], &configs[i], &tracks[i].audio_file->info, false, &arena)) goto done;
+        tracks[i].desc = &descs[i];
+        if (order > 0) {
+            tracks[i].ambisonic = arena_alloc(&arena, sizeof(ambisonic_stream_t));
+            ambisonic_stream_init(tracks[i].ambisonic, &configs[i].ambisonic, order);
+        }
+        voices[i] = mixer_add_voice(m, &tracks[i]);
+        if (!voices[i]) goto done;
+    }
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        memset(bus, 0, sizeof(bus));
+        mixer_render(m, out, TEST_QUANTUM);
+
+        for (uint32_t i = 0; i < TEST_QUANTUM; i++) {
+            float level = 0.0f;
+            for (uint32_t c = 0; c < TEST_CHANNELS; c++) {
+                if (!isfinite(bus[c][i])) {
+                    fprintf(stderr, "Cycle %u frame %u of AUX%u is not finite\n", cycle, i, c);
+                    goto done;
+                }
+                level += fabsf(bus[c][i]);
+            }
+            if (level < 0.01f) {
+                fprintf(stderr, "Cycle %u frame %u is silent\n", cycle, i);
+                goto done;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < TEST_VOICES; i++) {
+        const mixer_voice_t *v = voices[i];
+        if (v->track != &tracks[i] || v->bus != -1 || v->panned != (order == 0) ||
+            v->ambisonic != tracks[i].ambisonic || (order == 0 && v->decoder)) {
+            fprintf(stderr, "Voice %u was overwritten\n", i);
+            goto done;
+        }
+    }
+    ok = true;
+
+done:
+    for (uint32_t i = 0; i < TEST_VOICES; i++) {
+        if (voices[i]) mixer_remove_voice(m, voices[i]);
+        audio_file_close(tracks[i].audio_file);
+    }
+    mixer_destroy(m);
+    if (loop) pw_loop_destroy(loop);
+    arena_clear(&arena);
+    return ok;
+}
+
+static bool check(const char *what, const uint32_t order) {
+    char path[] = "/tmp/papa-test-XXXXXX.wav";
+    const int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        perror("mkstemps");
+        return false;
+    }
+    close(fd);
+
+    const bool ok = write_source(path, order > 0 ? (order + 1) * (order + 1) : 2) && run(path, order);
+    printf("%-45s %s\n", what, ok ? "ok" : "FAILED");
+    unlink(path);
+    return ok;
+}
+
+int main(void) {
+    bool ok = true;
+
+    pw_init(NULL, NULL);
+    log_set_level("WARN");
+
+    ok &= check("resampled panned voices", 0);
+    ok &= check("resampled first order ambisonic voices", 1);
+    ok &= check("resampled third order ambisonic voices", 3);
+
+    pw_deinit();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}